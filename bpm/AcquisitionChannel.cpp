@@ -0,0 +1,116 @@
+/**
+ * @file AcquisitionChannel.cpp
+ * @brief One pressure sensor of a multi-channel setup: its bus, its address and its sample buffer
+ */
+
+#include "AcquisitionChannel.h"
+
+//Absolute difference of two timestamps
+static inline uint64_t timeDifference(uint64_t firstMicroseconds, uint64_t secondMicroseconds)
+{
+    return firstMicroseconds > secondMicroseconds ? firstMicroseconds - secondMicroseconds : secondMicroseconds - firstMicroseconds;
+}
+
+AcquisitionChannel::AcquisitionChannel(int channelNumber, PressureSensorBus &sensorBus, int sensorAddress)
+    : number(channelNumber), acquisition(sensorBus, sensorAddress)
+{
+    sampleCount = 0;
+    droppedSamples = 0;
+}
+
+bool AcquisitionChannel::service(uint64_t nowMicroseconds)
+{
+    MprlsSample sample;
+    if(!acquisition.poll(nowMicroseconds, sample))
+        return false;
+
+    if(sampleCount < ACQUISITION_CHANNEL_BUFFER_SIZE)
+        samples[sampleCount++] = sample;
+    else
+        droppedSamples++;
+    return true;
+}
+
+void AcquisitionChannel::reset()
+{
+    acquisition.reset();
+    sampleCount = 0;
+    droppedSamples = 0;
+}
+
+MultiChannelAcquisition::MultiChannelAcquisition()
+{
+    channelCount = 0;
+}
+
+bool MultiChannelAcquisition::addChannel(AcquisitionChannel &channel)
+{
+    if(channelCount >= MULTI_CHANNEL_MAX_CHANNELS)
+        return false;
+    channels[channelCount++] = &channel;
+    return true;
+}
+
+int MultiChannelAcquisition::serviceAll(uint64_t nowMicroseconds)
+{
+    int newSamples = 0;
+    for(int i = 0; i < channelCount; i++)
+    {
+        if(channels[i]->service(nowMicroseconds))
+            newSamples++;
+    }
+    return newSamples;
+}
+
+uint64_t MultiChannelAcquisition::getNextServiceMicroseconds() const
+{
+    uint64_t nextService = UINT64_MAX;
+    for(int i = 0; i < channelCount; i++)
+    {
+        uint64_t channelNextService = channels[i]->getNextServiceMicroseconds();
+        if(channelNextService < nextService)
+            nextService = channelNextService;
+    }
+    return channelCount > 0 ? nextService : 0;
+}
+
+MultiChannelSkew MultiChannelAcquisition::calculateSkew() const
+{
+    MultiChannelSkew skew;
+    skew.comparedSamples = 0;
+    skew.meanSkewMicroseconds = 0.0;
+    skew.maxSkewMicroseconds = 0;
+    if(channelCount == 0 || channels[0]->getSampleCount() == 0)
+        return skew;
+
+    const AcquisitionChannel &reference = *channels[0];
+    double skewSum = 0.0;
+    for(int i = 1; i < channelCount; i++)
+    {
+        //Both buffers are in time order, so the closest reference sample only ever moves forward
+        int referenceIndex = 0;
+        for(int k = 0; k < channels[i]->getSampleCount(); k++)
+        {
+            uint64_t channelTime = channels[i]->getSample(k).timeMicroseconds;
+            while(referenceIndex + 1 < reference.getSampleCount() &&
+                  reference.getSample(referenceIndex + 1).timeMicroseconds <= channelTime)
+                referenceIndex++;
+
+            uint64_t difference = timeDifference(channelTime, reference.getSample(referenceIndex).timeMicroseconds);
+            if(referenceIndex + 1 < reference.getSampleCount())
+            {
+                uint64_t nextDifference = timeDifference(channelTime, reference.getSample(referenceIndex + 1).timeMicroseconds);
+                if(nextDifference < difference)
+                    difference = nextDifference;
+            }
+
+            skewSum += (double)difference;
+            skew.comparedSamples++;
+            if(difference > skew.maxSkewMicroseconds)
+                skew.maxSkewMicroseconds = difference;
+        }
+    }
+
+    skew.meanSkewMicroseconds = skew.comparedSamples > 0 ? skewSum / skew.comparedSamples : 0.0;
+    return skew;
+}
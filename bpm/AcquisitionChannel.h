@@ -0,0 +1,138 @@
+/**
+ * @file AcquisitionChannel.h
+ * @brief One pressure sensor of a multi-channel setup: its bus, its address and its sample buffer
+ */
+
+#ifndef ACQUISITION_CHANNEL_H
+#define ACQUISITION_CHANNEL_H
+
+#include <stdint.h>
+#include "hal/MeasurementHardware.h"
+#include "MprlsAcquisition.h"
+
+//Number of samples each channel can hold (16 bytes each)
+#ifndef ACQUISITION_CHANNEL_BUFFER_SIZE
+#define ACQUISITION_CHANNEL_BUFFER_SIZE 256
+#endif
+
+//Most channels a MultiChannelAcquisition can hold
+#ifndef MULTI_CHANNEL_MAX_CHANNELS
+#define MULTI_CHANNEL_MAX_CHANNELS 4
+#endif
+
+/**
+ * @brief A sensor with its own bus and buffer.
+ *
+ * service() moves the acquisition of this sensor forward without blocking and keeps every converted
+ * sample, stamped with the time the caller passes in. All channels of a setup are given the time of the
+ * same clock, so their timestamps can be compared directly. A channel is meant to be serviced by one
+ * thread at a time; read the buffered samples once that thread has stopped servicing it.
+ * When the buffer is full new samples are counted as dropped instead of overwriting older ones.
+ */
+class AcquisitionChannel
+{
+public:
+    /**
+     * @param channelNumber the number printed with the samples of this channel
+     * @param sensorBus the bus the sensor of this channel is on
+     * @param sensorAddress the 8-bit address of the sensor
+     */
+    AcquisitionChannel(int channelNumber, PressureSensorBus &sensorBus, int sensorAddress);
+
+    /**
+     * @brief Poll the sensor once
+     * @param nowMicroseconds the current time of the shared clock
+     * @return true if a new sample was taken
+     */
+    bool service(uint64_t nowMicroseconds);
+
+    /**
+     * @brief Empty the buffer and clear the counters
+     */
+    void reset();
+
+    //The earliest time service() can do anything useful, 0 for right away
+    uint64_t getNextServiceMicroseconds() const { return acquisition.getNextPollMicroseconds(); }
+    //The number given to this channel
+    int getChannelNumber() const { return number; }
+    //Number of samples in the buffer
+    int getSampleCount() const { return sampleCount; }
+    //A buffered sample, index from 0 to getSampleCount() - 1
+    const MprlsSample &getSample(int index) const { return samples[index]; }
+    //Samples that were read but did not fit in the buffer
+    uint32_t getDroppedSamples() const { return droppedSamples; }
+    //The bus counters of the sensor
+    const MprlsAcquisitionStatistics &getStatistics() const { return acquisition.getStatistics(); }
+
+private:
+    //The number of the channel
+    int number;
+    //Reads the sensor of this channel without blocking
+    MprlsAcquisition<PressureSensorBus> acquisition;
+    //The samples read so far
+    MprlsSample samples[ACQUISITION_CHANNEL_BUFFER_SIZE];
+    //Number of samples in the buffer
+    int sampleCount;
+    //Samples that did not fit in the buffer
+    uint32_t droppedSamples;
+};
+
+/**
+ * @brief How far apart in time the channels took their samples. Every sample of the other channels is
+ * paired with the sample of the first channel that is closest in time.
+ */
+struct MultiChannelSkew
+{
+    //Number of samples that were paired
+    int comparedSamples;
+    //Mean of the absolute time differences in microseconds
+    double meanSkewMicroseconds;
+    //Largest absolute time difference in microseconds
+    uint64_t maxSkewMicroseconds;
+};
+
+/**
+ * @brief A set of channels read together. serviceAll() polls them one after the other from the calling
+ * thread; with an RTOS each channel can instead be given its own thread (see hal/MbedAcquisitionChannelThread.h)
+ * and this class is only used to hold them and compare their timestamps.
+ */
+class MultiChannelAcquisition
+{
+public:
+    MultiChannelAcquisition();
+
+    /**
+     * @brief Add a channel, returns false when MULTI_CHANNEL_MAX_CHANNELS are already held
+     */
+    bool addChannel(AcquisitionChannel &channel);
+
+    /**
+     * @brief Poll every channel once, in the order they were added
+     * @return the number of channels that took a new sample
+     */
+    int serviceAll(uint64_t nowMicroseconds);
+
+    /**
+     * @brief The earliest time any channel needs to be serviced again
+     */
+    uint64_t getNextServiceMicroseconds() const;
+
+    /**
+     * @brief Compare the timestamps of the buffered samples of all channels
+     */
+    MultiChannelSkew calculateSkew() const;
+
+    //Number of channels held
+    int getChannelCount() const { return channelCount; }
+    //A channel, index from 0 to getChannelCount() - 1
+    AcquisitionChannel &getChannel(int index) { return *channels[index]; }
+    const AcquisitionChannel &getChannel(int index) const { return *channels[index]; }
+
+private:
+    //The channels, in the order they were added
+    AcquisitionChannel *channels[MULTI_CHANNEL_MAX_CHANNELS];
+    //Number of channels held
+    int channelCount;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file BeatDetector.cpp
+ * @brief Online detection of the heart beats in the oscillometric pulses, with the beat to beat intervals
+ * and the heart rate available at every sample
+ */
+
+#include "BeatDetector.h"
+
+static_assert((BEAT_INTERVAL_HISTORY & (BEAT_INTERVAL_HISTORY - 1)) == 0, "BEAT_INTERVAL_HISTORY must be a power of two");
+
+//Weight of a new value in the running averages of the peaks and the intervals
+static const float peakLevelWeight = 0.125f;
+static const float intervalWeight = 0.25f;
+//Rejected intervals in a row after which the average restarts
+static const int maximumConsecutiveRejections = 3;
+
+BeatDetector::BeatDetector()
+{
+    reset();
+}
+
+void BeatDetector::reset()
+{
+    isPulseHigh = false;
+    hasPreviousSample = false;
+    previousTime = 0.0f;
+    previousOscillation = 0.0f;
+    currentPeak = 0.0f;
+    peakLevel = 0.0f;
+    sessionPeakLevel = 0.0f;
+    beatCount = 0;
+    lastBeatTime = 0.0f;
+    lastInterval = 0.0f;
+    averageInterval = 0.0f;
+    consecutiveRejections = 0;
+    acceptedIntervals = 0;
+    rejectedIntervals = 0;
+    for(int i = 0; i < BEAT_INTERVAL_HISTORY; i++)
+        intervalHistory[i] = 0.0f;
+}
+
+bool BeatDetector::addSample(float timeMilliseconds, float oscillation)
+{
+    bool isBeat = false;
+    if(hasPreviousSample)
+    {
+        //The peak level fades while no beat comes, so a weakening pulse is still found
+        float elapsed = timeMilliseconds - previousTime;
+        peakLevel -= peakLevel * (elapsed < BEAT_PEAK_DECAY_MS ? elapsed / BEAT_PEAK_DECAY_MS : 1.0f);
+
+        float threshold = BEAT_THRESHOLD_FRACTION * peakLevel;
+        if(threshold < BEAT_SESSION_PEAK_FRACTION * sessionPeakLevel)
+            threshold = BEAT_SESSION_PEAK_FRACTION * sessionPeakLevel;
+        if(threshold < BEAT_MINIMUM_AMPLITUDE)
+            threshold = BEAT_MINIMUM_AMPLITUDE;
+
+        if(isPulseHigh)
+        {
+            if(oscillation > currentPeak)
+                currentPeak = oscillation;
+            //The pulse is over once it fell back below 0; its peak joins the average
+            if(oscillation < 0.0f)
+            {
+                isPulseHigh = false;
+                peakLevel = (peakLevel == 0.0f) ? currentPeak : peakLevel + peakLevelWeight * (currentPeak - peakLevel);
+                if(peakLevel > sessionPeakLevel)
+                    sessionPeakLevel = peakLevel;
+            }
+        }
+        else if(previousOscillation <= threshold && oscillation > threshold)
+        {
+            //Where the pulse crossed the threshold, between the two samples
+            float crossingTime = previousTime + (timeMilliseconds - previousTime) *
+                                 (threshold - previousOscillation) / (oscillation - previousOscillation);
+            if(beatCount == 0 || crossingTime - lastBeatTime >= BEAT_REFRACTORY_MS)
+            {
+                if(beatCount > 0)
+                {
+                    float interval = crossingTime - lastBeatTime;
+                    bool isPlausible = interval >= BEAT_INTERVAL_MINIMUM_MS && interval <= BEAT_INTERVAL_MAXIMUM_MS;
+                    bool isConsistent = averageInterval == 0.0f ||
+                                        (interval >= averageInterval * (1.0f - BEAT_INTERVAL_TOLERANCE) &&
+                                         interval <= averageInterval * (1.0f + BEAT_INTERVAL_TOLERANCE));
+                    if(isPlausible && (isConsistent || consecutiveRejections >= maximumConsecutiveRejections))
+                    {
+                        //After too many rejections the rate changed; start the average again from here
+                        if(averageInterval == 0.0f || !isConsistent)
+                            averageInterval = interval;
+                        else
+                            averageInterval += intervalWeight * (interval - averageInterval);
+                        lastInterval = interval;
+                        consecutiveRejections = 0;
+                        intervalHistory[acceptedIntervals & (BEAT_INTERVAL_HISTORY - 1)] = interval;
+                        acceptedIntervals++;
+                    }
+                    else
+                    {
+                        consecutiveRejections++;
+                        rejectedIntervals++;
+                    }
+                }
+                beatCount++;
+                lastBeatTime = crossingTime;
+                isPulseHigh = true;
+                currentPeak = oscillation;
+                isBeat = true;
+            }
+        }
+    }
+
+    previousTime = timeMilliseconds;
+    previousOscillation = oscillation;
+    hasPreviousSample = true;
+    return isBeat;
+}
+
+float BeatDetector::getInstantaneousHeartRate() const
+{
+    return lastInterval > 0.0f ? 60000.0f / lastInterval : 0.0f;
+}
+
+float BeatDetector::getAverageHeartRate() const
+{
+    return averageInterval > 0.0f ? 60000.0f / averageInterval : 0.0f;
+}
+
+float BeatDetector::getMedianHeartRate() const
+{
+    const int size = getIntervalHistorySize();
+    if(size == 0)
+        return 0.0f;
+
+    //Insertion sort of a copy, the history is short
+    float sorted[BEAT_INTERVAL_HISTORY];
+    for(int i = 0; i < size; i++)
+    {
+        float interval = getInterval(i);
+        int j = i;
+        for(; j > 0 && sorted[j - 1] > interval; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = interval;
+    }
+    float median = (size & 1) ? sorted[size / 2] : 0.5f * (sorted[size / 2 - 1] + sorted[size / 2]);
+    return 60000.0f / median;
+}
+
+int BeatDetector::getIntervalHistorySize() const
+{
+    return acceptedIntervals < BEAT_INTERVAL_HISTORY ? (int)acceptedIntervals : BEAT_INTERVAL_HISTORY;
+}
+
+float BeatDetector::getInterval(int index) const
+{
+    //The oldest interval held is acceptedIntervals - size
+    uint32_t position = acceptedIntervals - (uint32_t)getIntervalHistorySize() + (uint32_t)index;
+    return intervalHistory[position & (BEAT_INTERVAL_HISTORY - 1)];
+}
@@ -0,0 +1,129 @@
+/**
+ * @file BeatDetector.h
+ * @brief Online detection of the heart beats in the oscillometric pulses, with the beat to beat intervals
+ * and the heart rate available at every sample
+ */
+
+#ifndef BEAT_DETECTOR_H
+#define BEAT_DETECTOR_H
+
+#include <stdint.h>
+
+//A beat starts where the pulse rises through this fraction of the recent beat peaks
+#ifndef BEAT_THRESHOLD_FRACTION
+#define BEAT_THRESHOLD_FRACTION 0.4f
+#endif
+
+//Pulses smaller than this (in mmHg) are never taken for beats, whatever the recent peaks were
+#ifndef BEAT_MINIMUM_AMPLITUDE
+#define BEAT_MINIMUM_AMPLITUDE 0.05f
+#endif
+
+//No beat is accepted this soon after the previous one (250 ms is 240 bpm)
+#ifndef BEAT_REFRACTORY_MS
+#define BEAT_REFRACTORY_MS 250.0f
+#endif
+
+//Pulses smaller than this fraction of the strongest pulses of the session are not taken for beats, so the
+//noise is not counted once the pulses fade away at the end of the deflation
+#ifndef BEAT_SESSION_PEAK_FRACTION
+#define BEAT_SESSION_PEAK_FRACTION 0.25f
+#endif
+
+//Time for the peak level to fall to about a third when no beat comes, so the threshold follows a fading pulse
+#ifndef BEAT_PEAK_DECAY_MS
+#define BEAT_PEAK_DECAY_MS 2000.0f
+#endif
+
+//Intervals outside 30 to 220 bpm are never accepted
+#define BEAT_INTERVAL_MINIMUM_MS (60000.0f / 220.0f)
+#define BEAT_INTERVAL_MAXIMUM_MS (60000.0f / 30.0f)
+
+//An interval further than this fraction from the running average is rejected as a missed or extra beat
+#ifndef BEAT_INTERVAL_TOLERANCE
+#define BEAT_INTERVAL_TOLERANCE 0.3f
+#endif
+
+//Number of recent beat to beat intervals kept (a power of two)
+#ifndef BEAT_INTERVAL_HISTORY
+#define BEAT_INTERVAL_HISTORY 32
+#endif
+
+/**
+ * @brief Finds the beats in the band passed oscillation (see OscillationExtractor), one sample at a time,
+ * with a fixed amount of work and memory per sample.
+ *
+ * A beat starts where the oscillation rises through an adaptive threshold, a fraction of the average of
+ * the recent beat peaks that decays while no beat comes, but never below a fraction of the highest that
+ * average reached in the session. Its time is interpolated between the two samples
+ * around the crossing. After a beat nothing is detected for the refractory period and until the pulse fell
+ * back below 0. The interval to the previous beat is accepted if it lies between 30 and 220 bpm and close
+ * to the running average interval; three rejections in a row restart the average from the latest interval,
+ * so a change in heart rate is followed.
+ */
+class BeatDetector
+{
+public:
+    BeatDetector();
+
+    //Forget every beat
+    void reset();
+
+    /**
+     * @brief Add the next sample of the oscillation
+     * @param timeMilliseconds time of the sample
+     * @param oscillation the band passed pulse, in mmHg
+     * @return true if a beat started at this sample
+     */
+    bool addSample(float timeMilliseconds, float oscillation);
+
+    //Number of beats found
+    uint32_t getBeatCount() const { return beatCount; }
+    //Time of the latest beat, in milliseconds
+    float getLastBeatTime() const { return lastBeatTime; }
+
+    //Heart rate from the latest accepted interval, 0 before the first one
+    float getInstantaneousHeartRate() const;
+    //Heart rate from the running average interval, 0 before the first accepted interval
+    float getAverageHeartRate() const;
+    //Heart rate from the median of the accepted intervals in the history, 0 before the first one.
+    //Takes a sort of the history, call it when the rate is reported rather than at every sample.
+    float getMedianHeartRate() const;
+
+    //Number of intervals accepted and rejected so far
+    uint32_t getAcceptedIntervalCount() const { return acceptedIntervals; }
+    uint32_t getRejectedIntervalCount() const { return rejectedIntervals; }
+    //Number of accepted intervals held in the history, at most BEAT_INTERVAL_HISTORY
+    int getIntervalHistorySize() const;
+    //An accepted interval in milliseconds from the history, 0 being the oldest one held
+    float getInterval(int index) const;
+
+private:
+    //Whether the pulse is above the threshold since the last beat
+    bool isPulseHigh;
+    //Whether a sample was seen before, for the crossing interpolation and the peak decay
+    bool hasPreviousSample;
+    float previousTime;
+    float previousOscillation;
+    //Highest value of the current pulse
+    float currentPeak;
+    //Average of the recent beat peaks, and the highest it has been
+    float peakLevel;
+    float sessionPeakLevel;
+
+    //Beats found so far and the time of the latest one
+    uint32_t beatCount;
+    float lastBeatTime;
+    //Latest accepted interval and the running average of the accepted ones
+    float lastInterval;
+    float averageInterval;
+    //Rejected intervals in a row
+    int consecutiveRejections;
+    //Counts of the accepted and rejected intervals
+    uint32_t acceptedIntervals;
+    uint32_t rejectedIntervals;
+    //The latest accepted intervals, as a ring
+    float intervalHistory[BEAT_INTERVAL_HISTORY];
+};
+
+#endif
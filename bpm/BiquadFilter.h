@@ -0,0 +1,192 @@
+/**
+ * @file BiquadFilter.h
+ * @brief Second order IIR sections (biquads) in transposed direct form II, cascaded, per sample or per block
+ *
+ * Define BIQUAD_USE_CMSIS_DSP when CMSIS-DSP is linked (for example the mbed-dsp library) to run the block
+ * path through arm_biquad_cascade_df2T_f32(). Otherwise the portable block path runs the cascade one
+ * section at a time over the whole block, with the state held in locals, which is what the CMSIS code does.
+ * The coefficients and the state are stored in the CMSIS layout either way, so both paths can be mixed.
+ */
+
+#ifndef BIQUAD_FILTER_H
+#define BIQUAD_FILTER_H
+
+#include <math.h>
+
+#ifdef BIQUAD_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+/**
+ * @brief H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+ */
+struct BiquadCoefficients
+{
+    float b0;
+    float b1;
+    float b2;
+    float a1;
+    float a2;
+
+    /**
+     * @brief Second order low pass (Audio EQ Cookbook), Q = 0.7071 for a Butterworth section
+     */
+    static BiquadCoefficients lowPass(float sampleRateHz, float cutoffHz, float q)
+    {
+        double w0 = 2.0 * M_PI * cutoffHz / sampleRateHz;
+        double alpha = sin(w0) / (2.0 * q);
+        double cosine = cos(w0);
+        return normalise((1.0 - cosine) / 2.0, 1.0 - cosine, (1.0 - cosine) / 2.0, 1.0 + alpha, -2.0 * cosine, 1.0 - alpha);
+    }
+
+    /**
+     * @brief Second order high pass (Audio EQ Cookbook); it removes a constant and a linear ramp entirely
+     */
+    static BiquadCoefficients highPass(float sampleRateHz, float cutoffHz, float q)
+    {
+        double w0 = 2.0 * M_PI * cutoffHz / sampleRateHz;
+        double alpha = sin(w0) / (2.0 * q);
+        double cosine = cos(w0);
+        return normalise((1.0 + cosine) / 2.0, -(1.0 + cosine), (1.0 + cosine) / 2.0, 1.0 + alpha, -2.0 * cosine, 1.0 - alpha);
+    }
+
+private:
+    static BiquadCoefficients normalise(double b0, double b1, double b2, double a0, double a1, double a2)
+    {
+        BiquadCoefficients coefficients;
+        coefficients.b0 = (float)(b0 / a0);
+        coefficients.b1 = (float)(b1 / a0);
+        coefficients.b2 = (float)(b2 / a0);
+        coefficients.a1 = (float)(a1 / a0);
+        coefficients.a2 = (float)(a2 / a0);
+        return coefficients;
+    }
+};
+
+//Q of the two sections of a fourth order Butterworth filter
+#define BUTTERWORTH_4_Q1 0.5411961f
+#define BUTTERWORTH_4_Q2 1.3065630f
+//Q of a second order Butterworth filter
+#define BUTTERWORTH_2_Q 0.7071068f
+
+/**
+ * @brief StageCount biquads in series. Every section starts as a pass-through with a cleared state.
+ */
+template <int StageCount>
+class BiquadCascade
+{
+    static_assert(StageCount >= 1, "BiquadCascade needs at least one section");
+
+public:
+    BiquadCascade()
+    {
+        for(int stage = 0; stage < StageCount; stage++)
+        {
+            float *c = &coefficientValues[5 * stage];
+            c[0] = 1.0f;
+            c[1] = c[2] = c[3] = c[4] = 0.0f;
+        }
+#ifdef BIQUAD_USE_CMSIS_DSP
+        arm_biquad_cascade_df2T_init_f32(&instance, StageCount, coefficientValues, stateValues);
+#endif
+        reset();
+    }
+
+    //The CMSIS instance points into the object, so it is never copied
+    BiquadCascade(const BiquadCascade &) = delete;
+    BiquadCascade &operator=(const BiquadCascade &) = delete;
+
+    //Sets the coefficients of one section, the state is kept
+    void setStage(int stage, const BiquadCoefficients &coefficients)
+    {
+        //CMSIS order: b0, b1, b2, then the feedback coefficients with their sign flipped
+        float *c = &coefficientValues[5 * stage];
+        c[0] = coefficients.b0;
+        c[1] = coefficients.b1;
+        c[2] = coefficients.b2;
+        c[3] = -coefficients.a1;
+        c[4] = -coefficients.a2;
+    }
+
+    //Clears the state, as if the input had always been 0
+    void reset()
+    {
+        for(int i = 0; i < 2 * StageCount; i++)
+            stateValues[i] = 0.0f;
+    }
+
+    /**
+     * @brief Sets the state as if the input had always been value, so a cascade started on a cuff that is
+     * already at some pressure does not ring
+     */
+    void settle(float value)
+    {
+        for(int stage = 0; stage < StageCount; stage++)
+        {
+            const float *c = &coefficientValues[5 * stage];
+            //The DC gain of the section, 0 for a high pass
+            float denominator = 1.0f - c[3] - c[4];
+            float output = denominator != 0.0f ? value * (c[0] + c[1] + c[2]) / denominator : 0.0f;
+            stateValues[2 * stage] = output - c[0] * value;
+            stateValues[2 * stage + 1] = c[2] * value + c[4] * output;
+            value = output;
+        }
+    }
+
+    //Filters one sample
+    float process(float value)
+    {
+        for(int stage = 0; stage < StageCount; stage++)
+        {
+            const float *c = &coefficientValues[5 * stage];
+            float *d = &stateValues[2 * stage];
+            float output = c[0] * value + d[0];
+            d[0] = c[1] * value + c[3] * output + d[1];
+            d[1] = c[2] * value + c[4] * output;
+            value = output;
+        }
+        return value;
+    }
+
+    /**
+     * @brief Filters count samples; output may be the same array as input
+     */
+    void processBlock(const float *input, float *output, int count)
+    {
+#ifdef BIQUAD_USE_CMSIS_DSP
+        arm_biquad_cascade_df2T_f32(&instance, const_cast<float *>(input), output, (uint32_t)count);
+#else
+        for(int stage = 0; stage < StageCount; stage++)
+        {
+            const float *c = &coefficientValues[5 * stage];
+            const float b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+            float d0 = stateValues[2 * stage];
+            float d1 = stateValues[2 * stage + 1];
+            for(int i = 0; i < count; i++)
+            {
+                float value = input[i];
+                float filtered = b0 * value + d0;
+                d0 = b1 * value + a1 * filtered + d1;
+                d1 = b2 * value + a2 * filtered;
+                output[i] = filtered;
+            }
+            stateValues[2 * stage] = d0;
+            stateValues[2 * stage + 1] = d1;
+            //The next section works on the output of this one
+            input = output;
+        }
+#endif
+    }
+
+private:
+    //b0, b1, b2, -a1, -a2 of every section
+    float coefficientValues[5 * StageCount];
+    //The two delay elements of every section
+    float stateValues[2 * StageCount];
+#ifdef BIQUAD_USE_CMSIS_DSP
+    //Points at the arrays above
+    arm_biquad_cascade_df2T_instance_f32 instance;
+#endif
+};
+
+#endif
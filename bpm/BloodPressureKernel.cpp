@@ -0,0 +1,104 @@
+/**
+ * @file BloodPressureKernel.cpp
+ * @brief Blood pressure estimation over a whole recorded deflation in two passes, without globals
+ */
+
+#include "BloodPressureKernel.h"
+#include "OscillometricStages.h"
+#include <stdint.h>
+
+/**
+ * @brief The entry the old slope table would hold at index i: the slope between sample i and i+1,
+ * or its initial value (1.0 for the first entry, 0.0 otherwise) when that slope was never written
+ */
+static inline float slopeAt(const PressureSampleSpan &samples, int i)
+{
+    if(i + 1 < samples.sampleCount)
+    {
+        float consecutiveTimeDifference = samples.timeValues[i+1] - samples.timeValues[i];
+        if(consecutiveTimeDifference != 0.000000)
+            return (samples.pressureValues[i+1] - samples.pressureValues[i]) / consecutiveTimeDifference;
+    }
+    return (i == 0) ? 1.0f : 0.0f;
+}
+
+BloodPressureResult estimateBloodPressure(const PressureSampleSpan &samples)
+{
+    const int sampleCount = samples.sampleCount;
+
+    //First pass: the maximum positive slope and the sample that closes it
+    float maxSlope = 0;
+    int maxIndexPositiveSlope = 0;
+    for(int j = 0; j < sampleCount; j++)
+    {
+        float slope = slopeAt(samples, j);
+        if(slope > maxSlope)
+        {
+            maxSlope = slope;
+            maxIndexPositiveSlope = j + 1;
+        }
+    }
+
+    //Second pass: the systolic slope before the maximum, the diastolic slope after it and the running
+    //count of positive slopes, remembered where each candidate was taken
+    float sysSlopeMinThreshold = 0.5 * maxSlope;
+    float diaSlopeMinThreshold = 0.8 * maxSlope;
+    float minDiffInSlope = INT32_MAX;
+    float minDiffInSlopeDia = INT32_MAX;
+    int systolicPressureSlopeIndex = 0;
+    int diastolicPressureSlopeIndex = 0;
+    //Positive slopes before the systolic slope and up to and including the diastolic slope
+    int positiveSlopesBeforeSystolic = 0;
+    int positiveSlopesThroughDiastolic = 0;
+    int positiveSlopes = 0;
+    //The slopes before the maximum can hold the systolic slope
+    int k = 0;
+    for(; k < maxIndexPositiveSlope - 1; k++)
+    {
+        float slope = slopeAt(samples, k);
+        if((slope >= 0.0) && (slope < sysSlopeMinThreshold) && (sysSlopeMinThreshold - slope < minDiffInSlope))
+        {
+            minDiffInSlope = sysSlopeMinThreshold - slope;
+            systolicPressureSlopeIndex = k + 1;
+            positiveSlopesBeforeSystolic = positiveSlopes;
+        }
+        positiveSlopes += (slope > 0.0);
+    }
+    //The two slopes around the maximum are only counted
+    for(; k < maxIndexPositiveSlope + 1 && k < sampleCount; k++)
+        positiveSlopes += (slopeAt(samples, k) > 0.0);
+    //The slopes after the maximum can hold the diastolic slope
+    for(; k < sampleCount; k++)
+    {
+        float slope = slopeAt(samples, k);
+        positiveSlopes += (slope > 0.0);
+        if((slope >= 0.0) && (slope < diaSlopeMinThreshold) && (diaSlopeMinThreshold - slope < minDiffInSlopeDia))
+        {
+            minDiffInSlopeDia = diaSlopeMinThreshold - slope;
+            diastolicPressureSlopeIndex = k + 1;
+            positiveSlopesThroughDiastolic = positiveSlopes;
+        }
+    }
+
+    BloodPressureResult result;
+    result.sampleCount = sampleCount;
+    result.maxSlope = maxSlope;
+    result.maxSlopeIndex = maxIndexPositiveSlope;
+    result.systolicIndex = systolicPressureSlopeIndex;
+    result.diastolicIndex = diastolicPressureSlopeIndex;
+    result.systolicPressure = sampleValueAt(samples.pressureValues, sampleCount, systolicPressureSlopeIndex);
+    result.diastolicPressure = sampleValueAt(samples.pressureValues, sampleCount, diastolicPressureSlopeIndex);
+    result.meanArterialPressureSlope = sampleValueAt(samples.pressureValues, sampleCount, maxIndexPositiveSlope);
+    result.systolicTime = sampleValueAt(samples.timeValues, sampleCount, systolicPressureSlopeIndex);
+    result.diastolicTime = sampleValueAt(samples.timeValues, sampleCount, diastolicPressureSlopeIndex);
+
+    //The heart rate counts the positive slopes from the systolic slope up to the diastolic slope
+    result.positiveSlopeCount = 0;
+    if(diastolicPressureSlopeIndex != 0 && diastolicPressureSlopeIndex >= systolicPressureSlopeIndex)
+        result.positiveSlopeCount = positiveSlopesThroughDiastolic - positiveSlopesBeforeSystolic;
+
+    //Every slope was looked at, nothing had to be dropped
+    result.isExact = true;
+    completeBloodPressureResult(result);
+    return result;
+}
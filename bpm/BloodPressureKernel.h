@@ -0,0 +1,35 @@
+/**
+ * @file BloodPressureKernel.h
+ * @brief Blood pressure estimation over a whole recorded deflation in two passes, without globals
+ */
+
+#ifndef BLOOD_PRESSURE_KERNEL_H
+#define BLOOD_PRESSURE_KERNEL_H
+
+#include "BloodPressureResult.h"
+
+/**
+ * @brief A recorded deflation: sampleCount timestamps (ms) and pressures (mmHg) in two parallel arrays
+ */
+struct PressureSampleSpan
+{
+    //Timestamps in milliseconds
+    const float *timeValues;
+    //Pressures in mmHg
+    const float *pressureValues;
+    //Number of samples in both arrays
+    int sampleCount;
+};
+
+/**
+ * @brief Estimates systolic, diastolic, both MAPs, pulse pressure and heart rate from one deflation.
+ *
+ * Gives the same indices and values as the separate stages in OscillometricStages.h, but never stores
+ * the slope table: the first pass finds the maximum positive slope, the second searches for the
+ * systolic and diastolic slopes and counts the positive slopes for the heart rate at the same time.
+ * The function only reads the span and keeps its state on the stack, so it can be called from several
+ * threads and in tight loops. Nothing is printed.
+ */
+BloodPressureResult estimateBloodPressure(const PressureSampleSpan &samples);
+
+#endif
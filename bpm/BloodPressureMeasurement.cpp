@@ -0,0 +1,354 @@
+/**
+ * @file BloodPressureMeasurement.cpp
+ * @brief The measurement flow: pumping, deflation from 150 mmHg down to 30 mmHg and the slope search
+ */
+
+#include "BloodPressureMeasurement.h"
+#include "stdio.h"
+
+//Turns the 24-bit output of the sensor into mmHg with integer arithmetic only
+typedef MprlsCountsConverter<MeasurementSensorVariant> SensorConverter;
+
+BloodPressureMeasurement::BloodPressureMeasurement(PressureSensorBus &sensorBus, MeasurementClock &measurementClock,
+                                                   int sensorAddress)
+    : clock(measurementClock), acquisition(sensorBus, sensorAddress), oscillationExtractor(MEASUREMENT_SAMPLE_RATE_HZ)
+{
+    isSampleEchoEnabled = true;
+    telemetryEncoder = 0;
+    sessionLog = 0;
+    profiler = 0;
+    isEnvelopeAnalysisEnabled = false;
+    isEnvelopeFitEnabled = false;
+    isEarlyTerminationEnabled = false;
+    isArtifactRejectionEnabled = false;
+    reset();
+}
+
+void BloodPressureMeasurement::reset()
+{
+    acquisition.reset();
+    oscillometricAnalyzer.reset();
+    oscillationExtractor.reset();
+    beatDetector.reset();
+    artifactFilter.reset();
+    envelopeFit.reset();
+    sampleQueue.reset();
+    pressure = 0.0;
+    previousPressureVal = 0.0;
+    isPressureIncreasing = true;
+    isPressureDecreasing = false;
+    deflationRateMessage = "";
+    isEarlyStopReached = false;
+    envelopeDecimationCounter = 0;
+    envelopeBeats = 0;
+    oscillationPeakCuffPressure = 0.0f;
+    oscillationPeakTime = 0.0f;
+    sessionStartMicroseconds = 0;
+    hasSessionStarted = false;
+    pressureCounter = 0;
+    isMeasurementFinished.store(false);
+    maxProduceMicroseconds = 0;
+    totalProduceMicroseconds = 0;
+    skippedEchoLines = 0;
+    for(int i = 0; i < GRAPH_SAMPLE_COUNT; i++)
+    {
+        graphPressureValues[i] = 0.0;
+        graphTimeValues[i] = 0.0;
+    }
+}
+
+BloodPressureResult BloodPressureMeasurement::run()
+{
+    //A finished measurement would only give its old result back without sampling: start a new one
+    if(isMeasurementFinished.load())
+        reset();
+
+    while(!consume())
+    {
+        //Poll the sensor: a new conversion is started as soon as the previous one is read, and nothing
+        //happens until the sensor reports the result is ready; the session log is written in that time
+        if(!produce() && !serviceSessionLog())
+            clock.delayMicroseconds(MEASUREMENT_POLL_INTERVAL_US);
+    }
+
+    //Finish the slope search over all the recorded samples
+    return getResult();
+}
+
+bool BloodPressureMeasurement::produce()
+{
+    MprlsSample sample;
+    uint64_t startMicroseconds = clock.nowMicroseconds();
+    if(!acquisition.poll(startMicroseconds, sample))
+        return false;
+
+    //A full queue loses the sample (counted by the queue) rather than waiting for the processing side
+    sampleQueue.push(sample);
+
+    uint64_t produceMicroseconds = clock.nowMicroseconds() - startMicroseconds;
+    totalProduceMicroseconds += produceMicroseconds;
+    if(produceMicroseconds > maxProduceMicroseconds)
+        maxProduceMicroseconds = (uint32_t)produceMicroseconds;
+    return true;
+}
+
+bool BloodPressureMeasurement::consume()
+{
+    //The queued samples are taken a block at a time, so the conversion and the filters run over whole blocks
+    MprlsSample samples[OSCILLATION_BLOCK_SIZE];
+    OscillationBlock block;
+    while(!isMeasurementFinished.load())
+    {
+        block.sampleCount = 0;
+        while(block.sampleCount < OSCILLATION_BLOCK_SIZE && sampleQueue.pop(samples[block.sampleCount]))
+            block.sampleCount++;
+        if(block.sampleCount == 0)
+            break;
+
+        //Calcuate the pressure from the 24-bit output using the formula referring the datasheet
+        for(int i = 0; i < block.sampleCount; i++)
+        {
+            HOT_PATH_BEGIN(conversionStartTicks);
+            block.pressureValues[i] = SensorConverter::toMillimetresOfMercury(samples[i].counts);
+            HOT_PATH_END(profiler, HOT_PATH_CONVERSION, conversionStartTicks);
+        }
+
+        //Replace the spikes a movement of the arm puts into the pressure
+        for(int i = 0; i < block.sampleCount; i++)
+        {
+            isArtifact[i] = false;
+            if(!isArtifactRejectionEnabled)
+                continue;
+            HOT_PATH_BEGIN(artifactStartTicks);
+            block.pressureValues[i] = artifactFilter.process(block.pressureValues[i]);
+            isArtifact[i] = artifactFilter.isLastRejected();
+            HOT_PATH_END(profiler, HOT_PATH_ARTIFACT, artifactStartTicks);
+        }
+
+        //Separate the deflation ramp from the pulses and follow their envelope
+        HOT_PATH_BEGIN(filterStartTicks);
+        oscillationExtractor.processBlock(block);
+        HOT_PATH_END(profiler, HOT_PATH_FILTER, filterStartTicks);
+
+        for(int i = 0; i < block.sampleCount; i++)
+        {
+            processSample(samples[i], block, i);
+            if(updatePhase())
+            {
+                isMeasurementFinished.store(true);
+                if(telemetryEncoder != 0)
+                    telemetryEncoder->flush();
+                break;
+            }
+        }
+    }
+    return isMeasurementFinished.load();
+}
+
+bool BloodPressureMeasurement::updatePhase()
+{
+    //As and when the pressure goes above 150 for the first time as we pump, then isPressureIncreasing shall be false as we do
+    //not want to take this value into calculations.
+    if(pressure > 150)
+        isPressureIncreasing = false;
+
+    //now that we are releasing the valve and the pressure goes below than 151 mm Hg at that time isPressureDecreasing will
+    //be set to true
+    //isPressureIncreasing is false when we finished pumping (i.e After 150)
+    if (pressure < 151 && !isPressureIncreasing)
+        isPressureDecreasing = true;
+
+    //As soon as the pressure goes below 30 and isPressureDecreasing is set to true that means
+    //we now have to break out of the whole loop and show final readings
+    return (pressure < 30 && isPressureDecreasing) || isEarlyStopReached;
+}
+
+MeasurementProducerStatistics BloodPressureMeasurement::getProducerStatistics() const
+{
+    MeasurementProducerStatistics statistics;
+    statistics.samplesQueued = acquisition.getStatistics().samplesRead - sampleQueue.getOverflows();
+    statistics.queueOverflows = sampleQueue.getOverflows();
+    statistics.queueHighWaterMark = sampleQueue.getHighWaterMark();
+    statistics.maxProduceMicroseconds = maxProduceMicroseconds;
+    statistics.totalProduceMicroseconds = totalProduceMicroseconds;
+    statistics.skippedEchoLines = skippedEchoLines;
+    statistics.missedSamplePeriods = acquisition.getStatistics().missedPeriods;
+    return statistics;
+}
+
+void BloodPressureMeasurement::setSamplePeriod(uint32_t periodMicroseconds)
+{
+    acquisition.setSamplePeriod(periodMicroseconds);
+    oscillationExtractor.configure(periodMicroseconds > 0 ? 1000000.0f / periodMicroseconds : MEASUREMENT_SAMPLE_RATE_HZ);
+}
+
+void BloodPressureMeasurement::processSample(const MprlsSample &sample, const OscillationBlock &block, int index)
+{
+#ifdef HOT_PATH_PROFILING
+    if(profiler != 0)
+        profiler->recordSampleTime(sample.timeMicroseconds);
+#endif
+
+    //The pressure calculated from the 24-bit output
+    pressure = block.pressureValues[index];
+
+    //If the difference between the consecutive pressure values is less than 3.0 mmHg/sec, the deflation rate is too slow
+    if((previousPressureVal - pressure) < 3.0)
+    {
+        deflationRateMessage = "Deflation Rate too slow, Please make it fast";
+    }
+
+    //If the difference between the consecutive pressure values is greater than 5.0 mmHg/sec, the deflation rate is too fast
+    else if ((previousPressureVal - pressure) > 5.0)
+    {
+        deflationRateMessage = "Deflation Rate too fast, Please make it slow";
+    }
+
+    //If deflation rate is between 3.0 mmHg/sec and 5.0 mmHg/sec, it is Okay since we have been asked to keep reducing by 4.0 mmHg/sec
+    else
+    {
+        deflationRateMessage = "Deflation Rate Okay, continue";
+    }
+
+    //The time at which the conversion was read, in milliseconds since the first sample of the session,
+    //keeping the full microsecond resolution of the timestamp
+    if(!hasSessionStarted)
+    {
+        sessionStartMicroseconds = sample.timeMicroseconds;
+        hasSessionStarted = true;
+    }
+    float time_ms = (float)(sample.timeMicroseconds - sessionStartMicroseconds) / 1000.0f;
+
+    HOT_PATH_BEGIN(outputStartTicks);
+    //In binary telemetry mode the raw sample is sent instead of the text line
+    if(telemetryEncoder != 0)
+        telemetryEncoder->addSample(sample);
+    //The log only packs the sample in RAM here
+    if(sessionLog != 0)
+        sessionLog->addSample(sample);
+
+    //The printout is the slow part; while processing is behind it is dropped, the analysis never is.
+    //The samples still waiting are the queued ones and the rest of this block.
+    bool isEchoed = isSampleEchoEnabled && telemetryEncoder == 0;
+    uint32_t backlog = sampleQueue.size() + (uint32_t)(block.sampleCount - index - 1);
+    if(isEchoed && backlog > MEASUREMENT_ECHO_BACKLOG_LIMIT)
+    {
+        isEchoed = false;
+        skippedEchoLines++;
+    }
+    const char *artifactRemark = isArtifact[index] ? " | Artifact replaced" : "";
+
+    //If the isPressureDecreasing is true , we are deflating and going below 151mmHg
+    if(isPressureDecreasing)
+    {
+        if(isEchoed)
+            printf ("\nTimeStamp : %d | Pressure : %f%s \n", (int)time_ms, pressure, artifactRemark);
+        HOT_PATH_END(profiler, HOT_PATH_OUTPUT, outputStartTicks);
+        //The current calculated pressure and time are handed to the analyzer and the beat detector
+        HOT_PATH_BEGIN(analysisStartTicks);
+        bool isBeat = analyseOscillation(time_ms, block, index);
+        if(!isEnvelopeAnalysisEnabled)
+            oscillometricAnalyzer.addSample(time_ms, pressure);
+        HOT_PATH_END(profiler, HOT_PATH_ANALYSIS, analysisStartTicks);
+        if(isBeat && isEchoed)
+            printf ("\nBeat : %d | Heart Rate : %d | Average Heart Rate : %d \n", (int)beatDetector.getLastBeatTime(),
+                    (int)(beatDetector.getInstantaneousHeartRate() + 0.5f), (int)(beatDetector.getAverageHeartRate() + 0.5f));
+        //The first values are kept for the graph data
+        if(pressureCounter < GRAPH_SAMPLE_COUNT)
+        {
+            graphPressureValues[pressureCounter] = pressure;
+            graphTimeValues[pressureCounter] = time_ms;
+        }
+        //increment the counter value
+        pressureCounter++;
+    }
+
+    //If the pressure is pumped beyond 151 then start showing deflation rate remarks
+    else if(isPressureIncreasing == false)
+    {
+        if(isEchoed)
+            printf ("\nTimeStamp : %d | Pressure : %f | Deflation Comment : %s%s \n", (int)time_ms, pressure, deflationRateMessage,
+                    artifactRemark);
+        HOT_PATH_END(profiler, HOT_PATH_OUTPUT, outputStartTicks);
+    }
+    //The increasing pressure when we pump the cuff
+    else
+    {
+        if(isEchoed)
+            printf ("\nTimeStamp : %d | Pressure : %f%s\n", (int)time_ms, pressure, artifactRemark);
+        HOT_PATH_END(profiler, HOT_PATH_OUTPUT, outputStartTicks);
+    }
+
+    //Save the current pressure value into previousPressureVal before calculating the new pressure value
+    previousPressureVal = pressure;
+}
+
+bool BloodPressureMeasurement::analyseOscillation(float timeValue, const OscillationBlock &block, int index)
+{
+    //Pumping and the start of the deflation make the band pass ring; nothing is analysed until it settled
+    //after the cuff pressure stopped rising
+    if(block.cuffPressureValues[index] >= oscillationPeakCuffPressure)
+    {
+        oscillationPeakCuffPressure = block.cuffPressureValues[index];
+        oscillationPeakTime = timeValue;
+    }
+    if(timeValue - oscillationPeakTime < OSCILLATION_SETTLE_MS)
+        return false;
+
+    bool isBeat = beatDetector.addSample(timeValue, block.oscillationValues[index]);
+    if(!isEnvelopeAnalysisEnabled)
+        return isBeat;
+
+    //The envelope changes slowly, so only every OSCILLATION_ENVELOPE_DECIMATION-th point is analysed;
+    //the beats in between are all counted
+    envelopeBeats += isBeat;
+    if(++envelopeDecimationCounter < OSCILLATION_ENVELOPE_DECIMATION)
+        return isBeat;
+    oscillometricAnalyzer.addEnvelopeSample(timeValue, block.cuffPressureValues[index], block.envelopeValues[index], envelopeBeats);
+    if(isEnvelopeFitEnabled)
+        envelopeFit.addPoint(block.cuffPressureValues[index], block.envelopeValues[index]);
+    envelopeDecimationCounter = 0;
+    envelopeBeats = 0;
+
+    //Once the envelope is well past the diastolic point the rest of the deflation cannot change the
+    //result; the provisional result is only worked out then, and must pass every check. It comes from the
+    //search alone, the envelope fit is left to the final getResult()
+    if(isEarlyTerminationEnabled && oscillometricAnalyzer.isDiastolicSettled())
+    {
+        BloodPressureResult provisionalResult = evaluateResult(false);
+        isEarlyStopReached = provisionalResult.confidence >= MEASUREMENT_EARLY_STOP_CONFIDENCE &&
+                             provisionalResult.positiveSlopeCount >= MEASUREMENT_EARLY_STOP_MIN_BEATS;
+    }
+    return isBeat;
+}
+
+BloodPressureResult BloodPressureMeasurement::getResult() const
+{
+    return evaluateResult(isEnvelopeAnalysisEnabled && isEnvelopeFitEnabled);
+}
+
+BloodPressureResult BloodPressureMeasurement::evaluateResult(bool isEnvelopeFitApplied) const
+{
+    BloodPressureResult result = oscillometricAnalyzer.finish();
+
+    //The fitted envelope gives the pressures between the points; the search still gives where they are
+    if(isEnvelopeFitApplied)
+    {
+        EnvelopeFitResult fit = envelopeFit.fit();
+        if(fit.isValid)
+        {
+            result.systolicPressure = fit.systolicPressure;
+            result.diastolicPressure = fit.diastolicPressure;
+            result.meanArterialPressureSlope = fit.meanArterialPressure;
+            completeBloodPressureResult(result);
+        }
+    }
+
+    //The heart rate comes from the beat to beat intervals found while deflating, when there are any
+    if(beatDetector.getAcceptedIntervalCount() > 0)
+    {
+        result.heartRate = (int)(beatDetector.getMedianHeartRate() + 0.5f);
+        updateBloodPressureConfidence(result);
+    }
+    return result;
+}
@@ -0,0 +1,324 @@
+/**
+ * @file BloodPressureMeasurement.h
+ * @brief The measurement flow: pumping, deflation from 150 mmHg down to 30 mmHg and the slope search
+ */
+
+#ifndef BLOOD_PRESSURE_MEASUREMENT_H
+#define BLOOD_PRESSURE_MEASUREMENT_H
+
+#include "hal/MeasurementHardware.h"
+#include "MprlsAcquisition.h"
+#include "MprlsTransferFunction.h"
+#include "OscillometricAnalyzer.h"
+#include "BloodPressureResult.h"
+#include "SampleQueue.h"
+#include "Telemetry.h"
+#include "SessionLog.h"
+#include "HotPathProfiler.h"
+#include "OscillationExtractor.h"
+#include "BeatDetector.h"
+#include "HampelFilter.h"
+#include "EnvelopeFit.h"
+#include <atomic>
+
+//Number of samples kept for the graph data printed at the end
+#define GRAPH_SAMPLE_COUNT 50
+
+//The Honeywell part on the board: its range, unit and transfer function (refer the datasheet)
+typedef Mprls0300YG MeasurementSensorVariant;
+
+//Time between two polls of the sensor while a conversion is running
+#ifndef MEASUREMENT_POLL_INTERVAL_US
+#define MEASUREMENT_POLL_INTERVAL_US 100
+#endif
+
+//Slots of the queue between the sampling and the processing side, a power of two (16 bytes each)
+#ifndef MEASUREMENT_QUEUE_CAPACITY
+#define MEASUREMENT_QUEUE_CAPACITY 64
+#endif
+
+//The per-sample printout is skipped while more samples than this are waiting to be processed
+#ifndef MEASUREMENT_ECHO_BACKLOG_LIMIT
+#define MEASUREMENT_ECHO_BACKLOG_LIMIT (MEASUREMENT_QUEUE_CAPACITY / 4)
+#endif
+
+//The rate the sensor delivers samples at when it converts freely, used to set up the oscillation filters
+#ifndef MEASUREMENT_SAMPLE_RATE_HZ
+#define MEASUREMENT_SAMPLE_RATE_HZ (1000000.0f / (MPRLS_CONVERSION_TIME_US + 2 * MEASUREMENT_POLL_INTERVAL_US))
+#endif
+
+//Only every n-th envelope point is analysed, the envelope is far slower than the sample rate
+#ifndef OSCILLATION_ENVELOPE_DECIMATION
+#define OSCILLATION_ENVELOPE_DECIMATION 16
+#endif
+
+//Time the envelope analysis and the beat detection wait after the cuff pressure peaked, for the filters to settle
+#ifndef OSCILLATION_SETTLE_MS
+#define OSCILLATION_SETTLE_MS 2000.0f
+#endif
+
+//Least confidence the provisional result needs for the deflation to end early
+#ifndef MEASUREMENT_EARLY_STOP_CONFIDENCE
+#define MEASUREMENT_EARLY_STOP_CONFIDENCE 1.0f
+#endif
+
+//Least beats between the provisional systolic and diastolic points for the deflation to end early; a
+//filter transient right after the pump stopped makes a narrow envelope peak with hardly any beats under it
+#ifndef MEASUREMENT_EARLY_STOP_MIN_BEATS
+#define MEASUREMENT_EARLY_STOP_MIN_BEATS 3
+#endif
+
+/**
+ * @brief What the sampling side of a measurement cost
+ */
+struct MeasurementProducerStatistics
+{
+    //Samples handed to the processing side
+    uint32_t samplesQueued;
+    //Samples lost because the queue was full
+    uint32_t queueOverflows;
+    //Most samples that were waiting at once
+    uint32_t queueHighWaterMark;
+    //Longest and total time spent in produce() calls that read a sample, in microseconds
+    uint32_t maxProduceMicroseconds;
+    uint64_t totalProduceMicroseconds;
+    //Per-sample printouts skipped because processing was behind
+    uint32_t skippedEchoLines;
+    //Sample periods given up because a conversion could not start on time (with a sample period set)
+    uint32_t missedSamplePeriods;
+};
+
+/**
+ * @brief Runs one blood pressure measurement against any sensor bus and clock.
+ * On the board it is given the mbed I2C bus and Timer; on a PC a simulated sensor and a virtual clock,
+ * so the very same logic can replay a deflation much faster than real time.
+ *
+ * Sampling and processing are split by a SampleQueue: produce() only polls the sensor and queues the
+ * timestamped sample, consume() does the conversion, the printing, the deflation rate remarks and the
+ * analysis. run() calls both from one thread; on the board produce() can run in its own higher priority
+ * thread (see hal/MbedMeasurementProducerThread.h) so slow console output never delays a timestamp.
+ */
+class BloodPressureMeasurement
+{
+public:
+    /**
+     * @param sensorBus the bus the Honeywell sensor is on
+     * @param measurementClock the time base used for polling and timestamps
+     * @param sensorAddress the 8-bit address of the sensor
+     */
+    BloodPressureMeasurement(PressureSensorBus &sensorBus, MeasurementClock &measurementClock, int sensorAddress);
+
+    /**
+     * @brief Gets ready for another measurement: every sample, filter state, candidate and counter of the
+     * previous one is cleared, the settings (echo, telemetry, session log, profiler, envelope analysis,
+     * envelope fit, early termination, artifact rejection) are kept. Nothing is allocated. Not while produce() or consume() may run.
+     */
+    void reset();
+
+    /**
+     * @brief Samples the cuff pressure until it drops below 30 mmHg after the deflation started (or the
+     * diastolic point is settled, with early termination), printing every sample and the deflation rate remarks.
+     * Called again after a measurement finished, it calls reset() first and measures anew.
+     * @return the values found by the slope search
+     */
+    BloodPressureResult run();
+
+    /**
+     * @brief Sampling side: poll the sensor once and queue the sample if one was read. Never waits.
+     * Must only be called from one thread at a time.
+     * @return true if a sample was read
+     */
+    bool produce();
+
+    //The earliest time produce() can read a sample, 0 for right away
+    uint64_t getNextProduceMicroseconds() const { return acquisition.getNextPollMicroseconds(); }
+
+    /**
+     * @brief Processing side: handle every queued sample, printing and analysing it.
+     * Must only be called from one thread at a time.
+     * @return true once the pressure dropped below 30 mmHg after the deflation, or ended early
+     */
+    bool consume();
+
+    /**
+     * @brief Start a conversion every periodMicroseconds on a fixed grid instead of as soon as the previous
+     * sample was read (0, the default), and set the oscillation filters up for that rate. Set it before
+     * the measurement starts; it is kept by reset().
+     */
+    void setSamplePeriod(uint32_t periodMicroseconds);
+
+    //The sample period set, 0 when the sensor converts freely
+    uint32_t getSamplePeriod() const { return acquisition.getSamplePeriod(); }
+
+    //Writes the session log if a record is waiting (see setSessionLog()); returns true if it wrote one
+    bool serviceSessionLog() { return sessionLog != 0 && sessionLog->service(); }
+
+    //True once the measurement is complete; safe to read from any thread
+    bool isFinished() const { return isMeasurementFinished.load(); }
+
+    //The values found by the slope search over the samples processed so far (or by the envelope fit, see
+    //setEnvelopeFit()), with the heart rate of the beats found so far
+    BloodPressureResult getResult() const;
+
+    //The beats, beat to beat intervals and heart rates found so far during the deflation
+    const BeatDetector &getBeatDetector() const { return beatDetector; }
+
+    //The cost of the sampling side and the state of the queue
+    MeasurementProducerStatistics getProducerStatistics() const;
+
+    /**
+     * @brief Turn the per-sample printout on or off (on by default)
+     */
+    void setSampleEcho(bool isEnabled) { isSampleEchoEnabled = isEnabled; }
+
+    /**
+     * @brief Send every sample as binary telemetry instead of printing it (0 to print again).
+     * The encoder is flushed when the measurement finishes; send the result through it afterwards.
+     */
+    void setTelemetry(TelemetryEncoder *encoder) { telemetryEncoder = encoder; }
+
+    /**
+     * @brief Also keep every sample in a session log (0 to stop). Start the session before the measurement
+     * and end it with the result afterwards; run() writes the log while it waits for the sensor; when
+     * produce() and consume() are called separately, call SessionLog::service() on the processing side.
+     */
+    void setSessionLog(SessionLog *log) { sessionLog = log; }
+
+    /**
+     * @brief Record the sample timing and the cost of every hot path stage into a profiler (0 to stop).
+     * Only has an effect when built with HOT_PATH_PROFILING.
+     */
+    void setProfiler(HotPathProfiler *hotPathProfiler)
+    {
+        profiler = hotPathProfiler;
+        acquisition.setProfiler(hotPathProfiler);
+    }
+
+    /**
+     * @brief Analyse the envelope of the oscillometric pulses (OscillationExtractor) instead of the raw
+     * sample to sample slopes (off by default). Set it before the measurement starts.
+     */
+    void setEnvelopeAnalysis(bool isEnabled) { isEnvelopeAnalysisEnabled = isEnabled; }
+
+    /**
+     * @brief Report the systolic, diastolic and mean arterial pressures of an asymmetric Gaussian fitted
+     * to the whole envelope (EnvelopeFit) instead of the single envelope points the search picks (off by
+     * default). The indices, times and beat count still come from the search. When the fit fails the
+     * search result is kept. The early termination checks the search result, so the fit only runs when
+     * the result is read. Only has an effect together with the envelope analysis.
+     */
+    void setEnvelopeFit(bool isEnabled) { isEnvelopeFitEnabled = isEnabled; }
+
+    //The envelope fit over the points so far, see setEnvelopeFit()
+    EnvelopeFitResult getEnvelopeFit() const { return envelopeFit.fit(); }
+
+    /**
+     * @brief End the measurement as soon as the envelope is clearly past the diastolic point
+     * (OscillometricAnalyzer::isDiastolicSettled()) and the provisional result passes
+     * MEASUREMENT_EARLY_STOP_CONFIDENCE with MEASUREMENT_EARLY_STOP_MIN_BEATS under the peak, instead of at 30 mmHg (off by default). Only has an effect
+     * together with the envelope analysis.
+     */
+    void setEarlyTermination(bool isEnabled) { isEarlyTerminationEnabled = isEnabled; }
+
+    /**
+     * @brief Replace motion artifacts in the converted pressure with the median of the last
+     * ARTIFACT_REJECTION_WINDOW samples (HampelFilter) before anything looks at it (off by default). The
+     * raw counts sent as telemetry or kept in the session log are left as read; echoed samples that were
+     * replaced are marked. Set it before the measurement starts.
+     */
+    void setArtifactRejection(bool isEnabled) { isArtifactRejectionEnabled = isEnabled; }
+
+    //Samples replaced by the artifact rejection in this measurement
+    uint32_t getRejectedSampleCount() const { return artifactFilter.getRejectedCount(); }
+
+    //True if the measurement ended before the pressure dropped below 30 mmHg
+    bool isEndedEarly() const { return isEarlyStopReached; }
+
+    //Timestamp of the first sample of the measurement, 0 before it was processed
+    uint64_t getFirstSampleMicroseconds() const { return hasSessionStarted ? sessionStartMicroseconds : 0; }
+
+    //Number of samples recorded between 150 mmHg and 30 mmHg
+    int getSampleCount() const { return pressureCounter; }
+    //The first pressure values, for the graph data
+    const float *getGraphPressureValues() const { return graphPressureValues; }
+    //The first time values in milliseconds since the first sample, for the graph data
+    const float *getGraphTimeValues() const { return graphTimeValues; }
+
+private:
+    //Handles one converted sample, the index-th of the block
+    void processSample(const MprlsSample &sample, const OscillationBlock &block, int index);
+    //Hands the oscillation at the index-th sample of the block to the beat detector, and its envelope to
+    //the analyzer in envelope mode; returns true if a beat started there
+    bool analyseOscillation(float timeValue, const OscillationBlock &block, int index);
+    //Moves through the pumping and deflation phases, returns true when the measurement is complete
+    bool updatePhase();
+    //The result of the search so far with the heart rate, its pressures replaced by the envelope fit if
+    //isEnvelopeFitApplied (a fixed but not small cost, see EnvelopeFit::fit())
+    BloodPressureResult evaluateResult(bool isEnvelopeFitApplied) const;
+
+    //The time base
+    MeasurementClock &clock;
+    //Reads the sensor without blocking
+    MprlsAcquisition<PressureSensorBus> acquisition;
+    //Calculates the slopes and the systolic/diastolic candidates sample by sample
+    OscillometricAnalyzer oscillometricAnalyzer;
+    //The band pass, envelope and cuff pressure filters of the envelope analysis
+    OscillationExtractor oscillationExtractor;
+    //Whether the analyzer gets the envelope instead of the samples
+    bool isEnvelopeAnalysisEnabled;
+    //Whether the envelope points are fitted as well, and their bins
+    bool isEnvelopeFitEnabled;
+    EnvelopeFit envelopeFit;
+    //Whether artifacts are replaced, the filter doing it and which samples of the block it replaced
+    bool isArtifactRejectionEnabled;
+    HampelFilter<ARTIFACT_REJECTION_WINDOW> artifactFilter;
+    bool isArtifact[OSCILLATION_BLOCK_SIZE];
+    //Whether the deflation may end once the diastolic point is settled, and whether it did
+    bool isEarlyTerminationEnabled;
+    bool isEarlyStopReached;
+    //Samples since the last envelope point and beats counted over them
+    int envelopeDecimationCounter;
+    int envelopeBeats;
+    //Highest filtered cuff pressure so far and when it was seen
+    float oscillationPeakCuffPressure;
+    float oscillationPeakTime;
+    //Finds the beats in the oscillation while the cuff deflates
+    BeatDetector beatDetector;
+    //Samples read by produce() and not yet handled by consume()
+    SampleQueue<MprlsSample, MEASUREMENT_QUEUE_CAPACITY> sampleQueue;
+    //Set by consume() when the pressure dropped below 30 mmHg after the deflation
+    std::atomic<bool> isMeasurementFinished;
+    //Written by produce() only
+    uint32_t maxProduceMicroseconds;
+    uint64_t totalProduceMicroseconds;
+    //Written by consume() only
+    uint32_t skippedEchoLines;
+
+    //Stores the pressure calculated from the sensor
+    float pressure;
+    //The previous pressure value that was calculated
+    float previousPressureVal;
+    //Check if pressure is increasing or decreasing
+    bool isPressureIncreasing;
+    bool isPressureDecreasing;
+    //The deflation rate message
+    const char *deflationRateMessage;
+    //Whether every sample is printed
+    bool isSampleEchoEnabled;
+    //Where the samples go in binary telemetry mode, 0 when they are printed
+    TelemetryEncoder *telemetryEncoder;
+    //Where the samples are kept on the device, 0 when they are not
+    SessionLog *sessionLog;
+    //Where the hot path timing goes, 0 when it is not recorded
+    HotPathProfiler *profiler;
+    //Timestamp of the first sample; the analysed times are counted from it
+    uint64_t sessionStartMicroseconds;
+    bool hasSessionStarted;
+    //Stores the total values recorded from the sensor between 150 mm hg and 30 mm hg
+    int pressureCounter;
+    //The first pressure and time values, printed at the end so they can be plotted
+    float graphPressureValues[GRAPH_SAMPLE_COUNT];
+    float graphTimeValues[GRAPH_SAMPLE_COUNT];
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file BloodPressureResult.h
+ * @brief The values estimated from one oscillometric deflation
+ */
+
+#ifndef BLOOD_PRESSURE_RESULT_H
+#define BLOOD_PRESSURE_RESULT_H
+
+/**
+ * @brief Everything the estimators report about one measurement.
+ * Indices refer to the position of the sample in the recorded deflation, exactly like the indices
+ * that used to point into pressureArrayValues. An index of 0 means "not found", as before.
+ */
+struct BloodPressureResult
+{
+    //Total number of samples recorded between 150 mmHg and 30 mmHg
+    int sampleCount;
+    //The value of the maximum positive slope
+    float maxSlope;
+    //The index of the sample that closes the maximum positive slope
+    int maxSlopeIndex;
+    //The index of the Systolic Pressure sample
+    int systolicIndex;
+    //The index of the Diastolic Pressure sample
+    int diastolicIndex;
+    //Systolic pressure in mmHg
+    float systolicPressure;
+    //Diastolic pressure in mmHg
+    float diastolicPressure;
+    //Mean arterial pressure in mmHg, taken where the slope is maximum
+    float meanArterialPressureSlope;
+    //Timestamp of the systolic sample
+    float systolicTime;
+    //Timestamp of the diastolic sample
+    float diastolicTime;
+    //Number of positive slopes between the systolic and diastolic samples
+    int positiveSlopeCount;
+    //Pulse pressure (systolic - diastolic) in mmHg
+    float pulsePressure;
+    //Mean arterial pressure in mmHg, 0.33 * systolic + 0.67 * diastolic
+    float meanArterialPressureWeightedAverage;
+    //Heart rate in beats per minute, 0 when the systolic and diastolic samples have the same timestamp
+    int heartRate;
+    //Fraction (0 to 1) of the plausibility checks the result passes, see completeBloodPressureResult()
+    float confidence;
+    //False when the bounded analyzer had to drop a candidate that could have changed the result
+    bool isExact;
+};
+
+/**
+ * @brief Sets the confidence from the values already in the result, see completeBloodPressureResult().
+ * Call it again after replacing one of them, for example the heart rate.
+ */
+inline void updateBloodPressureConfidence(BloodPressureResult &result)
+{
+    int passedChecks = 0;
+    if(result.systolicIndex != 0)
+        passedChecks++;
+    if(result.diastolicIndex != 0)
+        passedChecks++;
+    if(result.systolicPressure > result.diastolicPressure)
+        passedChecks++;
+    if(result.meanArterialPressureSlope >= result.diastolicPressure && result.meanArterialPressureSlope <= result.systolicPressure)
+        passedChecks++;
+    if(result.heartRate >= 30 && result.heartRate <= 220)
+        passedChecks++;
+    result.confidence = passedChecks / 5.0f;
+}
+
+/**
+ * @brief Fills in the values that follow from the indices, pressures and times already in the result:
+ * pulse pressure, weighted average MAP, heart rate and confidence.
+ *
+ * The confidence is the share of these checks that hold: a systolic sample was found, a diastolic
+ * sample was found, systolic is above diastolic, the slope MAP lies between them and the heart rate
+ * is between 30 and 220 beats per minute.
+ */
+inline void completeBloodPressureResult(BloodPressureResult &result)
+{
+    //Pulse pressure is calculated as the difference between the Systolic and the Diastolic values
+    result.pulsePressure = result.systolicPressure - result.diastolicPressure;
+    //MAP = 1/3 Systolic Value + 2/3 Diastolic Value
+    result.meanArterialPressureWeightedAverage = (0.33) * result.systolicPressure + (0.67) * result.diastolicPressure;
+
+    //calculate the heart rate by dividing by the time (ms to s) and then multiplying by 60
+    float heartRateSeconds = result.diastolicTime/1000 - result.systolicTime/1000;
+    result.heartRate = 0;
+    if(heartRateSeconds != 0.0f)
+        result.heartRate = (int)((((float)result.positiveSlopeCount) / heartRateSeconds) * 60.0f);
+
+    updateBloodPressureConfidence(result);
+}
+
+#endif
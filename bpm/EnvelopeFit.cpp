@@ -0,0 +1,220 @@
+/**
+ * @file EnvelopeFit.cpp
+ * @brief Fits an asymmetric Gaussian to the oscillation envelope against the cuff pressure, in constant
+ * memory, for sub-sample systolic, mean arterial and diastolic pressures
+ */
+
+#include "EnvelopeFit.h"
+#include <math.h>
+
+//Pressures enter the fit in units of 10 mmHg, which keeps the squared distances near 1 in single precision
+static const float pressureScale = 10.0f;
+
+EnvelopeFit::EnvelopeFit()
+{
+    reset();
+}
+
+void EnvelopeFit::reset()
+{
+    for(int i = 0; i < ENVELOPE_FIT_BIN_COUNT; i++)
+    {
+        bins[i].count = 0;
+        bins[i].pressureSum = 0.0f;
+        bins[i].amplitudeSum = 0.0f;
+        bins[i].logMeanAmplitude = 0.0f;
+    }
+    pointCount = 0;
+    skippedPointCount = 0;
+}
+
+void EnvelopeFit::addPoint(float cuffPressure, float amplitude)
+{
+    pointCount++;
+    float binPosition = (cuffPressure - ENVELOPE_FIT_MIN_PRESSURE_MMHG) / ENVELOPE_FIT_BIN_WIDTH_MMHG;
+    //Written so that NaN is skipped as well
+    if(!(binPosition >= 0.0f && binPosition < ENVELOPE_FIT_BIN_COUNT && amplitude > 0.0f))
+    {
+        skippedPointCount++;
+        return;
+    }
+
+    EnvelopeBin &bin = bins[(int)binPosition];
+    bin.count++;
+    bin.pressureSum += cuffPressure;
+    bin.amplitudeSum += amplitude;
+    bin.logMeanAmplitude = logf(bin.amplitudeSum / bin.count);
+}
+
+EnvelopeFit::PeakFit EnvelopeFit::fitAtPeak(float peakPressure, float minAmplitude) const
+{
+    //The model is y = a + bs * u + bd * v with y the log amplitude, u the squared distance above the peak
+    //and v the one below it (each 0 on the other side). u * v is always 0, which leaves
+    //    [ sw  su  sv  ] [a ]   [ sy  ]
+    //    [ su  suu 0   ] [bs] = [ suy ]
+    //    [ sv  0   svv ] [bd]   [ svy ]
+    float sw = 0.0f, su = 0.0f, sv = 0.0f, suu = 0.0f, svv = 0.0f, sy = 0.0f, suy = 0.0f, svy = 0.0f;
+    int systolicBins = 0;
+    int diastolicBins = 0;
+    for(int i = 0; i < ENVELOPE_FIT_BIN_COUNT; i++)
+    {
+        const EnvelopeBin &bin = bins[i];
+        if(!isFitted(bin, minAmplitude))
+            continue;
+        float meanAmplitude = bin.amplitudeSum / bin.count;
+        float weight = bin.count * meanAmplitude * meanAmplitude;
+        float distance = (bin.pressureSum / bin.count - peakPressure) / pressureScale;
+        float squaredDistance = distance * distance;
+        float y = bin.logMeanAmplitude;
+        sw += weight;
+        sy += weight * y;
+        if(distance > 0.0f)
+        {
+            su += weight * squaredDistance;
+            suu += weight * squaredDistance * squaredDistance;
+            suy += weight * squaredDistance * y;
+            systolicBins++;
+        }
+        else if(distance < 0.0f)
+        {
+            sv += weight * squaredDistance;
+            svv += weight * squaredDistance * squaredDistance;
+            svy += weight * squaredDistance * y;
+            diastolicBins++;
+        }
+    }
+
+    PeakFit peakFit;
+    peakFit.isValid = false;
+    peakFit.peakPressure = peakPressure;
+    peakFit.logPeak = 0.0f;
+    peakFit.systolicCurvature = 0.0f;
+    peakFit.diastolicCurvature = 0.0f;
+    peakFit.residual = INFINITY;
+    //Each side needs two bins besides the peak for a curvature that is not just a line through them
+    if(systolicBins < 2 || diastolicBins < 2)
+        return peakFit;
+
+    float determinant = sw - su * su / suu - sv * sv / svv;
+    if(!(determinant > 0.0f))
+        return peakFit;
+    float logPeak = (sy - su * suy / suu - sv * svy / svv) / determinant;
+    float systolicSlope = (suy - su * logPeak) / suu;
+    float diastolicSlope = (svy - sv * logPeak) / svv;
+
+    //The weighted mean squared error, from the bins again rather than from the sums, which would cancel
+    float squaredErrorSum = 0.0f;
+    for(int i = 0; i < ENVELOPE_FIT_BIN_COUNT; i++)
+    {
+        const EnvelopeBin &bin = bins[i];
+        if(!isFitted(bin, minAmplitude))
+            continue;
+        float meanAmplitude = bin.amplitudeSum / bin.count;
+        float weight = bin.count * meanAmplitude * meanAmplitude;
+        float distance = (bin.pressureSum / bin.count - peakPressure) / pressureScale;
+        float slope = distance > 0.0f ? systolicSlope : diastolicSlope;
+        float error = bin.logMeanAmplitude - logPeak - slope * distance * distance;
+        squaredErrorSum += weight * error * error;
+    }
+
+    peakFit.logPeak = logPeak;
+    peakFit.systolicCurvature = -systolicSlope;
+    peakFit.diastolicCurvature = -diastolicSlope;
+    peakFit.residual = squaredErrorSum / sw;
+    //Both sides have to fall off away from the peak
+    peakFit.isValid = peakFit.systolicCurvature > 0.0f && peakFit.diastolicCurvature > 0.0f;
+    return peakFit;
+}
+
+EnvelopeFitResult EnvelopeFit::fit() const
+{
+    EnvelopeFitResult result;
+    result.isValid = false;
+    result.meanArterialPressure = 0.0f;
+    result.systolicPressure = 0.0f;
+    result.diastolicPressure = 0.0f;
+    result.peakAmplitude = 0.0f;
+    result.systolicWidth = 0.0f;
+    result.diastolicWidth = 0.0f;
+    result.fittedBins = 0;
+    result.residual = 0.0f;
+
+    //The bins below ENVELOPE_FIT_MIN_FRACTION of the largest mean amplitude stay out of the fit
+    float largestMeanAmplitude = 0.0f;
+    for(int i = 0; i < ENVELOPE_FIT_BIN_COUNT; i++)
+    {
+        if(bins[i].count > 0 && bins[i].amplitudeSum / bins[i].count > largestMeanAmplitude)
+            largestMeanAmplitude = bins[i].amplitudeSum / bins[i].count;
+    }
+    const float minAmplitude = ENVELOPE_FIT_MIN_FRACTION * largestMeanAmplitude;
+
+    //The peak at the mean pressure of every fitted bin; the search is refined between the fitted bins
+    //on either side of the best one
+    PeakFit best = { false, 0.0f, 0.0f, 0.0f, 0.0f, INFINITY };
+    float lowerBound = 0.0f;
+    float upperBound = 0.0f;
+    float previousPressure = NAN;
+    bool isBestPrevious = false;
+    for(int i = 0; i < ENVELOPE_FIT_BIN_COUNT; i++)
+    {
+        if(!isFitted(bins[i], minAmplitude))
+            continue;
+        result.fittedBins++;
+        float pressure = bins[i].pressureSum / bins[i].count;
+        if(isBestPrevious)
+            upperBound = pressure;
+        isBestPrevious = false;
+        PeakFit candidate = fitAtPeak(pressure, minAmplitude);
+        if(candidate.isValid && candidate.residual < best.residual)
+        {
+            best = candidate;
+            lowerBound = isnan(previousPressure) ? pressure : previousPressure;
+            upperBound = pressure;
+            isBestPrevious = true;
+        }
+        previousPressure = pressure;
+    }
+    if(!best.isValid)
+        return result;
+
+    //Golden section search of the residual between the two neighbours, keeping the best peak seen
+    const float goldenRatio = 0.618034f;
+    float lower = lowerBound;
+    float upper = upperBound;
+    PeakFit first = fitAtPeak(upper - goldenRatio * (upper - lower), minAmplitude);
+    PeakFit second = fitAtPeak(lower + goldenRatio * (upper - lower), minAmplitude);
+    for(int step = 0; step < ENVELOPE_FIT_REFINE_STEPS; step++)
+    {
+        if(first.residual <= second.residual)
+        {
+            if(first.isValid && first.residual < best.residual)
+                best = first;
+            upper = second.peakPressure;
+            second = first;
+            first = fitAtPeak(upper - goldenRatio * (upper - lower), minAmplitude);
+        }
+        else
+        {
+            if(second.isValid && second.residual < best.residual)
+                best = second;
+            lower = first.peakPressure;
+            first = second;
+            second = fitAtPeak(lower + goldenRatio * (upper - lower), minAmplitude);
+        }
+    }
+    if(first.isValid && first.residual < best.residual)
+        best = first;
+    if(second.isValid && second.residual < best.residual)
+        best = second;
+
+    //ln(A0 / A) = k * ((p - m) / scale)^2, solved for the pressure where A / A0 is the ratio
+    result.isValid = true;
+    result.meanArterialPressure = best.peakPressure;
+    result.peakAmplitude = expf(best.logPeak);
+    result.systolicWidth = pressureScale / sqrtf(best.systolicCurvature);
+    result.diastolicWidth = pressureScale / sqrtf(best.diastolicCurvature);
+    result.systolicPressure = best.peakPressure + result.systolicWidth * sqrtf(logf(1.0f / ENVELOPE_FIT_SYSTOLIC_RATIO));
+    result.diastolicPressure = best.peakPressure - result.diastolicWidth * sqrtf(logf(1.0f / ENVELOPE_FIT_DIASTOLIC_RATIO));
+    result.residual = best.residual;
+    return result;
+}
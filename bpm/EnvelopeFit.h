@@ -0,0 +1,143 @@
+/**
+ * @file EnvelopeFit.h
+ * @brief Fits an asymmetric Gaussian to the oscillation envelope against the cuff pressure, in constant
+ * memory, for sub-sample systolic, mean arterial and diastolic pressures
+ */
+
+#ifndef ENVELOPE_FIT_H
+#define ENVELOPE_FIT_H
+
+#include <stdint.h>
+
+//The envelope points are summed into bins of this many mmHg of cuff pressure, from the lowest pressure up
+#ifndef ENVELOPE_FIT_BIN_WIDTH_MMHG
+#define ENVELOPE_FIT_BIN_WIDTH_MMHG 2.0f
+#endif
+#ifndef ENVELOPE_FIT_MIN_PRESSURE_MMHG
+#define ENVELOPE_FIT_MIN_PRESSURE_MMHG 20.0f
+#endif
+#ifndef ENVELOPE_FIT_BIN_COUNT
+#define ENVELOPE_FIT_BIN_COUNT 96
+#endif
+
+//Only bins whose mean amplitude reaches this fraction of the largest one are fitted; below it the noise
+//floor and the filter ringing bend the envelope away from the model
+#ifndef ENVELOPE_FIT_MIN_FRACTION
+#define ENVELOPE_FIT_MIN_FRACTION 0.3f
+#endif
+
+//Golden section steps that refine the peak pressure between the bins around the best one
+#ifndef ENVELOPE_FIT_REFINE_STEPS
+#define ENVELOPE_FIT_REFINE_STEPS 20
+#endif
+
+//The fractions of the peak amplitude that mark systolic and diastolic, the ratios the slope search uses
+#ifndef ENVELOPE_FIT_SYSTOLIC_RATIO
+#define ENVELOPE_FIT_SYSTOLIC_RATIO 0.5f
+#endif
+#ifndef ENVELOPE_FIT_DIASTOLIC_RATIO
+#define ENVELOPE_FIT_DIASTOLIC_RATIO 0.8f
+#endif
+
+/**
+ * @brief The fitted envelope and the pressures read from it
+ */
+struct EnvelopeFitResult
+{
+    //False if there were too few bins on either side of the peak, or a side did not fall off
+    bool isValid;
+    //Cuff pressure where the model peaks, the mean arterial pressure, in mmHg
+    float meanArterialPressure;
+    //Cuff pressures above and below it where the model falls to the systolic and diastolic ratio
+    float systolicPressure;
+    float diastolicPressure;
+    //Peak amplitude of the model, in the units of the envelope
+    float peakAmplitude;
+    //Widths of the two halves: the amplitude is peakAmplitude * exp(-((p - MAP) / width)^2)
+    float systolicWidth;
+    float diastolicWidth;
+    //Bins the fit used, and the weighted mean squared error of the log amplitude over them
+    int fittedBins;
+    float residual;
+};
+
+/**
+ * @brief Collects (cuff pressure, envelope amplitude) points as they arrive and fits
+ *     A(p) = A0 * exp(-((p - m) / ws)^2) for p above m, and with wd instead of ws below it
+ * once the deflation is over.
+ *
+ * Every point only adds to the count, the pressure sum and the amplitude sum of its pressure bin (the
+ * sufficient statistics of the binned envelope), so the memory is ENVELOPE_FIT_BIN_COUNT bins however
+ * long the deflation runs. The fit works on the log of the bin means, where the model is a parabola on
+ * each side of m: for a given m, the log peak and the two curvatures are a weighted linear least squares
+ * problem in closed form (the two sides share no term, so the 3x3 normal equations solve directly). The
+ * weights are the number of points times the squared amplitude, which undoes the noise the log blows up
+ * at small amplitudes. m is tried at the mean pressure of every fitted bin, then refined with
+ * ENVELOPE_FIT_REFINE_STEPS golden section steps around the best one, so the fit takes a fixed number of
+ * passes over the bins and no iteration has to converge.
+ */
+class EnvelopeFit
+{
+public:
+    EnvelopeFit();
+
+    //Forgets every point
+    void reset();
+
+    /**
+     * @brief Adds one point of the envelope. Points outside the bins, and amplitudes that are not
+     * positive, are only counted as skipped.
+     * @param cuffPressure the cuff pressure without the pulses, in mmHg
+     * @param amplitude the pulse amplitude at that pressure
+     */
+    void addPoint(float cuffPressure, float amplitude);
+
+    //Points added since the last reset, and how many of them fell outside the bins
+    uint32_t getPointCount() const { return pointCount; }
+    uint32_t getSkippedPointCount() const { return skippedPointCount; }
+
+    /**
+     * @brief Fits the model to the points so far; the points are kept, so more may be added afterwards
+     */
+    EnvelopeFitResult fit() const;
+
+private:
+    //The sums of one bin, and the log of its mean amplitude, updated with every point so the fit
+    //takes no logarithm
+    struct EnvelopeBin
+    {
+        uint32_t count;
+        float pressureSum;
+        float amplitudeSum;
+        float logMeanAmplitude;
+    };
+
+    //The model for a fixed peak pressure
+    struct PeakFit
+    {
+        bool isValid;
+        float peakPressure;
+        float logPeak;
+        //Curvatures of the log amplitude per (10 mmHg)^2 above and below the peak
+        float systolicCurvature;
+        float diastolicCurvature;
+        float residual;
+    };
+
+    //Solves the weighted least squares problem with the peak at peakPressure, over the bins whose mean
+    //amplitude reaches minAmplitude: one pass for the sums, one for the residual
+    PeakFit fitAtPeak(float peakPressure, float minAmplitude) const;
+    //Whether a bin takes part in the fit
+    static bool isFitted(const EnvelopeBin &bin, float minAmplitude)
+    {
+        return bin.count > 0 && bin.amplitudeSum >= minAmplitude * bin.count;
+    }
+
+    //The bins of cuff pressure
+    EnvelopeBin bins[ENVELOPE_FIT_BIN_COUNT];
+    //Points added, and points that fell outside the bins
+    uint32_t pointCount;
+    uint32_t skippedPointCount;
+};
+
+#endif
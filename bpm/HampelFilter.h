@@ -0,0 +1,286 @@
+/**
+ * @file HampelFilter.h
+ * @brief Sliding window median and a streaming Hampel filter that replaces motion artifacts in the pressure
+ */
+
+#ifndef HAMPEL_FILTER_H
+#define HAMPEL_FILTER_H
+
+#include <stdint.h>
+#include <math.h>
+
+//Samples in the window of the artifact rejection; spikes up to half of it long are removed. At most
+//HAMPEL_FILTER_MAX_WINDOW (see HampelFilter)
+#ifndef ARTIFACT_REJECTION_WINDOW
+#define ARTIFACT_REJECTION_WINDOW 7
+#endif
+
+//A sample is an artifact when it is this many robust standard deviations (1.4826 x MAD) from the median
+#ifndef ARTIFACT_REJECTION_THRESHOLD
+#define ARTIFACT_REJECTION_THRESHOLD 3.0f
+#endif
+
+//Smallest distance from the median, in mmHg, that counts as an artifact, for when the window is quiet
+//and the MAD close to 0: the pulses alone never move the pressure that far within a window. At 2 mmHg
+//the edges of a spike still pass and set the maximum slope; at 0.5 mmHg clean samples are replaced
+#ifndef ARTIFACT_REJECTION_MIN_DEVIATION_MMHG
+#define ARTIFACT_REJECTION_MIN_DEVIATION_MMHG 1.0f
+#endif
+
+//Largest window of HampelFilter: up to it the sliding MAD decides like the exact one (host/HampelBenchmark.cpp)
+#define HAMPEL_FILTER_MAX_WINDOW 31
+
+/**
+ * @brief The median of the last WindowSize values, updated in O(log WindowSize) per value.
+ *
+ * The window is a ring of values split over two heaps of ring slots: a max-heap with the lower half and
+ * a min-heap with the upper half, the lower one holding the extra value when the count is odd, so the
+ * median is at the roots. Every slot knows its heap and its place in it; once the window is full the new
+ * value overwrites the oldest slot where it stands, is sifted up or down in that heap, and if it crossed
+ * the other half the two roots swap heaps. Nothing is allocated and nothing is sorted.
+ */
+template <int WindowSize>
+class SlidingMedian
+{
+    static_assert(WindowSize >= 2 && WindowSize <= 255, "SlidingMedian window must be 2 to 255 values");
+
+public:
+    SlidingMedian() { reset(); }
+
+    //Empties the window
+    void reset()
+    {
+        count = 0;
+        oldestSlot = 0;
+        lowCount = 0;
+        highCount = 0;
+    }
+
+    /**
+     * @brief Adds a value, dropping the oldest one once the window is full
+     * @return the median of the window with the new value
+     */
+    float add(float value)
+    {
+        if(count < WindowSize)
+            insert((uint8_t)count++, value);
+        else
+        {
+            replace(oldestSlot, value);
+            oldestSlot = oldestSlot + 1 == WindowSize ? 0 : oldestSlot + 1;
+        }
+        return getMedian();
+    }
+
+    //The median of the window, the mean of the two middle values for an even count, 0 when it is empty
+    float getMedian() const
+    {
+        if(count == 0)
+            return 0.0f;
+        if(lowCount > highCount)
+            return values[lowHeap[0]];
+        return 0.5f * (values[lowHeap[0]] + values[highHeap[0]]);
+    }
+
+    //Number of values in the window
+    int size() const { return count; }
+    bool isFull() const { return count == WindowSize; }
+
+private:
+    //Puts a value in an empty slot and moves a root over if a half got too big
+    void insert(uint8_t slot, float value)
+    {
+        values[slot] = value;
+        if(lowCount == 0 || value <= values[lowHeap[0]])
+            push(true, slot);
+        else
+            push(false, slot);
+
+        if(lowCount > highCount + 1)
+            push(false, pop(true));
+        else if(highCount > lowCount)
+            push(true, pop(false));
+    }
+
+    //Overwrites the value of a slot that is in a heap and restores both heaps
+    void replace(uint8_t slot, float value)
+    {
+        values[slot] = value;
+        bool isLow = isInLowHeap[slot];
+        siftDown(isLow, siftUp(isLow, heapPosition[slot]));
+
+        //Only the new value can be on the wrong side, and if so it is at a root now
+        if(lowCount > 0 && highCount > 0 && values[lowHeap[0]] > values[highHeap[0]])
+        {
+            uint8_t lowRoot = lowHeap[0];
+            uint8_t highRoot = highHeap[0];
+            place(true, 0, highRoot);
+            place(false, 0, lowRoot);
+            siftDown(true, 0);
+            siftDown(false, 0);
+        }
+    }
+
+    void push(bool isLow, uint8_t slot)
+    {
+        int &heapCount = isLow ? lowCount : highCount;
+        place(isLow, heapCount, slot);
+        siftUp(isLow, heapCount++);
+    }
+
+    //Takes the root out of a heap, returns its slot
+    uint8_t pop(bool isLow)
+    {
+        uint8_t *heap = isLow ? lowHeap : highHeap;
+        int &heapCount = isLow ? lowCount : highCount;
+        uint8_t root = heap[0];
+        if(--heapCount > 0)
+        {
+            place(isLow, 0, heap[heapCount]);
+            siftDown(isLow, 0);
+        }
+        return root;
+    }
+
+    void place(bool isLow, int position, uint8_t slot)
+    {
+        (isLow ? lowHeap : highHeap)[position] = slot;
+        heapPosition[slot] = (uint8_t)position;
+        isInLowHeap[slot] = isLow;
+    }
+
+    //True if slot a belongs above slot b: larger in the lower half, smaller in the upper half
+    bool isAbove(bool isLow, uint8_t a, uint8_t b) const
+    {
+        return isLow ? values[a] > values[b] : values[a] < values[b];
+    }
+
+    //Moves the slot at a position up while it is above its parent, returns where it stopped
+    int siftUp(bool isLow, int position)
+    {
+        uint8_t *heap = isLow ? lowHeap : highHeap;
+        uint8_t slot = heap[position];
+        while(position > 0)
+        {
+            int parent = (position - 1) / 2;
+            if(!isAbove(isLow, slot, heap[parent]))
+                break;
+            place(isLow, position, heap[parent]);
+            position = parent;
+        }
+        place(isLow, position, slot);
+        return position;
+    }
+
+    //Moves the slot at a position down while a child is above it
+    void siftDown(bool isLow, int position)
+    {
+        uint8_t *heap = isLow ? lowHeap : highHeap;
+        const int heapCount = isLow ? lowCount : highCount;
+        uint8_t slot = heap[position];
+        for(;;)
+        {
+            int child = 2 * position + 1;
+            if(child >= heapCount)
+                break;
+            if(child + 1 < heapCount && isAbove(isLow, heap[child + 1], heap[child]))
+                child++;
+            if(!isAbove(isLow, heap[child], slot))
+                break;
+            place(isLow, position, heap[child]);
+            position = child;
+        }
+        place(isLow, position, slot);
+    }
+
+    //The window, as a ring
+    float values[WindowSize];
+    //Slots of the lower half (max-heap) and of the upper half (min-heap)
+    uint8_t lowHeap[WindowSize];
+    uint8_t highHeap[WindowSize];
+    int lowCount;
+    int highCount;
+    //Where every slot is: its heap and its position there
+    uint8_t heapPosition[WindowSize];
+    bool isInLowHeap[WindowSize];
+    //Values in the window and the slot the next one overwrites once it is full
+    int count;
+    int oldestSlot;
+};
+
+/**
+ * @brief Streaming Hampel filter: a value further from the median of the last WindowSize values than
+ * threshold x 1.4826 x MAD (and than the minimum deviation) is an artifact and replaced by that median.
+ *
+ * The decision is made on the newest value against a window that already holds it, so nothing is
+ * delayed: a spike is replaced on its first sample, and until it lasts more than half the window it
+ * cannot move the median. The window keeps the raw values, so a genuine step in the pressure is followed
+ * after half a window. The MAD is the sliding median of the deviations of the last WindowSize values
+ * from the median they were compared with, a second SlidingMedian instead of the median of the
+ * deviations from the current median: O(log WindowSize) for both, where the exact MAD needs a sort.
+ * The older deviations were taken from older medians, so the longer the window the further this drifts
+ * from the exact MAD: up to 31 values the two disagree on a few samples in 100k, at 63 on thousands.
+ * The window is therefore limited to HAMPEL_FILTER_MAX_WINDOW. Values are accepted as they are until the
+ * window is full.
+ */
+template <int WindowSize = ARTIFACT_REJECTION_WINDOW>
+class HampelFilter
+{
+    static_assert(WindowSize <= HAMPEL_FILTER_MAX_WINDOW,
+                  "HampelFilter window beyond HAMPEL_FILTER_MAX_WINDOW, the sliding MAD drifts from the exact one");
+
+public:
+    explicit HampelFilter(float thresholdDeviations = ARTIFACT_REJECTION_THRESHOLD,
+                          float minimumDeviation = ARTIFACT_REJECTION_MIN_DEVIATION_MMHG)
+        : threshold(thresholdDeviations), minDeviation(minimumDeviation)
+    {
+        reset();
+    }
+
+    //Empties the windows and clears the counters, keeps the thresholds
+    void reset()
+    {
+        median.reset();
+        deviations.reset();
+        isRejected = false;
+        sampleCount = 0;
+        rejectedCount = 0;
+    }
+
+    /**
+     * @brief Passes one value through the filter
+     * @return the value, or the median of the window if it is an artifact (see isLastRejected())
+     */
+    float process(float value)
+    {
+        sampleCount++;
+        float windowMedian = median.add(value);
+        float deviation = fabsf(value - windowMedian);
+        float scale = 1.4826f * deviations.add(deviation);
+        float limit = threshold * scale > minDeviation ? threshold * scale : minDeviation;
+        isRejected = median.isFull() && deviation > limit;
+        if(!isRejected)
+            return value;
+        rejectedCount++;
+        return windowMedian;
+    }
+
+    //True if the last value was an artifact
+    bool isLastRejected() const { return isRejected; }
+    //Values processed and values replaced since reset()
+    uint32_t getSampleCount() const { return sampleCount; }
+    uint32_t getRejectedCount() const { return rejectedCount; }
+
+private:
+    //The raw values and their deviations from the median
+    SlidingMedian<WindowSize> median;
+    SlidingMedian<WindowSize> deviations;
+    //Robust standard deviations from the median that make an artifact, and the smallest deviation that does
+    float threshold;
+    float minDeviation;
+    bool isRejected;
+    uint32_t sampleCount;
+    uint32_t rejectedCount;
+};
+
+#endif
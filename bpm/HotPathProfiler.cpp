@@ -0,0 +1,156 @@
+/**
+ * @file HotPathProfiler.cpp
+ * @brief Cycle counters, latency histograms and sample timing for the sampling and processing hot path
+ */
+
+#include "HotPathProfiler.h"
+#include "stdio.h"
+
+#ifdef HOT_PATH_CYCLE_COUNTER
+//The core clock, kept up to date by the CMSIS system code
+extern "C" uint32_t SystemCoreClock;
+#endif
+
+uint32_t hotPathTicksPerSecond()
+{
+#ifdef HOT_PATH_CYCLE_COUNTER
+    return SystemCoreClock;
+#else
+    return 1000000000;
+#endif
+}
+
+void hotPathStartTicks()
+{
+#ifdef HOT_PATH_CYCLE_COUNTER
+    //CoreDebug->DEMCR |= TRCENA, then DWT->CTRL |= CYCCNTENA
+    *(volatile uint32_t *)0xE000EDFC |= (1UL << 24);
+    *(volatile uint32_t *)0xE0001000 |= 1UL;
+#endif
+}
+
+//The middle of the values a bucket holds
+static uint32_t bucketMiddle(int index)
+{
+    if(index < 8)
+        return (uint32_t)index;
+    int octave = (index - 8) / 8 + 3;
+    uint64_t lowest = (uint64_t)(8 + (index - 8) % 8) << (octave - 3);
+    uint64_t width = (uint64_t)1 << (octave - 3);
+    return (uint32_t)(lowest + width / 2);
+}
+
+void LatencyHistogram::reset()
+{
+    for(int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+        buckets[i] = 0;
+    count = 0;
+    total = 0;
+    minimum = UINT32_MAX;
+    maximum = 0;
+}
+
+uint32_t LatencyHistogram::percentile(double fraction) const
+{
+    if(count == 0)
+        return 0;
+    //The rank of the value asked for, from 1 to count
+    uint64_t rank = (uint64_t)(fraction * count + 0.5);
+    if(rank < 1)
+        rank = 1;
+    if(rank >= count)
+        return maximum;
+    uint64_t seen = 0;
+    for(int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if(seen >= rank)
+        {
+            uint32_t middle = bucketMiddle(i);
+            if(middle < minimum)
+                return minimum;
+            return middle < maximum ? middle : maximum;
+        }
+    }
+    return maximum;
+}
+
+HotPathProfiler::HotPathProfiler()
+{
+    reset();
+}
+
+void HotPathProfiler::reset()
+{
+    for(int i = 0; i < HOT_PATH_STAGE_COUNT; i++)
+        stageHistograms[i].reset();
+    intervalHistogram.reset();
+    jitterHistogram.reset();
+    firstSampleMicroseconds = 0;
+    lastSampleMicroseconds = 0;
+    lastIntervalMicroseconds = 0;
+    sampleCount = 0;
+}
+
+void HotPathProfiler::recordSampleTime(uint64_t timeMicroseconds)
+{
+    if(sampleCount == 0)
+    {
+        firstSampleMicroseconds = timeMicroseconds;
+    }
+    else
+    {
+        uint64_t interval = timeMicroseconds - lastSampleMicroseconds;
+        intervalHistogram.add((uint32_t)interval);
+        if(sampleCount >= 2)
+            jitterHistogram.add((uint32_t)(interval > lastIntervalMicroseconds ? interval - lastIntervalMicroseconds
+                                                                                : lastIntervalMicroseconds - interval));
+        lastIntervalMicroseconds = interval;
+    }
+    lastSampleMicroseconds = timeMicroseconds;
+    sampleCount++;
+}
+
+HotPathSummary HotPathProfiler::getSummary() const
+{
+    HotPathSummary summary;
+    summary.sampleCount = sampleCount;
+    summary.sampleRateHz = sampleCount >= 2 ? (sampleCount - 1) * 1e6 / (double)(lastSampleMicroseconds - firstSampleMicroseconds) : 0.0;
+    summary.intervalP50Microseconds = intervalHistogram.percentile(0.50);
+    summary.intervalP99Microseconds = intervalHistogram.percentile(0.99);
+    summary.intervalMaxMicroseconds = intervalHistogram.getMaximum();
+    summary.jitterP50Microseconds = jitterHistogram.percentile(0.50);
+    summary.jitterP99Microseconds = jitterHistogram.percentile(0.99);
+
+    const double nanosecondsPerTick = 1e9 / hotPathTicksPerSecond();
+    for(int i = 0; i < HOT_PATH_STAGE_COUNT; i++)
+    {
+        const LatencyHistogram &histogram = stageHistograms[i];
+        HotPathStageSummary &stage = summary.stages[i];
+        stage.count = histogram.getCount();
+        stage.meanNanoseconds = histogram.getCount() ? histogram.getTotal() * nanosecondsPerTick / histogram.getCount() : 0.0;
+        stage.p50Nanoseconds = histogram.percentile(0.50) * nanosecondsPerTick;
+        stage.p99Nanoseconds = histogram.percentile(0.99) * nanosecondsPerTick;
+        stage.maxNanoseconds = histogram.getMaximum() * nanosecondsPerTick;
+    }
+    return summary;
+}
+
+void HotPathProfiler::printSummary() const
+{
+    static const char *stageNames[HOT_PATH_STAGE_COUNT] = {
+        "I2C write", "Status poll", "Data read", "Conversion", "Artifact", "Filter", "Output", "Analysis"
+    };
+
+    HotPathSummary summary = getSummary();
+    printf("\nSamples : %lu | Rate : %.2f Hz | Interval p50/p99/max : %lu/%lu/%lu us | Jitter p50/p99 : %lu/%lu us\n",
+           (unsigned long)summary.sampleCount, summary.sampleRateHz, (unsigned long)summary.intervalP50Microseconds,
+           (unsigned long)summary.intervalP99Microseconds, (unsigned long)summary.intervalMaxMicroseconds,
+           (unsigned long)summary.jitterP50Microseconds, (unsigned long)summary.jitterP99Microseconds);
+    for(int i = 0; i < HOT_PATH_STAGE_COUNT; i++)
+    {
+        const HotPathStageSummary &stage = summary.stages[i];
+        printf("%-12s : %8lu calls | mean %10.0f ns | p50 %10.0f ns | p99 %10.0f ns | max %10.0f ns\n", stageNames[i],
+               (unsigned long)stage.count, stage.meanNanoseconds, stage.p50Nanoseconds, stage.p99Nanoseconds, stage.maxNanoseconds);
+    }
+}
@@ -0,0 +1,198 @@
+/**
+ * @file HotPathProfiler.h
+ * @brief Cycle counters, latency histograms and sample timing for the sampling and processing hot path
+ *
+ * Profiling is compiled in only when HOT_PATH_PROFILING is defined; otherwise the HOT_PATH_BEGIN/END
+ * markers in the hot path compile to nothing. The tick source is the DWT cycle counter (CYCCNT) on
+ * Cortex-M3/M4/M7/M33 and std::chrono::steady_clock (nanoseconds) everywhere else.
+ */
+
+#ifndef HOT_PATH_PROFILER_H
+#define HOT_PATH_PROFILER_H
+
+#include <stdint.h>
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define HOT_PATH_CYCLE_COUNTER 1
+#else
+#include <chrono>
+#endif
+
+/**
+ * @brief The current tick count; 32 bits wrap around, so only differences are meaningful
+ */
+inline uint32_t hotPathTicks()
+{
+#ifdef HOT_PATH_CYCLE_COUNTER
+    //DWT->CYCCNT
+    return *(volatile uint32_t *)0xE0001004;
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Ticks per second of hotPathTicks(): the core clock on target, 1e9 on a PC
+ */
+uint32_t hotPathTicksPerSecond();
+
+/**
+ * @brief Starts the tick source (enables the DWT cycle counter on target)
+ */
+void hotPathStartTicks();
+
+#ifdef HOT_PATH_PROFILING
+//Remember the tick count at the start of a stage
+#define HOT_PATH_BEGIN(name) const uint32_t name = hotPathTicks()
+//Record the ticks since HOT_PATH_BEGIN(name) for a stage, if a profiler is attached
+#define HOT_PATH_END(profiler, stage, name) \
+    do { if((profiler) != 0) (profiler)->recordStage((stage), hotPathTicks() - (name)); } while(0)
+#else
+#define HOT_PATH_BEGIN(name) do {} while(0)
+#define HOT_PATH_END(profiler, stage, name) do {} while(0)
+#endif
+
+/**
+ * @brief The timed stages of the hot path
+ */
+enum HotPathStage
+{
+    //Writing the 0xAA conversion command
+    HOT_PATH_I2C_WRITE,
+    //A read that found the sensor still busy
+    HOT_PATH_STATUS_POLL,
+    //The read that returned the output
+    HOT_PATH_DATA_READ,
+    //Counts to mmHg
+    HOT_PATH_CONVERSION,
+    //Artifact rejection (HampelFilter), with it enabled
+    HOT_PATH_ARTIFACT,
+    //The oscillation and envelope filters, once per block
+    HOT_PATH_FILTER,
+    //Printing or telemetry of the sample
+    HOT_PATH_OUTPUT,
+    //The streaming slope analysis
+    HOT_PATH_ANALYSIS,
+    HOT_PATH_STAGE_COUNT
+};
+
+//Exact buckets for 0 to 7, then 8 buckets per power of two (at most 12.5% wide)
+#define LATENCY_HISTOGRAM_BUCKETS (8 + 29 * 8)
+
+/**
+ * @brief Counts values in log-linear buckets, so percentiles can be read at the end with a fixed,
+ * small amount of memory (under 1 KB) whatever the number of values
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset();
+
+    //Counts one value; inline and branch-light, it runs in the hot path
+    void add(uint32_t value)
+    {
+        buckets[bucketIndex(value)]++;
+        count++;
+        total += value;
+        if(value > maximum)
+            maximum = value;
+        if(value < minimum)
+            minimum = value;
+    }
+
+    //The value below which the given fraction (0 to 1) of the values lie, to the bucket resolution
+    //and never outside the smallest and largest value seen
+    uint32_t percentile(double fraction) const;
+
+    uint32_t getCount() const { return count; }
+    uint64_t getTotal() const { return total; }
+    uint32_t getMaximum() const { return maximum; }
+
+    //Index of the bucket that holds a value
+    static int bucketIndex(uint32_t value)
+    {
+        if(value < 8)
+            return (int)value;
+        int octave = 31 - __builtin_clz(value);
+        return 8 + (octave - 3) * 8 + (int)((value >> (octave - 3)) & 7);
+    }
+
+private:
+    //Number of values in every bucket
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    //Number of values, their sum, the smallest and the largest one
+    uint32_t count;
+    uint64_t total;
+    uint32_t minimum;
+    uint32_t maximum;
+};
+
+/**
+ * @brief The cost of one stage, in nanoseconds
+ */
+struct HotPathStageSummary
+{
+    uint32_t count;
+    double meanNanoseconds;
+    double p50Nanoseconds;
+    double p99Nanoseconds;
+    double maxNanoseconds;
+};
+
+/**
+ * @brief What a session looked like: sample rate and timing jitter, and the cost of every stage
+ */
+struct HotPathSummary
+{
+    //Samples seen and their average rate
+    uint32_t sampleCount;
+    double sampleRateHz;
+    //Time between consecutive samples in microseconds
+    uint32_t intervalP50Microseconds;
+    uint32_t intervalP99Microseconds;
+    uint32_t intervalMaxMicroseconds;
+    //Change of that time from one sample to the next (cycle-to-cycle jitter) in microseconds
+    uint32_t jitterP50Microseconds;
+    uint32_t jitterP99Microseconds;
+    //Cost of every stage
+    HotPathStageSummary stages[HOT_PATH_STAGE_COUNT];
+};
+
+/**
+ * @brief Collects the stage costs and the sample timestamps of one session.
+ * Every stage histogram is only written by the thread that runs that stage, so the sampling thread and
+ * the processing thread can both record into the same profiler; read the summary once both are done.
+ */
+class HotPathProfiler
+{
+public:
+    HotPathProfiler();
+
+    //Forget everything recorded so far
+    void reset();
+    //Add the ticks one pass through a stage took
+    void recordStage(HotPathStage stage, uint32_t ticks) { stageHistograms[stage].add(ticks); }
+    //Add the full resolution timestamp of a sample, in microseconds
+    void recordSampleTime(uint64_t timeMicroseconds);
+
+    HotPathSummary getSummary() const;
+    //Prints the summary as a few lines of text
+    void printSummary() const;
+
+private:
+    //One histogram of ticks per stage
+    LatencyHistogram stageHistograms[HOT_PATH_STAGE_COUNT];
+    //Intervals between samples and their changes, in microseconds
+    LatencyHistogram intervalHistogram;
+    LatencyHistogram jitterHistogram;
+    //The first and the last timestamp, and the last interval
+    uint64_t firstSampleMicroseconds;
+    uint64_t lastSampleMicroseconds;
+    uint64_t lastIntervalMicroseconds;
+    uint32_t sampleCount;
+};
+
+#endif
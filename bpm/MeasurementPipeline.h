@@ -0,0 +1,225 @@
+/**
+ * @file MeasurementPipeline.h
+ * @brief A blood pressure measurement put together at compile time from a sensor, a conversion, a filter, a
+ * feature detector and a sink
+ */
+
+#ifndef MEASUREMENT_PIPELINE_H
+#define MEASUREMENT_PIPELINE_H
+
+#include <stdint.h>
+#include "hal/MeasurementHardware.h"
+#include "MprlsAcquisition.h"
+#include "OscillationExtractor.h"
+#include "BloodPressureResult.h"
+
+//Time between two polls of the sensor in MeasurementPipeline::run() while a conversion is running
+#ifndef PIPELINE_POLL_INTERVAL_US
+#define PIPELINE_POLL_INTERVAL_US 100
+#endif
+
+/**
+ * @brief One sample on its way down the pipeline, every stage adds its part
+ */
+struct PipelineSample
+{
+    //As read from the sensor
+    MprlsSample raw;
+    //Milliseconds since the first sample of the measurement
+    float timeMilliseconds;
+    //The cuff pressure in mmHg, from the conversion
+    float pressure;
+    //From the filter: the cuff pressure without the pulses, the pulses and their envelope (the pressure,
+    //0 and 0 when the filter gives no oscillation)
+    float cuffPressure;
+    float oscillationValue;
+    float envelopeValue;
+    //True once the cuff was pumped above 150 mmHg and is deflating
+    bool isDeflating;
+};
+
+/**
+ * @brief The measurement flow of BloodPressureMeasurement, with every stage a template parameter.
+ *
+ * The stages are plain classes held by value and called directly, so the compiler sees through all of
+ * them: there is no virtual call on the per-sample path and a stage that does nothing (NoOscillationFilter,
+ * NoSampleSink) leaves no code behind. Samples are converted and filtered a block at a time, then handed
+ * one by one to the sink and, while the cuff deflates, to the detector; the measurement ends when the
+ * pressure drops below 30 mmHg after the pump went above 150 mmHg, or when the detector says so.
+ *
+ * What every stage must provide (bpm/PipelinePolicies.h has the standard ones and the presets):
+ *     Sensor      bool poll(uint64_t nowMicroseconds, MprlsSample &sample), void reset()
+ *                 (MprlsAcquisition<Bus> as it is, PushedSampleSource when the samples are pushed)
+ *     Conversion  static float toMillimetresOfMercury(uint32_t counts) (MprlsCountsConverter<Variant>)
+ *     Filter      void processBlock(OscillationBlock &block), void reset(), static const bool hasOscillation
+ *     Detector    bool addSample(const PipelineSample &sample) returning true to end the measurement,
+ *                 BloodPressureResult getResult() const, void reset()
+ *     Sink        void writeSample(const PipelineSample &sample), void finish(const BloodPressureResult &result)
+ */
+template <typename Sensor, typename Conversion, typename Filter, typename Detector, typename Sink>
+class MeasurementPipeline
+{
+public:
+    typedef Sensor SensorType;
+    typedef Conversion ConversionType;
+    typedef Filter FilterType;
+    typedef Detector DetectorType;
+    typedef Sink SinkType;
+
+    //The filter and the detector are built in place (the filters cannot be copied); set them up through
+    //getFilter() and getDetector() if their defaults do not fit
+    explicit MeasurementPipeline(const Sensor &sampleSensor, const Sink &sampleSink = Sink())
+        : sensor(sampleSensor), sink(sampleSink)
+    {
+        reset();
+    }
+
+    //Gets every stage ready for another measurement
+    void reset()
+    {
+        sensor.reset();
+        filter.reset();
+        detector.reset();
+        block.sampleCount = 0;
+        isPressureIncreasing = true;
+        isPressureDecreasing = false;
+        isMeasurementFinished = false;
+        hasSessionStarted = false;
+        sessionStartMicroseconds = 0;
+    }
+
+    /**
+     * @brief Polls the sensor once and processes the sample if one was read. Never waits.
+     * @return true if a sample was read
+     */
+    bool poll(uint64_t nowMicroseconds)
+    {
+        MprlsSample sample;
+        if(isMeasurementFinished || !sensor.poll(nowMicroseconds, sample))
+            return false;
+        push(sample);
+        process();
+        return true;
+    }
+
+    //Queues a sample read elsewhere; the block is processed once it is full
+    void push(const MprlsSample &sample)
+    {
+        if(isMeasurementFinished)
+            return;
+        samples[block.sampleCount++] = sample;
+        if(block.sampleCount == OSCILLATION_BLOCK_SIZE)
+            process();
+    }
+
+    /**
+     * @brief Runs the queued samples through the stages
+     * @return true once the measurement is finished
+     */
+    bool process()
+    {
+        const int count = block.sampleCount;
+        if(count == 0 || isMeasurementFinished)
+        {
+            block.sampleCount = 0;
+            return isMeasurementFinished;
+        }
+
+        for(int i = 0; i < count; i++)
+            block.pressureValues[i] = Conversion::toMillimetresOfMercury(samples[i].counts);
+        filter.processBlock(block);
+        block.sampleCount = 0;
+
+        for(int i = 0; i < count; i++)
+        {
+            PipelineSample sample;
+            sample.raw = samples[i];
+            sample.pressure = block.pressureValues[i];
+            if(!hasSessionStarted)
+            {
+                sessionStartMicroseconds = sample.raw.timeMicroseconds;
+                hasSessionStarted = true;
+            }
+            sample.timeMilliseconds = (float)(sample.raw.timeMicroseconds - sessionStartMicroseconds) / 1000.0f;
+            if(Filter::hasOscillation)
+            {
+                sample.cuffPressure = block.cuffPressureValues[i];
+                sample.oscillationValue = block.oscillationValues[i];
+                sample.envelopeValue = block.envelopeValues[i];
+            }
+            else
+            {
+                sample.cuffPressure = sample.pressure;
+                sample.oscillationValue = 0.0f;
+                sample.envelopeValue = 0.0f;
+            }
+            sample.isDeflating = isPressureDecreasing;
+
+            sink.writeSample(sample);
+            bool isStopped = isPressureDecreasing && detector.addSample(sample);
+
+            //The deflation starts once the pump went above 150 mmHg and ends below 30 mmHg
+            if(sample.pressure > 150)
+                isPressureIncreasing = false;
+            if(sample.pressure < 151 && !isPressureIncreasing)
+                isPressureDecreasing = true;
+            if((sample.pressure < 30 && isPressureDecreasing) || isStopped)
+            {
+                isMeasurementFinished = true;
+                break;
+            }
+        }
+        return isMeasurementFinished;
+    }
+
+    /**
+     * @brief Polls the sensor until the measurement is finished, waiting on the clock while it converts
+     * @return the result, also handed to the sink
+     */
+    BloodPressureResult run(MeasurementClock &clock)
+    {
+        while(!isMeasurementFinished)
+        {
+            if(!poll(clock.nowMicroseconds()))
+                clock.delayMicroseconds(PIPELINE_POLL_INTERVAL_US);
+        }
+        return finish();
+    }
+
+    //Processes what is still queued and hands the result to the sink
+    BloodPressureResult finish()
+    {
+        process();
+        BloodPressureResult result = detector.getResult();
+        sink.finish(result);
+        return result;
+    }
+
+    bool isFinished() const { return isMeasurementFinished; }
+
+    //The result over the samples processed so far
+    BloodPressureResult getResult() const { return detector.getResult(); }
+
+    Sensor &getSensor() { return sensor; }
+    Filter &getFilter() { return filter; }
+    Detector &getDetector() { return detector; }
+    Sink &getSink() { return sink; }
+
+private:
+    Sensor sensor;
+    Filter filter;
+    Detector detector;
+    Sink sink;
+    //The samples waiting to be processed and their block
+    MprlsSample samples[OSCILLATION_BLOCK_SIZE];
+    OscillationBlock block;
+    //The phases of the measurement
+    bool isPressureIncreasing;
+    bool isPressureDecreasing;
+    bool isMeasurementFinished;
+    //Timestamp of the first sample; the times handed on are counted from it
+    bool hasSessionStarted;
+    uint64_t sessionStartMicroseconds;
+};
+
+#endif
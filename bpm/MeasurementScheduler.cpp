@@ -0,0 +1,121 @@
+/**
+ * @file MeasurementScheduler.cpp
+ * @brief Runs one blood pressure measurement after the other, at a fixed interval or on request
+ */
+
+#include "MeasurementScheduler.h"
+#include <string.h>
+
+MeasurementScheduler::MeasurementScheduler(BloodPressureMeasurement &bloodPressureMeasurement, MeasurementClock &measurementClock)
+    : measurement(bloodPressureMeasurement), clock(measurementClock)
+{
+    interval = 0;
+    nextSlotMicroseconds = 0;
+    hasSlots = false;
+    isRequested.store(false);
+    dueMicroseconds = 0;
+    previousEndMicroseconds = 0;
+    hasPreviousMeasurement = false;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void MeasurementScheduler::setInterval(uint64_t intervalMicroseconds)
+{
+    interval = intervalMicroseconds;
+    //The first measurement is due right away, the slots are counted from its start
+    hasSlots = false;
+}
+
+uint64_t MeasurementScheduler::getMicrosecondsUntilDue()
+{
+    if(isRequested.load() || (interval > 0 && !hasSlots))
+        return 0;
+    if(interval == 0)
+        return UINT64_MAX;
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    return nextSlotMicroseconds > nowMicroseconds ? nextSlotMicroseconds - nowMicroseconds : 0;
+}
+
+void MeasurementScheduler::waitUntilDue()
+{
+    uint64_t remainingMicroseconds;
+    while((remainingMicroseconds = getMicrosecondsUntilDue()) > 0 && remainingMicroseconds != UINT64_MAX)
+        clock.delayMicroseconds(remainingMicroseconds < MEASUREMENT_SCHEDULER_WAIT_STEP_US ? (uint32_t)remainingMicroseconds
+                                                                                          : MEASUREMENT_SCHEDULER_WAIT_STEP_US);
+}
+
+void MeasurementScheduler::beginMeasurement()
+{
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    bool isSlotDue = interval > 0 && (!hasSlots || nextSlotMicroseconds <= nowMicroseconds);
+    //A requested measurement is due now; a slot was due when it came, however late it is taken
+    dueMicroseconds = nowMicroseconds;
+    if(isSlotDue && hasSlots)
+        dueMicroseconds = nextSlotMicroseconds;
+    isRequested.store(false);
+
+    if(interval > 0)
+    {
+        if(!hasSlots)
+        {
+            nextSlotMicroseconds = nowMicroseconds;
+            hasSlots = true;
+        }
+        if(isSlotDue)
+            nextSlotMicroseconds += interval;
+    }
+
+    measurement.reset();
+    uint32_t resetMicroseconds = (uint32_t)(clock.nowMicroseconds() - nowMicroseconds);
+    if(resetMicroseconds > statistics.maxResetMicroseconds)
+        statistics.maxResetMicroseconds = resetMicroseconds;
+}
+
+void MeasurementScheduler::completeMeasurement()
+{
+    uint64_t endMicroseconds = clock.nowMicroseconds();
+    uint64_t firstSampleMicroseconds = measurement.getFirstSampleMicroseconds();
+    if(firstSampleMicroseconds < dueMicroseconds)
+        firstSampleMicroseconds = dueMicroseconds;
+
+    statistics.lastStartLatencyMicroseconds = (uint32_t)(firstSampleMicroseconds - dueMicroseconds);
+    if(statistics.lastStartLatencyMicroseconds > statistics.maxStartLatencyMicroseconds)
+        statistics.maxStartLatencyMicroseconds = statistics.lastStartLatencyMicroseconds;
+
+    if(hasPreviousMeasurement)
+    {
+        uint64_t turnaround = firstSampleMicroseconds - previousEndMicroseconds;
+        statistics.lastTurnaroundMicroseconds = turnaround;
+        if(statistics.measurementsCompleted == 1 || turnaround < statistics.minTurnaroundMicroseconds)
+            statistics.minTurnaroundMicroseconds = turnaround;
+        if(turnaround > statistics.maxTurnaroundMicroseconds)
+            statistics.maxTurnaroundMicroseconds = turnaround;
+        statistics.totalTurnaroundMicroseconds += turnaround;
+    }
+    previousEndMicroseconds = endMicroseconds;
+    hasPreviousMeasurement = true;
+    statistics.measurementsCompleted++;
+
+    //Of the slots that came while the measurement ran only the last one is kept, still on the grid
+    while(interval > 0 && hasSlots && nextSlotMicroseconds + interval <= endMicroseconds)
+    {
+        nextSlotMicroseconds += interval;
+        statistics.missedSlots++;
+    }
+}
+
+BloodPressureResult MeasurementScheduler::runNext()
+{
+    waitUntilDue();
+    beginMeasurement();
+    BloodPressureResult result = measurement.run();
+    completeMeasurement();
+    return result;
+}
+
+uint64_t MeasurementScheduler::getMeanTurnaroundMicroseconds() const
+{
+    if(statistics.measurementsCompleted < 2)
+        return 0;
+    return statistics.totalTurnaroundMicroseconds / (statistics.measurementsCompleted - 1);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file MeasurementScheduler.h
+ * @brief Runs one blood pressure measurement after the other, at a fixed interval or on request
+ */
+
+#ifndef MEASUREMENT_SCHEDULER_H
+#define MEASUREMENT_SCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "hal/MeasurementHardware.h"
+#include "BloodPressureMeasurement.h"
+
+//Longest single delay waitUntilDue() makes, so a request is noticed within this time
+#ifndef MEASUREMENT_SCHEDULER_WAIT_STEP_US
+#define MEASUREMENT_SCHEDULER_WAIT_STEP_US 10000
+#endif
+
+/**
+ * @brief How quickly one measurement followed another
+ */
+struct MeasurementSchedulerStatistics
+{
+    //Measurements run to the end
+    uint32_t measurementsCompleted;
+    //Time from the end of a measurement to the first sample of the next one in microseconds: the last,
+    //shortest, longest and total over every measurement but the first
+    uint64_t lastTurnaroundMicroseconds;
+    uint64_t minTurnaroundMicroseconds;
+    uint64_t maxTurnaroundMicroseconds;
+    uint64_t totalTurnaroundMicroseconds;
+    //Time from the moment a measurement was due (its slot came or it was asked for) to its first sample
+    uint32_t lastStartLatencyMicroseconds;
+    uint32_t maxStartLatencyMicroseconds;
+    //Time reset() took to get the measurement ready, the longest so far
+    uint32_t maxResetMicroseconds;
+    //Slots skipped because a later one also passed while a measurement was running
+    uint32_t missedSlots;
+};
+
+/**
+ * @brief Reuses one BloodPressureMeasurement for every measurement, so back-to-back and interval
+ * (ambulatory) measurements need no memory beyond the one measurement.
+ *
+ * Slots are counted from the start of the first measurement, so the interval never drifts. A slot that
+ * passes while a measurement runs is taken as soon as it ended; any earlier ones are skipped and counted.
+ * requestMeasurement() starts one as soon as the current one ended, whatever the interval. Either drive
+ * it with runNext(), which samples and processes on the calling thread, or call beginMeasurement() and
+ * completeMeasurement() around your own loop (for example the producer thread of the board) and wait
+ * with getMicrosecondsUntilDue() in between.
+ */
+class MeasurementScheduler
+{
+public:
+    MeasurementScheduler(BloodPressureMeasurement &bloodPressureMeasurement, MeasurementClock &measurementClock);
+
+    //A measurement every intervalMicroseconds, 0 for requested measurements only (the default)
+    void setInterval(uint64_t intervalMicroseconds);
+
+    //Ask for a measurement as soon as possible; safe from any thread or interrupt
+    void requestMeasurement() { isRequested.store(true); }
+
+    //Microseconds until the next measurement is due, 0 if it is due now, UINT64_MAX if none is planned
+    uint64_t getMicrosecondsUntilDue();
+
+    //Waits on the clock until a measurement is due; returns right away if none is planned
+    void waitUntilDue();
+
+    //Gets the measurement ready (reset()) and notes when it was due. Call right before the sampling starts.
+    void beginMeasurement();
+
+    //Notes the end of the measurement and works out its turnaround. Call once the measurement is finished.
+    void completeMeasurement();
+
+    //waitUntilDue(), beginMeasurement(), BloodPressureMeasurement::run() and completeMeasurement()
+    BloodPressureResult runNext();
+
+    const MeasurementSchedulerStatistics &getStatistics() const { return statistics; }
+
+    //Mean turnaround over every measurement but the first, 0 before the second one
+    uint64_t getMeanTurnaroundMicroseconds() const;
+
+private:
+    //The measurement that is reused
+    BloodPressureMeasurement &measurement;
+    //The time base of the slots
+    MeasurementClock &clock;
+    //0 when only requested measurements run
+    uint64_t interval;
+    //When the next slot comes, valid once the first measurement started
+    uint64_t nextSlotMicroseconds;
+    bool hasSlots;
+    //Set by requestMeasurement(), taken by beginMeasurement()
+    std::atomic<bool> isRequested;
+    //When the measurement being run was due
+    uint64_t dueMicroseconds;
+    //When the previous measurement ended
+    uint64_t previousEndMicroseconds;
+    bool hasPreviousMeasurement;
+    MeasurementSchedulerStatistics statistics;
+};
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @file MprlsAcquisition.h
+ * @brief Non-blocking, conversion driven acquisition state machine for the Honeywell MPRLS sensor
+ */
+
+#ifndef MPRLS_ACQUISITION_H
+#define MPRLS_ACQUISITION_H
+
+#include <stdint.h>
+#include "HotPathProfiler.h"
+
+/**
+* Status byte bits of the MPRLS sensor (refer the datasheet)
+*/
+#define MPRLS_STATUS_POWERED 0x40
+#define MPRLS_STATUS_BUSY 0x20
+#define MPRLS_STATUS_MEMORY_ERROR 0x04
+#define MPRLS_STATUS_MATH_SATURATION 0x01
+
+//The conversion time of the MPRLS sensor in microseconds, the sensor is not polled before it has passed
+#ifndef MPRLS_CONVERSION_TIME_US
+#define MPRLS_CONVERSION_TIME_US 5000
+#endif
+
+/**
+ * @brief One conversion read from the sensor
+ */
+struct MprlsSample
+{
+    //The status byte returned together with the output
+    uint8_t status;
+    //The 24-bit output of the sensor
+    uint32_t counts;
+    //Time at which the conversion was found to be complete, in microseconds
+    uint64_t timeMicroseconds;
+};
+
+/**
+ * @brief Counters kept by the acquisition engine
+ */
+struct MprlsAcquisitionStatistics
+{
+    //Number of 0xAA commands written to the sensor
+    uint32_t conversionsStarted;
+    //Number of complete samples read
+    uint32_t samplesRead;
+    //Number of reads that found the sensor still busy
+    uint32_t busyPolls;
+    //Number of I2C transfers that were not acknowledged
+    uint32_t busErrors;
+    //Number of I2C transfers
+    uint32_t transfers;
+    //Number of bytes moved over the bus, including the address byte of every transfer
+    uint32_t bytesTransferred;
+    //Number of sample periods skipped because the previous conversion was read too late to start on time
+    uint32_t missedPeriods;
+};
+
+/**
+ * @brief Used when the EOC (end of conversion) pin of the sensor is not wired
+ */
+struct MprlsNoEndOfConversionPin
+{
+    //Never used, the busy bit of the status byte is polled instead
+    int read() { return 0; }
+};
+
+/**
+ * @brief Drives the MPRLS sensor without ever waiting.
+ *
+ * The 0xAA command starts a conversion. Once the conversion time has passed, every call to poll()
+ * fetches the status byte and the 24-bit output in a single 4-byte read and keeps the output only if
+ * the busy bit (0x20) is clear. If the EOC pin is given, nothing is read until the pin goes high.
+ * The next conversion is started right away, so the sensor is kept converting at its own rate, unless
+ * a sample period is set: then conversions start on a fixed grid (one every period from the first one)
+ * and the sensor sits idle in between, so the samples keep an exact cadence whatever the polling did.
+ *
+ * Bus can be the mbed I2C class or anything else with the same read()/write() methods.
+ * EndOfConversionPin can be a DigitalIn connected to the EOC pin of the sensor.
+ */
+template <typename Bus, typename EndOfConversionPin = MprlsNoEndOfConversionPin>
+class MprlsAcquisition
+{
+public:
+    /**
+     * @brief Acquisition that polls the busy bit of the status byte
+     * @param sensorBus the I2C bus the sensor is on
+     * @param sensorAddress the 8-bit address of the sensor, (0x18 << 1) for the MPRLS
+     */
+    MprlsAcquisition(Bus &sensorBus, int sensorAddress)
+        : bus(sensorBus), endOfConversionPin(0), address(sensorAddress), samplePeriod(0), profiler(0)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Acquisition that waits for the EOC pin of the sensor instead of reading the status byte
+     */
+    MprlsAcquisition(Bus &sensorBus, int sensorAddress, EndOfConversionPin &endOfConversion)
+        : bus(sensorBus), endOfConversionPin(&endOfConversion), address(sensorAddress), samplePeriod(0), profiler(0)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Clear the counters and go back to idle. The next poll() starts a new conversion, and the
+     * grid of the sample period (which is kept) from there.
+     */
+    void reset()
+    {
+        isConverting = false;
+        conversionStartMicroseconds = 0;
+        nextConversionMicroseconds = 0;
+        hasConversionGrid = false;
+        statistics.conversionsStarted = 0;
+        statistics.samplesRead = 0;
+        statistics.busyPolls = 0;
+        statistics.busErrors = 0;
+        statistics.transfers = 0;
+        statistics.bytesTransferred = 0;
+        statistics.missedPeriods = 0;
+    }
+
+    /**
+     * @brief Start a conversion every periodMicroseconds instead of as soon as the previous one was read
+     * (0, the default). A period shorter than the conversion and the read can take is missed every time.
+     */
+    void setSamplePeriod(uint32_t periodMicroseconds) { samplePeriod = periodMicroseconds; }
+
+    uint32_t getSamplePeriod() const { return samplePeriod; }
+
+    /**
+     * @brief Move the acquisition forward without blocking
+     * @param nowMicroseconds the current time
+     * @param sample filled in when a new conversion is available
+     * @return true if sample holds a new conversion
+     */
+    bool poll(uint64_t nowMicroseconds, MprlsSample &sample)
+    {
+        if(!isConverting)
+        {
+            if(samplePeriod == 0 || !hasConversionGrid || nowMicroseconds >= nextConversionMicroseconds)
+                startConversion(nowMicroseconds);
+            return false;
+        }
+
+        //There is no point in asking before the conversion time has passed
+        if(nowMicroseconds - conversionStartMicroseconds < MPRLS_CONVERSION_TIME_US)
+            return false;
+
+        if(endOfConversionPin != 0 && !endOfConversionPin->read())
+            return false;
+
+        //The status byte and the 24-bit output in one read; the output is only used if the busy bit is clear
+        char sensorReading[4] = {0};
+        HOT_PATH_BEGIN(readStartTicks);
+        if(!transfer(bus.read(address, sensorReading, 4), 4))
+        {
+            isConverting = false;
+            return false;
+        }
+        if((uint8_t)sensorReading[0] & MPRLS_STATUS_BUSY)
+        {
+            HOT_PATH_END(profiler, HOT_PATH_STATUS_POLL, readStartTicks);
+            statistics.busyPolls++;
+            return false;
+        }
+        HOT_PATH_END(profiler, HOT_PATH_DATA_READ, readStartTicks);
+
+        sample.status = (uint8_t)sensorReading[0];
+        sample.counts = ((uint32_t)(uint8_t)sensorReading[1] << 16) |
+                        ((uint32_t)(uint8_t)sensorReading[2] << 8) |
+                        (uint32_t)(uint8_t)sensorReading[3];
+        sample.timeMicroseconds = nowMicroseconds;
+        statistics.samplesRead++;
+
+        //Start the next conversion straight away, or leave it to the next poll() on the grid
+        isConverting = false;
+        if(samplePeriod == 0 || nowMicroseconds >= nextConversionMicroseconds)
+            startConversion(nowMicroseconds);
+        return true;
+    }
+
+    /**
+     * @brief The earliest time the next call to poll() can do anything useful: the end of the conversion
+     * time of the running conversion, the start of the next period, or 0 (right away)
+     */
+    uint64_t getNextPollMicroseconds() const
+    {
+        if(isConverting)
+            return conversionStartMicroseconds + MPRLS_CONVERSION_TIME_US;
+        return samplePeriod > 0 && hasConversionGrid ? nextConversionMicroseconds : 0;
+    }
+
+    /**
+     * @brief The counters kept since the last reset
+     */
+    const MprlsAcquisitionStatistics &getStatistics() const { return statistics; }
+
+    /**
+     * @brief Time the bus transfers into a profiler (0 to stop). Only has an effect when built with
+     * HOT_PATH_PROFILING.
+     */
+    void setProfiler(HotPathProfiler *hotPathProfiler) { profiler = hotPathProfiler; }
+
+private:
+    //Write the commands 0xAA, 0x00 and 0x00 at the sensor address
+    void startConversion(uint64_t nowMicroseconds)
+    {
+        static const char conversionCommand[] = { (char)0xAA, 0x00, 0x00 };
+        HOT_PATH_BEGIN(writeStartTicks);
+        isConverting = transfer(bus.write(address, conversionCommand, 3), 3);
+        HOT_PATH_END(profiler, HOT_PATH_I2C_WRITE, writeStartTicks);
+        if(isConverting)
+        {
+            conversionStartMicroseconds = nowMicroseconds;
+            statistics.conversionsStarted++;
+        }
+        if(samplePeriod == 0)
+            return;
+
+        //The grid is counted from the first conversion; a start that came too late for its period gives
+        //up the periods that already passed instead of pushing every later one back
+        if(!hasConversionGrid)
+        {
+            nextConversionMicroseconds = nowMicroseconds;
+            hasConversionGrid = true;
+        }
+        nextConversionMicroseconds += samplePeriod;
+        while(nextConversionMicroseconds <= nowMicroseconds)
+        {
+            nextConversionMicroseconds += samplePeriod;
+            statistics.missedPeriods++;
+        }
+    }
+
+    //Counts one transfer, returns true if it was acknowledged
+    bool transfer(int busResult, int length)
+    {
+        statistics.transfers++;
+        statistics.bytesTransferred += length + 1;
+        if(busResult != 0)
+        {
+            statistics.busErrors++;
+            return false;
+        }
+        return true;
+    }
+
+    //The bus the sensor is on
+    Bus &bus;
+    //The EOC pin, or 0 if the status byte is polled
+    EndOfConversionPin *endOfConversionPin;
+    //The 8-bit address of the sensor
+    int address;
+    //Whether a conversion has been started and not read yet
+    bool isConverting;
+    //Time the current conversion was started
+    uint64_t conversionStartMicroseconds;
+    //Time between conversion starts, 0 to start the next one as soon as a sample is read
+    uint32_t samplePeriod;
+    //When the next conversion is due on the grid of the sample period, valid once the first one started
+    uint64_t nextConversionMicroseconds;
+    bool hasConversionGrid;
+    //Counters
+    MprlsAcquisitionStatistics statistics;
+    //Where the transfer times go, 0 when they are not recorded
+    HotPathProfiler *profiler;
+};
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * @file MprlsTransferFunction.h
+ * @brief Compile-time description of the MPRLS sensor family and an FPU-free counts to pressure conversion
+ *
+ * The datasheet transfer function is
+ *     pressure = (counts - outputMinimum) * (pressureMaximum - pressureMinimum) / (outputMaximum - outputMinimum) + pressureMinimum
+ * where outputMinimum/outputMaximum are fixed percentages of 2^24 (the transfer function letter of the
+ * part number). Every one of those percentages is a whole number of fortieths of 2^24, so the whole
+ * formula is a ratio of integers and can be evaluated exactly with 64-bit integer arithmetic.
+ */
+
+#ifndef MPRLS_TRANSFER_FUNCTION_H
+#define MPRLS_TRANSFER_FUNCTION_H
+
+#include <stdint.h>
+
+//Fixed point results have 16 fractional bits
+#define MPRLS_PRESSURE_FRACTION_BITS 16
+
+/**
+ * Transfer function A: output from 10% to 90% of 2^24 counts
+ */
+struct MprlsTransferFunctionA
+{
+    static const int64_t outputMinimumFortieths = 4;
+    static const int64_t outputMaximumFortieths = 36;
+};
+
+/**
+ * Transfer function B: output from 2.5% to 22.5% of 2^24 counts (419430.4 to 3774873.6)
+ */
+struct MprlsTransferFunctionB
+{
+    static const int64_t outputMinimumFortieths = 1;
+    static const int64_t outputMaximumFortieths = 9;
+};
+
+/**
+ * Transfer function C: output from 20% to 80% of 2^24 counts
+ */
+struct MprlsTransferFunctionC
+{
+    static const int64_t outputMinimumFortieths = 8;
+    static const int64_t outputMaximumFortieths = 32;
+};
+
+/**
+ * The pressure units of the family, with the ratio that turns one unit into mmHg.
+ * The ratios are chosen so every product stays below 2^63 for the ranges below.
+ */
+struct MprlsUnitPsi
+{
+    static const int64_t millimetresOfMercuryNumerator = 5171493;
+    static const int64_t millimetresOfMercuryDenominator = 100000;
+};
+struct MprlsUnitKilopascal
+{
+    static const int64_t millimetresOfMercuryNumerator = 7500617;
+    static const int64_t millimetresOfMercuryDenominator = 1000000;
+};
+struct MprlsUnitMillibar
+{
+    static const int64_t millimetresOfMercuryNumerator = 7500617;
+    static const int64_t millimetresOfMercuryDenominator = 10000000;
+};
+struct MprlsUnitMillimetreOfMercury
+{
+    static const int64_t millimetresOfMercuryNumerator = 1;
+    static const int64_t millimetresOfMercuryDenominator = 1;
+};
+
+/**
+ * @brief One member of the MPRLS family: pressure range in its own unit and the transfer function
+ */
+template <int32_t PressureMinimum, int32_t PressureMaximum, typename Unit, typename TransferFunction>
+struct MprlsVariant
+{
+    static const int32_t pressureMinimum = PressureMinimum;
+    static const int32_t pressureMaximum = PressureMaximum;
+    typedef Unit PressureUnit;
+    typedef TransferFunction Transfer;
+};
+
+//The sensor used in this project: 0 to 300 mmHg gauge, outputs 419430.4 to 3774873.6 counts
+typedef MprlsVariant<0, 300, MprlsUnitMillimetreOfMercury, MprlsTransferFunctionB> Mprls0300YG;
+//Other members of the family, ordered with transfer function A (use MprlsVariant directly for B or C)
+typedef MprlsVariant<0, 1, MprlsUnitPsi, MprlsTransferFunctionA> Mprls0001PG;
+typedef MprlsVariant<0, 15, MprlsUnitPsi, MprlsTransferFunctionA> Mprls0015PA;
+typedef MprlsVariant<0, 25, MprlsUnitPsi, MprlsTransferFunctionA> Mprls0025PA;
+typedef MprlsVariant<0, 30, MprlsUnitPsi, MprlsTransferFunctionA> Mprls0030PG;
+typedef MprlsVariant<0, 60, MprlsUnitKilopascal, MprlsTransferFunctionA> Mprls0060KG;
+typedef MprlsVariant<0, 100, MprlsUnitKilopascal, MprlsTransferFunctionA> Mprls0100KA;
+typedef MprlsVariant<0, 160, MprlsUnitMillibar, MprlsTransferFunctionA> Mprls0160MG;
+typedef MprlsVariant<0, 250, MprlsUnitMillibar, MprlsTransferFunctionA> Mprls0250MG;
+typedef MprlsVariant<0, 600, MprlsUnitMillibar, MprlsTransferFunctionA> Mprls0600MG;
+
+/**
+ * @brief Integer division rounded to the nearest value, halves away from zero
+ */
+inline int64_t mprlsRoundedDivide(int64_t numerator, int64_t denominator)
+{
+    return numerator >= 0 ? (numerator + denominator / 2) / denominator
+                          : -((-numerator + denominator / 2) / denominator);
+}
+
+/**
+ * @brief Turns 24-bit counts into pressure without floating point.
+ *
+ * With x = 40 * counts - outputMinimumFortieths * 2^24 the datasheet formula becomes
+ *     pressure * 2^16 = x * range / ((outputMaximumFortieths - outputMinimumFortieths) * 2^8) + pressureMinimum * 2^16
+ * The divisor is a compile-time constant (a power of two for transfer functions A and B), and the
+ * result is the exactly rounded value of the datasheet formula.
+ */
+template <typename Variant>
+class MprlsCountsConverter
+{
+public:
+    /**
+     * @brief Pressure in the unit of the part, in Q16.16
+     */
+    static int32_t toPressureQ16(uint32_t counts)
+    {
+        const int64_t range = (int64_t)Variant::pressureMaximum - Variant::pressureMinimum;
+        return (int32_t)(mprlsRoundedDivide(scaledOffset(counts) * range, spanDivisor()) +
+                         ((int64_t)Variant::pressureMinimum << MPRLS_PRESSURE_FRACTION_BITS));
+    }
+
+    /**
+     * @brief Pressure in mmHg, in Q16.16. Exact for mmHg parts; other units go through the ratio of the unit.
+     */
+    static int32_t toMillimetresOfMercuryQ16(uint32_t counts)
+    {
+        typedef typename Variant::PressureUnit Unit;
+        const int64_t range = (int64_t)Variant::pressureMaximum - Variant::pressureMinimum;
+        const int64_t offset = ((int64_t)Variant::pressureMinimum << MPRLS_PRESSURE_FRACTION_BITS) * Unit::millimetresOfMercuryNumerator;
+        return (int32_t)mprlsRoundedDivide(scaledOffset(counts) * range * Unit::millimetresOfMercuryNumerator + offset * spanDivisor(),
+                                           spanDivisor() * Unit::millimetresOfMercuryDenominator);
+    }
+
+    /**
+     * @brief Pressure in mmHg as a float, for the analysis code
+     */
+    static float toMillimetresOfMercury(uint32_t counts)
+    {
+        return toMillimetresOfMercuryQ16(counts) * (1.0f / (1 << MPRLS_PRESSURE_FRACTION_BITS));
+    }
+
+private:
+    typedef typename Variant::Transfer Transfer;
+
+    //40 * counts - outputMinimum * 40
+    static int64_t scaledOffset(uint32_t counts)
+    {
+        return 40 * (int64_t)counts - (Transfer::outputMinimumFortieths << 24);
+    }
+
+    //(outputMaximum - outputMinimum) * 40 / 2^16
+    static int64_t spanDivisor()
+    {
+        return (Transfer::outputMaximumFortieths - Transfer::outputMinimumFortieths) << (24 - MPRLS_PRESSURE_FRACTION_BITS);
+    }
+};
+
+#endif
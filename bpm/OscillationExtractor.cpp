@@ -0,0 +1,54 @@
+/**
+ * @file OscillationExtractor.cpp
+ * @brief Splits the cuff pressure into the deflation ramp and the oscillometric pulses, and tracks the
+ * envelope of the pulses, one block of samples at a time
+ */
+
+#include "OscillationExtractor.h"
+
+OscillationExtractor::OscillationExtractor(float sampleRateHz)
+{
+    configure(sampleRateHz);
+}
+
+void OscillationExtractor::configure(float sampleRateHz)
+{
+    oscillationFilter.setStage(0, BiquadCoefficients::highPass(sampleRateHz, OSCILLATION_HIGH_PASS_HZ, BUTTERWORTH_2_Q));
+    oscillationFilter.setStage(1, BiquadCoefficients::lowPass(sampleRateHz, OSCILLATION_LOW_PASS_HZ, BUTTERWORTH_2_Q));
+    BiquadCoefficients envelopeSection1 = BiquadCoefficients::lowPass(sampleRateHz, OSCILLATION_ENVELOPE_CUTOFF_HZ, BUTTERWORTH_4_Q1);
+    BiquadCoefficients envelopeSection2 = BiquadCoefficients::lowPass(sampleRateHz, OSCILLATION_ENVELOPE_CUTOFF_HZ, BUTTERWORTH_4_Q2);
+    envelopeFilter.setStage(0, envelopeSection1);
+    envelopeFilter.setStage(1, envelopeSection2);
+    cuffPressureFilter.setStage(0, envelopeSection1);
+    cuffPressureFilter.setStage(1, envelopeSection2);
+    reset();
+}
+
+void OscillationExtractor::reset()
+{
+    oscillationFilter.reset();
+    envelopeFilter.reset();
+    cuffPressureFilter.reset();
+    isSettled = false;
+}
+
+void OscillationExtractor::processBlock(OscillationBlock &block)
+{
+    const int count = block.sampleCount;
+    if(count <= 0)
+        return;
+
+    //Start as if the cuff had always been at the first pressure, instead of stepping up from 0
+    if(!isSettled)
+    {
+        oscillationFilter.settle(block.pressureValues[0]);
+        cuffPressureFilter.settle(block.pressureValues[0]);
+        isSettled = true;
+    }
+
+    oscillationFilter.processBlock(block.pressureValues, block.oscillationValues, count);
+    cuffPressureFilter.processBlock(block.pressureValues, block.cuffPressureValues, count);
+    for(int i = 0; i < count; i++)
+        block.envelopeValues[i] = fabsf(block.oscillationValues[i]);
+    envelopeFilter.processBlock(block.envelopeValues, block.envelopeValues, count);
+}
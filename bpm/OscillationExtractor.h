@@ -0,0 +1,89 @@
+/**
+ * @file OscillationExtractor.h
+ * @brief Splits the cuff pressure into the deflation ramp and the oscillometric pulses, and tracks the
+ * envelope of the pulses, one block of samples at a time
+ */
+
+#ifndef OSCILLATION_EXTRACTOR_H
+#define OSCILLATION_EXTRACTOR_H
+
+#include "BiquadFilter.h"
+
+//Most samples handled in one call to processBlock()
+#ifndef OSCILLATION_BLOCK_SIZE
+#define OSCILLATION_BLOCK_SIZE 16
+#endif
+
+//Band of the oscillometric pulses: above the deflation ramp, below the sensor noise (30 to 220 bpm fit in)
+#ifndef OSCILLATION_HIGH_PASS_HZ
+#define OSCILLATION_HIGH_PASS_HZ 0.5f
+#endif
+#ifndef OSCILLATION_LOW_PASS_HZ
+#define OSCILLATION_LOW_PASS_HZ 10.0f
+#endif
+
+//Cutoff of the envelope and of the cuff pressure, well below the slowest heart rate of interest
+#ifndef OSCILLATION_ENVELOPE_CUTOFF_HZ
+#define OSCILLATION_ENVELOPE_CUTOFF_HZ 0.4f
+#endif
+
+/**
+ * @brief The input and the outputs of one block; only the first sampleCount entries are used
+ */
+struct OscillationBlock
+{
+    //Number of samples in the block, up to OSCILLATION_BLOCK_SIZE
+    int sampleCount;
+    //Cuff pressure in mmHg, the input
+    float pressureValues[OSCILLATION_BLOCK_SIZE];
+    //The deflation ramp: the cuff pressure without the pulses, delayed like the envelope
+    float cuffPressureValues[OSCILLATION_BLOCK_SIZE];
+    //The oscillometric pulses in mmHg, around 0
+    float oscillationValues[OSCILLATION_BLOCK_SIZE];
+    //The mean rectified pulse amplitude in mmHg
+    float envelopeValues[OSCILLATION_BLOCK_SIZE];
+};
+
+/**
+ * @brief Three biquad cascades run over every block:
+ *     - a 2nd order high pass and a 2nd order low pass give the oscillation. The high pass has two zeros
+ *       at DC, so the linear deflation ramp is removed completely, not just reduced.
+ *     - a 4th order low pass of the rectified oscillation gives the envelope
+ *     - the same 4th order low pass of the input gives the cuff pressure, with the same delay as the
+ *       envelope, so an envelope value and the cuff pressure next to it belong together
+ * The beats are found in the oscillation by BeatDetector.
+ *
+ * The coefficients are calculated once for the sample rate. All the state is in the object; one
+ * extractor follows one sensor.
+ */
+class OscillationExtractor
+{
+public:
+    /**
+     * @param sampleRateHz the rate the samples arrive at
+     */
+    explicit OscillationExtractor(float sampleRateHz);
+
+    //Calculates the coefficients for another sample rate and forgets the state
+    void configure(float sampleRateHz);
+
+    //Forgets the state; the next block settles the filters on its first sample
+    void reset();
+
+    /**
+     * @brief Filters block.pressureValues and fills in the other arrays of the block
+     */
+    void processBlock(OscillationBlock &block);
+
+private:
+    //The band pass giving the oscillation
+    BiquadCascade<2> oscillationFilter;
+    //The low pass giving the envelope from the rectified oscillation
+    BiquadCascade<2> envelopeFilter;
+    //The same low pass giving the cuff pressure
+    BiquadCascade<2> cuffPressureFilter;
+    //Whether the filters were settled on the first sample yet
+    bool isSettled;
+};
+
+#endif
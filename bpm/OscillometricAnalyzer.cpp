@@ -0,0 +1,360 @@
+/**
+ * @file OscillometricAnalyzer.cpp
+ * @brief Streaming, constant-memory version of the slope based systolic/diastolic search
+ */
+
+#include "OscillometricAnalyzer.h"
+#include <stdint.h>
+
+//The smallest difference in slope readings is initialised with a very large value, as before
+static const float initialMinimumDifference = (float)INT32_MAX;
+
+OscillometricAnalyzer::OscillometricAnalyzer()
+{
+    reset();
+}
+
+void OscillometricAnalyzer::reset()
+{
+    totalSamples = 0;
+    totalSlopes = 0;
+    positiveSlopes = 0;
+    isEnvelopeInput = false;
+    isBelowEarlyStopLevel = false;
+    earlyStopLevelTime = 0.0f;
+    firstPressure = 0.0f;
+    firstTime = 0.0f;
+    previousPressure = 0.0f;
+    previousTime = 0.0f;
+
+    maxSlope = 0.0f;
+    maxSlopeCandidate.isValid = false;
+    systolicThreshold = 0.0f;
+    diastolicThreshold = 0.0f;
+
+    systolicCandidate.isValid = false;
+    trailingSystolicCandidate.isValid = false;
+    pendingCount = 0;
+    smallestDroppedSlope = 0.0f;
+    hasDroppedSlope = false;
+
+    diastolicCandidate.isValid = false;
+    diastolicMinDifference = initialMinimumDifference;
+}
+
+void OscillometricAnalyzer::addSample(float timeValue, float pressureValue)
+{
+    if(totalSamples == 0)
+    {
+        firstPressure = pressureValue;
+        firstTime = timeValue;
+    }
+    else
+    {
+        //The consecutive pressure and time differences
+        float consecutivePressureDifference = pressureValue - previousPressure;
+        float consecutiveTimeDifference = timeValue - previousTime;
+
+        //A zero time difference leaves the slope at the value the zero-initialised slope table had
+        //(1.0 for the very first slope, 0.0 for every other one)
+        float slopeValue = (totalSlopes == 0) ? 1.0f : 0.0f;
+        if(consecutiveTimeDifference != 0.000000)
+            slopeValue = consecutivePressureDifference / consecutiveTimeDifference;
+
+        addSlope(slopeValue, pressureValue, timeValue, slopeValue > 0.0);
+    }
+
+    previousPressure = pressureValue;
+    previousTime = timeValue;
+    totalSamples++;
+}
+
+void OscillometricAnalyzer::addEnvelopeSample(float timeValue, float cuffPressure, float envelopeValue, int beatCount)
+{
+    if(totalSamples == 0)
+    {
+        firstPressure = cuffPressure;
+        firstTime = timeValue;
+        isEnvelopeInput = true;
+    }
+    addSlope(envelopeValue, cuffPressure, timeValue, beatCount);
+
+    //The time since the envelope fell to the early stop level, once the diastolic point is behind it
+    if(diastolicCandidate.isValid && envelopeValue < OSCILLOMETRIC_EARLY_STOP_FRACTION * maxSlope)
+    {
+        if(!isBelowEarlyStopLevel)
+            earlyStopLevelTime = timeValue;
+        isBelowEarlyStopLevel = true;
+    }
+    else
+    {
+        isBelowEarlyStopLevel = false;
+    }
+
+    previousTime = timeValue;
+    totalSamples++;
+}
+
+bool OscillometricAnalyzer::isDiastolicSettled() const
+{
+    return isEnvelopeInput && isBelowEarlyStopLevel && previousTime - earlyStopLevelTime >= OSCILLOMETRIC_EARLY_STOP_MS;
+}
+
+void OscillometricAnalyzer::addSlope(float slopeValue, float pressureValue, float timeValue, int positiveCount)
+{
+    SlopeCandidate candidate;
+    candidate.slope = slopeValue;
+    candidate.sampleIndex = totalSlopes + 1;
+    candidate.pressure = pressureValue;
+    candidate.time = timeValue;
+    candidate.positiveSlopesBefore = positiveSlopes;
+    positiveSlopes += positiveCount;
+    candidate.positiveSlopesThrough = positiveSlopes;
+    candidate.isValid = true;
+
+    if(slopeValue > maxSlope)
+    {
+        //Every slope seen so far now lies before the maximum and belongs to the systolic search
+        keepBetterSystolicCandidate(systolicCandidate, trailingSystolicCandidate);
+        trailingSystolicCandidate.isValid = false;
+
+        maxSlope = slopeValue;
+        maxSlopeCandidate = candidate;
+        systolicThreshold = 0.5 * maxSlope;
+        diastolicThreshold = 0.8 * maxSlope;
+        collapsePendingCandidates();
+
+        //The diastolic search restarts after the new maximum
+        diastolicCandidate.isValid = false;
+        diastolicMinDifference = initialMinimumDifference;
+
+        addPendingCandidate(candidate);
+    }
+    else
+    {
+        //Slopes after the maximum only matter for the systolic search if the maximum moves later on
+        if(slopeValue >= 0.0)
+        {
+            if(slopeValue < systolicThreshold)
+                keepBetterSystolicCandidate(trailingSystolicCandidate, candidate);
+            else
+                addPendingCandidate(candidate);
+        }
+
+        //The diastolic search starts one slope after the maximum slope
+        int maxSlopeIndex = maxSlopeCandidate.isValid ? maxSlopeCandidate.sampleIndex : 0;
+        if(totalSlopes >= maxSlopeIndex + 1)
+            considerDiastolicCandidate(diastolicCandidate, diastolicMinDifference, diastolicThreshold, candidate);
+    }
+
+    totalSlopes++;
+}
+
+void OscillometricAnalyzer::collapsePendingCandidates()
+{
+    //The smallest slopes are the ones below the new threshold, and they never come back above it
+    while(pendingCount > 0 && pendingCandidates[pendingMinHeap[0]].slope < systolicThreshold)
+    {
+        keepBetterSystolicCandidate(systolicCandidate, pendingCandidates[pendingMinHeap[0]]);
+        removePendingCandidate(pendingMinHeap[0]);
+    }
+}
+
+void OscillometricAnalyzer::keepBetterSystolicCandidate(SlopeCandidate &best, const SlopeCandidate &other)
+{
+    if(!other.isValid)
+        return;
+
+    //Below the threshold the largest slope has the smallest difference; the earlier slope wins a tie
+    if(!best.isValid || other.slope > best.slope ||
+       (other.slope == best.slope && other.sampleIndex < best.sampleIndex))
+        best = other;
+}
+
+void OscillometricAnalyzer::addPendingCandidate(const SlopeCandidate &candidate)
+{
+    if(pendingCount == OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY)
+    {
+        //The set is full: drop the largest slope, it is the last one that could fall below the threshold
+        float largestSlope = pendingCandidates[pendingMaxHeap[0]].slope;
+        //An earlier candidate with the same slope always wins, so the new one can go without loss
+        if(largestSlope == candidate.slope)
+            return;
+        float droppedSlope = largestSlope > candidate.slope ? largestSlope : candidate.slope;
+        if(!hasDroppedSlope || droppedSlope < smallestDroppedSlope)
+            smallestDroppedSlope = droppedSlope;
+        hasDroppedSlope = true;
+        if(droppedSlope == candidate.slope)
+            return;
+        removePendingCandidate(pendingMaxHeap[0]);
+    }
+
+    int slot = pendingCount++;
+    pendingCandidates[slot] = candidate;
+    placePending(false, slot, slot);
+    placePending(true, slot, slot);
+    siftPendingUp(false, slot);
+    siftPendingUp(true, slot);
+}
+
+void OscillometricAnalyzer::removePendingCandidate(int slot)
+{
+    //The last heap position and the last slot, the same number since both heaps hold every used slot
+    const int last = pendingCount - 1;
+
+    //In both heaps the last entry takes the place of the slot and is sifted from there
+    for(int heap = 0; heap < 2; heap++)
+    {
+        bool isMaxHeap = heap == 1;
+        const uint16_t *heapSlots = isMaxHeap ? pendingMaxHeap : pendingMinHeap;
+        const uint16_t *positions = isMaxHeap ? pendingMaxPosition : pendingMinPosition;
+        int position = positions[slot];
+        if(position == last)
+            continue;
+        int movedSlot = heapSlots[last];
+        placePending(isMaxHeap, position, movedSlot);
+        siftPendingDown(isMaxHeap, position, last);
+        siftPendingUp(isMaxHeap, positions[movedSlot]);
+    }
+
+    //The last slot moves into the freed one, so the used slots stay at the front
+    if(slot != last)
+    {
+        pendingCandidates[slot] = pendingCandidates[last];
+        placePending(false, pendingMinPosition[last], slot);
+        placePending(true, pendingMaxPosition[last], slot);
+    }
+    pendingCount--;
+}
+
+bool OscillometricAnalyzer::isPendingAbove(bool isMaxHeap, int a, int b) const
+{
+    //The later of two equal slopes sits above in the max-heap, it is the one that can go without loss
+    const SlopeCandidate &first = pendingCandidates[a];
+    const SlopeCandidate &second = pendingCandidates[b];
+    if(isMaxHeap)
+        return first.slope > second.slope || (first.slope == second.slope && first.sampleIndex > second.sampleIndex);
+    return first.slope < second.slope;
+}
+
+void OscillometricAnalyzer::placePending(bool isMaxHeap, int position, int slot)
+{
+    (isMaxHeap ? pendingMaxHeap : pendingMinHeap)[position] = (uint16_t)slot;
+    (isMaxHeap ? pendingMaxPosition : pendingMinPosition)[slot] = (uint16_t)position;
+}
+
+void OscillometricAnalyzer::siftPendingUp(bool isMaxHeap, int position)
+{
+    const uint16_t *heapSlots = isMaxHeap ? pendingMaxHeap : pendingMinHeap;
+    int slot = heapSlots[position];
+    while(position > 0)
+    {
+        int parent = (position - 1) / 2;
+        if(!isPendingAbove(isMaxHeap, slot, heapSlots[parent]))
+            break;
+        placePending(isMaxHeap, position, heapSlots[parent]);
+        position = parent;
+    }
+    placePending(isMaxHeap, position, slot);
+}
+
+void OscillometricAnalyzer::siftPendingDown(bool isMaxHeap, int position, int heapCount)
+{
+    const uint16_t *heapSlots = isMaxHeap ? pendingMaxHeap : pendingMinHeap;
+    int slot = heapSlots[position];
+    for(;;)
+    {
+        int child = 2 * position + 1;
+        if(child >= heapCount)
+            break;
+        if(child + 1 < heapCount && isPendingAbove(isMaxHeap, heapSlots[child + 1], heapSlots[child]))
+            child++;
+        if(!isPendingAbove(isMaxHeap, heapSlots[child], slot))
+            break;
+        placePending(isMaxHeap, position, heapSlots[child]);
+        position = child;
+    }
+    placePending(isMaxHeap, position, slot);
+}
+
+void OscillometricAnalyzer::considerDiastolicCandidate(SlopeCandidate &best, float &minDifference, float threshold,
+                                                       const SlopeCandidate &candidate)
+{
+    //check first if slope is positive && is the slope less than our diastolic threshold value
+    if((candidate.slope >= 0.0) && (candidate.slope < threshold))
+    {
+        float difference = threshold - candidate.slope;
+        if(difference < minDifference)
+        {
+            minDifference = difference;
+            best = candidate;
+        }
+    }
+}
+
+BloodPressureResult OscillometricAnalyzer::finish() const
+{
+    BloodPressureResult result;
+    result.sampleCount = totalSamples;
+
+    float finalMaxSlope = maxSlope;
+    SlopeCandidate finalMaxCandidate = maxSlopeCandidate;
+    SlopeCandidate finalDiastolicCandidate = diastolicCandidate;
+    float finalDiastolicMinDifference = diastolicMinDifference;
+
+    //The batch code also visits the last, never written slope entry; its sample lies past the end of
+    //the recording and reads as 0. An envelope has no such entry.
+    if(totalSamples > 0 && !isEnvelopeInput)
+    {
+        SlopeCandidate unsetSlope;
+        unsetSlope.slope = (totalSlopes == 0) ? 1.0f : 0.0f;
+        unsetSlope.sampleIndex = totalSlopes + 1;
+        unsetSlope.pressure = 0.0f;
+        unsetSlope.time = 0.0f;
+        unsetSlope.positiveSlopesBefore = positiveSlopes;
+        unsetSlope.positiveSlopesThrough = positiveSlopes;
+        unsetSlope.isValid = true;
+
+        if(unsetSlope.slope > finalMaxSlope)
+        {
+            //Only possible with a single sample: nothing lies before or after this maximum
+            finalMaxSlope = unsetSlope.slope;
+            finalMaxCandidate = unsetSlope;
+            finalDiastolicCandidate.isValid = false;
+        }
+        else
+        {
+            int maxSlopeIndex = finalMaxCandidate.isValid ? finalMaxCandidate.sampleIndex : 0;
+            if(totalSlopes >= maxSlopeIndex + 1)
+                considerDiastolicCandidate(finalDiastolicCandidate, finalDiastolicMinDifference,
+                                           diastolicThreshold, unsetSlope);
+        }
+    }
+
+    result.maxSlope = finalMaxSlope;
+    result.maxSlopeIndex = finalMaxCandidate.isValid ? finalMaxCandidate.sampleIndex : 0;
+    result.meanArterialPressureSlope = finalMaxCandidate.isValid ? finalMaxCandidate.pressure : firstPressure;
+
+    result.systolicIndex = systolicCandidate.isValid ? systolicCandidate.sampleIndex : 0;
+    result.systolicPressure = systolicCandidate.isValid ? systolicCandidate.pressure : firstPressure;
+    result.systolicTime = systolicCandidate.isValid ? systolicCandidate.time : firstTime;
+
+    result.diastolicIndex = finalDiastolicCandidate.isValid ? finalDiastolicCandidate.sampleIndex : 0;
+    result.diastolicPressure = finalDiastolicCandidate.isValid ? finalDiastolicCandidate.pressure : firstPressure;
+    result.diastolicTime = finalDiastolicCandidate.isValid ? finalDiastolicCandidate.time : firstTime;
+
+    //Positive slopes from the systolic slope up to and including the diastolic slope
+    result.positiveSlopeCount = 0;
+    if(finalDiastolicCandidate.isValid && result.diastolicIndex >= result.systolicIndex)
+    {
+        result.positiveSlopeCount = finalDiastolicCandidate.positiveSlopesThrough;
+        if(systolicCandidate.isValid)
+            result.positiveSlopeCount -= systolicCandidate.positiveSlopesBefore;
+    }
+
+    //A dropped slope only matters if it ended up below the final systolic threshold
+    result.isExact = !(hasDroppedSlope && smallestDroppedSlope < systolicThreshold);
+
+    completeBloodPressureResult(result);
+    return result;
+}
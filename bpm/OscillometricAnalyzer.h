@@ -0,0 +1,190 @@
+/**
+ * @file OscillometricAnalyzer.h
+ * @brief Streaming, constant-memory version of the slope based systolic/diastolic search
+ */
+
+#ifndef OSCILLOMETRIC_ANALYZER_H
+#define OSCILLOMETRIC_ANALYZER_H
+
+#include <stdint.h>
+#include "BloodPressureResult.h"
+
+/**
+ * Number of systolic candidates that are kept while their slope is still above half of the running
+ * maximum slope. Only these candidates can become the systolic point later, so this bounds the memory
+ * of the analyzer no matter how long the deflation runs: 36 bytes per candidate, 2.3 KB by default.
+ */
+#ifndef OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY
+#define OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY 64
+#endif
+
+//An envelope search is settled once the envelope stayed below this fraction of its peak for
+//OSCILLOMETRIC_EARLY_STOP_MS after the diastolic point was found
+#ifndef OSCILLOMETRIC_EARLY_STOP_FRACTION
+#define OSCILLOMETRIC_EARLY_STOP_FRACTION 0.5f
+#endif
+#ifndef OSCILLOMETRIC_EARLY_STOP_MS
+#define OSCILLOMETRIC_EARLY_STOP_MS 2000.0f
+#endif
+
+/**
+ * @brief Takes one (time, pressure) sample at a time and keeps only what the final search needs:
+ * the previous sample, the running maximum slope, the best diastolic candidate after that maximum,
+ * the best systolic candidate below half of the maximum and a bounded set of slopes that may still
+ * become the systolic candidate if the maximum grows.
+ *
+ * Whenever BloodPressureResult::isExact is set the results are identical to the array based
+ * evaluateSystolicPressure()/evaluateDiastolicPressure() including their quirks (the zero-initialised
+ * slope table, the trailing unset slope and the "first smallest difference wins" rule), which is always
+ * the case for sessions of up to OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY + 1 samples. Longer sessions
+ * can fill the candidate set; the largest slope is then dropped, and isExact is cleared if that slope
+ * ends up below the final systolic threshold, where it could have been the systolic point.
+ *
+ * The candidates sit in slots indexed by a min-heap, whose root is the next to fall below a rising
+ * threshold, and a max-heap, whose root is the one dropped when the set is full. Every slot knows its
+ * place in both, so adding, dropping and collapsing a candidate are O(log capacity), and every candidate
+ * is collapsed at most once.
+ */
+class OscillometricAnalyzer
+{
+    static_assert(OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY >= 1 && OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY <= 65535,
+                  "OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY must be 1 to 65535");
+
+public:
+    OscillometricAnalyzer();
+
+    /**
+     * @brief Forget everything and get ready for a new deflation
+     */
+    void reset();
+
+    /**
+     * @brief Add the next sample of the deflation
+     * @param timeValue timestamp of the sample (the same units as the old timerDataArray)
+     * @param pressureValue cuff pressure in mmHg
+     */
+    void addSample(float timeValue, float pressureValue);
+
+    /**
+     * @brief Add the next point of the oscillation envelope instead of a raw sample (see OscillationExtractor).
+     * The envelope values take the place of the slopes, so the same search finds the point before the
+     * maximum closest below 0.5 of the peak amplitude (systolic) and the point after it closest below 0.8 of
+     * it (diastolic). Beats take the place of the positive slopes in the heart rate.
+     * Do not mix with addSample() between two resets.
+     * @param timeValue timestamp of the point
+     * @param cuffPressure the cuff pressure without the pulses, in mmHg
+     * @param envelopeValue the pulse amplitude
+     * @param beatCount beats that started since the previous point
+     */
+    void addEnvelopeSample(float timeValue, float cuffPressure, float envelopeValue, int beatCount);
+
+    /**
+     * @brief Whether the envelope search can stop: a diastolic point was found and the envelope has stayed
+     * below OSCILLOMETRIC_EARLY_STOP_FRACTION of its peak for OSCILLOMETRIC_EARLY_STOP_MS since. From then
+     * on, only an envelope that climbs back towards 0.8 of the peak could still move the result.
+     * Always false for raw samples, where any later slope can still become the diastolic one.
+     */
+    bool isDiastolicSettled() const;
+
+    /**
+     * @brief Number of samples added since the last reset
+     */
+    int sampleCount() const { return totalSamples; }
+
+    /**
+     * @brief Finish the search and return the estimate. The analyzer is left untouched so more
+     * samples may still be added afterwards.
+     */
+    BloodPressureResult finish() const;
+
+private:
+    //A slope together with the sample that closes it
+    struct SlopeCandidate
+    {
+        //Value of the slope
+        float slope;
+        //Index of the sample that closes the slope (slope index + 1)
+        int32_t sampleIndex;
+        //Pressure of that sample
+        float pressure;
+        //Time of that sample
+        float time;
+        //Number of positive slopes before this slope
+        int32_t positiveSlopesBefore;
+        //Number of positive slopes up to and including this slope
+        int32_t positiveSlopesThrough;
+        //Whether the candidate holds a value
+        bool isValid;
+    };
+
+    //Core of the search, fed with every slope in order; positiveCount is added to the positive slopes
+    void addSlope(float slopeValue, float pressureValue, float timeValue, int positiveCount);
+    //Moves candidates that fell below the new systolic threshold into the best systolic candidate
+    void collapsePendingCandidates();
+    //Keeps the better of two systolic candidates (the larger slope, the earlier one on a tie)
+    static void keepBetterSystolicCandidate(SlopeCandidate &best, const SlopeCandidate &other);
+    //Stores a slope that is still above the systolic threshold
+    void addPendingCandidate(const SlopeCandidate &candidate);
+    //Takes a candidate out of both heaps and moves the last slot into its place
+    void removePendingCandidate(int slot);
+    //The heaps of pending candidates: isMaxHeap selects the max-heap of slopes, otherwise the min-heap
+    bool isPendingAbove(bool isMaxHeap, int a, int b) const;
+    void placePending(bool isMaxHeap, int position, int slot);
+    void siftPendingUp(bool isMaxHeap, int position);
+    void siftPendingDown(bool isMaxHeap, int position, int heapCount);
+    //Updates the diastolic candidate with the given slope
+    static void considerDiastolicCandidate(SlopeCandidate &best, float &minDifference, float threshold,
+                                           const SlopeCandidate &candidate);
+
+    //Number of samples added
+    int totalSamples;
+    //Number of slopes calculated so far
+    int totalSlopes;
+    //Number of positive slopes calculated so far (beats for an envelope)
+    int32_t positiveSlopes;
+    //Whether the points came from addEnvelopeSample()
+    bool isEnvelopeInput;
+    //Whether the envelope is below the early stop level after the diastolic point, and since when
+    bool isBelowEarlyStopLevel;
+    float earlyStopLevelTime;
+    //The first sample, used when an index stays 0
+    float firstPressure;
+    float firstTime;
+    //The previous sample, used to calculate the next slope
+    float previousPressure;
+    float previousTime;
+
+    //The value of the maximum positive slope
+    float maxSlope;
+    //The candidate holding the maximum positive slope
+    SlopeCandidate maxSlopeCandidate;
+    //Half of maxSlope, the systolic threshold
+    float systolicThreshold;
+    //0.8 times maxSlope, the diastolic threshold
+    float diastolicThreshold;
+
+    //Best systolic candidate among the slopes before the maximum slope
+    SlopeCandidate systolicCandidate;
+    //Best systolic candidate among the slopes after the maximum slope, in case the maximum moves
+    SlopeCandidate trailingSystolicCandidate;
+    //Slopes that are above the systolic threshold and may qualify once the maximum grows, in slots
+    SlopeCandidate pendingCandidates[OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY];
+    //Number of slots used, the same in both heaps
+    int pendingCount;
+    //Slots by slope, smallest and largest at the root, and where every slot is in each heap
+    uint16_t pendingMinHeap[OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY];
+    uint16_t pendingMaxHeap[OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY];
+    uint16_t pendingMinPosition[OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY];
+    uint16_t pendingMaxPosition[OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY];
+    //The smallest slope that had to be dropped from pendingCandidates
+    float smallestDroppedSlope;
+    //Whether any slope was dropped
+    bool hasDroppedSlope;
+
+    //Best diastolic candidate after the maximum slope
+    SlopeCandidate diastolicCandidate;
+    //The smallest difference between the diastolic threshold and a slope so far
+    float diastolicMinDifference;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file OscillometricStages.cpp
+ * @brief The array based post-processing stages of the original firmware, without the printing
+ */
+
+#include "OscillometricStages.h"
+#include <stdint.h>
+
+void calculatePressureSlopes(const float *timeValues, const float *pressureValues, int sampleCount, float *pressureSlope)
+{
+    //The slope table started out as {1.0, 0.0, 0.0, ...}
+    for(int i = 0; i < sampleCount; i++)
+        pressureSlope[i] = 0.0f;
+    if(sampleCount > 0)
+        pressureSlope[0] = 1.0f;
+
+    for(int i = 1; i < sampleCount; i++)
+    {
+        //The consecutive pressure differences
+        float consecutivePressureDifference = pressureValues[i] - pressureValues[i-1];
+        //The consecutive time differences
+        float consecutiveTimeDifference = timeValues[i] - timeValues[i-1];
+        //Ensure that the time difference not zero, this prevents getting an infinite slope
+        if(consecutiveTimeDifference != 0.000000)
+            pressureSlope[i-1] = consecutivePressureDifference / consecutiveTimeDifference;
+    }
+}
+
+int findMaximumPositiveSlope(const float *pressureSlope, int sampleCount, float &maxSlope)
+{
+    int maxIndexPositiveSlope = 0;
+    maxSlope = 0;
+    for(int j = 0; j < sampleCount; j++)
+    {
+        //If the current slope in the array is greater than our current max positive slope
+        if(pressureSlope[j] > maxSlope)
+        {
+            maxSlope = pressureSlope[j];
+            //The higher pressure reading used to calculate the positive slope
+            maxIndexPositiveSlope = j + 1;
+        }
+    }
+    return maxIndexPositiveSlope;
+}
+
+int findSystolicPressureIndex(const float *pressureSlope, float maxSlope, int maxIndexPositiveSlope)
+{
+    //The Systolic pressure slope minimum threshold is calculated by multiplying the maximum slope by 0.5
+    float sysSlopeMinThreshold = 0.5 * maxSlope;
+    //The smallest difference in slope readings. We initialize it with a large value (INT32_MAX)
+    float minDiffInSlope = INT32_MAX;
+    int systolicPressureSlopeIndex = 0;
+
+    //Run through the slope array from the start till the slope of the MAP
+    for(int k = 0; k < maxIndexPositiveSlope - 1; k++)
+    {
+        //If slope is positive && if the slope is less than our systolic threshold value
+        if((pressureSlope[k] >= 0.0) && (pressureSlope[k] < sysSlopeMinThreshold))
+        {
+            float diffInSlope = sysSlopeMinThreshold - pressureSlope[k];
+            if(diffInSlope < minDiffInSlope)
+            {
+                minDiffInSlope = diffInSlope;
+                systolicPressureSlopeIndex = k + 1;
+            }
+        }
+    }
+    return systolicPressureSlopeIndex;
+}
+
+int findDiastolicPressureIndex(const float *pressureSlope, int sampleCount, float maxSlope, int maxIndexPositiveSlope)
+{
+    //Diastolic pressure slope minimum threshold is calculated by multiplying the maximum slope with 0.8
+    float diaSlopeMinThreshold = 0.8 * maxSlope;
+    //The smallest difference in slope readings. We initialize it with a very large value using int32_max
+    float minDiffInSlope_dia = INT32_MAX;
+    int diastolic_pressureSlopeIndex = 0;
+
+    //Loop through the slope array from the index post MAP till the last slope
+    for(int l = maxIndexPositiveSlope + 1; l < sampleCount; l++)
+    {
+        //check first if slope is positive && is the slope less than our diastolic threshold value
+        if((pressureSlope[l] >= 0.0) && (pressureSlope[l] < diaSlopeMinThreshold))
+        {
+            float diffInSlope_dia = diaSlopeMinThreshold - pressureSlope[l];
+            if(diffInSlope_dia < minDiffInSlope_dia)
+            {
+                minDiffInSlope_dia = diffInSlope_dia;
+                diastolic_pressureSlopeIndex = l + 1;
+            }
+        }
+    }
+    return diastolic_pressureSlopeIndex;
+}
+
+int countPositiveSlopes(const float *pressureSlope, int systolicIndex, int diastolicIndex)
+{
+    int heartRateCount = 0;
+    //Loop through the slopes between the systolic and diastolic samples (the slope before the first sample is never positive)
+    for(int m = systolicIndex - 1; m < diastolicIndex; m++)
+    {
+        if(m >= 0 && pressureSlope[m] > 0.0)
+            heartRateCount++;
+    }
+    return heartRateCount;
+}
+
+int calculateHeartRate(const float *timeValues, int sampleCount, int systolicIndex, int diastolicIndex, int positiveSlopeCount)
+{
+    float heartRateCount = positiveSlopeCount;
+    float diastolicTime = sampleValueAt(timeValues, sampleCount, diastolicIndex);
+    float systolicTime = sampleValueAt(timeValues, sampleCount, systolicIndex);
+    //calculate the heart rate by dividing by the time and then multiplying by 60
+    return (int)(((heartRateCount) / (diastolicTime/1000 - systolicTime/1000))* 60.0f);
+}
+
+float calculateMeanArterialPressureWeightedAverage(float systolicPressure, float diastolicPressure)
+{
+    //MAP = 1/3 Systolic Value + 2/3 Diastolic Value
+    return (0.33) * systolicPressure + (0.67) * diastolicPressure;
+}
+
+float calculateMeanArterialPressureSlope(const float *pressureValues, int sampleCount, int maxIndexPositiveSlope)
+{
+    //MAP is taken as the value when the slope is maximum
+    return sampleValueAt(pressureValues, sampleCount, maxIndexPositiveSlope);
+}
@@ -0,0 +1,66 @@
+/**
+ * @file OscillometricStages.h
+ * @brief The array based post-processing stages of the original firmware, without the printing
+ *
+ * These are the reference the streaming analyzer and the benchmarks are checked against. Every function
+ * works on whole sessions that are already in memory and keeps the exact behaviour of the code it came
+ * from, including the zero-initialised slope table and the sample one past the end reading as 0.
+ */
+
+#ifndef OSCILLOMETRIC_STAGES_H
+#define OSCILLOMETRIC_STAGES_H
+
+/**
+ * @brief The value at an index, or 0 past the end of the recording (as the zero-initialised global arrays gave)
+ */
+inline float sampleValueAt(const float *values, int sampleCount, int index)
+{
+    return (index >= 0 && index < sampleCount) ? values[index] : 0.0f;
+}
+
+/**
+ * @brief Slope between consecutive samples: pressureSlope[i-1] = (pressure[i] - pressure[i-1]) / (time[i] - time[i-1]).
+ * pressureSlope must hold sampleCount values; it is initialised like the old table (1.0 then 0.0) first,
+ * so slopes with a zero time difference keep that value.
+ */
+void calculatePressureSlopes(const float *timeValues, const float *pressureValues, int sampleCount, float *pressureSlope);
+
+/**
+ * @brief Finds the maximum positive slope
+ * @param maxSlope set to the maximum positive slope, 0 if there is none
+ * @return the index of the sample that closes the maximum slope (MaxIndexPositiveSlope), 0 if there is none
+ */
+int findMaximumPositiveSlope(const float *pressureSlope, int sampleCount, float &maxSlope);
+
+/**
+ * @brief Index of the systolic sample: the slope before the maximum that is closest below 0.5 * maxSlope
+ */
+int findSystolicPressureIndex(const float *pressureSlope, float maxSlope, int maxIndexPositiveSlope);
+
+/**
+ * @brief Index of the diastolic sample: the slope after the maximum that is closest below 0.8 * maxSlope
+ */
+int findDiastolicPressureIndex(const float *pressureSlope, int sampleCount, float maxSlope, int maxIndexPositiveSlope);
+
+/**
+ * @brief Number of positive slopes from the systolic slope up to the diastolic slope
+ */
+int countPositiveSlopes(const float *pressureSlope, int systolicIndex, int diastolicIndex);
+
+/**
+ * @brief Heart rate in beats per minute from the positive slope count and the time between the
+ * systolic and diastolic samples (times in milliseconds)
+ */
+int calculateHeartRate(const float *timeValues, int sampleCount, int systolicIndex, int diastolicIndex, int positiveSlopeCount);
+
+/**
+ * @brief MAP = 0.33 * SBP + 0.67 * DBP
+ */
+float calculateMeanArterialPressureWeightedAverage(float systolicPressure, float diastolicPressure);
+
+/**
+ * @brief MAP taken as the pressure where the slope is maximum
+ */
+float calculateMeanArterialPressureSlope(const float *pressureValues, int sampleCount, int maxIndexPositiveSlope);
+
+#endif
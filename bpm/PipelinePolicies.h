@@ -0,0 +1,280 @@
+/**
+ * @file PipelinePolicies.h
+ * @brief The standard stages of MeasurementPipeline and the preset pipelines made of them
+ */
+
+#ifndef PIPELINE_POLICIES_H
+#define PIPELINE_POLICIES_H
+
+#include <stdio.h>
+#include "MeasurementPipeline.h"
+#include "BloodPressureMeasurement.h"
+
+/**
+ * @brief Sensor stage for samples that were read elsewhere (a recording, another thread) and are handed
+ * over with MeasurementPipeline::push()
+ */
+struct PushedSampleSource
+{
+    bool poll(uint64_t, MprlsSample &) { return false; }
+    void reset() {}
+};
+
+/**
+ * @brief Filter stage that does nothing, for detectors that only look at the pressure
+ */
+struct NoOscillationFilter
+{
+    static const bool hasOscillation = false;
+    void processBlock(OscillationBlock &) {}
+    void reset() {}
+};
+
+/**
+ * @brief Filter stage giving the oscillation, its envelope and the cuff pressure (OscillationExtractor)
+ */
+class BiquadOscillationFilter : public OscillationExtractor
+{
+public:
+    static const bool hasOscillation = true;
+    explicit BiquadOscillationFilter(float sampleRateHz = MEASUREMENT_SAMPLE_RATE_HZ) : OscillationExtractor(sampleRateHz) {}
+};
+
+/**
+ * @brief Filter stage that replaces motion artifacts in the pressure (HampelFilter) before handing the
+ * block to another filter stage, e.g. ArtifactRejectingFilter<BiquadOscillationFilter> or
+ * ArtifactRejectingFilter<NoOscillationFilter> in front of a detector that only looks at the pressure
+ */
+template <typename InnerFilter, int WindowSize = ARTIFACT_REJECTION_WINDOW>
+class ArtifactRejectingFilter : public InnerFilter
+{
+public:
+    static const bool hasOscillation = InnerFilter::hasOscillation;
+
+    void processBlock(OscillationBlock &block)
+    {
+        for(int i = 0; i < block.sampleCount; i++)
+            block.pressureValues[i] = artifactFilter.process(block.pressureValues[i]);
+        InnerFilter::processBlock(block);
+    }
+
+    void reset()
+    {
+        artifactFilter.reset();
+        InnerFilter::reset();
+    }
+
+    const HampelFilter<WindowSize> &getArtifactFilter() const { return artifactFilter; }
+
+private:
+    HampelFilter<WindowSize> artifactFilter;
+};
+
+/**
+ * @brief Detector stage of the original firmware: the slopes between consecutive samples. Needs no filter,
+ * so there is no heart rate: the positive slopes count every rising sample, not every beat, so it is
+ * reported as 0 and the confidence is lowered. SlopeBeatFeatureDetector adds the beats.
+ */
+class SlopeFeatureDetector
+{
+public:
+    void reset() { analyzer.reset(); }
+
+    bool addSample(const PipelineSample &sample)
+    {
+        analyzer.addSample(sample.timeMilliseconds, sample.pressure);
+        return false;
+    }
+
+    BloodPressureResult getResult() const
+    {
+        BloodPressureResult result = analyzer.finish();
+        result.heartRate = 0;
+        updateBloodPressureConfidence(result);
+        return result;
+    }
+
+private:
+    OscillometricAnalyzer analyzer;
+};
+
+/**
+ * @brief Detector stage of BloodPressureMeasurement without ENVELOPE_ANALYSIS: the slopes between
+ * consecutive samples for the pressures, the beats of the oscillation for the heart rate, counted once
+ * the filters settled as BloodPressureMeasurement does. The heart rate is 0 while no beat interval was
+ * accepted. Needs BiquadOscillationFilter.
+ */
+class SlopeBeatFeatureDetector
+{
+public:
+    SlopeBeatFeatureDetector() { reset(); }
+
+    void reset()
+    {
+        analyzer.reset();
+        beatDetector.reset();
+        peakCuffPressure = 0.0f;
+        peakTime = 0.0f;
+    }
+
+    bool addSample(const PipelineSample &sample)
+    {
+        analyzer.addSample(sample.timeMilliseconds, sample.pressure);
+
+        //The beats are only looked for once the filters settled after the cuff pressure stopped rising
+        if(sample.cuffPressure >= peakCuffPressure)
+        {
+            peakCuffPressure = sample.cuffPressure;
+            peakTime = sample.timeMilliseconds;
+        }
+        if(sample.timeMilliseconds - peakTime >= OSCILLATION_SETTLE_MS)
+            beatDetector.addSample(sample.timeMilliseconds, sample.oscillationValue);
+        return false;
+    }
+
+    BloodPressureResult getResult() const
+    {
+        BloodPressureResult result = analyzer.finish();
+        result.heartRate = 0;
+        if(beatDetector.getAcceptedIntervalCount() > 0)
+            result.heartRate = (int)(beatDetector.getMedianHeartRate() + 0.5f);
+        updateBloodPressureConfidence(result);
+        return result;
+    }
+
+    const BeatDetector &getBeatDetector() const { return beatDetector; }
+
+private:
+    OscillometricAnalyzer analyzer;
+    BeatDetector beatDetector;
+    //Highest filtered cuff pressure so far and when it was seen
+    float peakCuffPressure;
+    float peakTime;
+};
+
+/**
+ * @brief Detector stage of ENVELOPE_ANALYSIS: the envelope of the pulses for systolic and diastolic, the
+ * beats for the heart rate, with the same settling and decimation as BloodPressureMeasurement. With
+ * isEarlyTerminationEnabled it ends the measurement once the diastolic point is settled, as
+ * EARLY_TERMINATION does. Needs BiquadOscillationFilter.
+ */
+template <bool isEarlyTerminationEnabled = false>
+class EnvelopeFeatureDetector
+{
+public:
+    EnvelopeFeatureDetector() { reset(); }
+
+    void reset()
+    {
+        analyzer.reset();
+        beatDetector.reset();
+        decimationCounter = 0;
+        decimatedBeats = 0;
+        peakCuffPressure = 0.0f;
+        peakTime = 0.0f;
+    }
+
+    bool addSample(const PipelineSample &sample)
+    {
+        //Nothing is analysed until the filters settled after the cuff pressure stopped rising
+        if(sample.cuffPressure >= peakCuffPressure)
+        {
+            peakCuffPressure = sample.cuffPressure;
+            peakTime = sample.timeMilliseconds;
+        }
+        if(sample.timeMilliseconds - peakTime < OSCILLATION_SETTLE_MS)
+            return false;
+
+        decimatedBeats += beatDetector.addSample(sample.timeMilliseconds, sample.oscillationValue);
+        if(++decimationCounter < OSCILLATION_ENVELOPE_DECIMATION)
+            return false;
+        analyzer.addEnvelopeSample(sample.timeMilliseconds, sample.cuffPressure, sample.envelopeValue, decimatedBeats);
+        decimationCounter = 0;
+        decimatedBeats = 0;
+
+        if(!isEarlyTerminationEnabled || !analyzer.isDiastolicSettled())
+            return false;
+        BloodPressureResult provisionalResult = getResult();
+        return provisionalResult.confidence >= MEASUREMENT_EARLY_STOP_CONFIDENCE &&
+               provisionalResult.positiveSlopeCount >= MEASUREMENT_EARLY_STOP_MIN_BEATS;
+    }
+
+    BloodPressureResult getResult() const
+    {
+        BloodPressureResult result = analyzer.finish();
+        if(beatDetector.getAcceptedIntervalCount() > 0)
+        {
+            result.heartRate = (int)(beatDetector.getMedianHeartRate() + 0.5f);
+            updateBloodPressureConfidence(result);
+        }
+        return result;
+    }
+
+    const BeatDetector &getBeatDetector() const { return beatDetector; }
+
+private:
+    OscillometricAnalyzer analyzer;
+    BeatDetector beatDetector;
+    //Samples since the last envelope point and the beats counted over them
+    int decimationCounter;
+    int decimatedBeats;
+    //Highest filtered cuff pressure so far and when it was seen
+    float peakCuffPressure;
+    float peakTime;
+};
+
+/**
+ * @brief Sink stage that keeps nothing
+ */
+struct NoSampleSink
+{
+    void writeSample(const PipelineSample &) {}
+    void finish(const BloodPressureResult &) {}
+};
+
+/**
+ * @brief Sink stage printing every sample the way the firmware does
+ */
+struct PrintSampleSink
+{
+    void writeSample(const PipelineSample &sample)
+    {
+        printf("\nTimeStamp : %d | Pressure : %f \n", (int)sample.timeMilliseconds, sample.pressure);
+    }
+    void finish(const BloodPressureResult &) {}
+};
+
+/**
+ * @brief Sink stage packing every raw sample into binary telemetry (bpm/Telemetry.h). The encoder is
+ * flushed at the end; send the result through it afterwards. The sink behind the encoder is only called
+ * once per packet, not per sample.
+ */
+class TelemetrySampleSink
+{
+public:
+    explicit TelemetrySampleSink(TelemetryEncoder &telemetryEncoder) : encoder(&telemetryEncoder) {}
+
+    void writeSample(const PipelineSample &sample) { encoder->addSample(sample.raw); }
+    void finish(const BloodPressureResult &) { encoder->flush(); }
+
+private:
+    TelemetryEncoder *encoder;
+};
+
+//On the board, only the result: the raw slopes for the pressures, the beats for the heart rate and nothing
+//per sample. Bus can be the mbed I2C class.
+template <typename Bus>
+using OnTargetMinimalPipeline = MeasurementPipeline<MprlsAcquisition<Bus>, MprlsCountsConverter<MeasurementSensorVariant>,
+                                                    BiquadOscillationFilter, SlopeBeatFeatureDetector, NoSampleSink>;
+
+//On the board with the envelope analysis, the beats and every sample sent as binary telemetry
+template <typename Bus>
+using OnTargetTelemetryPipeline = MeasurementPipeline<MprlsAcquisition<Bus>, MprlsCountsConverter<MeasurementSensorVariant>,
+                                                      BiquadOscillationFilter, EnvelopeFeatureDetector<>, TelemetrySampleSink>;
+
+//On a PC over recorded samples pushed a block at a time, with the envelope analysis
+typedef MeasurementPipeline<PushedSampleSource, MprlsCountsConverter<MeasurementSensorVariant>, BiquadOscillationFilter,
+                            EnvelopeFeatureDetector<>, NoSampleSink>
+    HostBatchPipeline;
+
+#endif
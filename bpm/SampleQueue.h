@@ -0,0 +1,103 @@
+/**
+ * @file SampleQueue.h
+ * @brief Wait-free single-producer/single-consumer ring buffer for handing samples between threads
+ */
+
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief A fixed size ring shared by exactly one producer thread and one consumer thread.
+ *
+ * push() and pop() never wait and never take a lock: each one reads the index of the other side,
+ * copies one element and publishes its own index. When the ring is full push() fails and the sample is
+ * counted as an overflow, so the producer never stalls behind a slow consumer.
+ * Capacity must be a power of two; one slot is kept free to tell a full ring from an empty one.
+ */
+template <typename T, uint32_t Capacity>
+class SampleQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SampleQueue capacity must be a power of two");
+
+public:
+    SampleQueue() : head(0), tail(0), overflows(0), highWaterMark(0) {}
+
+    /**
+     * @brief Producer side: append a copy of the element
+     * @return false (and one more overflow) if the ring was full
+     */
+    bool push(const T &element)
+    {
+        uint32_t currentTail = tail.load(std::memory_order_relaxed);
+        uint32_t nextTail = (currentTail + 1) & (Capacity - 1);
+        uint32_t currentHead = head.load(std::memory_order_acquire);
+        if(nextTail == currentHead)
+        {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        elements[currentTail] = element;
+        tail.store(nextTail, std::memory_order_release);
+
+        //Deepest the ring has been, as seen by the producer
+        uint32_t depth = (nextTail - currentHead) & (Capacity - 1);
+        if(depth > highWaterMark.load(std::memory_order_relaxed))
+            highWaterMark.store(depth, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Consumer side: take the oldest element
+     * @return false if the ring was empty
+     */
+    bool pop(T &element)
+    {
+        uint32_t currentHead = head.load(std::memory_order_relaxed);
+        if(currentHead == tail.load(std::memory_order_acquire))
+            return false;
+
+        element = elements[currentHead];
+        head.store((currentHead + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    //Number of elements waiting, exact from either side and an estimate from any other thread
+    uint32_t size() const
+    {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+    //Number of elements the ring can hold
+    static uint32_t capacity() { return Capacity - 1; }
+    /**
+     * @brief Empty the ring and clear the counters. Only while neither side is running.
+     */
+    void reset()
+    {
+        head.store(0);
+        tail.store(0);
+        overflows.store(0);
+        highWaterMark.store(0);
+    }
+
+    //Elements push() had to throw away
+    uint32_t getOverflows() const { return overflows.load(std::memory_order_relaxed); }
+    //Most elements that were ever waiting at once
+    uint32_t getHighWaterMark() const { return highWaterMark.load(std::memory_order_relaxed); }
+
+private:
+    //The slots
+    T elements[Capacity];
+    //Next slot to read, written by the consumer only
+    std::atomic<uint32_t> head;
+    //Next slot to write, written by the producer only
+    std::atomic<uint32_t> tail;
+    //Written by the producer only
+    std::atomic<uint32_t> overflows;
+    std::atomic<uint32_t> highWaterMark;
+};
+
+#endif
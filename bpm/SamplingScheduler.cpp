@@ -0,0 +1,122 @@
+/**
+ * @file SamplingScheduler.cpp
+ * @brief Wakes the sampling side of a measurement only when the sensor has something to give, and sleeps in between
+ */
+
+#include "SamplingScheduler.h"
+#include <string.h>
+
+SamplingScheduler::SamplingScheduler(BloodPressureMeasurement &bloodPressureMeasurement, MeasurementClock &measurementClock,
+                                     SamplingTimer &samplingTimer)
+    : measurement(bloodPressureMeasurement), clock(measurementClock), timer(samplingTimer)
+{
+    start();
+}
+
+void SamplingScheduler::start()
+{
+    startMicroseconds = clock.nowMicroseconds();
+    wakeMicroseconds = startMicroseconds;
+    previousSampleMicroseconds = 0;
+    hasPreviousSample = false;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+uint64_t SamplingScheduler::produceDue()
+{
+    while(true)
+    {
+        //produce() stamps the sample with the time it polls at
+        uint64_t pollMicroseconds = clock.nowMicroseconds();
+        if(!measurement.produce())
+            break;
+
+        statistics.samples++;
+        if(hasPreviousSample)
+        {
+            uint32_t interval = (uint32_t)(pollMicroseconds - previousSampleMicroseconds);
+            if(statistics.samples == 2 || interval < statistics.minSampleIntervalMicroseconds)
+                statistics.minSampleIntervalMicroseconds = interval;
+            if(interval > statistics.maxSampleIntervalMicroseconds)
+                statistics.maxSampleIntervalMicroseconds = interval;
+            statistics.totalSampleIntervalMicroseconds += interval;
+        }
+        previousSampleMicroseconds = pollMicroseconds;
+        hasPreviousSample = true;
+    }
+
+    //Nothing to wait for means the sensor is still busy past its conversion time, or a transfer failed
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    uint64_t nextWakeMicroseconds = measurement.getNextProduceMicroseconds();
+    if(nextWakeMicroseconds <= nowMicroseconds)
+        nextWakeMicroseconds = nowMicroseconds + MEASUREMENT_POLL_INTERVAL_US;
+    return nextWakeMicroseconds;
+}
+
+void SamplingScheduler::sleepUntil(uint64_t wakeUpMicroseconds)
+{
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    if(wakeUpMicroseconds <= nowMicroseconds)
+        return;
+
+    noteSleep(nowMicroseconds);
+    timer.sleepUntil(wakeUpMicroseconds);
+    wakeMicroseconds = clock.nowMicroseconds();
+    statistics.wakeups++;
+    statistics.elapsedMicroseconds = wakeMicroseconds - startMicroseconds;
+
+    uint32_t latency = wakeMicroseconds > wakeUpMicroseconds ? (uint32_t)(wakeMicroseconds - wakeUpMicroseconds) : 0;
+    statistics.totalWakeLatencyMicroseconds += latency;
+    if(latency > statistics.maxWakeLatencyMicroseconds)
+        statistics.maxWakeLatencyMicroseconds = latency;
+}
+
+BloodPressureResult SamplingScheduler::run()
+{
+    start();
+    while(true)
+    {
+        uint64_t nextWakeMicroseconds = produceDue();
+        //Every sample is processed as soon as it is read
+        if(measurement.consume())
+            break;
+
+        //The session log is written while the sensor converts, as long as there is time left
+        while(clock.nowMicroseconds() < nextWakeMicroseconds && measurement.serviceSessionLog())
+        {
+        }
+        sleepUntil(nextWakeMicroseconds);
+    }
+    stop();
+
+    //Finish the slope search over all the recorded samples
+    return measurement.getResult();
+}
+
+float SamplingScheduler::getDutyCycle() const
+{
+    if(statistics.elapsedMicroseconds == 0)
+        return 0.0f;
+    return (float)statistics.awakeMicroseconds / statistics.elapsedMicroseconds;
+}
+
+float SamplingScheduler::getWakeupsPerSecond() const
+{
+    if(statistics.elapsedMicroseconds == 0)
+        return 0.0f;
+    return statistics.wakeups * 1000000.0f / statistics.elapsedMicroseconds;
+}
+
+float SamplingScheduler::getMeanSampleIntervalMicroseconds() const
+{
+    if(statistics.samples < 2)
+        return 0.0f;
+    return (float)statistics.totalSampleIntervalMicroseconds / (statistics.samples - 1);
+}
+
+void SamplingScheduler::noteSleep(uint64_t nowMicroseconds)
+{
+    statistics.awakeMicroseconds += nowMicroseconds - wakeMicroseconds;
+    statistics.elapsedMicroseconds = nowMicroseconds - startMicroseconds;
+    wakeMicroseconds = nowMicroseconds;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file SamplingScheduler.h
+ * @brief Wakes the sampling side of a measurement only when the sensor has something to give, and sleeps in between
+ */
+
+#ifndef SAMPLING_SCHEDULER_H
+#define SAMPLING_SCHEDULER_H
+
+#include <stdint.h>
+#include "hal/MeasurementHardware.h"
+#include "BloodPressureMeasurement.h"
+
+//The sample period used by the firmware in microseconds, 0 to sample as fast as the sensor converts
+#ifndef MEASUREMENT_SAMPLE_PERIOD_US
+#define MEASUREMENT_SAMPLE_PERIOD_US 0
+#endif
+
+/**
+ * @brief How the sampling side spent its time
+ */
+struct SamplingSchedulerStatistics
+{
+    //Times the sampling side woke up
+    uint32_t wakeups;
+    //Samples read
+    uint32_t samples;
+    //Time spent awake (from a wake up to the next sleep) and the time covered, in microseconds
+    uint64_t awakeMicroseconds;
+    uint64_t elapsedMicroseconds;
+    //How much later than asked the timer woke the sampling up: the longest and the total
+    uint32_t maxWakeLatencyMicroseconds;
+    uint64_t totalWakeLatencyMicroseconds;
+    //Time between consecutive samples: the shortest, the longest and the total
+    uint32_t minSampleIntervalMicroseconds;
+    uint32_t maxSampleIntervalMicroseconds;
+    uint64_t totalSampleIntervalMicroseconds;
+};
+
+/**
+ * @brief Drives produce() of a measurement from a SamplingTimer instead of polling it in a loop.
+ *
+ * After every wake up it reads whatever the sensor has ready, then asks the measurement when the next
+ * poll can do anything (the end of the running conversion, or the start of the next sample period) and
+ * sleeps until then; only a sensor that is still busy after its conversion time is polled again after
+ * MEASUREMENT_POLL_INTERVAL_US. With a sample period set the conversions start on a fixed grid, so the
+ * cadence does not drift with the printing or with late wake ups. The statistics give the duty cycle
+ * (the share of the time awake) and the wake ups per second. run() does everything from one thread; a
+ * sampling thread calls start(), then produceDue() and sleepUntil() until the measurement is finished,
+ * then stop() (see hal/MbedMeasurementProducerThread.h).
+ */
+class SamplingScheduler
+{
+public:
+    SamplingScheduler(BloodPressureMeasurement &bloodPressureMeasurement, MeasurementClock &measurementClock,
+                      SamplingTimer &samplingTimer);
+
+    //Sets the sample period of the measurement (see BloodPressureMeasurement::setSamplePeriod())
+    void setSamplePeriod(uint32_t periodMicroseconds) { measurement.setSamplePeriod(periodMicroseconds); }
+
+    //Clears the statistics; the time they cover starts now
+    void start();
+
+    /**
+     * @brief Reads every sample that is ready
+     * @return the time the sampling should be woken up again
+     */
+    uint64_t produceDue();
+
+    //Sleeps on the timer until wakeUpMicroseconds and counts the time awake before and the wake up
+    void sleepUntil(uint64_t wakeUpMicroseconds);
+
+    //Counts the time awake up to now; call once the sampling is over
+    void stop() { noteSleep(clock.nowMicroseconds()); }
+
+    /**
+     * @brief Samples and processes the whole measurement from the calling thread, sleeping whenever the
+     * sensor is converting and nothing is left to process or to write to the session log
+     * @return the values found by the slope search
+     */
+    BloodPressureResult run();
+
+    const SamplingSchedulerStatistics &getStatistics() const { return statistics; }
+
+    //Share of the time spent awake, 0 to 1
+    float getDutyCycle() const;
+
+    float getWakeupsPerSecond() const;
+
+    //Mean time between consecutive samples in microseconds, 0 before the second sample
+    float getMeanSampleIntervalMicroseconds() const;
+
+private:
+    //Counts the time awake up to now and the time covered
+    void noteSleep(uint64_t nowMicroseconds);
+
+    //The measurement that is sampled
+    BloodPressureMeasurement &measurement;
+    //The time base
+    MeasurementClock &clock;
+    //What the sampling sleeps on
+    SamplingTimer &timer;
+    //When the statistics were cleared, and when the sampling last woke up
+    uint64_t startMicroseconds;
+    uint64_t wakeMicroseconds;
+    //When the previous sample was read, valid once hasPreviousSample is set
+    uint64_t previousSampleMicroseconds;
+    bool hasPreviousSample;
+    SamplingSchedulerStatistics statistics;
+};
+
+#endif
@@ -0,0 +1,539 @@
+/**
+ * @file SessionLog.cpp
+ * @brief Keeps every measurement in flash as a ring of erase sectors, see SessionLog.h for the layout
+ */
+
+#include "SessionLog.h"
+#include "TelemetryCoding.h"
+#include <string.h>
+
+//"BPLS", the first bytes of a sector header
+#define SESSION_LOG_SECTOR_MARKER 0x534C5042u
+#define SESSION_LOG_SECTOR_HEADER_SIZE 20
+#define SESSION_LOG_VERSION 1
+//The first bytes of a record, never all erased or all programmed
+#define SESSION_LOG_RECORD_MARKER 0x4C52u
+
+#define SESSION_LOG_RECORD_BEGIN 1
+#define SESSION_LOG_RECORD_SAMPLES 2
+#define SESSION_LOG_RECORD_END 3
+
+//Payload of an END record: six integers, nine floats and the isExact flag
+#define SESSION_LOG_RESULT_SIZE (6 * 4 + 9 * 4 + 1)
+
+//Everything is stored little endian
+static void storeUnsigned(uint64_t value, uint8_t *output, int length)
+{
+    for(int i = 0; i < length; i++)
+        output[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t loadUnsigned(const uint8_t *input, int length)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < length; i++)
+        value |= (uint64_t)input[i] << (8 * i);
+    return value;
+}
+
+static void storeFloat(float value, uint8_t *output)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    storeUnsigned(bits, output, 4);
+}
+
+static float loadFloat(const uint8_t *input)
+{
+    uint32_t bits = (uint32_t)loadUnsigned(input, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void storeResult(const BloodPressureResult &result, uint8_t *output)
+{
+    storeUnsigned((uint32_t)result.sampleCount, output, 4);
+    storeUnsigned((uint32_t)result.maxSlopeIndex, output + 4, 4);
+    storeUnsigned((uint32_t)result.systolicIndex, output + 8, 4);
+    storeUnsigned((uint32_t)result.diastolicIndex, output + 12, 4);
+    storeUnsigned((uint32_t)result.positiveSlopeCount, output + 16, 4);
+    storeUnsigned((uint32_t)result.heartRate, output + 20, 4);
+    storeFloat(result.maxSlope, output + 24);
+    storeFloat(result.systolicPressure, output + 28);
+    storeFloat(result.diastolicPressure, output + 32);
+    storeFloat(result.meanArterialPressureSlope, output + 36);
+    storeFloat(result.meanArterialPressureWeightedAverage, output + 40);
+    storeFloat(result.pulsePressure, output + 44);
+    storeFloat(result.systolicTime, output + 48);
+    storeFloat(result.diastolicTime, output + 52);
+    storeFloat(result.confidence, output + 56);
+    output[60] = result.isExact ? 1 : 0;
+}
+
+static void loadResult(const uint8_t *input, BloodPressureResult &result)
+{
+    result.sampleCount = (int32_t)loadUnsigned(input, 4);
+    result.maxSlopeIndex = (int32_t)loadUnsigned(input + 4, 4);
+    result.systolicIndex = (int32_t)loadUnsigned(input + 8, 4);
+    result.diastolicIndex = (int32_t)loadUnsigned(input + 12, 4);
+    result.positiveSlopeCount = (int32_t)loadUnsigned(input + 16, 4);
+    result.heartRate = (int32_t)loadUnsigned(input + 20, 4);
+    result.maxSlope = loadFloat(input + 24);
+    result.systolicPressure = loadFloat(input + 28);
+    result.diastolicPressure = loadFloat(input + 32);
+    result.meanArterialPressureSlope = loadFloat(input + 36);
+    result.meanArterialPressureWeightedAverage = loadFloat(input + 40);
+    result.pulsePressure = loadFloat(input + 44);
+    result.systolicTime = loadFloat(input + 48);
+    result.diastolicTime = loadFloat(input + 52);
+    result.confidence = loadFloat(input + 56);
+    result.isExact = input[60] != 0;
+}
+
+//The CRC of a record covers its header (with the CRC field taken as 0) and its payload
+static uint16_t recordCrc(uint8_t *record, size_t payloadLength)
+{
+    uint8_t storedCrc[2] = { record[6], record[7] };
+    record[6] = 0;
+    record[7] = 0;
+    uint16_t crc = telemetryCrc16(record, SESSION_LOG_RECORD_HEADER_SIZE + payloadLength);
+    record[6] = storedCrc[0];
+    record[7] = storedCrc[1];
+    return crc;
+}
+
+SessionLog::SessionLog(SessionStorage &sessionStorage) : storage(sessionStorage)
+{
+    programSize = 1;
+    eraseSize = 0;
+    sectorCount = 0;
+    sectorHeaderSize = SESSION_LOG_SECTOR_HEADER_SIZE;
+    paddingValue = 0xFF;
+    canCheckBlank = false;
+    hasCurrentSector = false;
+    currentSector = 0;
+    writeOffset = 0;
+    sequence = 0;
+    currentEraseCount = 0;
+    erasedAheadCount = 0;
+    sessionId = 0;
+    isSessionOpen = false;
+    batchCount = 0;
+    previousSampleMicroseconds = 0;
+    pendingHead = 0;
+    pendingCount = 0;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+int SessionLog::mount()
+{
+    programSize = storage.getProgramSize();
+    eraseSize = storage.getEraseSize();
+    int eraseValue = storage.getEraseValue();
+    canCheckBlank = eraseValue >= 0;
+    paddingValue = canCheckBlank ? (uint8_t)eraseValue : 0xFF;
+    if(programSize == 0 || programSize > SESSION_LOG_MAX_PROGRAM_SIZE || eraseSize % programSize != 0 || eraseSize > 0x80000000u)
+        return -1;
+    sectorHeaderSize = padded(SESSION_LOG_SECTOR_HEADER_SIZE);
+    uint32_t largestRecord = padded(SESSION_LOG_RECORD_HEADER_SIZE + SESSION_LOG_MAX_PAYLOAD_SIZE);
+    if(largestRecord > SESSION_LOG_RECORD_CAPACITY || eraseSize < sectorHeaderSize + largestRecord)
+        return -1;
+    sectorCount = (uint32_t)(storage.getSize() / eraseSize);
+    if(sectorCount < 2)
+        return -1;
+
+    //The newest sector is the one with the highest sequence number
+    hasCurrentSector = false;
+    currentSector = sectorCount - 1;
+    sequence = 0;
+    sessionId = 0;
+    erasedAheadCount = 0;
+    pendingCount = 0;
+    batchCount = 0;
+    isSessionOpen = false;
+    for(uint32_t sector = 0; sector < sectorCount; sector++)
+    {
+        uint32_t sectorSequence, eraseCount, firstSessionId;
+        if(!readSectorHeader(sector, sectorSequence, eraseCount, firstSessionId))
+            continue;
+        if(!hasCurrentSector || sectorSequence > sequence)
+        {
+            hasCurrentSector = true;
+            currentSector = sector;
+            sequence = sectorSequence;
+            currentEraseCount = eraseCount;
+            sessionId = firstSessionId;
+        }
+    }
+    if(!hasCurrentSector)
+        return 0;
+
+    //Records go after the last valid one; anything but erased bytes after it is a torn write, and the
+    //next record then goes to a fresh sector rather than on top of it
+    writeOffset = sectorHeaderSize;
+    uint32_t recordLength;
+    while(writeOffset < eraseSize && (recordLength = readRecord(currentSector, writeOffset)) != 0)
+    {
+        uint32_t recordSessionId = (uint32_t)loadUnsigned(recordBuffer + 8, 4);
+        if(recordSessionId > sessionId)
+            sessionId = recordSessionId;
+        writeOffset += recordLength;
+    }
+    if(writeOffset < eraseSize && !isBlank((uint64_t)currentSector * eraseSize + writeOffset, eraseSize - writeOffset))
+        writeOffset = (uint32_t)eraseSize;
+    return 0;
+}
+
+uint32_t SessionLog::beginSession(uint64_t startMicroseconds)
+{
+    if(isSessionOpen)
+        sealBatch();
+    flush();
+
+    //The sectors the session will fill are erased now, while nothing is being sampled
+    uint32_t eraseAheadLimit = sectorCount - 1 < SESSION_LOG_ERASE_AHEAD_SECTORS ? sectorCount - 1 : SESSION_LOG_ERASE_AHEAD_SECTORS;
+    while(erasedAheadCount < eraseAheadLimit)
+    {
+        uint32_t sector = (currentSector + 1 + erasedAheadCount) % sectorCount;
+        if(!prepareSector(sector, erasedAheadCounts[erasedAheadCount]))
+            break;
+        erasedAheadCount++;
+    }
+
+    sessionId++;
+    uint8_t payload[8];
+    storeUnsigned(startMicroseconds, payload, 8);
+    queueRecord(SESSION_LOG_RECORD_BEGIN, payload, sizeof(payload));
+    isSessionOpen = true;
+    batchCount = 0;
+    return sessionId;
+}
+
+void SessionLog::addSample(const MprlsSample &sample)
+{
+    if(!isSessionOpen)
+        return;
+    //The interval to the previous sample has 16 bits; a longer gap (or a clock going back) starts a new record
+    if(batchCount > 0 && (sample.timeMicroseconds < previousSampleMicroseconds ||
+                          sample.timeMicroseconds - previousSampleMicroseconds > 0xFFFF))
+        sealBatch();
+
+    //The record is packed in place in the first free pending slot
+    if(batchCount == 0 && pendingCount == SESSION_LOG_PENDING_RECORDS)
+    {
+        statistics.samplesDropped++;
+        return;
+    }
+    uint8_t *record = pendingRecords[(pendingHead + pendingCount) % SESSION_LOG_PENDING_RECORDS];
+    uint8_t *payload = record + SESSION_LOG_RECORD_HEADER_SIZE;
+    if(batchCount == 0)
+    {
+        storeUnsigned(sample.timeMicroseconds, payload, 8);
+        previousSampleMicroseconds = sample.timeMicroseconds;
+    }
+    uint8_t *packedSample = payload + 8 + SESSION_LOG_SAMPLE_SIZE * batchCount;
+    storeUnsigned(sample.timeMicroseconds - previousSampleMicroseconds, packedSample, 2);
+    storeUnsigned(sample.counts, packedSample + 2, 3);
+    packedSample[5] = sample.status;
+    previousSampleMicroseconds = sample.timeMicroseconds;
+    statistics.samplesLogged++;
+    if(++batchCount == SESSION_LOG_BATCH_SAMPLES)
+        sealBatch();
+}
+
+void SessionLog::endSession(const BloodPressureResult &result)
+{
+    if(!isSessionOpen)
+        return;
+    sealBatch();
+    uint8_t payload[SESSION_LOG_RESULT_SIZE];
+    storeResult(result, payload);
+    //The commit marker is never dropped: the sampling is over, so waiting for a free slot is fine
+    while(!queueRecord(SESSION_LOG_RECORD_END, payload, sizeof(payload)))
+        service();
+    isSessionOpen = false;
+}
+
+bool SessionLog::service()
+{
+    if(pendingCount == 0)
+    {
+        //A session that outgrew the sectors erased ahead gets its next one while the sampling is idle
+        if(isSessionOpen && erasedAheadCount == 0 && hasCurrentSector)
+        {
+            if(prepareSector((currentSector + 1) % sectorCount, erasedAheadCounts[0]))
+            {
+                erasedAheadCount = 1;
+                statistics.sessionErases++;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    uint8_t *record = pendingRecords[pendingHead];
+    uint32_t length = pendingLengths[pendingHead];
+    pendingHead = (pendingHead + 1) % SESSION_LOG_PENDING_RECORDS;
+    pendingCount--;
+
+    if(!hasCurrentSector || writeOffset + length > eraseSize)
+    {
+        if(!openNextSector())
+            return true;
+    }
+    //The CRC is left to here, so sealing a record on the sampling side stays cheap
+    uint32_t payloadLength = (uint32_t)loadUnsigned(record + 4, 2);
+    storeUnsigned(recordCrc(record, payloadLength), record + 6, 2);
+    if(storage.program(record, (uint64_t)currentSector * eraseSize + writeOffset, length) != 0)
+    {
+        //The bytes may be half programmed, nothing more goes into this sector
+        statistics.storageErrors++;
+        writeOffset = (uint32_t)eraseSize;
+        return true;
+    }
+    writeOffset += length;
+    statistics.recordsWritten++;
+    statistics.recordBytes += SESSION_LOG_RECORD_HEADER_SIZE + payloadLength;
+    statistics.programmedBytes += length;
+    return true;
+}
+
+void SessionLog::flush()
+{
+    while(pendingCount > 0)
+        service();
+}
+
+int SessionLog::readSessions(SessionLogListener &listener)
+{
+    if(!hasCurrentSector)
+        return 0;
+
+    int sessionCount = 0;
+    bool hasOpenSession = false;
+    uint32_t openSessionId = 0;
+    bool hasPreviousSequence = false;
+    uint32_t previousSequence = 0;
+    //Oldest first: the sectors after the current one, around the ring, back to the current one
+    for(uint32_t step = 1; step <= sectorCount; step++)
+    {
+        uint32_t sector = (currentSector + step) % sectorCount;
+        uint32_t sectorSequence, eraseCount, firstSessionId;
+        if(!readSectorHeader(sector, sectorSequence, eraseCount, firstSessionId))
+            continue;
+        if(hasPreviousSequence && sectorSequence <= previousSequence)
+            continue;
+        hasPreviousSequence = true;
+        previousSequence = sectorSequence;
+
+        uint32_t offset = sectorHeaderSize;
+        uint32_t recordLength;
+        while(offset < eraseSize && (recordLength = readRecord(sector, offset)) != 0)
+        {
+            offset += recordLength;
+            uint8_t type = recordBuffer[2];
+            uint32_t recordSessionId = (uint32_t)loadUnsigned(recordBuffer + 8, 4);
+            const uint8_t *payload = recordBuffer + SESSION_LOG_RECORD_HEADER_SIZE;
+            uint32_t payloadLength = (uint32_t)loadUnsigned(recordBuffer + 4, 2);
+
+            //A session whose start was overwritten, or that was cut short, still gets its samples reported
+            if(type == SESSION_LOG_RECORD_BEGIN || !hasOpenSession || recordSessionId != openSessionId)
+            {
+                if(hasOpenSession)
+                    listener.onSessionEnd(openSessionId, 0);
+                listener.onSessionStart(recordSessionId, type == SESSION_LOG_RECORD_BEGIN ? loadUnsigned(payload, 8) : 0);
+                hasOpenSession = true;
+                openSessionId = recordSessionId;
+                sessionCount++;
+            }
+            if(type == SESSION_LOG_RECORD_SAMPLES)
+            {
+                MprlsSample sample;
+                sample.timeMicroseconds = loadUnsigned(payload, 8);
+                for(uint32_t position = 8; position + SESSION_LOG_SAMPLE_SIZE <= payloadLength; position += SESSION_LOG_SAMPLE_SIZE)
+                {
+                    sample.timeMicroseconds += loadUnsigned(payload + position, 2);
+                    sample.counts = (uint32_t)loadUnsigned(payload + position + 2, 3);
+                    sample.status = payload[position + 5];
+                    listener.onSample(recordSessionId, sample);
+                }
+            }
+            else if(type == SESSION_LOG_RECORD_END)
+            {
+                BloodPressureResult result;
+                loadResult(payload, result);
+                listener.onSessionEnd(recordSessionId, &result);
+                hasOpenSession = false;
+            }
+        }
+    }
+    if(hasOpenSession)
+        listener.onSessionEnd(openSessionId, 0);
+    return sessionCount;
+}
+
+bool SessionLog::queueRecord(uint8_t type, const uint8_t *payload, size_t length)
+{
+    if(pendingCount == SESSION_LOG_PENDING_RECORDS)
+        return false;
+    int slot = (pendingHead + pendingCount) % SESSION_LOG_PENDING_RECORDS;
+    memcpy(pendingRecords[slot] + SESSION_LOG_RECORD_HEADER_SIZE, payload, length);
+    pendingLengths[slot] = finishRecord(pendingRecords[slot], type, sessionId, length);
+    pendingCount++;
+    return true;
+}
+
+void SessionLog::sealBatch()
+{
+    if(batchCount == 0)
+        return;
+    int slot = (pendingHead + pendingCount) % SESSION_LOG_PENDING_RECORDS;
+    pendingLengths[slot] = finishRecord(pendingRecords[slot], SESSION_LOG_RECORD_SAMPLES, sessionId,
+                                        8 + SESSION_LOG_SAMPLE_SIZE * batchCount);
+    pendingCount++;
+    batchCount = 0;
+}
+
+uint32_t SessionLog::finishRecord(uint8_t *record, uint8_t type, uint32_t id, size_t payloadLength)
+{
+    storeUnsigned(SESSION_LOG_RECORD_MARKER, record, 2);
+    record[2] = type;
+    record[3] = 0;
+    storeUnsigned(payloadLength, record + 4, 2);
+    storeUnsigned(id, record + 8, 4);
+    uint32_t length = padded((uint32_t)(SESSION_LOG_RECORD_HEADER_SIZE + payloadLength));
+    memset(record + SESSION_LOG_RECORD_HEADER_SIZE + payloadLength, paddingValue,
+           length - SESSION_LOG_RECORD_HEADER_SIZE - payloadLength);
+    return length;
+}
+
+bool SessionLog::openNextSector()
+{
+    uint32_t sector = (currentSector + 1) % sectorCount;
+    uint32_t eraseCount;
+    if(erasedAheadCount > 0)
+    {
+        eraseCount = erasedAheadCounts[0];
+        erasedAheadCount--;
+        memmove(erasedAheadCounts, erasedAheadCounts + 1, erasedAheadCount * sizeof(erasedAheadCounts[0]));
+    }
+    else
+    {
+        if(isSessionOpen)
+            statistics.sessionErases++;
+        if(!prepareSector(sector, eraseCount))
+            return false;
+    }
+
+    uint8_t header[SESSION_LOG_MAX_PROGRAM_SIZE > SESSION_LOG_SECTOR_HEADER_SIZE ? SESSION_LOG_MAX_PROGRAM_SIZE : SESSION_LOG_SECTOR_HEADER_SIZE];
+    memset(header, paddingValue, sectorHeaderSize);
+    storeUnsigned(SESSION_LOG_SECTOR_MARKER, header, 4);
+    storeUnsigned(sequence + 1, header + 4, 4);
+    storeUnsigned(eraseCount, header + 8, 4);
+    //The session being logged when the sector was opened, so ids keep counting up after a reboot
+    storeUnsigned(sessionId, header + 12, 4);
+    storeUnsigned(SESSION_LOG_VERSION, header + 16, 2);
+    storeUnsigned(telemetryCrc16(header, 18), header + 18, 2);
+
+    //The sector is current from here on, even if its header fails: the next record then moves on again
+    hasCurrentSector = true;
+    currentSector = sector;
+    currentEraseCount = eraseCount;
+    sequence++;
+    if(storage.program(header, (uint64_t)sector * eraseSize, sectorHeaderSize) != 0)
+    {
+        statistics.storageErrors++;
+        writeOffset = (uint32_t)eraseSize;
+        return false;
+    }
+    writeOffset = sectorHeaderSize;
+    statistics.programmedBytes += sectorHeaderSize;
+    return true;
+}
+
+bool SessionLog::prepareSector(uint32_t sector, uint32_t &eraseCount)
+{
+    //A sector erased before a reboot has lost its header; the ring wears evenly, so the count of the
+    //current sector is a close estimate
+    uint32_t sectorSequence, previousEraseCount, firstSessionId;
+    if(!readSectorHeader(sector, sectorSequence, previousEraseCount, firstSessionId))
+        previousEraseCount = currentEraseCount;
+
+    uint64_t address = (uint64_t)sector * eraseSize;
+    if(canCheckBlank && isBlank(address, eraseSize))
+    {
+        statistics.skippedErases++;
+        eraseCount = previousEraseCount;
+        return true;
+    }
+    if(storage.erase(address, eraseSize) != 0)
+    {
+        statistics.storageErrors++;
+        return false;
+    }
+    statistics.erases++;
+    eraseCount = previousEraseCount + 1;
+    return true;
+}
+
+bool SessionLog::isBlank(uint64_t address, uint64_t length)
+{
+    if(!canCheckBlank)
+        return false;
+    uint64_t chunkSize = sizeof(recordBuffer) / programSize * programSize;
+    while(length > 0)
+    {
+        uint64_t size = length < chunkSize ? length : chunkSize;
+        if(storage.read(recordBuffer, address, size) != 0)
+        {
+            statistics.storageErrors++;
+            return false;
+        }
+        for(uint64_t i = 0; i < size; i++)
+        {
+            if(recordBuffer[i] != paddingValue)
+                return false;
+        }
+        address += size;
+        length -= size;
+    }
+    return true;
+}
+
+bool SessionLog::readSectorHeader(uint32_t sector, uint32_t &sectorSequence, uint32_t &eraseCount, uint32_t &firstSessionId)
+{
+    if(storage.read(recordBuffer, (uint64_t)sector * eraseSize, sectorHeaderSize) != 0)
+    {
+        statistics.storageErrors++;
+        return false;
+    }
+    if(loadUnsigned(recordBuffer, 4) != SESSION_LOG_SECTOR_MARKER || loadUnsigned(recordBuffer + 16, 2) != SESSION_LOG_VERSION ||
+       loadUnsigned(recordBuffer + 18, 2) != telemetryCrc16(recordBuffer, 18))
+        return false;
+    sectorSequence = (uint32_t)loadUnsigned(recordBuffer + 4, 4);
+    eraseCount = (uint32_t)loadUnsigned(recordBuffer + 8, 4);
+    firstSessionId = (uint32_t)loadUnsigned(recordBuffer + 12, 4);
+    return true;
+}
+
+uint32_t SessionLog::readRecord(uint32_t sector, uint32_t offset)
+{
+    uint64_t address = (uint64_t)sector * eraseSize + offset;
+    uint32_t headerLength = padded(SESSION_LOG_RECORD_HEADER_SIZE);
+    if(offset + headerLength > eraseSize || storage.read(recordBuffer, address, headerLength) != 0)
+        return 0;
+    if(loadUnsigned(recordBuffer, 2) != SESSION_LOG_RECORD_MARKER)
+        return 0;
+    uint32_t payloadLength = (uint32_t)loadUnsigned(recordBuffer + 4, 2);
+    if(payloadLength > SESSION_LOG_MAX_PAYLOAD_SIZE)
+        return 0;
+    uint32_t length = padded(SESSION_LOG_RECORD_HEADER_SIZE + payloadLength);
+    if(offset + length > eraseSize)
+        return 0;
+    if(length > headerLength && storage.read(recordBuffer + headerLength, address + headerLength, length - headerLength) != 0)
+        return 0;
+    if(loadUnsigned(recordBuffer + 6, 2) != recordCrc(recordBuffer, payloadLength))
+        return 0;
+    return length;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file SessionLog.h
+ * @brief Keeps every measurement (raw samples and result) in flash, as a ring of erase sectors that wears evenly
+ *
+ * Layout: every erase sector starts with a header (sequence number, erase count, CRC), padded to the program
+ * size, followed by records padded to the program size:
+ *     marker (uint16) | type (uint8) | 0 | payload length (uint16) | CRC-16 (uint16) | session id (uint32) | payload
+ * A session is a BEGIN record, SAMPLES records of up to SESSION_LOG_BATCH_SAMPLES samples (the time of the
+ * first one, then 6 bytes per sample: the interval in microseconds, the 24-bit counts and the status byte)
+ * and an END record with the result. The END record is the commit marker: a session without one was cut
+ * short by a reset or a power loss. A record whose CRC does not match ends the sector, so a torn write
+ * loses at most the record that was being programmed.
+ *
+ * Sectors are used strictly in turn, the oldest one is erased when the ring is full, so every sector is
+ * erased equally often; its erase count is kept in the header. Erasing is slow, so beginSession() erases
+ * SESSION_LOG_ERASE_AHEAD_SECTORS sectors before the measurement starts (sectors that are already blank
+ * are not erased again). addSample() only packs the sample into RAM; sealed records wait in a small
+ * queue until service() programs them, one record per call, when the sampling side is idle.
+ */
+
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal/MeasurementHardware.h"
+#include "MprlsAcquisition.h"
+#include "BloodPressureResult.h"
+
+//Samples in one SAMPLES record
+#ifndef SESSION_LOG_BATCH_SAMPLES
+#define SESSION_LOG_BATCH_SAMPLES 32
+#endif
+
+//Sealed records that can wait for service(); samples are dropped (and counted) when they are all taken
+#ifndef SESSION_LOG_PENDING_RECORDS
+#define SESSION_LOG_PENDING_RECORDS 4
+#endif
+
+//Sectors beginSession() makes sure are erased; a session that needs more erases them as it goes
+#ifndef SESSION_LOG_ERASE_AHEAD_SECTORS
+#define SESSION_LOG_ERASE_AHEAD_SECTORS 32
+#endif
+
+//Largest program size of a storage the log can be kept on
+#ifndef SESSION_LOG_MAX_PROGRAM_SIZE
+#define SESSION_LOG_MAX_PROGRAM_SIZE 256
+#endif
+
+//Size of the record header and of the largest payload
+#define SESSION_LOG_RECORD_HEADER_SIZE 12
+#define SESSION_LOG_SAMPLE_SIZE 6
+#define SESSION_LOG_MAX_PAYLOAD_SIZE (8 + SESSION_LOG_SAMPLE_SIZE * SESSION_LOG_BATCH_SAMPLES)
+//Room for the largest record padded to the largest program size
+#define SESSION_LOG_RECORD_CAPACITY \
+    (((SESSION_LOG_RECORD_HEADER_SIZE + SESSION_LOG_MAX_PAYLOAD_SIZE + SESSION_LOG_MAX_PROGRAM_SIZE - 1) / \
+      SESSION_LOG_MAX_PROGRAM_SIZE) * SESSION_LOG_MAX_PROGRAM_SIZE)
+
+/**
+ * @brief What the log wrote and what it cost
+ */
+struct SessionLogStatistics
+{
+    //Samples packed into records, and samples lost because every pending record was taken
+    uint32_t samplesLogged;
+    uint32_t samplesDropped;
+    //Records programmed, and the bytes of their headers and payloads
+    uint32_t recordsWritten;
+    uint64_t recordBytes;
+    //Bytes programmed, padding and sector headers included
+    uint64_t programmedBytes;
+    //Sector erases, erases skipped because the sector was blank, and erases service() had to do mid-session
+    uint32_t erases;
+    uint32_t skippedErases;
+    uint32_t sessionErases;
+    //Storage calls that failed
+    uint32_t storageErrors;
+};
+
+/**
+ * @brief Gets the sessions back from the log, oldest first
+ */
+class SessionLogListener
+{
+public:
+    virtual ~SessionLogListener() {}
+    //startMicroseconds is 0 when the BEGIN record was already overwritten by newer sessions
+    virtual void onSessionStart(uint32_t sessionId, uint64_t startMicroseconds) = 0;
+    virtual void onSample(uint32_t sessionId, const MprlsSample &sample) = 0;
+    //result is 0 when the session was never committed
+    virtual void onSessionEnd(uint32_t sessionId, const BloodPressureResult *result) = 0;
+};
+
+/**
+ * @brief Appends sessions to a SessionStorage. All calls must come from one thread.
+ */
+class SessionLog
+{
+public:
+    SessionLog(SessionStorage &sessionStorage);
+
+    /**
+     * @brief Finds the newest sector and the end of its records. Call once before anything else.
+     * @return 0, or -1 if the storage geometry cannot hold the log, or the error of the storage
+     */
+    int mount();
+
+    /**
+     * @brief Starts a new session and erases the sectors it will need, which can take a while: call it
+     * before sampling starts
+     * @return the id of the new session
+     */
+    uint32_t beginSession(uint64_t startMicroseconds);
+
+    //Packs a sample into the current record, never touches the storage
+    void addSample(const MprlsSample &sample);
+
+    //Seals the last samples and queues the commit marker with the result
+    void endSession(const BloodPressureResult &result);
+
+    /**
+     * @brief Programs one pending record, or erases the next sector if a session outgrew the erased ones
+     * @return true if the storage was written
+     */
+    bool service();
+
+    //Calls service() until nothing is pending
+    void flush();
+
+    /**
+     * @brief Reads back every session in the storage, oldest first. Records still pending are not included.
+     * @return the number of sessions found
+     */
+    int readSessions(SessionLogListener &listener);
+
+    const SessionLogStatistics &getStatistics() const { return statistics; }
+
+    //The session being logged, 0 before the first one
+    uint32_t getSessionId() const { return sessionId; }
+
+    //Number of erase sectors in the ring
+    uint32_t getSectorCount() const { return sectorCount; }
+
+private:
+    //Adds a record to the pending queue; false if the queue is full
+    bool queueRecord(uint8_t type, const uint8_t *payload, size_t length);
+    //Closes the record the samples are packed into and hands it to service()
+    void sealBatch();
+    //Fills in the header (but the CRC, see service()) and padding of the record in a pending slot, returns its padded size
+    uint32_t finishRecord(uint8_t *record, uint8_t type, uint32_t id, size_t payloadLength);
+    //Makes the next sector the current one, erasing it if needed
+    bool openNextSector();
+    //Erases a sector unless it is blank already; eraseCount is set to its new erase count
+    bool prepareSector(uint32_t sector, uint32_t &eraseCount);
+    //True if length bytes from address read as erased
+    bool isBlank(uint64_t address, uint64_t length);
+    //Reads the header of a sector, false if it holds no valid one
+    bool readSectorHeader(uint32_t sector, uint32_t &sequence, uint32_t &eraseCount, uint32_t &firstSessionId);
+    //Reads the record at offset in sector into recordBuffer, returns its padded size or 0 if it is not valid
+    uint32_t readRecord(uint32_t sector, uint32_t offset);
+    //Rounds up to the program size
+    uint32_t padded(uint32_t length) const { return (uint32_t)((length + programSize - 1) / programSize * programSize); }
+
+    SessionStorage &storage;
+    uint64_t programSize;
+    uint64_t eraseSize;
+    uint32_t sectorCount;
+    uint32_t sectorHeaderSize;
+    uint8_t paddingValue;
+
+    //False when the erase value is not known, every sector is then erased before use
+    bool canCheckBlank;
+
+    //The sector records go to, where the next one starts inside it, its sequence number and erase count
+    bool hasCurrentSector;
+    uint32_t currentSector;
+    uint32_t writeOffset;
+    uint32_t sequence;
+    uint32_t currentEraseCount;
+    //Sectors after the current one known to be erased, and the erase counts their headers get
+    uint32_t erasedAheadCount;
+    uint32_t erasedAheadCounts[SESSION_LOG_ERASE_AHEAD_SECTORS];
+
+    uint32_t sessionId;
+    bool isSessionOpen;
+    //Samples in the record being packed, which is built in place in the first free pending slot
+    int batchCount;
+    uint64_t previousSampleMicroseconds;
+
+    //Sealed records waiting for service(), each padded to the program size
+    uint8_t pendingRecords[SESSION_LOG_PENDING_RECORDS][SESSION_LOG_RECORD_CAPACITY];
+    uint32_t pendingLengths[SESSION_LOG_PENDING_RECORDS];
+    int pendingHead;
+    int pendingCount;
+
+    //Scratch space for reading records back
+    uint8_t recordBuffer[SESSION_LOG_RECORD_CAPACITY];
+    SessionLogStatistics statistics;
+};
+
+#endif
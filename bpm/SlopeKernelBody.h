@@ -0,0 +1,170 @@
+/**
+ * @file SlopeKernelBody.h
+ * @brief The kernels of SlopeKernels.h written once against a batch of lanes, included by SlopeKernels.cpp
+ * once per instruction set
+ *
+ * Included inside a namespace that defines Batch, with these static members:
+ *     width, Float, Mask, Index, load(), store(), set(), sub(), mul(), div(), greater(), greaterEqual(),
+ *     less(), notEqual(), both(), select(), indexSet(), laneIndices(), indexAdd(), indexSelect(),
+ *     indexStore(), countIf()
+ * There is deliberately no include guard. Every loop runs whole batches, then finishes the last elements
+ * one by one with the scalar expression of the same operation, so the result never depends on the width.
+ */
+
+static void differences(const float *values, int sampleCount, float *output)
+{
+    int i = 0;
+    for(; i + Batch::width < sampleCount; i += Batch::width)
+        Batch::store(output + i, Batch::sub(Batch::load(values + i + 1), Batch::load(values + i)));
+    for(; i + 1 < sampleCount; i++)
+        output[i] = values[i + 1] - values[i];
+}
+
+//The first entry and the last one keep the initial values of the old table
+static void finishSlopeTable(const float *timeValues, int sampleCount, float *pressureSlope)
+{
+    if(sampleCount <= 0)
+        return;
+    pressureSlope[sampleCount - 1] = 0.0f;
+    if(sampleCount == 1 || timeValues == 0 || timeValues[1] - timeValues[0] == 0.0f)
+        pressureSlope[0] = 1.0f;
+}
+
+static void slopes(const float *timeValues, const float *pressureValues, int sampleCount, float *pressureSlope)
+{
+    const Batch::Float zero = Batch::set(0.0f);
+    int i = 0;
+    for(; i + Batch::width < sampleCount; i += Batch::width)
+    {
+        Batch::Float timeDifference = Batch::sub(Batch::load(timeValues + i + 1), Batch::load(timeValues + i));
+        Batch::Float pressureDifference =
+            Batch::sub(Batch::load(pressureValues + i + 1), Batch::load(pressureValues + i));
+        Batch::store(pressureSlope + i, Batch::select(Batch::notEqual(timeDifference, zero),
+                                                      Batch::div(pressureDifference, timeDifference), zero));
+    }
+    for(; i + 1 < sampleCount; i++)
+    {
+        float timeDifference = timeValues[i + 1] - timeValues[i];
+        pressureSlope[i] = timeDifference != 0.0f ? (pressureValues[i + 1] - pressureValues[i]) / timeDifference : 0.0f;
+    }
+    finishSlopeTable(timeValues, sampleCount, pressureSlope);
+}
+
+static void uniformSlopes(const float *pressureValues, int sampleCount, float reciprocalTimeStep, float *pressureSlope)
+{
+    const Batch::Float reciprocal = Batch::set(reciprocalTimeStep);
+    int i = 0;
+    for(; i + Batch::width < sampleCount; i += Batch::width)
+        Batch::store(pressureSlope + i,
+                     Batch::mul(Batch::sub(Batch::load(pressureValues + i + 1), Batch::load(pressureValues + i)), reciprocal));
+    for(; i + 1 < sampleCount; i++)
+        pressureSlope[i] = (pressureValues[i + 1] - pressureValues[i]) * reciprocalTimeStep;
+    finishSlopeTable(0, sampleCount, pressureSlope);
+}
+
+static int maximumPositiveSlope(const float *pressureSlope, int sampleCount, float &maxSlope)
+{
+    //Every lane keeps its own first maximum; the lanes are merged keeping the lowest index on ties
+    Batch::Float best = Batch::set(0.0f);
+    Batch::Index bestIndex = Batch::indexSet(-1);
+    Batch::Index lane = Batch::laneIndices();
+    const Batch::Index step = Batch::indexSet(Batch::width);
+    int j = 0;
+    for(; j + Batch::width <= sampleCount; j += Batch::width)
+    {
+        Batch::Float slope = Batch::load(pressureSlope + j);
+        Batch::Mask isGreater = Batch::greater(slope, best);
+        best = Batch::select(isGreater, slope, best);
+        bestIndex = Batch::indexSelect(isGreater, lane, bestIndex);
+        lane = Batch::indexAdd(lane, step);
+    }
+
+    float laneBest[Batch::width];
+    int32_t laneIndex[Batch::width];
+    Batch::store(laneBest, best);
+    Batch::indexStore(laneIndex, bestIndex);
+    maxSlope = 0.0f;
+    int index = -1;
+    for(int k = 0; k < Batch::width; k++)
+    {
+        if(laneIndex[k] >= 0 && (laneBest[k] > maxSlope || (laneBest[k] == maxSlope && laneIndex[k] < index)))
+        {
+            maxSlope = laneBest[k];
+            index = laneIndex[k];
+        }
+    }
+    for(; j < sampleCount; j++)
+    {
+        if(pressureSlope[j] > maxSlope)
+        {
+            maxSlope = pressureSlope[j];
+            index = j;
+        }
+    }
+    return index + 1;
+}
+
+static int nearestBelowThreshold(const float *pressureSlope, int begin, int end, float threshold)
+{
+    //The scalar search starts from INT32_MAX as well, so a distance must be below it to count
+    const float noDistance = (float)INT32_MAX;
+    Batch::Float bestDistance = Batch::set(noDistance);
+    Batch::Index bestIndex = Batch::indexSet(-1);
+    Batch::Index lane = Batch::indexAdd(Batch::laneIndices(), Batch::indexSet(begin));
+    const Batch::Index step = Batch::indexSet(Batch::width);
+    const Batch::Float zero = Batch::set(0.0f);
+    const Batch::Float limit = Batch::set(threshold);
+    int k = begin;
+    for(; k + Batch::width <= end; k += Batch::width)
+    {
+        Batch::Float slope = Batch::load(pressureSlope + k);
+        Batch::Float distance = Batch::sub(limit, slope);
+        Batch::Mask isCloser = Batch::both(Batch::both(Batch::greaterEqual(slope, zero), Batch::less(slope, limit)),
+                                           Batch::less(distance, bestDistance));
+        bestDistance = Batch::select(isCloser, distance, bestDistance);
+        bestIndex = Batch::indexSelect(isCloser, lane, bestIndex);
+        lane = Batch::indexAdd(lane, step);
+    }
+
+    float laneDistance[Batch::width];
+    int32_t laneIndex[Batch::width];
+    Batch::store(laneDistance, bestDistance);
+    Batch::indexStore(laneIndex, bestIndex);
+    float minDistance = noDistance;
+    int index = -1;
+    for(int l = 0; l < Batch::width; l++)
+    {
+        if(laneIndex[l] >= 0 && (laneDistance[l] < minDistance || (laneDistance[l] == minDistance && laneIndex[l] < index)))
+        {
+            minDistance = laneDistance[l];
+            index = laneIndex[l];
+        }
+    }
+    for(; k < end; k++)
+    {
+        if(pressureSlope[k] >= 0.0f && pressureSlope[k] < threshold && threshold - pressureSlope[k] < minDistance)
+        {
+            minDistance = threshold - pressureSlope[k];
+            index = k;
+        }
+    }
+    return index;
+}
+
+static int countPositiveSlopes(const float *pressureSlope, int begin, int end)
+{
+    Batch::Index counts = Batch::indexSet(0);
+    const Batch::Float zero = Batch::set(0.0f);
+    int k = begin;
+    for(; k + Batch::width <= end; k += Batch::width)
+        counts = Batch::countIf(counts, Batch::greater(Batch::load(pressureSlope + k), zero));
+
+    int32_t laneCount[Batch::width];
+    Batch::indexStore(laneCount, counts);
+    int count = 0;
+    for(int l = 0; l < Batch::width; l++)
+        count += laneCount[l];
+    for(; k < end; k++)
+        count += pressureSlope[k] > 0.0f;
+    return count;
+}
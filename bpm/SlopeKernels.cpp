@@ -0,0 +1,340 @@
+/**
+ * @file SlopeKernels.cpp
+ * @brief The kernels of SlopeKernels.h for every instruction set, and the choice between them
+ *
+ * Each instruction set wraps its intrinsics in a Batch of lanes and includes SlopeKernelBody.h in its own
+ * namespace. On x86 the SSE2 and AVX2 versions are both compiled in, the AVX2 one for that target only,
+ * and the CPU is asked once which one runs. On Arm the compiler flags decide: AArch64 Advanced SIMD, or
+ * Helium (MVE) with floating point on Armv8.1-M. Armv7 NEON is not used, it flushes denormals to zero
+ * where the scalar code does not, so the slopes could differ. The Cortex-M4 of the board gets the scalar
+ * version only.
+ */
+
+#include "SlopeKernels.h"
+#include "OscillometricStages.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SLOPE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SLOPE_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__ARM_FEATURE_MVE) && (__ARM_FEATURE_MVE & 2)
+#define SLOPE_KERNELS_MVE 1
+#include <arm_mve.h>
+#endif
+
+namespace scalar
+{
+/**
+ * @brief One lane of plain floats
+ */
+struct Batch
+{
+    static const int width = 1;
+    typedef float Float;
+    typedef bool Mask;
+    typedef int32_t Index;
+
+    static Float load(const float *values) { return *values; }
+    static void store(float *values, Float value) { *values = value; }
+    static Float set(float value) { return value; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float div(Float a, Float b) { return a / b; }
+    static Mask greater(Float a, Float b) { return a > b; }
+    static Mask greaterEqual(Float a, Float b) { return a >= b; }
+    static Mask less(Float a, Float b) { return a < b; }
+    static Mask notEqual(Float a, Float b) { return a != b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static Float select(Mask mask, Float a, Float b) { return mask ? a : b; }
+    static Index indexSet(int32_t value) { return value; }
+    static Index laneIndices() { return 0; }
+    static Index indexAdd(Index a, Index b) { return a + b; }
+    static Index indexSelect(Mask mask, Index a, Index b) { return mask ? a : b; }
+    static void indexStore(int32_t *indices, Index index) { *indices = index; }
+    static Index countIf(Index counts, Mask mask) { return counts + (mask ? 1 : 0); }
+};
+#include "SlopeKernelBody.h"
+}
+
+#ifdef SLOPE_KERNELS_X86
+namespace sse2
+{
+/**
+ * @brief Four lanes of SSE2; the masks are all-ones lanes, so a mask subtracted from a count adds 1
+ */
+struct Batch
+{
+    static const int width = 4;
+    typedef __m128 Float;
+    typedef __m128 Mask;
+    typedef __m128i Index;
+
+    static Float load(const float *values) { return _mm_loadu_ps(values); }
+    static void store(float *values, Float value) { _mm_storeu_ps(values, value); }
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Mask greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+    static Mask less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Mask notEqual(Float a, Float b) { return _mm_cmpneq_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static Index indexSet(int32_t value) { return _mm_set1_epi32(value); }
+    static Index laneIndices() { return _mm_setr_epi32(0, 1, 2, 3); }
+    static Index indexAdd(Index a, Index b) { return _mm_add_epi32(a, b); }
+    static Index indexSelect(Mask mask, Index a, Index b)
+    {
+        __m128i integerMask = _mm_castps_si128(mask);
+        return _mm_or_si128(_mm_and_si128(integerMask, a), _mm_andnot_si128(integerMask, b));
+    }
+    static void indexStore(int32_t *indices, Index index) { _mm_storeu_si128((__m128i *)indices, index); }
+    static Index countIf(Index counts, Mask mask) { return _mm_sub_epi32(counts, _mm_castps_si128(mask)); }
+};
+#include "SlopeKernelBody.h"
+}
+
+//Everything up to the pop is compiled for AVX2, whatever the flags of the file
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2
+{
+/**
+ * @brief Eight lanes of AVX2. The comparisons are the ordered ones of SSE, and not-equal the unordered
+ * one, so NaN compares as in C++.
+ */
+struct Batch
+{
+    static const int width = 8;
+    typedef __m256 Float;
+    typedef __m256 Mask;
+    typedef __m256i Index;
+
+    static Float load(const float *values) { return _mm256_loadu_ps(values); }
+    static void store(float *values, Float value) { _mm256_storeu_ps(values, value); }
+    static Float set(float value) { return _mm256_set1_ps(value); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Mask greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask greaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static Mask less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask notEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    static Index indexSet(int32_t value) { return _mm256_set1_epi32(value); }
+    static Index laneIndices() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+    static Index indexAdd(Index a, Index b) { return _mm256_add_epi32(a, b); }
+    static Index indexSelect(Mask mask, Index a, Index b) { return _mm256_blendv_epi8(b, a, _mm256_castps_si256(mask)); }
+    static void indexStore(int32_t *indices, Index index) { _mm256_storeu_si256((__m256i *)indices, index); }
+    static Index countIf(Index counts, Mask mask) { return _mm256_sub_epi32(counts, _mm256_castps_si256(mask)); }
+};
+#include "SlopeKernelBody.h"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+#ifdef SLOPE_KERNELS_NEON
+namespace neon
+{
+/**
+ * @brief Four lanes of AArch64 Advanced SIMD, IEEE compliant like the scalar floating point
+ */
+struct Batch
+{
+    static const int width = 4;
+    typedef float32x4_t Float;
+    typedef uint32x4_t Mask;
+    typedef int32x4_t Index;
+
+    static Float load(const float *values) { return vld1q_f32(values); }
+    static void store(float *values, Float value) { vst1q_f32(values, value); }
+    static Float set(float value) { return vdupq_n_f32(value); }
+    static Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+    static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+    static Float div(Float a, Float b) { return vdivq_f32(a, b); }
+    static Mask greater(Float a, Float b) { return vcgtq_f32(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return vcgeq_f32(a, b); }
+    static Mask less(Float a, Float b) { return vcltq_f32(a, b); }
+    static Mask notEqual(Float a, Float b) { return vmvnq_u32(vceqq_f32(a, b)); }
+    static Mask both(Mask a, Mask b) { return vandq_u32(a, b); }
+    static Float select(Mask mask, Float a, Float b) { return vbslq_f32(mask, a, b); }
+    static Index indexSet(int32_t value) { return vdupq_n_s32(value); }
+    static Index laneIndices()
+    {
+        static const int32_t lanes[4] = { 0, 1, 2, 3 };
+        return vld1q_s32(lanes);
+    }
+    static Index indexAdd(Index a, Index b) { return vaddq_s32(a, b); }
+    static Index indexSelect(Mask mask, Index a, Index b) { return vbslq_s32(mask, a, b); }
+    static void indexStore(int32_t *indices, Index index) { vst1q_s32(indices, index); }
+    static Index countIf(Index counts, Mask mask) { return vsubq_s32(counts, vreinterpretq_s32_u32(mask)); }
+};
+#include "SlopeKernelBody.h"
+}
+#endif
+
+#ifdef SLOPE_KERNELS_MVE
+namespace mve
+{
+/**
+ * @brief Four lanes of Helium. Comparisons give predicates instead of lane masks, and there is no vector
+ * divide, so the slopes are divided lane by lane (the differences and the searches stay vectorised).
+ */
+struct Batch
+{
+    static const int width = 4;
+    typedef float32x4_t Float;
+    typedef mve_pred16_t Mask;
+    typedef int32x4_t Index;
+
+    static Float load(const float *values) { return vld1q_f32(values); }
+    static void store(float *values, Float value) { vst1q_f32(values, value); }
+    static Float set(float value) { return vdupq_n_f32(value); }
+    static Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+    static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+    static Float div(Float a, Float b)
+    {
+        float numerators[4];
+        float denominators[4];
+        vst1q_f32(numerators, a);
+        vst1q_f32(denominators, b);
+        for(int i = 0; i < 4; i++)
+            numerators[i] /= denominators[i];
+        return vld1q_f32(numerators);
+    }
+    static Mask greater(Float a, Float b) { return vcmpgtq_f32(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return vcmpgeq_f32(a, b); }
+    static Mask less(Float a, Float b) { return vcmpltq_f32(a, b); }
+    static Mask notEqual(Float a, Float b) { return vcmpneq_f32(a, b); }
+    static Mask both(Mask a, Mask b) { return (Mask)(a & b); }
+    static Float select(Mask mask, Float a, Float b) { return vpselq_f32(a, b, mask); }
+    static Index indexSet(int32_t value) { return vdupq_n_s32(value); }
+    static Index laneIndices() { return vreinterpretq_s32_u32(vidupq_n_u32(0, 1)); }
+    static Index indexAdd(Index a, Index b) { return vaddq_s32(a, b); }
+    static Index indexSelect(Mask mask, Index a, Index b) { return vpselq_s32(a, b, mask); }
+    static void indexStore(int32_t *indices, Index index) { vst1q_s32(indices, index); }
+    static Index countIf(Index counts, Mask mask) { return vaddq_m_n_s32(counts, counts, 1, mask); }
+};
+#include "SlopeKernelBody.h"
+}
+#endif
+
+//Fills in a table from the functions of one namespace
+#define SLOPE_KERNEL_TABLE(space, isaName, isaValue)                                                           \
+    {                                                                                                          \
+        isaName, isaValue, space::differences, space::slopes, space::uniformSlopes, space::maximumPositiveSlope, \
+            space::nearestBelowThreshold, space::countPositiveSlopes                                           \
+    }
+
+static const SlopeKernels scalarKernels = SLOPE_KERNEL_TABLE(scalar, "scalar", SLOPE_KERNEL_SCALAR);
+#ifdef SLOPE_KERNELS_X86
+static const SlopeKernels sse2Kernels = SLOPE_KERNEL_TABLE(sse2, "SSE2", SLOPE_KERNEL_SSE2);
+static const SlopeKernels avx2Kernels = SLOPE_KERNEL_TABLE(avx2, "AVX2", SLOPE_KERNEL_AVX2);
+#endif
+#ifdef SLOPE_KERNELS_NEON
+static const SlopeKernels neonKernels = SLOPE_KERNEL_TABLE(neon, "NEON", SLOPE_KERNEL_NEON);
+#endif
+#ifdef SLOPE_KERNELS_MVE
+static const SlopeKernels mveKernels = SLOPE_KERNEL_TABLE(mve, "MVE", SLOPE_KERNEL_MVE);
+#endif
+
+const SlopeKernels *getSlopeKernels(SlopeKernelIsa isa)
+{
+    switch(isa)
+    {
+    case SLOPE_KERNEL_SCALAR:
+        return &scalarKernels;
+#ifdef SLOPE_KERNELS_X86
+    case SLOPE_KERNEL_SSE2:
+        return __builtin_cpu_supports("sse2") ? &sse2Kernels : 0;
+    case SLOPE_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2") ? &avx2Kernels : 0;
+#endif
+#ifdef SLOPE_KERNELS_NEON
+    case SLOPE_KERNEL_NEON:
+        return &neonKernels;
+#endif
+#ifdef SLOPE_KERNELS_MVE
+    case SLOPE_KERNEL_MVE:
+        return &mveKernels;
+#endif
+    default:
+        return 0;
+    }
+}
+
+//The widest kernels this CPU runs
+static const SlopeKernels &pickBestKernels()
+{
+    const SlopeKernels *kernels = &scalarKernels;
+    for(int isa = SLOPE_KERNEL_SCALAR + 1; isa < SLOPE_KERNEL_ISA_COUNT; isa++)
+    {
+        const SlopeKernels *candidate = getSlopeKernels((SlopeKernelIsa)isa);
+        if(candidate != 0)
+            kernels = candidate;
+    }
+    return *kernels;
+}
+
+const SlopeKernels &getSlopeKernels()
+{
+    static const SlopeKernels &best = pickBestKernels();
+    return best;
+}
+
+BloodPressureResult estimateBloodPressureVectorized(const PressureSampleSpan &samples, float *slopeBuffer,
+                                                    const SlopeKernels &kernels)
+{
+    const int sampleCount = samples.sampleCount;
+    kernels.slopes(samples.timeValues, samples.pressureValues, sampleCount, slopeBuffer);
+
+    //The thresholds are worked out exactly as in the scalar stages
+    float maxSlope = 0;
+    int maxIndexPositiveSlope = kernels.maximumPositiveSlope(slopeBuffer, sampleCount, maxSlope);
+    float sysSlopeMinThreshold = 0.5 * maxSlope;
+    float diaSlopeMinThreshold = 0.8 * maxSlope;
+    int systolicSlope = kernels.nearestBelowThreshold(slopeBuffer, 0, maxIndexPositiveSlope - 1, sysSlopeMinThreshold);
+    int diastolicSlope = kernels.nearestBelowThreshold(slopeBuffer, maxIndexPositiveSlope + 1, sampleCount,
+                                                       diaSlopeMinThreshold);
+
+    BloodPressureResult result;
+    result.sampleCount = sampleCount;
+    result.maxSlope = maxSlope;
+    result.maxSlopeIndex = maxIndexPositiveSlope;
+    result.systolicIndex = systolicSlope + 1;
+    result.diastolicIndex = diastolicSlope + 1;
+    result.systolicPressure = sampleValueAt(samples.pressureValues, sampleCount, result.systolicIndex);
+    result.diastolicPressure = sampleValueAt(samples.pressureValues, sampleCount, result.diastolicIndex);
+    result.meanArterialPressureSlope = sampleValueAt(samples.pressureValues, sampleCount, maxIndexPositiveSlope);
+    result.systolicTime = sampleValueAt(samples.timeValues, sampleCount, result.systolicIndex);
+    result.diastolicTime = sampleValueAt(samples.timeValues, sampleCount, result.diastolicIndex);
+
+    //The positive slopes from the systolic slope up to the diastolic slope, as countPositiveSlopes() counts them
+    result.positiveSlopeCount = 0;
+    if(result.diastolicIndex != 0 && result.diastolicIndex >= result.systolicIndex)
+    {
+        int begin = result.systolicIndex > 0 ? result.systolicIndex - 1 : 0;
+        result.positiveSlopeCount = kernels.countPositiveSlopes(slopeBuffer, begin, result.diastolicIndex);
+    }
+
+    result.isExact = true;
+    completeBloodPressureResult(result);
+    return result;
+}
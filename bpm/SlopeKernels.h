@@ -0,0 +1,81 @@
+/**
+ * @file SlopeKernels.h
+ * @brief Vectorised kernels for the slope search over long recordings, with the instruction set picked at run time
+ */
+
+#ifndef SLOPE_KERNELS_H
+#define SLOPE_KERNELS_H
+
+#include "BloodPressureKernel.h"
+
+/**
+ * @brief The instruction sets the kernels are built for
+ */
+enum SlopeKernelIsa
+{
+    //Plain C++, always there
+    SLOPE_KERNEL_SCALAR,
+    //x86 SSE2 (4 lanes) and AVX2 (8 lanes), picked at run time
+    SLOPE_KERNEL_SSE2,
+    SLOPE_KERNEL_AVX2,
+    //AArch64 Advanced SIMD (4 lanes)
+    SLOPE_KERNEL_NEON,
+    //Armv8.1-M Helium with floating point (4 lanes); it has no vector divide, so the slopes divide lane by lane
+    SLOPE_KERNEL_MVE,
+    SLOPE_KERNEL_ISA_COUNT
+};
+
+/**
+ * @brief One implementation of every kernel. Each one gives exactly the values and indices of the scalar
+ * stages in OscillometricStages.h: the arithmetic is the same IEEE single precision operation per
+ * element, and the searches keep the first index on ties as the scalar loops do.
+ */
+struct SlopeKernels
+{
+    //Name of the instruction set
+    const char *name;
+    SlopeKernelIsa isa;
+
+    //differences[i] = values[i + 1] - values[i] for i < sampleCount - 1
+    void (*differences)(const float *values, int sampleCount, float *differences);
+
+    //The slope table of calculatePressureSlopes(): a division per slope, the initial value (1.0 for the
+    //first, 0.0 otherwise) where the time difference is 0 and for the last entry
+    void (*slopes)(const float *timeValues, const float *pressureValues, int sampleCount, float *pressureSlope);
+
+    //The slope table of a recording sampled at a fixed rate, without a division: the pressure differences
+    //times the reciprocal of the time step. Not bit-identical to slopes(), only to its own scalar version.
+    void (*uniformSlopes)(const float *pressureValues, int sampleCount, float reciprocalTimeStep, float *pressureSlope);
+
+    //findMaximumPositiveSlope(): the first largest slope above 0; returns its index + 1, 0 if there is none
+    int (*maximumPositiveSlope)(const float *pressureSlope, int sampleCount, float &maxSlope);
+
+    //The first slope from begin to end (excluded) that is at least 0 and below the threshold with the
+    //smallest distance to it, the search of findSystolicPressureIndex()/findDiastolicPressureIndex();
+    //returns its index, -1 if there is none
+    int (*nearestBelowThreshold)(const float *pressureSlope, int begin, int end, float threshold);
+
+    //Number of slopes above 0 from begin to end (excluded)
+    int (*countPositiveSlopes)(const float *pressureSlope, int begin, int end);
+};
+
+/**
+ * @brief The kernels for the widest instruction set this CPU runs, chosen once on the first call (safe from
+ * several threads at once)
+ */
+const SlopeKernels &getSlopeKernels();
+
+/**
+ * @brief The kernels for one instruction set
+ * @return 0 if they were not built in or this CPU does not run them
+ */
+const SlopeKernels *getSlopeKernels(SlopeKernelIsa isa);
+
+/**
+ * @brief estimateBloodPressure() with the kernels: the slope table is written once into slopeBuffer
+ * (sampleCount floats), then searched. Gives the same result, to the bit.
+ */
+BloodPressureResult estimateBloodPressureVectorized(const PressureSampleSpan &samples, float *slopeBuffer,
+                                                    const SlopeKernels &kernels = getSlopeKernels());
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * @file Telemetry.cpp
+ * @brief Compact binary telemetry: the samples of a measurement and its result as CRC checked COBS frames
+ */
+
+#include "Telemetry.h"
+#include "TelemetryCoding.h"
+#include <string.h>
+
+//Floats are sent as their IEEE 754 bits, little endian
+static void storeFloat(float value, uint8_t *output)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    output[0] = (uint8_t)bits;
+    output[1] = (uint8_t)(bits >> 8);
+    output[2] = (uint8_t)(bits >> 16);
+    output[3] = (uint8_t)(bits >> 24);
+}
+
+static float loadFloat(const uint8_t *input)
+{
+    uint32_t bits = (uint32_t)input[0] | ((uint32_t)input[1] << 8) | ((uint32_t)input[2] << 16) | ((uint32_t)input[3] << 24);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void clearStatistics(TelemetryStatistics &statistics)
+{
+    statistics.samples = 0;
+    statistics.frames = 0;
+    statistics.bytes = 0;
+    statistics.corruptFrames = 0;
+    statistics.missedPackets = 0;
+    statistics.skippedPackets = 0;
+}
+
+//::::::::::::::::::::::::::::::::::::::::::Encoder::::::::::::::::::::::::::::::::::::::::::::::
+
+TelemetryEncoder::TelemetryEncoder(TelemetrySink &telemetrySink) : sink(telemetrySink)
+{
+    reset();
+}
+
+void TelemetryEncoder::reset()
+{
+    packetLength = 0;
+    packetSamples = 0;
+    sequence = 0;
+    packetsSinceKeyframe = TELEMETRY_KEYFRAME_INTERVAL;
+    previousSample.status = 0;
+    previousSample.counts = 0;
+    previousSample.timeMicroseconds = 0;
+    previousInterval = 0;
+    clearStatistics(statistics);
+}
+
+void TelemetryEncoder::addSample(const MprlsSample &sample)
+{
+    if(packetSamples == 0)
+    {
+        //A keyframe carries its first sample in full, so a decoder can start (again) from it
+        if(packetsSinceKeyframe >= TELEMETRY_KEYFRAME_INTERVAL)
+        {
+            beginPacket(TELEMETRY_PACKET_KEYFRAME);
+            appendVarint(sample.timeMicroseconds);
+            appendVarint(sample.counts);
+            packet[packetLength++] = sample.status;
+            packetsSinceKeyframe = 0;
+            previousInterval = 0;
+            previousSample = sample;
+            packetSamples = 1;
+            statistics.samples++;
+            return;
+        }
+        beginPacket(TELEMETRY_PACKET_DELTA);
+    }
+
+    int64_t interval = (int64_t)(sample.timeMicroseconds - previousSample.timeMicroseconds);
+    int64_t countsDifference = (int64_t)sample.counts - (int64_t)previousSample.counts;
+    bool isStatusChanged = sample.status != previousSample.status;
+    appendVarint(zigzagEncode(interval - previousInterval));
+    appendVarint((zigzagEncode(countsDifference) << 1) | (isStatusChanged ? 1 : 0));
+    if(isStatusChanged)
+        packet[packetLength++] = sample.status;
+
+    previousInterval = interval;
+    previousSample = sample;
+    packetSamples++;
+    statistics.samples++;
+
+    if(packetSamples >= TELEMETRY_SAMPLES_PER_PACKET)
+        flush();
+}
+
+void TelemetryEncoder::flush()
+{
+    if(packetSamples == 0)
+        return;
+    sendPacket();
+    packetSamples = 0;
+    packetsSinceKeyframe++;
+}
+
+void TelemetryEncoder::sendResult(const BloodPressureResult &result)
+{
+    flush();
+    beginPacket(TELEMETRY_PACKET_RESULT);
+    appendVarint((uint32_t)result.sampleCount);
+    appendVarint((uint32_t)result.maxSlopeIndex);
+    appendVarint((uint32_t)result.systolicIndex);
+    appendVarint((uint32_t)result.diastolicIndex);
+    appendVarint((uint32_t)result.positiveSlopeCount);
+    appendVarint(zigzagEncode(result.heartRate));
+    packet[packetLength++] = result.isExact ? 1 : 0;
+    appendFloat(result.maxSlope);
+    appendFloat(result.systolicPressure);
+    appendFloat(result.diastolicPressure);
+    appendFloat(result.meanArterialPressureSlope);
+    appendFloat(result.meanArterialPressureWeightedAverage);
+    appendFloat(result.pulsePressure);
+    appendFloat(result.systolicTime);
+    appendFloat(result.diastolicTime);
+    appendFloat(result.confidence);
+    sendPacket();
+}
+
+void TelemetryEncoder::beginPacket(uint8_t packetType)
+{
+    packetLength = 0;
+    packet[packetLength++] = packetType;
+    appendVarint(sequence++);
+}
+
+void TelemetryEncoder::sendPacket()
+{
+    uint16_t crc = telemetryCrc16(packet, packetLength);
+    packet[packetLength++] = (uint8_t)(crc >> 8);
+    packet[packetLength++] = (uint8_t)crc;
+
+    size_t frameLength = cobsEncode(packet, packetLength, frame);
+    frame[frameLength++] = 0x00;
+    sink.write(frame, frameLength);
+
+    statistics.frames++;
+    statistics.bytes += frameLength;
+    packetLength = 0;
+}
+
+void TelemetryEncoder::appendVarint(uint64_t value)
+{
+    packetLength += varintEncode(value, packet + packetLength);
+}
+
+void TelemetryEncoder::appendFloat(float value)
+{
+    storeFloat(value, packet + packetLength);
+    packetLength += 4;
+}
+
+//::::::::::::::::::::::::::::::::::::::::::Decoder::::::::::::::::::::::::::::::::::::::::::::::
+
+TelemetryDecoder::TelemetryDecoder(TelemetryListener &telemetryListener) : listener(telemetryListener)
+{
+    reset();
+}
+
+void TelemetryDecoder::reset()
+{
+    frameLength = 0;
+    isFrameOverflowed = false;
+    isSynchronised = false;
+    expectedSequence = 0;
+    hasSequence = false;
+    previousSample.status = 0;
+    previousSample.counts = 0;
+    previousSample.timeMicroseconds = 0;
+    previousInterval = 0;
+    clearStatistics(statistics);
+}
+
+void TelemetryDecoder::feed(const uint8_t *data, size_t length)
+{
+    statistics.bytes += length;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(data[i] != 0x00)
+        {
+            if(frameLength < sizeof(frame))
+                frame[frameLength++] = data[i];
+            else
+                isFrameOverflowed = true;
+            continue;
+        }
+
+        //A delimiter: whatever came before it is one frame
+        if(isFrameOverflowed)
+            statistics.corruptFrames++;
+        else if(frameLength > 0)
+            decodeFrame();
+        frameLength = 0;
+        isFrameOverflowed = false;
+    }
+}
+
+void TelemetryDecoder::decodeFrame()
+{
+    size_t packetLength = cobsDecode(frame, frameLength, frame);
+    if(packetLength < 4 || telemetryCrc16(frame, packetLength - 2) !=
+                           (uint16_t)((frame[packetLength - 2] << 8) | frame[packetLength - 1]))
+    {
+        statistics.corruptFrames++;
+        isSynchronised = false;
+        return;
+    }
+
+    const uint8_t *end = frame + packetLength - 2;
+    const uint8_t *position = frame + 1;
+    uint64_t packetSequence;
+    size_t length = varintDecode(position, end, packetSequence);
+    if(length == 0)
+    {
+        statistics.corruptFrames++;
+        isSynchronised = false;
+        return;
+    }
+    position += length;
+    statistics.frames++;
+
+    //A gap in the sequence numbers means the delta base is lost
+    if(hasSequence && (uint32_t)packetSequence != expectedSequence)
+    {
+        statistics.missedPackets += (uint32_t)packetSequence - expectedSequence;
+        isSynchronised = false;
+    }
+    hasSequence = true;
+    expectedSequence = (uint32_t)packetSequence + 1;
+
+    uint8_t packetType = frame[0];
+    if(packetType == TELEMETRY_PACKET_KEYFRAME)
+    {
+        uint64_t timeMicroseconds;
+        uint64_t counts;
+        size_t timeLength = varintDecode(position, end, timeMicroseconds);
+        size_t countsLength = timeLength ? varintDecode(position + timeLength, end, counts) : 0;
+        if(countsLength == 0 || position + timeLength + countsLength >= end)
+        {
+            statistics.corruptFrames++;
+            isSynchronised = false;
+            return;
+        }
+        position += timeLength + countsLength;
+        previousSample.timeMicroseconds = timeMicroseconds;
+        previousSample.counts = (uint32_t)counts;
+        previousSample.status = *position++;
+        previousInterval = 0;
+        isSynchronised = true;
+        listener.onSample(previousSample);
+        statistics.samples++;
+        if(!decodeDeltaSamples(position, end))
+            isSynchronised = false;
+    }
+    else if(packetType == TELEMETRY_PACKET_DELTA)
+    {
+        if(!isSynchronised)
+        {
+            statistics.skippedPackets++;
+            return;
+        }
+        if(!decodeDeltaSamples(position, end))
+            isSynchronised = false;
+    }
+    else if(packetType == TELEMETRY_PACKET_RESULT)
+    {
+        if(!decodeResult(position, end))
+            statistics.corruptFrames++;
+    }
+}
+
+bool TelemetryDecoder::decodeDeltaSamples(const uint8_t *position, const uint8_t *end)
+{
+    while(position < end)
+    {
+        uint64_t intervalChange;
+        uint64_t countsField;
+        size_t intervalLength = varintDecode(position, end, intervalChange);
+        if(intervalLength == 0)
+            return false;
+        position += intervalLength;
+        size_t countsLength = varintDecode(position, end, countsField);
+        if(countsLength == 0)
+            return false;
+        position += countsLength;
+
+        MprlsSample sample;
+        sample.status = previousSample.status;
+        if(countsField & 1)
+        {
+            if(position >= end)
+                return false;
+            sample.status = *position++;
+        }
+        previousInterval += zigzagDecode(intervalChange);
+        sample.timeMicroseconds = previousSample.timeMicroseconds + (uint64_t)previousInterval;
+        sample.counts = (uint32_t)((int64_t)previousSample.counts + zigzagDecode(countsField >> 1));
+
+        previousSample = sample;
+        listener.onSample(sample);
+        statistics.samples++;
+    }
+    return true;
+}
+
+bool TelemetryDecoder::decodeResult(const uint8_t *position, const uint8_t *end)
+{
+    uint64_t fields[6];
+    for(int i = 0; i < 6; i++)
+    {
+        size_t length = varintDecode(position, end, fields[i]);
+        if(length == 0)
+            return false;
+        position += length;
+    }
+    if(end - position != 1 + 9 * 4)
+        return false;
+
+    BloodPressureResult result;
+    result.sampleCount = (int)fields[0];
+    result.maxSlopeIndex = (int)fields[1];
+    result.systolicIndex = (int)fields[2];
+    result.diastolicIndex = (int)fields[3];
+    result.positiveSlopeCount = (int)fields[4];
+    result.heartRate = (int)zigzagDecode(fields[5]);
+    result.isExact = *position++ != 0;
+    result.maxSlope = loadFloat(position);
+    result.systolicPressure = loadFloat(position + 4);
+    result.diastolicPressure = loadFloat(position + 8);
+    result.meanArterialPressureSlope = loadFloat(position + 12);
+    result.meanArterialPressureWeightedAverage = loadFloat(position + 16);
+    result.pulsePressure = loadFloat(position + 20);
+    result.systolicTime = loadFloat(position + 24);
+    result.diastolicTime = loadFloat(position + 28);
+    result.confidence = loadFloat(position + 32);
+    listener.onResult(result);
+    return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file Telemetry.h
+ * @brief Compact binary telemetry: the samples of a measurement and its result as CRC checked COBS frames
+ *
+ * Every frame is one packet, COBS encoded and followed by a 0x00 byte:
+ *     type (1 byte) | sequence (varint) | body | CRC-16/CCITT-FALSE of everything before it (2 bytes, big endian)
+ * Packet types:
+ *     TELEMETRY_PACKET_KEYFRAME  first sample in full: time in us (varint), counts (varint), status (1 byte),
+ *                                then delta samples
+ *     TELEMETRY_PACKET_DELTA     delta samples only, continuing from the last sample of the previous packet
+ *     TELEMETRY_PACKET_RESULT    the BloodPressureResult of the measurement
+ * A delta sample is
+ *     varint zigzag(interval - previous interval) | varint (zigzag(counts - previous counts) << 1 | status changed) [| status]
+ * so a sensor read at a steady rate costs about 3 to 4 bytes per sample instead of a ~60 byte text line.
+ * A decoder that missed a packet waits for the next keyframe before it trusts the deltas again.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal/MeasurementHardware.h"
+#include "MprlsAcquisition.h"
+#include "BloodPressureResult.h"
+
+#define TELEMETRY_PACKET_KEYFRAME 0x01
+#define TELEMETRY_PACKET_DELTA 0x02
+#define TELEMETRY_PACKET_RESULT 0x03
+
+//Samples sent together in one packet
+#ifndef TELEMETRY_SAMPLES_PER_PACKET
+#define TELEMETRY_SAMPLES_PER_PACKET 16
+#endif
+
+//Every this many sample packets one is a keyframe
+#ifndef TELEMETRY_KEYFRAME_INTERVAL
+#define TELEMETRY_KEYFRAME_INTERVAL 4
+#endif
+
+//Largest packet before framing: header, a full first sample, the longest possible deltas and the CRC
+#define TELEMETRY_MAX_PACKET_SIZE (1 + 5 + 16 + 16 * TELEMETRY_SAMPLES_PER_PACKET + 2)
+//Largest frame: the COBS overhead and the 0x00 delimiter on top
+#define TELEMETRY_MAX_FRAME_SIZE (TELEMETRY_MAX_PACKET_SIZE + TELEMETRY_MAX_PACKET_SIZE / 254 + 2)
+
+/**
+ * @brief Counters kept by the encoder and the decoder
+ */
+struct TelemetryStatistics
+{
+    //Samples encoded or decoded
+    uint32_t samples;
+    //Frames sent or decoded correctly
+    uint32_t frames;
+    //Bytes sent or received, delimiters included
+    uint32_t bytes;
+    //Decoder only: frames with a bad COBS encoding, length or CRC
+    uint32_t corruptFrames;
+    //Decoder only: packets that were missed, found from the sequence numbers
+    uint32_t missedPackets;
+    //Decoder only: delta packets thrown away while waiting for a keyframe
+    uint32_t skippedPackets;
+};
+
+/**
+ * @brief Turns samples and results into frames and writes them to a TelemetrySink.
+ * Samples are collected until TELEMETRY_SAMPLES_PER_PACKET are waiting, so the sink is written about
+ * once every 16 samples; call flush() at the end of a measurement.
+ */
+class TelemetryEncoder
+{
+public:
+    TelemetryEncoder(TelemetrySink &telemetrySink);
+
+    //Start a new stream: the next packet is a keyframe and the counters are cleared
+    void reset();
+    //Queue one sample, sends a packet when it is full
+    void addSample(const MprlsSample &sample);
+    //Send the samples waiting in the current packet
+    void flush();
+    //Send the waiting samples, then the result
+    void sendResult(const BloodPressureResult &result);
+
+    const TelemetryStatistics &getStatistics() const { return statistics; }
+
+private:
+    //Starts a packet of the given type in packet[]
+    void beginPacket(uint8_t packetType);
+    //Adds the CRC, frames the packet and writes it to the sink
+    void sendPacket();
+    void appendVarint(uint64_t value);
+    void appendFloat(float value);
+
+    //Where the frames go
+    TelemetrySink &sink;
+    //The packet being filled and the frame it is encoded into
+    uint8_t packet[TELEMETRY_MAX_PACKET_SIZE];
+    size_t packetLength;
+    uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+    //Samples in the current packet
+    int packetSamples;
+    //Sequence number of the next packet
+    uint32_t sequence;
+    //Sample packets sent since the last keyframe
+    uint32_t packetsSinceKeyframe;
+    //The last sample encoded and the interval before it, the base of the next delta
+    MprlsSample previousSample;
+    int64_t previousInterval;
+    //Counters
+    TelemetryStatistics statistics;
+};
+
+/**
+ * @brief Receives what a TelemetryDecoder finds in the stream
+ */
+class TelemetryListener
+{
+public:
+    virtual ~TelemetryListener() {}
+    virtual void onSample(const MprlsSample &sample) = 0;
+    virtual void onResult(const BloodPressureResult &result) = 0;
+};
+
+/**
+ * @brief Splits a byte stream into frames, checks them and hands the samples and results to a listener.
+ * Bytes can be fed in pieces of any size; anything between frames that is not a valid frame (console
+ * text, line noise) is counted as a corrupt frame and skipped.
+ */
+class TelemetryDecoder
+{
+public:
+    TelemetryDecoder(TelemetryListener &telemetryListener);
+
+    //Forget the stream so far
+    void reset();
+    //Feed received bytes
+    void feed(const uint8_t *data, size_t length);
+
+    const TelemetryStatistics &getStatistics() const { return statistics; }
+
+private:
+    //Decodes the frame in frame[]
+    void decodeFrame();
+    //Reads the delta samples from position to end, returns false if the packet is malformed
+    bool decodeDeltaSamples(const uint8_t *position, const uint8_t *end);
+    bool decodeResult(const uint8_t *position, const uint8_t *end);
+
+    //Who gets the samples and results
+    TelemetryListener &listener;
+    //The frame being received
+    uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+    size_t frameLength;
+    //Set when a frame grew too long, the bytes up to the next delimiter are dropped
+    bool isFrameOverflowed;
+    //Whether the delta base is valid (a keyframe was received and nothing was missed since)
+    bool isSynchronised;
+    //Sequence number expected next
+    uint32_t expectedSequence;
+    bool hasSequence;
+    //The delta base
+    MprlsSample previousSample;
+    int64_t previousInterval;
+    //Counters
+    TelemetryStatistics statistics;
+};
+
+#endif
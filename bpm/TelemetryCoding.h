@@ -0,0 +1,124 @@
+/**
+ * @file TelemetryCoding.h
+ * @brief The byte level pieces of the binary telemetry: zigzag and varint numbers, CRC-16 and COBS framing
+ */
+
+#ifndef TELEMETRY_CODING_H
+#define TELEMETRY_CODING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Maps signed values to unsigned ones so small magnitudes stay small: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+ */
+inline uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * @brief Writes value 7 bits at a time, lowest first, with the top bit set on every byte but the last
+ * @return the number of bytes written (at most 10)
+ */
+inline size_t varintEncode(uint64_t value, uint8_t *output)
+{
+    size_t length = 0;
+    while(value >= 0x80)
+    {
+        output[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    output[length++] = (uint8_t)value;
+    return length;
+}
+
+/**
+ * @brief Reads a varint from [input, end)
+ * @return the number of bytes read, 0 if the input ended first or the number is longer than 10 bytes
+ */
+inline size_t varintDecode(const uint8_t *input, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for(size_t length = 0; length < 10 && input + length < end; length++)
+    {
+        value |= (uint64_t)(input[length] & 0x7F) << (7 * length);
+        if((input[length] & 0x80) == 0)
+            return length + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), nibble table
+ */
+inline uint16_t telemetryCrc16(const uint8_t *data, size_t length)
+{
+    static const uint16_t nibbleTable[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < length; i++)
+    {
+        crc = (uint16_t)((crc << 4) ^ nibbleTable[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ nibbleTable[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+/**
+ * @brief Consistent overhead byte stuffing: removes every 0x00 from the data, so 0x00 can end a frame.
+ * The output needs length + length / 254 + 1 bytes at most.
+ * @return the number of bytes written
+ */
+inline size_t cobsEncode(const uint8_t *input, size_t length, uint8_t *output)
+{
+    size_t codeIndex = 0;
+    size_t outputLength = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(input[i] != 0)
+        {
+            output[outputLength++] = input[i];
+            code++;
+        }
+        if(input[i] == 0 || code == 0xFF)
+        {
+            output[codeIndex] = code;
+            codeIndex = outputLength++;
+            code = 1;
+        }
+    }
+    output[codeIndex] = code;
+    return outputLength;
+}
+
+/**
+ * @brief Undoes cobsEncode(); output may be the same buffer as input
+ * @return the number of bytes written, 0 if the input is not valid COBS
+ */
+inline size_t cobsDecode(const uint8_t *input, size_t length, uint8_t *output)
+{
+    size_t inputIndex = 0;
+    size_t outputLength = 0;
+    while(inputIndex < length)
+    {
+        uint8_t code = input[inputIndex++];
+        if(code == 0 || inputIndex + code - 1 > length)
+            return 0;
+        for(uint8_t i = 1; i < code; i++)
+            output[outputLength++] = input[inputIndex++];
+        if(code != 0xFF && inputIndex < length)
+            output[outputLength++] = 0;
+    }
+    return outputLength;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file MbedAcquisitionChannelThread.h
+ * @brief Services one acquisition channel from its own mbed-os thread
+ */
+
+#ifndef MBED_ACQUISITION_CHANNEL_THREAD_H
+#define MBED_ACQUISITION_CHANNEL_THREAD_H
+
+#include "mbed.h"
+#include <atomic>
+#include "MeasurementHardware.h"
+#include "MbedSamplingTimer.h"
+#include "bpm/AcquisitionChannel.h"
+
+//Stack of every channel thread in bytes
+#ifndef ACQUISITION_CHANNEL_THREAD_STACK_SIZE
+#define ACQUISITION_CHANNEL_THREAD_STACK_SIZE 1024
+#endif
+
+//Time between two polls of a sensor that is still busy after its conversion time
+#ifndef ACQUISITION_CHANNEL_POLL_INTERVAL_US
+#define ACQUISITION_CHANNEL_POLL_INTERVAL_US 100
+#endif
+
+/**
+ * @brief Gives a channel a thread of its own, so a slow or stuck bus only delays its own samples.
+ *
+ * The thread sleeps on its own MbedSamplingTimer until the conversion of its sensor is due (the RTOS runs
+ * the other channels, or the idle thread, in the meantime) and only polls again after
+ * ACQUISITION_CHANNEL_POLL_INTERVAL_US if the sensor is still busy then. All threads take their
+ * timestamps from the same clock. Sensors on the same I2C object are safe, the mbed I2C class
+ * locks the bus for every transfer.
+ */
+class MbedAcquisitionChannelThread
+{
+public:
+    MbedAcquisitionChannelThread(AcquisitionChannel &acquisitionChannel, MeasurementClock &sharedClock,
+                                 osPriority priority = osPriorityAboveNormal)
+        : channel(acquisitionChannel), clock(sharedClock), samplingTimer(sharedClock),
+          thread(priority, ACQUISITION_CHANNEL_THREAD_STACK_SIZE), isStopRequested(false)
+    {
+    }
+
+    //Start servicing the channel
+    void start()
+    {
+        isStopRequested.store(false);
+        thread.start(callback(this, &MbedAcquisitionChannelThread::serviceLoop));
+    }
+
+    //Ask the thread to finish and wait for it; the samples of the channel can be read afterwards
+    void stop()
+    {
+        isStopRequested.store(true);
+        thread.join();
+    }
+
+private:
+    void serviceLoop()
+    {
+        while(!isStopRequested.load())
+        {
+            if(channel.service(clock.nowMicroseconds()))
+                continue;
+
+            //Sleep through the conversion; nothing to wait for means the sensor is still busy past it
+            uint64_t nowMicroseconds = clock.nowMicroseconds();
+            uint64_t nextServiceMicroseconds = channel.getNextServiceMicroseconds();
+            if(nextServiceMicroseconds <= nowMicroseconds)
+                nextServiceMicroseconds = nowMicroseconds + ACQUISITION_CHANNEL_POLL_INTERVAL_US;
+            samplingTimer.sleepUntil(nextServiceMicroseconds);
+        }
+    }
+
+    //The channel serviced by this thread
+    AcquisitionChannel &channel;
+    //The clock shared by all channels
+    MeasurementClock &clock;
+    //Wakes the thread when the sensor is due
+    MbedSamplingTimer samplingTimer;
+    //The thread itself
+    Thread thread;
+    //Set by stop()
+    std::atomic<bool> isStopRequested;
+};
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file MbedMeasurementHardware.h
+ * @brief The measurement hardware interfaces implemented with mbed-os drivers
+ */
+
+#ifndef MBED_MEASUREMENT_HARDWARE_H
+#define MBED_MEASUREMENT_HARDWARE_H
+
+#include "mbed.h"
+#include "MeasurementHardware.h"
+
+/**
+ * @brief The Honeywell sensor on an mbed I2C object
+ */
+class MbedPressureSensorBus : public PressureSensorBus
+{
+public:
+    MbedPressureSensorBus(I2C &i2cBus) : i2c(i2cBus) {}
+
+    virtual int write(int address, const char *data, int length, bool repeated = false)
+    {
+        return i2c.write(address, data, length, repeated);
+    }
+
+    virtual int read(int address, char *data, int length, bool repeated = false)
+    {
+        return i2c.read(address, data, length, repeated);
+    }
+
+private:
+    I2C &i2c;
+};
+
+/**
+ * @brief An mbed Timer for the time and wait_us() for delays. A LowPowerTimer works as well and does not
+ * keep the board out of deep sleep, at the resolution of the low power ticker.
+ */
+class MbedMeasurementClock : public MeasurementClock
+{
+public:
+    MbedMeasurementClock(TimerBase &measurementTimer) : timer(measurementTimer) {}
+
+    virtual uint64_t nowMicroseconds()
+    {
+        return timer.elapsed_time().count();
+    }
+
+    virtual void delayMicroseconds(uint32_t microseconds)
+    {
+        wait_us(microseconds);
+    }
+
+private:
+    TimerBase &timer;
+};
+
+#endif
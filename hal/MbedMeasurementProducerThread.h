@@ -0,0 +1,104 @@
+/**
+ * @file MbedMeasurementProducerThread.h
+ * @brief Runs the sampling side of a blood pressure measurement in its own mbed-os thread
+ */
+
+#ifndef MBED_MEASUREMENT_PRODUCER_THREAD_H
+#define MBED_MEASUREMENT_PRODUCER_THREAD_H
+
+#include "mbed.h"
+#include "MeasurementHardware.h"
+#include "bpm/BloodPressureMeasurement.h"
+#include "bpm/SamplingScheduler.h"
+
+//Stack of the sampling thread in bytes
+#ifndef MEASUREMENT_PRODUCER_THREAD_STACK_SIZE
+#define MEASUREMENT_PRODUCER_THREAD_STACK_SIZE 1024
+#endif
+
+/**
+ * @brief Calls produce() of a measurement from a thread that runs above the console.
+ *
+ * The thread sleeps on the SamplingScheduler until the conversion of the sensor is due, polls it, queues
+ * the sample, wakes the processing side and goes back to sleep, so its cost per sample is one or two short
+ * I2C transfers and never depends on the printing done by consume() in the lower priority thread. It
+ * stops by itself once the measurement is finished.
+ * The thread is created by the first start() and then waits for the next one, so repeated measurements
+ * reuse its stack.
+ */
+class MbedMeasurementProducerThread
+{
+public:
+    MbedMeasurementProducerThread(BloodPressureMeasurement &bloodPressureMeasurement, SamplingScheduler &samplingScheduler,
+                                  osPriority priority = osPriorityHigh)
+        : measurement(bloodPressureMeasurement), scheduler(samplingScheduler),
+          thread(priority, MEASUREMENT_PRODUCER_THREAD_STACK_SIZE), isStarted(false), startSignal(0), finishedSignal(0),
+          samplesSignal(0, 1)
+    {
+    }
+
+    //Start sampling
+    void start()
+    {
+        if(!isStarted)
+        {
+            thread.start(callback(this, &MbedMeasurementProducerThread::produceLoop));
+            isStarted = true;
+        }
+        startSignal.release();
+    }
+
+    //Wait for the thread to notice the measurement is finished
+    void join()
+    {
+        finishedSignal.acquire();
+    }
+
+    //Sleep until the thread queued another sample; for the processing side, once it has nothing left to do
+    void waitForSamples()
+    {
+        samplesSignal.acquire();
+    }
+
+private:
+    void produceLoop()
+    {
+        while(true)
+        {
+            startSignal.acquire();
+            produceUntilFinished();
+            finishedSignal.release();
+        }
+    }
+
+    void produceUntilFinished()
+    {
+        scheduler.start();
+        while(!measurement.isFinished())
+        {
+            uint32_t samples = scheduler.getStatistics().samples;
+            uint64_t nextWakeMicroseconds = scheduler.produceDue();
+            if(scheduler.getStatistics().samples != samples)
+                samplesSignal.release();
+
+            //Sleep through the conversion, or until the next sample period starts
+            scheduler.sleepUntil(nextWakeMicroseconds);
+        }
+        scheduler.stop();
+    }
+
+    //The measurement being sampled
+    BloodPressureMeasurement &measurement;
+    //Wakes the thread when the sensor has something to give, and keeps the duty cycle
+    SamplingScheduler &scheduler;
+    //The sampling thread, created by the first start()
+    Thread thread;
+    bool isStarted;
+    //Released by start() for every measurement, and by the thread when the measurement is finished
+    Semaphore startSignal;
+    Semaphore finishedSignal;
+    //Released whenever samples were queued, at most one release is kept
+    Semaphore samplesSignal;
+};
+
+#endif
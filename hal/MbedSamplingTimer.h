@@ -0,0 +1,60 @@
+/**
+ * @file MbedSamplingTimer.h
+ * @brief The sleep between samples on the mbed low power ticker
+ */
+
+#ifndef MBED_SAMPLING_TIMER_H
+#define MBED_SAMPLING_TIMER_H
+
+#include "mbed.h"
+#include "MeasurementHardware.h"
+
+//The timer fires this long before the sample is due, to cover the wake up from deep sleep and the ticker resolution
+#ifndef SAMPLING_TIMER_WAKEUP_LEAD_US
+#define SAMPLING_TIMER_WAKEUP_LEAD_US 100
+#endif
+
+//Shorter sleeps are waited out with wait_us(), they are not worth the wake up
+#ifndef SAMPLING_TIMER_MIN_SLEEP_US
+#define SAMPLING_TIMER_MIN_SLEEP_US 300
+#endif
+
+/**
+ * @brief Blocks the calling thread on a semaphore released by a LowPowerTimeout, so the RTOS idle thread
+ * sleeps until the sample is due. The low power ticker does not hold the deep sleep lock; deep sleep is
+ * only entered when nothing else holds it, the Timer of the measurement clock included (use a
+ * LowPowerTimer there). The timeout fires SAMPLING_TIMER_WAKEUP_LEAD_US early and the rest is waited out,
+ * so the wake up lands on time whatever the sleep mode.
+ */
+class MbedSamplingTimer : public SamplingTimer
+{
+public:
+    MbedSamplingTimer(MeasurementClock &measurementClock) : clock(measurementClock), wakeSignal(0, 1) {}
+
+    virtual void sleepUntil(uint64_t wakeMicroseconds)
+    {
+        uint64_t nowMicroseconds = clock.nowMicroseconds();
+        if(wakeMicroseconds > nowMicroseconds + SAMPLING_TIMER_MIN_SLEEP_US)
+        {
+            timeout.attach(callback(this, &MbedSamplingTimer::onTimeout),
+                           std::chrono::microseconds(wakeMicroseconds - nowMicroseconds - SAMPLING_TIMER_WAKEUP_LEAD_US));
+            wakeSignal.acquire();
+            nowMicroseconds = clock.nowMicroseconds();
+        }
+        if(wakeMicroseconds > nowMicroseconds)
+            wait_us((int)(wakeMicroseconds - nowMicroseconds));
+    }
+
+private:
+    //Called from the ticker interrupt
+    void onTimeout() { wakeSignal.release(); }
+
+    //The time base the wake up times are given in
+    MeasurementClock &clock;
+    //Fires shortly before the wake up time
+    LowPowerTimeout timeout;
+    //Released by the timeout, the sleeping thread waits on it
+    Semaphore wakeSignal;
+};
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file MbedSessionStorage.h
+ * @brief Keeps the session log on an mbed BlockDevice, by default the one the target configures
+ */
+
+#ifndef MBED_SESSION_STORAGE_H
+#define MBED_SESSION_STORAGE_H
+
+#include "mbed.h"
+#include "BlockDevice.h"
+#include "MeasurementHardware.h"
+
+/**
+ * @brief Passes every call to the BlockDevice. The device is initialised by init() and left initialised.
+ * The read size of the device must not be larger than its program size, which holds for flash parts.
+ */
+class MbedSessionStorage : public SessionStorage
+{
+public:
+    MbedSessionStorage(mbed::BlockDevice *blockDevice = mbed::BlockDevice::get_default_instance()) : device(blockDevice) {}
+
+    //0 on success, like BlockDevice::init()
+    int init() { return device != 0 ? device->init() : -1; }
+
+    virtual int read(void *buffer, uint64_t address, uint64_t size) { return device->read(buffer, address, size); }
+    virtual int program(const void *buffer, uint64_t address, uint64_t size) { return device->program(buffer, address, size); }
+    virtual int erase(uint64_t address, uint64_t size) { return device->erase(address, size); }
+    virtual uint64_t getProgramSize() const { return device->get_program_size(); }
+    virtual uint64_t getEraseSize() const { return device->get_erase_size(); }
+    virtual uint64_t getSize() const { return device->size(); }
+    virtual int getEraseValue() const { return device->get_erase_value(); }
+
+private:
+    mbed::BlockDevice *device;
+};
+
+#endif
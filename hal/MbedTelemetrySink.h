@@ -0,0 +1,36 @@
+/**
+ * @file MbedTelemetrySink.h
+ * @brief Writes the binary telemetry to the console serial port of the board
+ */
+
+#ifndef MBED_TELEMETRY_SINK_H
+#define MBED_TELEMETRY_SINK_H
+
+#include "mbed.h"
+#include "stdio.h"
+#include "MeasurementHardware.h"
+
+/**
+ * @brief The frames go straight to the file handle behind stdout, so mbed's newline conversion
+ * (platform.stdio-convert-newlines) never touches the binary data
+ */
+class MbedTelemetrySink : public TelemetrySink
+{
+public:
+    MbedTelemetrySink() : console(0) {}
+
+    virtual void write(const uint8_t *data, size_t length)
+    {
+        //The console is only looked up once the C library has set it up
+        if(console == 0)
+            console = mbed_file_handle(STDOUT_FILENO);
+        //Keep the order with any text printed before
+        fflush(stdout);
+        console->write(data, length);
+    }
+
+private:
+    FileHandle *console;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file MeasurementHardware.h
+ * @brief The thin interfaces the measurement code uses to reach the sensor, the clock, delays, the sleep between
+ * samples, the telemetry output and the storage of the session log
+ */
+
+#ifndef MEASUREMENT_HARDWARE_H
+#define MEASUREMENT_HARDWARE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief An I2C bus with a pressure sensor on it. The methods have the same meaning as the ones of the
+ * mbed I2C class: the address is the 8-bit address and 0 is returned when the transfer was acknowledged.
+ */
+class PressureSensorBus
+{
+public:
+    virtual ~PressureSensorBus() {}
+    virtual int write(int address, const char *data, int length, bool repeated = false) = 0;
+    virtual int read(int address, char *data, int length, bool repeated = false) = 0;
+};
+
+/**
+ * @brief The time base of a measurement
+ */
+class MeasurementClock
+{
+public:
+    virtual ~MeasurementClock() {}
+    //Microseconds since the clock was started
+    virtual uint64_t nowMicroseconds() = 0;
+    //Waits the given number of microseconds
+    virtual void delayMicroseconds(uint32_t microseconds) = 0;
+};
+
+/**
+ * @brief Puts the sampling to sleep until the next sample is due, on a hardware timer rather than a busy
+ * wait, so the CPU can sleep (deep sleep where the timer allows it) in between
+ */
+class SamplingTimer
+{
+public:
+    virtual ~SamplingTimer() {}
+    //Returns once the measurement clock reached wakeMicroseconds (right away if it already has)
+    virtual void sleepUntil(uint64_t wakeMicroseconds) = 0;
+};
+
+/**
+ * @brief Where the binary telemetry goes, usually the serial port the console is on
+ */
+class TelemetrySink
+{
+public:
+    virtual ~TelemetrySink() {}
+    //Writes length bytes as they are, without any newline conversion
+    virtual void write(const uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * @brief Flash the session log is kept on. The methods have the same meaning as the ones of the mbed
+ * BlockDevice class: 0 is returned on success, program() can only be given erased bytes, and addresses
+ * and sizes are multiples of the program size (read() and program()) or of the erase size (erase()).
+ */
+class SessionStorage
+{
+public:
+    virtual ~SessionStorage() {}
+    virtual int read(void *buffer, uint64_t address, uint64_t size) = 0;
+    virtual int program(const void *buffer, uint64_t address, uint64_t size) = 0;
+    virtual int erase(uint64_t address, uint64_t size) = 0;
+    //Smallest unit that can be programmed, and erased
+    virtual uint64_t getProgramSize() const = 0;
+    virtual uint64_t getEraseSize() const = 0;
+    //Total size in bytes
+    virtual uint64_t getSize() const = 0;
+    //The value every byte reads as after an erase, -1 if it is not known
+    virtual int getEraseValue() const = 0;
+};
+
+#endif
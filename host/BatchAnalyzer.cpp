@@ -0,0 +1,319 @@
+/**
+ * @file BatchAnalyzer.cpp
+ * @brief Runs the blood pressure estimation over many recorded sessions on all cores
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -pthread -I. host/BatchAnalyzer.cpp bpm/BloodPressureKernel.cpp bpm/SlopeKernels.cpp \
+ *         bpm/OscillometricStages.cpp bpm/Telemetry.cpp -o batch_analyzer
+ *     ./batch_analyzer [--threads N] [--scaling] [--output results.tsv] [--list paths.txt] [--synthetic N]
+ *                      [session archives, files or folders ...]
+ *
+ * Sessions come from session archives (*.bpa, host/SessionArchive.h, every session of it is mapped and
+ * read in place) or from single session files (host/SessionFiles.h): telemetry captures (*.bin), the CSV
+ * written by TelemetryDecode or "time in seconds, pressure in mmHg" CSV. Folders are read one level deep,
+ * --list names one file per line, and --synthetic adds N simulated deflations with varying blood
+ * pressures, heart rates and deflation rates.
+ *
+ * Every session goes through the same phases as the firmware (pumping above 150 mmHg, deflation down to
+ * 30 mmHg) and the deflation through estimateBloodPressureVectorized(), the slope search of main.cpp on the
+ * widest SIMD kernels of this CPU (bpm/SlopeKernels.h), to the bit the result of estimateBloodPressure().
+ * The sessions are spread over the threads by a WorkStealingPool and every result lands in its own row, so
+ * the table is the same whatever the thread count. One tab separated row per session goes to stdout (or
+ * --output), in input order; sessions/sec goes to stderr. --scaling runs the whole batch
+ * with 1, 2, 4 ... up to the thread count, prints the speedup and checks every table is identical.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bpm/BloodPressureKernel.h"
+#include "bpm/SlopeKernels.h"
+#include "bpm/MprlsTransferFunction.h"
+#include "host/SessionArchive.h"
+#include "host/SessionFiles.h"
+#include "host/WorkStealingPool.h"
+
+//Where a session comes from: a session of a mapped archive, a file, or a synthetic deflation when both are empty
+struct BatchSource
+{
+    std::string path;
+    int syntheticIndex;
+    const SessionArchiveReader *archive;
+    uint64_t archiveSession;
+};
+
+//What one session gave
+struct BatchRow
+{
+    //False if the file could not be read
+    bool isRead;
+    //Samples in the session and in the deflation from 150 mmHg to 30 mmHg
+    int recordedSamples;
+    int deflationSamples;
+    //Time from the first to the last deflation sample, in seconds
+    float deflationSeconds;
+    BloodPressureResult result;
+};
+
+/**
+ * @brief Keeps the samples the firmware analyses: once the pressure went above 150 mmHg, every sample from
+ * the one after it fell below 151 mmHg up to the first one below 30 mmHg (see BloodPressureMeasurement)
+ */
+class DeflationSelector
+{
+public:
+    DeflationSelector(std::vector<float> &deflationTimes, std::vector<float> &deflationPressures)
+        : timeValues(deflationTimes), pressureValues(deflationPressures), isPressureIncreasing(true),
+          isPressureDecreasing(false)
+    {
+        timeValues.clear();
+        pressureValues.clear();
+    }
+
+    //Takes the next sample, returns false once the deflation is over
+    bool add(float timeMilliseconds, uint32_t counts)
+    {
+        float pressure = MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(counts);
+        if(isPressureDecreasing)
+        {
+            timeValues.push_back(timeMilliseconds);
+            pressureValues.push_back(pressure);
+        }
+        if(pressure > 150)
+            isPressureIncreasing = false;
+        if(pressure < 151 && !isPressureIncreasing)
+            isPressureDecreasing = true;
+        return !(pressure < 30 && isPressureDecreasing);
+    }
+
+private:
+    std::vector<float> &timeValues;
+    std::vector<float> &pressureValues;
+    bool isPressureIncreasing;
+    bool isPressureDecreasing;
+};
+
+static BatchRow analyseSession(const BatchSource &source)
+{
+    //Every thread reuses its buffers, so a batch of many sessions does not hammer the allocator
+    thread_local std::vector<MprlsSample> samples;
+    thread_local std::vector<float> timeValues;
+    thread_local std::vector<float> pressureValues;
+    thread_local std::vector<float> slopeValues;
+    DeflationSelector deflation(timeValues, pressureValues);
+
+    BatchRow row;
+    memset(&row, 0, sizeof(row));
+    if(source.archive != 0)
+    {
+        //The columns are read straight from the mapping
+        SessionView view;
+        row.isRead = source.archive->getSession(source.archiveSession, view);
+        if(!row.isRead)
+            return row;
+        row.recordedSamples = (int)view.sampleCount;
+        for(uint32_t i = 0; i < view.sampleCount; i++)
+        {
+            if(!deflation.add(view.timeMicroseconds[i] / 1000.0f, view.counts[i]))
+                break;
+        }
+    }
+    else
+    {
+        samples.clear();
+        if(source.path.empty())
+        {
+            makeSyntheticSession(source.syntheticIndex, samples);
+            row.isRead = true;
+        }
+        else
+        {
+            row.isRead = readSessionFile(source.path.c_str(), samples);
+        }
+        if(!row.isRead)
+            return row;
+        row.recordedSamples = (int)samples.size();
+        for(size_t i = 0; i < samples.size(); i++)
+        {
+            if(!deflation.add((samples[i].timeMicroseconds - samples[0].timeMicroseconds) / 1000.0f, samples[i].counts))
+                break;
+        }
+    }
+
+    row.deflationSamples = (int)timeValues.size();
+    if(row.deflationSamples > 0)
+        row.deflationSeconds = (timeValues.back() - timeValues.front()) / 1000.0f;
+
+    PressureSampleSpan span;
+    span.timeValues = timeValues.data();
+    span.pressureValues = pressureValues.data();
+    span.sampleCount = row.deflationSamples;
+    slopeValues.resize(timeValues.size());
+    row.result = estimateBloodPressureVectorized(span, slopeValues.data());
+    return row;
+}
+
+static bool isSameRow(const BatchRow &a, const BatchRow &b)
+{
+    return a.isRead == b.isRead && a.recordedSamples == b.recordedSamples && a.deflationSamples == b.deflationSamples &&
+           a.deflationSeconds == b.deflationSeconds && a.result.systolicPressure == b.result.systolicPressure &&
+           a.result.diastolicPressure == b.result.diastolicPressure &&
+           a.result.meanArterialPressureSlope == b.result.meanArterialPressureSlope &&
+           a.result.meanArterialPressureWeightedAverage == b.result.meanArterialPressureWeightedAverage &&
+           a.result.heartRate == b.result.heartRate && a.result.systolicTime == b.result.systolicTime &&
+           a.result.diastolicTime == b.result.diastolicTime && a.result.confidence == b.result.confidence &&
+           a.result.isExact == b.result.isExact;
+}
+
+//Runs the batch with the given number of threads, returns the wall time in seconds
+static double runBatch(const std::vector<BatchSource> &sources, int threadCount, std::vector<BatchRow> &rows,
+                       size_t &steals)
+{
+    rows.assign(sources.size(), BatchRow());
+    WorkStealingPool pool(threadCount);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.run(sources.size(), [&sources, &rows](size_t index) { rows[index] = analyseSession(sources[index]); });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    steals = pool.getSteals();
+    return seconds;
+}
+
+static void writeTable(FILE *output, const std::vector<BatchSource> &sources, const std::vector<BatchRow> &rows)
+{
+    fprintf(output, "session\tsource\tsamples\tdeflation_samples\tdeflation_s\tsystolic\tdiastolic\tmap_slope\t"
+            "map_weighted\tpulse_pressure\theart_rate\tsystolic_s\tdiastolic_s\tconfidence\texact\n");
+    for(size_t i = 0; i < rows.size(); i++)
+    {
+        std::string name = sources[i].path;
+        if(sources[i].archive != 0)
+            name += "#" + std::to_string(sources[i].archiveSession);
+        else if(name.empty())
+            name = "synthetic:" + std::to_string(sources[i].syntheticIndex);
+        const BatchRow &row = rows[i];
+        if(!row.isRead)
+        {
+            fprintf(output, "%zu\t%s\tunreadable\n", i, name.c_str());
+            continue;
+        }
+        const BloodPressureResult &result = row.result;
+        fprintf(output, "%zu\t%s\t%d\t%d\t%.3f\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\t%d\t%.3f\t%.3f\t%.2f\t%s\n", i, name.c_str(),
+                row.recordedSamples, row.deflationSamples, row.deflationSeconds, result.systolicPressure,
+                result.diastolicPressure, result.meanArterialPressureSlope, result.meanArterialPressureWeightedAverage,
+                result.pulsePressure, result.heartRate, result.systolicTime / 1000.0f, result.diastolicTime / 1000.0f,
+                result.confidence, result.isExact ? "yes" : "no");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int threadCount = 0;
+    bool isScalingRun = false;
+    const char *outputPath = 0;
+    int syntheticCount = 0;
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threadCount = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--scaling") == 0)
+            isScalingRun = true;
+        else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputPath = argv[++i];
+        else if(strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc)
+            syntheticCount = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+        {
+            if(!addSessionList(argv[++i], paths))
+            {
+                fprintf(stderr, "Could not open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+            addSessionPath(argv[i], paths);
+    }
+
+    //Every session of an archive is a source of its own; the archives stay mapped until the end
+    std::vector<BatchSource> sources;
+    std::vector<std::unique_ptr<SessionArchiveReader>> archives;
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        if(!hasFileSuffix(paths[i], ".bpa"))
+        {
+            sources.push_back(BatchSource{paths[i], 0, 0, 0});
+            continue;
+        }
+        archives.push_back(std::unique_ptr<SessionArchiveReader>(new SessionArchiveReader()));
+        if(!archives.back()->open(paths[i].c_str()))
+        {
+            fprintf(stderr, "%s is not a session archive\n", paths[i].c_str());
+            return 1;
+        }
+        for(uint64_t session = 0; session < archives.back()->getSessionCount(); session++)
+            sources.push_back(BatchSource{paths[i], 0, archives.back().get(), session});
+    }
+    for(int index = 0; index < syntheticCount; index++)
+        sources.push_back(BatchSource{std::string(), index, 0, 0});
+
+    if(sources.empty())
+    {
+        fprintf(stderr, "No sessions: name files, folders, --list paths.txt or --synthetic N\n");
+        return 1;
+    }
+    if(threadCount < 1)
+        threadCount = WorkStealingPool().getThreadCount();
+
+    std::vector<BatchRow> rows;
+    size_t steals = 0;
+    int exitCode = 0;
+    if(isScalingRun)
+    {
+        //1, 2, 4 ... threads and the full count, each against the table of the single thread run
+        std::vector<int> threadCounts;
+        for(int count = 1; count < threadCount; count *= 2)
+            threadCounts.push_back(count);
+        threadCounts.push_back(threadCount);
+
+        std::vector<BatchRow> referenceRows;
+        double referenceSeconds = 0.0;
+        fprintf(stderr, "threads\tseconds\tsessions_per_s\tspeedup\tefficiency\tsteals\tsame_table\n");
+        for(size_t i = 0; i < threadCounts.size(); i++)
+        {
+            double seconds = runBatch(sources, threadCounts[i], rows, steals);
+            bool isSameTable = true;
+            if(i == 0)
+            {
+                referenceRows = rows;
+                referenceSeconds = seconds;
+            }
+            for(size_t row = 0; row < rows.size() && isSameTable; row++)
+                isSameTable = isSameRow(rows[row], referenceRows[row]);
+            if(!isSameTable)
+                exitCode = 1;
+            fprintf(stderr, "%d\t%.3f\t%.1f\t%.2f\t%.2f\t%zu\t%s\n", threadCounts[i], seconds, sources.size() / seconds,
+                    referenceSeconds / seconds, referenceSeconds / seconds / threadCounts[i], steals,
+                    isSameTable ? "yes" : "no");
+        }
+    }
+    else
+    {
+        double seconds = runBatch(sources, threadCount, rows, steals);
+        fprintf(stderr, "%zu sessions in %.3f s on %d threads: %.1f sessions/s, %zu steals\n", sources.size(), seconds,
+                threadCount, sources.size() / seconds, steals);
+    }
+
+    FILE *output = outputPath == 0 ? stdout : fopen(outputPath, "w");
+    if(output == 0)
+    {
+        fprintf(stderr, "Could not open %s\n", outputPath);
+        return 1;
+    }
+    writeTable(output, sources, rows);
+    if(output != stdout)
+        fclose(output);
+    return exitCode;
+}
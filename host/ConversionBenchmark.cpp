@@ -0,0 +1,105 @@
+/**
+ * @file ConversionBenchmark.cpp
+ * @brief Checks the fixed-point MPRLS conversion against the exact formula and times it against the float code
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/ConversionBenchmark.cpp -o conversion_benchmark
+ *     ./conversion_benchmark
+ *
+ * Every one of the 2^24 possible outputs is converted. The error columns are in units of the last bit of
+ * the Q16.16 result (1/65536 of the unit); 0.5 means correctly rounded.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "bpm/MprlsTransferFunction.h"
+
+//Keeps the compiler from dropping the work being timed
+static volatile int64_t benchmarkSink;
+
+//The conversion the firmware used before, with its runtime globals
+float sensorMinimumPressureReading = 419430.4;
+float sensorMaximumPressureReading = 3774873.6;
+float lowestPressure = 0.0;
+float highestPressure = 300.0;
+
+static float floatConversion(uint32_t counts)
+{
+    float pressureOutput = (float)counts;
+    return (((pressureOutput - sensorMinimumPressureReading) * (highestPressure - lowestPressure)) /
+            (sensorMaximumPressureReading - sensorMinimumPressureReading)) + lowestPressure;
+}
+
+//The datasheet formula in long double, as the reference
+template <typename Variant>
+static long double exactPressure(uint32_t counts)
+{
+    typedef typename Variant::Transfer Transfer;
+    long double outputMinimum = Transfer::outputMinimumFortieths * 16777216.0L / 40.0L;
+    long double outputMaximum = Transfer::outputMaximumFortieths * 16777216.0L / 40.0L;
+    return (counts - outputMinimum) * (Variant::pressureMaximum - Variant::pressureMinimum) /
+           (outputMaximum - outputMinimum) + Variant::pressureMinimum;
+}
+
+template <typename Variant>
+static void checkVariant(const char *name)
+{
+    long double largestError = 0.0L;
+    for(uint32_t counts = 0; counts < (1u << 24); counts++)
+    {
+        long double error = fabsl(MprlsCountsConverter<Variant>::toPressureQ16(counts) - exactPressure<Variant>(counts) * 65536.0L);
+        if(error > largestError)
+            largestError = error;
+    }
+    printf("%-14s largest error %.4Lf LSB\n", name, largestError);
+}
+
+template <typename Function>
+static double nanosecondsPerConversion(Function convert)
+{
+    typedef std::chrono::steady_clock Clock;
+    const int repetitions = 8;
+    int64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    for(int r = 0; r < repetitions; r++)
+    {
+        for(uint32_t counts = 0; counts < (1u << 24); counts++)
+            sum += convert(counts);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    benchmarkSink = sum;
+    return seconds * 1e9 / (repetitions * (double)(1u << 24));
+}
+
+int main()
+{
+    printf("Accuracy of the fixed-point conversion over all 2^24 outputs\n");
+    checkVariant<Mprls0300YG>("MPRLS0300YG");
+    checkVariant<Mprls0001PG>("MPRLS0001PG");
+    checkVariant<Mprls0025PA>("MPRLS0025PA");
+    checkVariant<Mprls0060KG>("MPRLS0060KG");
+    checkVariant<Mprls0600MG>("MPRLS0600MG");
+    checkVariant<MprlsVariant<0, 300, MprlsUnitMillimetreOfMercury, MprlsTransferFunctionC> >("0-300 mmHg, C");
+
+    long double largestFloatError = 0.0L;
+    for(uint32_t counts = 0; counts < (1u << 24); counts++)
+    {
+        long double error = fabsl(floatConversion(counts) * 65536.0L - exactPressure<Mprls0300YG>(counts) * 65536.0L);
+        if(error > largestFloatError)
+            largestFloatError = error;
+    }
+    printf("%-14s largest error %.4Lf LSB (old float code)\n", "MPRLS0300YG", largestFloatError);
+
+    printf("\nSpeed on this machine\n");
+    printf("old float code       %.3f ns/sample\n", nanosecondsPerConversion([](uint32_t counts) {
+        return (int64_t)(floatConversion(counts) * 65536.0f);
+    }));
+    printf("fixed point Q16.16   %.3f ns/sample\n", nanosecondsPerConversion([](uint32_t counts) {
+        return (int64_t)MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercuryQ16(counts);
+    }));
+    printf("fixed point, psi     %.3f ns/sample\n", nanosecondsPerConversion([](uint32_t counts) {
+        return (int64_t)MprlsCountsConverter<Mprls0025PA>::toMillimetresOfMercuryQ16(counts);
+    }));
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file EarlyTerminationStudy.cpp
+ * @brief How much measurement time the early termination saves, and whether it changes any reported value
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/EarlyTerminationStudy.cpp bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o early_termination_study
+ *     ./early_termination_study [trace.csv ...]
+ *
+ * Every trace is measured twice with the envelope analysis, once down to 30 mmHg and once with the early
+ * termination, on the simulated MPRLS0300YG and a virtual clock. Without files, synthetic deflations over
+ * a grid of blood pressures, heart rates, deflation rates and sensor noise levels are used. One tab
+ * separated row per trace, then the median session times and how many results changed.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "bpm/BloodPressureMeasurement.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+//One measurement of a trace
+struct StudyRun
+{
+    BloodPressureResult result;
+    //Simulated time from the first sample to the end of the measurement
+    double sessionSeconds;
+    bool isEndedEarly;
+};
+
+//One trace, measured with and without the early termination
+struct StudyCase
+{
+    char name[64];
+    PressureTrace trace;
+    StudyRun full;
+    StudyRun early;
+};
+
+static StudyRun measure(const PressureTrace &trace, bool isEarlyTerminationEnabled)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(true);
+    measurement.setEarlyTermination(isEarlyTerminationEnabled);
+
+    StudyRun run;
+    run.result = measurement.run();
+    run.sessionSeconds = clock.nowMicroseconds() / 1e6;
+    run.isEndedEarly = measurement.isEndedEarly();
+    return run;
+}
+
+//The synthetic deflation with white noise of the given standard deviation added to every point
+static PressureTrace noisyDeflation(double systolic, double diastolic, double heartRate, double deflationRate,
+                                    double noiseMmHg, unsigned seed)
+{
+    PressureTrace clean = PressureTrace::syntheticDeflation(systolic, diastolic, heartRate, deflationRate);
+    if(noiseMmHg <= 0.0)
+        return clean;
+
+    std::mt19937 generator(seed);
+    std::normal_distribution<double> noise(0.0, noiseMmHg);
+    PressureTrace noisy;
+    const double stepSeconds = 0.001;
+    for(double t = 0.0; t <= clean.durationSeconds(); t += stepSeconds)
+        noisy.addPoint(t, clean.pressureAt(t) + noise(generator));
+    return noisy;
+}
+
+static bool isSameResult(const BloodPressureResult &a, const BloodPressureResult &b)
+{
+    return a.systolicPressure == b.systolicPressure && a.diastolicPressure == b.diastolicPressure &&
+           a.meanArterialPressureSlope == b.meanArterialPressureSlope && a.heartRate == b.heartRate &&
+           a.confidence == b.confidence;
+}
+
+static double median(std::vector<double> values)
+{
+    if(values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<StudyCase> cases;
+    for(int i = 1; i < argc; i++)
+    {
+        StudyCase recorded;
+        snprintf(recorded.name, sizeof(recorded.name), "%s", argv[i]);
+        if(!recorded.trace.loadCsv(argv[i]) || recorded.trace.size() < 2)
+        {
+            fprintf(stderr, "Could not read a pressure trace from %s\n", argv[i]);
+            return 1;
+        }
+        cases.push_back(recorded);
+    }
+
+    if(cases.empty())
+    {
+        const double pressures[][2] = {{100, 60}, {110, 70}, {120, 80}, {130, 85}, {140, 90}};
+        const double heartRates[] = {50, 72, 100};
+        const double deflationRates[] = {3, 4, 5};
+        const double noiseLevels[] = {0.0, 0.1};
+        unsigned seed = 1;
+        for(const double *pressure : pressures)
+            for(double heartRate : heartRates)
+                for(double deflationRate : deflationRates)
+                    for(double noiseMmHg : noiseLevels)
+                    {
+                        StudyCase synthetic;
+                        snprintf(synthetic.name, sizeof(synthetic.name), "%.0f/%.0f@%.0fbpm,%.0fmmHg/s,noise%.1f",
+                                 pressure[0], pressure[1], heartRate, deflationRate, noiseMmHg);
+                        synthetic.trace = noisyDeflation(pressure[0], pressure[1], heartRate, deflationRate, noiseMmHg, seed++);
+                        cases.push_back(synthetic);
+                    }
+    }
+
+    printf("trace\tfull_s\tearly_s\tsaved_s\tended_early\tsystolic\tdiastolic\tmap\theart_rate\tconfidence\tsame\n");
+    std::vector<double> fullSeconds;
+    std::vector<double> earlySeconds;
+    std::vector<double> savedSeconds;
+    int endedEarlyCount = 0;
+    int changedCount = 0;
+    for(size_t i = 0; i < cases.size(); i++)
+    {
+        StudyCase &study = cases[i];
+        study.full = measure(study.trace, false);
+        study.early = measure(study.trace, true);
+        bool isSame = isSameResult(study.full.result, study.early.result);
+
+        double saved = study.full.sessionSeconds - study.early.sessionSeconds;
+        fullSeconds.push_back(study.full.sessionSeconds);
+        earlySeconds.push_back(study.early.sessionSeconds);
+        savedSeconds.push_back(saved);
+        endedEarlyCount += study.early.isEndedEarly;
+        changedCount += !isSame;
+
+        const BloodPressureResult &result = study.early.result;
+        printf("%s\t%.2f\t%.2f\t%.2f\t%s\t%.1f\t%.1f\t%.1f\t%d\t%.2f\t%s\n", study.name, study.full.sessionSeconds,
+               study.early.sessionSeconds, saved, study.early.isEndedEarly ? "yes" : "no", result.systolicPressure,
+               result.diastolicPressure, result.meanArterialPressureSlope, result.heartRate, result.confidence,
+               isSame ? "yes" : "no");
+        if(!isSame)
+        {
+            const BloodPressureResult &full = study.full.result;
+            printf("#\tfull run: %.1f/%.1f map %.1f heart rate %d confidence %.2f\n", full.systolicPressure,
+                   full.diastolicPressure, full.meanArterialPressureSlope, full.heartRate, full.confidence);
+        }
+    }
+
+    printf("\nTraces                : %zu\n", cases.size());
+    printf("Ended early           : %d\n", endedEarlyCount);
+    printf("Median session        : %.2f s full, %.2f s early\n", median(fullSeconds), median(earlySeconds));
+    printf("Median time saved     : %.2f s (%.1f%%)\n", median(savedSeconds),
+           100.0 * median(savedSeconds) / median(fullSeconds));
+    printf("Changed results       : %d\n", changedCount);
+    return changedCount == 0 ? 0 : 1;
+}
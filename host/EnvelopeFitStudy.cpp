@@ -0,0 +1,241 @@
+/**
+ * @file EnvelopeFitStudy.cpp
+ * @brief How far the envelope search and the envelope fit (bpm/EnvelopeFit.h) land from the true systolic,
+ * mean arterial and diastolic pressures, how much they move with the sensor noise, and what the fit costs
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/EnvelopeFitStudy.cpp bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o envelope_fit_study
+ *     ./envelope_fit_study [--seeds N] [--rows]
+ *
+ * Synthetic deflations (host/OscillometricWaveform.h) over a grid of blood pressures, heart rates and
+ * deflation rates, each without noise and with N seeds of 0.1 and 0.3 mmHg of sensor noise, are measured
+ * with the envelope analysis on the simulated MPRLS0300YG and a virtual clock, once with the envelope
+ * search alone and once with the fit. Per noise level and method it prints the mean absolute error and
+ * the bias against the truth, and the spread: the standard deviation of the estimate over the seeds of
+ * the same deflation, which is what one noisy envelope point does to the search. --rows adds one row per
+ * measurement. Last the fit of a 120/80 deflation is timed, next to the memory it holds. The program
+ * exits with 1 if the fit failed on any deflation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "bpm/BloodPressureMeasurement.h"
+#include "host/OscillometricWaveform.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+//The three pressures of one estimate or of the truth
+struct PressureTriple
+{
+    double systolic;
+    double meanArterial;
+    double diastolic;
+};
+
+//Running error statistics of one method at one noise level
+struct ErrorStatistics
+{
+    int count;
+    int failures;
+    PressureTriple absoluteSum;
+    PressureTriple errorSum;
+    //Squared deviations from the mean over the seeds of each deflation, and how many there were
+    PressureTriple spreadSum;
+    int spreadCount;
+};
+
+static PressureTriple estimateOf(const BloodPressureResult &result)
+{
+    PressureTriple estimate = { result.systolicPressure, result.meanArterialPressureSlope, result.diastolicPressure };
+    return estimate;
+}
+
+static void addError(ErrorStatistics &statistics, const PressureTriple &estimate, const PressureTriple &truth)
+{
+    statistics.count++;
+    statistics.absoluteSum.systolic += fabs(estimate.systolic - truth.systolic);
+    statistics.absoluteSum.meanArterial += fabs(estimate.meanArterial - truth.meanArterial);
+    statistics.absoluteSum.diastolic += fabs(estimate.diastolic - truth.diastolic);
+    statistics.errorSum.systolic += estimate.systolic - truth.systolic;
+    statistics.errorSum.meanArterial += estimate.meanArterial - truth.meanArterial;
+    statistics.errorSum.diastolic += estimate.diastolic - truth.diastolic;
+}
+
+//Adds the spread of the estimates of one deflation over its seeds
+static void addSpread(ErrorStatistics &statistics, const std::vector<PressureTriple> &estimates)
+{
+    if(estimates.size() < 2)
+        return;
+    PressureTriple mean = { 0.0, 0.0, 0.0 };
+    for(size_t i = 0; i < estimates.size(); i++)
+    {
+        mean.systolic += estimates[i].systolic / estimates.size();
+        mean.meanArterial += estimates[i].meanArterial / estimates.size();
+        mean.diastolic += estimates[i].diastolic / estimates.size();
+    }
+    for(size_t i = 0; i < estimates.size(); i++)
+    {
+        statistics.spreadSum.systolic += pow(estimates[i].systolic - mean.systolic, 2.0);
+        statistics.spreadSum.meanArterial += pow(estimates[i].meanArterial - mean.meanArterial, 2.0);
+        statistics.spreadSum.diastolic += pow(estimates[i].diastolic - mean.diastolic, 2.0);
+    }
+    statistics.spreadCount += (int)estimates.size() - 1;
+}
+
+static void printStatistics(const char *method, double noiseMmHg, const ErrorStatistics &statistics)
+{
+    const double count = statistics.count > 0 ? statistics.count : 1;
+    const double spreadCount = statistics.spreadCount > 0 ? statistics.spreadCount : 1;
+    printf("%-7s %5.1f  %4d %3d   %5.2f %5.2f %5.2f   %+6.2f %+6.2f %+6.2f", method, noiseMmHg, statistics.count,
+           statistics.failures, statistics.absoluteSum.systolic / count, statistics.absoluteSum.meanArterial / count,
+           statistics.absoluteSum.diastolic / count, statistics.errorSum.systolic / count,
+           statistics.errorSum.meanArterial / count, statistics.errorSum.diastolic / count);
+    if(statistics.spreadCount > 0)
+        printf("   %5.2f %5.2f %5.2f\n", sqrt(statistics.spreadSum.systolic / spreadCount),
+               sqrt(statistics.spreadSum.meanArterial / spreadCount), sqrt(statistics.spreadSum.diastolic / spreadCount));
+    else
+        printf("       -     -     -\n");
+}
+
+//The deflation of the parameters at 1 kHz, with its noise
+static PressureTrace waveformTrace(const WaveformParameters &parameters)
+{
+    WaveformParameters traceParameters = parameters;
+    traceParameters.sampleRateHz = 1000.0;
+    OscillometricWaveform waveform(traceParameters);
+    PressureTrace trace;
+    WaveformSample sample;
+    while(waveform.next(sample))
+        trace.addPoint(sample.timeSeconds, sample.pressure);
+    return trace;
+}
+
+//Measures a trace with the envelope analysis, with or without the fit
+static BloodPressureResult measure(const PressureTrace &trace, bool isEnvelopeFitEnabled, bool &isFitValid)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(true);
+    measurement.setEnvelopeFit(isEnvelopeFitEnabled);
+
+    BloodPressureResult result = measurement.run();
+    isFitValid = measurement.getEnvelopeFit().isValid;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int seedCount = 4;
+    bool isPrintingRows = false;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+            seedCount = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--rows") == 0)
+            isPrintingRows = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--seeds N] [--rows]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(seedCount < 1)
+        seedCount = 1;
+
+    const double pressures[][2] = {{100, 60}, {110, 70}, {120, 80}, {130, 85}, {140, 90}, {160, 100}};
+    const double heartRates[] = {55, 75, 95};
+    const double deflationRates[] = {3, 5};
+    const double noiseLevels[] = {0.0, 0.1, 0.3};
+    const int noiseLevelCount = sizeof(noiseLevels) / sizeof(noiseLevels[0]);
+    ErrorStatistics searchStatistics[noiseLevelCount];
+    ErrorStatistics fitStatistics[noiseLevelCount];
+    memset(searchStatistics, 0, sizeof(searchStatistics));
+    memset(fitStatistics, 0, sizeof(fitStatistics));
+
+    if(isPrintingRows)
+        printf("systolic\tdiastolic\theart_rate\tdeflation_rate\tnoise\tseed\tsearch_sys\tsearch_map\tsearch_dia\tfit_sys\tfit_map\tfit_dia\n");
+    int failedFits = 0;
+    for(const double *pressure : pressures)
+        for(double heartRate : heartRates)
+            for(double deflationRate : deflationRates)
+                for(int level = 0; level < noiseLevelCount; level++)
+                {
+                    WaveformParameters parameters;
+                    parameters.systolic = pressure[0];
+                    parameters.diastolic = pressure[1];
+                    parameters.heartRate = heartRate;
+                    parameters.deflationRate = deflationRate;
+                    parameters.noiseMmHg = noiseLevels[level];
+                    const PressureTriple truth = { parameters.systolic, OscillometricWaveform::meanArterialPressure(parameters),
+                                                   parameters.diastolic };
+
+                    //Without noise every seed gives the same deflation
+                    const int seeds = noiseLevels[level] > 0.0 ? seedCount : 1;
+                    std::vector<PressureTriple> searchEstimates;
+                    std::vector<PressureTriple> fitEstimates;
+                    for(int seed = 1; seed <= seeds; seed++)
+                    {
+                        parameters.seed = seed;
+                        PressureTrace trace = waveformTrace(parameters);
+                        bool isFitValid = false;
+                        PressureTriple search = estimateOf(measure(trace, false, isFitValid));
+                        PressureTriple fit = estimateOf(measure(trace, true, isFitValid));
+                        addError(searchStatistics[level], search, truth);
+                        addError(fitStatistics[level], fit, truth);
+                        searchEstimates.push_back(search);
+                        fitEstimates.push_back(fit);
+                        if(!isFitValid)
+                        {
+                            fitStatistics[level].failures++;
+                            failedFits++;
+                        }
+                        if(isPrintingRows)
+                            printf("%.0f\t%.0f\t%.0f\t%.0f\t%.1f\t%d\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\n", pressure[0],
+                                   pressure[1], heartRate, deflationRate, noiseLevels[level], seed, search.systolic,
+                                   search.meanArterial, search.diastolic, fit.systolic, fit.meanArterial, fit.diastolic);
+                    }
+                    addSpread(searchStatistics[level], searchEstimates);
+                    addSpread(fitStatistics[level], fitEstimates);
+                }
+
+    printf("\n                          mean absolute error    bias                     spread over seeds\n");
+    printf("method  noise  runs failed  SBP   MAP   DBP      SBP    MAP    DBP        SBP   MAP   DBP\n");
+    for(int level = 0; level < noiseLevelCount; level++)
+    {
+        printStatistics("search", noiseLevels[level], searchStatistics[level]);
+        printStatistics("fit", noiseLevels[level], fitStatistics[level]);
+    }
+
+    //The fit of a 120/80 deflation with 0.1 mmHg of noise, timed as the firmware runs it once at the end
+    WaveformParameters parameters;
+    parameters.noiseMmHg = 0.1;
+    PressureTrace trace = waveformTrace(parameters);
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(true);
+    measurement.setEnvelopeFit(true);
+    measurement.run();
+
+    typedef std::chrono::steady_clock Clock;
+    const int repeats = 20000;
+    volatile float sink = 0.0f;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < repeats; i++)
+        sink = sink + measurement.getEnvelopeFit().systolicPressure;
+    double fitMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / repeats;
+    printf("\nFit: %.2f us on this PC for %d fitted bins of %d (%zu bytes), %d golden section steps\n", fitMicroseconds,
+           measurement.getEnvelopeFit().fittedBins, ENVELOPE_FIT_BIN_COUNT, sizeof(EnvelopeFit), ENVELOPE_FIT_REFINE_STEPS);
+    printf("Failed fits: %d\n", failedFits);
+    return failedFits == 0 ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file HampelBenchmark.cpp
+ * @brief The streaming artifact rejection of bpm/HampelFilter.h: its cost against re-sorting the window for
+ * every sample, and what it does to a measurement with motion artifacts in it
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/HampelBenchmark.cpp bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o hampel_benchmark
+ *     ./hampel_benchmark [--artifacts N] [trace.csv]
+ *
+ * First SlidingMedian is checked against a sorted copy of the window on random values with many repeats,
+ * for several window sizes. Then, per window size up to HAMPEL_FILTER_MAX_WINDOW, the cost per sample of
+ * HampelFilter is compared with the naive Hampel filter that sorts the window for the median and the
+ * deviations for the exact MAD on every sample, together with how often the two disagree on what is an
+ * artifact; more than one disagreement in 10000 samples fails the check.
+ *
+ * Last the trace (a synthetic 120/80 deflation by default) gets N spikes of 10 to 40 mmHg, up or down,
+ * each 3 to 12 ms long, at fixed pseudo random times; BloodPressureMeasurement runs on the clean and on the
+ * spiked trace, with the raw slopes and with the envelope analysis, without and with the artifact
+ * rejection. On the clean trace the rejection must replace nothing, and on the spiked trace it must bring
+ * the maximum slope back within 5% of the clean one; the program exits with 1 if either fails, if the
+ * median is ever wrong or if the streaming and the naive filter disagree too often.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "bpm/BloodPressureMeasurement.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+//Samples every filter is timed over
+static const int timedSampleCount = 2000000;
+//Most samples in 10000 on which HampelFilter and the naive filter may disagree
+static const uint32_t allowedDisagreementsPer10000 = 1;
+//How far the maximum slope with the rejection may end up from the clean one, as a fraction of it
+static const float allowedMaxSlopeError = 0.05f;
+
+//Linear congruential generator, so every run sees the same values
+static uint32_t randomState = 12345;
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1103515245u + 12345u;
+    return randomState >> 8;
+}
+
+//The median of a copy of the values, sorted
+static float sortedMedian(std::vector<float> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : 0.5f * (values[middle - 1] + values[middle]);
+}
+
+/**
+ * @brief The textbook Hampel filter with the same decision rule as HampelFilter: the window is copied and
+ * sorted for the median, the deviations from it are sorted for the MAD, on every sample
+ */
+class NaiveHampelFilter
+{
+public:
+    explicit NaiveHampelFilter(size_t windowSize) : window(windowSize), count(0), next(0), isRejected(false) {}
+
+    float process(float value)
+    {
+        window[next] = value;
+        next = (next + 1) % window.size();
+        if(count < window.size())
+            count++;
+        std::vector<float> values(window.begin(), window.begin() + count);
+        float median = sortedMedian(values);
+        for(size_t i = 0; i < values.size(); i++)
+            values[i] = fabsf(values[i] - median);
+        float scale = 1.4826f * sortedMedian(values);
+        float limit = std::max(ARTIFACT_REJECTION_THRESHOLD * scale, ARTIFACT_REJECTION_MIN_DEVIATION_MMHG);
+        float deviation = fabsf(value - median);
+        isRejected = count == window.size() && deviation > limit;
+        return isRejected ? median : value;
+    }
+
+    bool isLastRejected() const { return isRejected; }
+
+private:
+    std::vector<float> window;
+    size_t count;
+    size_t next;
+    bool isRejected;
+};
+
+//Checks SlidingMedian against the sorted window on values with many repeats
+template <int WindowSize>
+static bool checkSlidingMedian()
+{
+    SlidingMedian<WindowSize> median;
+    std::vector<float> window;
+    for(int i = 0; i < 20000; i++)
+    {
+        float value = (float)(nextRandom() % 64) - 32.0f;
+        if(i == 10000)
+        {
+            median.reset();
+            window.clear();
+        }
+        window.push_back(value);
+        if((int)window.size() > WindowSize)
+            window.erase(window.begin());
+        if(median.add(value) != sortedMedian(window))
+        {
+            printf("SlidingMedian<%d> is WRONG after %d values\n", WindowSize, i + 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+//A pressure like the one of a deflation, with pulses, noise and a spike now and then
+static std::vector<float> makeSignal(size_t length)
+{
+    std::vector<float> signal(length);
+    for(size_t i = 0; i < length; i++)
+    {
+        float t = i * 0.0052f;
+        float value = 150.0f - 4.0f * fmodf(t, 30.0f) + 1.5f * sinf(2.0f * (float)M_PI * 1.2f * t) +
+                      0.02f * ((float)(nextRandom() % 1000) / 1000.0f - 0.5f);
+        if(nextRandom() % 500 == 0)
+            value += (nextRandom() % 2 == 0 ? 1.0f : -1.0f) * (10.0f + (float)(nextRandom() % 30));
+        signal[i] = value;
+    }
+    return signal;
+}
+
+template <typename Filter>
+static double timeFilter(Filter &filter, const std::vector<float> &signal, size_t sampleCount, float &checksum)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float sum = 0.0f;
+    for(size_t i = 0; i < sampleCount; i++)
+        sum += filter.process(signal[i % signal.size()]);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checksum = sum;
+    return seconds * 1e9 / sampleCount;
+}
+
+//Times HampelFilter and the naive filter over the same signal and counts where they disagree; false if too often
+template <int WindowSize>
+static bool compareWithNaive(const std::vector<float> &signal)
+{
+    HampelFilter<WindowSize> filter;
+    NaiveHampelFilter naive(WindowSize);
+    uint32_t naiveRejected = 0;
+    uint32_t disagreements = 0;
+    for(size_t i = 0; i < signal.size(); i++)
+    {
+        filter.process(signal[i]);
+        naive.process(signal[i]);
+        naiveRejected += naive.isLastRejected();
+        disagreements += filter.isLastRejected() != naive.isLastRejected();
+    }
+    uint32_t rejected = filter.getRejectedCount();
+
+    //The naive filter is slow enough for fewer samples to do
+    float checksum = 0.0f;
+    filter.reset();
+    double streamingNanoseconds = timeFilter(filter, signal, timedSampleCount, checksum);
+    NaiveHampelFilter timedNaive(WindowSize);
+    double naiveNanoseconds = timeFilter(timedNaive, signal, timedSampleCount / 10, checksum);
+    printf("%6d %12.1f ns %12.1f ns %8.1fx %10lu %10lu %10lu  %zu bytes\n", WindowSize, streamingNanoseconds,
+           naiveNanoseconds, naiveNanoseconds / streamingNanoseconds, (unsigned long)rejected,
+           (unsigned long)naiveRejected, (unsigned long)disagreements, sizeof(HampelFilter<WindowSize>));
+    if(disagreements * 10000 > allowedDisagreementsPer10000 * signal.size())
+    {
+        printf("    FAILED: the streaming and the naive filter disagree on too many samples\n");
+        return false;
+    }
+    return true;
+}
+
+//The trace with spikes of 10 to 40 mmHg, 3 to 12 ms long, added at pseudo random times
+static PressureTrace addArtifacts(const PressureTrace &trace, int artifactCount)
+{
+    const double stepSeconds = 0.0005;
+    const double duration = trace.durationSeconds();
+    std::vector<double> offsets((size_t)(duration / stepSeconds) + 1, 0.0);
+    for(int i = 0; i < artifactCount; i++)
+    {
+        size_t start = (size_t)((nextRandom() % 1000000) / 1000000.0 * (offsets.size() - 30));
+        size_t length = 6 + nextRandom() % 19;
+        double amplitude = (nextRandom() % 2 == 0 ? 1.0 : -1.0) * (10.0 + (nextRandom() % 300) / 10.0);
+        for(size_t k = start; k < start + length; k++)
+            offsets[k] += amplitude;
+    }
+
+    PressureTrace spiked;
+    for(size_t k = 0; k < offsets.size(); k++)
+        spiked.addPoint(k * stepSeconds, trace.pressureAt(k * stepSeconds) + offsets[k]);
+    return spiked;
+}
+
+static BloodPressureResult measure(const PressureTrace &trace, bool isEnvelopeAnalysisEnabled, bool isArtifactRejectionEnabled,
+                                   uint32_t &rejectedSamples)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+    measurement.setArtifactRejection(isArtifactRejectionEnabled);
+    BloodPressureResult result = measurement.run();
+    rejectedSamples = measurement.getRejectedSampleCount();
+    return result;
+}
+
+static void printMeasurement(const char *name, const BloodPressureResult &result, uint32_t rejectedSamples)
+{
+    printf("%-36s %7.2f/%6.2f mmHg %4d bpm %8.3f max slope %8lu replaced\n", name, result.systolicPressure,
+           result.diastolicPressure, result.heartRate, result.maxSlope, (unsigned long)rejectedSamples);
+}
+
+int main(int argc, char **argv)
+{
+    int artifactCount = 60;
+    const char *tracePath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--artifacts") == 0 && i + 1 < argc)
+            artifactCount = atoi(argv[++i]);
+        else
+            tracePath = argv[i];
+    }
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    if(tracePath != 0 && (!trace.loadCsv(tracePath) || trace.size() < 2))
+    {
+        fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+        return 1;
+    }
+
+    bool isPassed = checkSlidingMedian<2>() && checkSlidingMedian<3>() && checkSlidingMedian<7>() &&
+                    checkSlidingMedian<8>() && checkSlidingMedian<31>() && checkSlidingMedian<255>();
+    printf("SlidingMedian %s the sorted window\n\n", isPassed ? "matches" : "does NOT match");
+
+    std::vector<float> signal = makeSignal(100000);
+    printf("%6s %15s %15s %9s %10s %10s %10s\n", "Window", "Streaming", "Re-sort", "Speedup", "Replaced", "Naive",
+           "Disagree");
+    isPassed = compareWithNaive<7>(signal) && isPassed;
+    isPassed = compareWithNaive<15>(signal) && isPassed;
+    isPassed = compareWithNaive<HAMPEL_FILTER_MAX_WINDOW>(signal) && isPassed;
+
+    PressureTrace spiked = addArtifacts(trace, artifactCount);
+    printf("\n%d artifacts added\n", artifactCount);
+    for(int envelope = 0; envelope < 2; envelope++)
+    {
+        printf("%s\n", envelope ? "Envelope analysis" : "Slope analysis");
+        uint32_t rejectedSamples = 0;
+        BloodPressureResult clean = measure(trace, envelope != 0, false, rejectedSamples);
+        printMeasurement("  clean", clean, rejectedSamples);
+        BloodPressureResult result;
+        result = measure(trace, envelope != 0, true, rejectedSamples);
+        printMeasurement("  clean, artifacts rejected", result, rejectedSamples);
+        if(rejectedSamples != 0)
+        {
+            printf("    FAILED: samples of the clean trace were replaced\n");
+            isPassed = false;
+        }
+        result = measure(spiked, envelope != 0, false, rejectedSamples);
+        printMeasurement("  with artifacts", result, rejectedSamples);
+        result = measure(spiked, envelope != 0, true, rejectedSamples);
+        printMeasurement("  with artifacts, rejected", result, rejectedSamples);
+        if(fabsf(result.maxSlope - clean.maxSlope) > allowedMaxSlopeError * clean.maxSlope)
+        {
+            printf("    FAILED: the artifacts still set the maximum slope\n");
+            isPassed = false;
+        }
+    }
+
+    printf("\n%s\n", isPassed ? "All checks passed" : "Some checks FAILED");
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file HeapSessionStorage.h
+ * @brief A NOR flash in RAM (optionally loaded from and saved to a file), so the session log runs on a PC
+ */
+
+#ifndef HEAP_SESSION_STORAGE_H
+#define HEAP_SESSION_STORAGE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "hal/MeasurementHardware.h"
+
+/**
+ * @brief Behaves like NOR flash: erasing sets every byte of a sector to 0xFF, programming can only clear
+ * bits, and misaligned calls fail. It counts the bytes every call moved and the erases of every sector.
+ *
+ * cutPowerAfter() simulates a power loss: the program call that crosses the given number of bytes only
+ * writes the bytes before it (a torn write) and every call fails from then on, until restorePower().
+ */
+class HeapSessionStorage : public SessionStorage
+{
+public:
+    HeapSessionStorage(uint64_t totalSize, uint64_t sectorSize, uint64_t writeSize)
+        : memory(totalSize, 0xFF), eraseCounts(totalSize / sectorSize, 0), eraseSize(sectorSize), programSize(writeSize)
+    {
+        bytesRead = 0;
+        bytesProgrammed = 0;
+        bytesErased = 0;
+        programViolations = 0;
+        isPowerCutArmed = false;
+        isPowerLost = false;
+        bytesUntilPowerCut = 0;
+    }
+
+    virtual int read(void *buffer, uint64_t address, uint64_t size)
+    {
+        if(isPowerLost || address + size > memory.size())
+            return -1;
+        memcpy(buffer, memory.data() + address, size);
+        bytesRead += size;
+        return 0;
+    }
+
+    virtual int program(const void *buffer, uint64_t address, uint64_t size)
+    {
+        if(isPowerLost || address % programSize != 0 || size % programSize != 0 || address + size > memory.size())
+            return -1;
+        uint64_t length = size;
+        if(isPowerCutArmed && size > bytesUntilPowerCut)
+        {
+            length = bytesUntilPowerCut;
+            isPowerLost = true;
+        }
+        const uint8_t *data = (const uint8_t *)buffer;
+        for(uint64_t i = 0; i < length; i++)
+        {
+            //Programming can only clear bits; setting one again is a bug in the caller
+            if((memory[address + i] & data[i]) != data[i])
+                programViolations++;
+            memory[address + i] &= data[i];
+        }
+        bytesProgrammed += length;
+        if(isPowerCutArmed)
+            bytesUntilPowerCut -= length;
+        return isPowerLost ? -1 : 0;
+    }
+
+    virtual int erase(uint64_t address, uint64_t size)
+    {
+        if(isPowerLost || address % eraseSize != 0 || size % eraseSize != 0 || address + size > memory.size())
+            return -1;
+        memset(memory.data() + address, 0xFF, size);
+        for(uint64_t sector = address / eraseSize; sector < (address + size) / eraseSize; sector++)
+            eraseCounts[sector]++;
+        bytesErased += size;
+        return 0;
+    }
+
+    virtual uint64_t getProgramSize() const { return programSize; }
+    virtual uint64_t getEraseSize() const { return eraseSize; }
+    virtual uint64_t getSize() const { return memory.size(); }
+    virtual int getEraseValue() const { return 0xFF; }
+
+    //The power goes once byteCount more bytes were programmed
+    void cutPowerAfter(uint64_t byteCount)
+    {
+        isPowerCutArmed = true;
+        bytesUntilPowerCut = byteCount;
+    }
+
+    void restorePower()
+    {
+        isPowerCutArmed = false;
+        isPowerLost = false;
+    }
+
+    bool isPowerCut() const { return isPowerLost; }
+
+    //Replaces the contents with the ones of a file written by save(); false if it does not match the size
+    bool load(const char *path)
+    {
+        FILE *file = fopen(path, "rb");
+        if(file == 0)
+            return false;
+        std::vector<uint8_t> contents(memory.size());
+        bool isLoaded = fread(contents.data(), 1, contents.size(), file) == contents.size() && fgetc(file) == EOF;
+        fclose(file);
+        if(isLoaded)
+            memory.swap(contents);
+        return isLoaded;
+    }
+
+    bool save(const char *path) const
+    {
+        FILE *file = fopen(path, "wb");
+        if(file == 0)
+            return false;
+        bool isSaved = fwrite(memory.data(), 1, memory.size(), file) == memory.size();
+        return fclose(file) == 0 && isSaved;
+    }
+
+    //Erases of every sector so far
+    const std::vector<uint32_t> &getEraseCounts() const { return eraseCounts; }
+
+    uint64_t bytesRead;
+    uint64_t bytesProgrammed;
+    uint64_t bytesErased;
+    //Program calls that tried to set bits that were cleared
+    uint64_t programViolations;
+
+private:
+    std::vector<uint8_t> memory;
+    std::vector<uint32_t> eraseCounts;
+    uint64_t eraseSize;
+    uint64_t programSize;
+    bool isPowerCutArmed;
+    bool isPowerLost;
+    uint64_t bytesUntilPowerCut;
+};
+
+#endif
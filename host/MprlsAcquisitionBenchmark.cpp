@@ -0,0 +1,188 @@
+/**
+ * @file MprlsAcquisitionBenchmark.cpp
+ * @brief Compares the old blocking sensor loop with MprlsAcquisition against a mock MPRLS on a mock I2C bus
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/MprlsAcquisitionBenchmark.cpp -o mprls_acquisition_benchmark
+ *     ./mprls_acquisition_benchmark [seconds] [bus frequency in Hz] [poll interval in us]
+ *
+ * Time is simulated: every bus transfer and every wait advances a virtual clock, so the numbers only
+ * depend on the bus frequency, the conversion time of the sensor and how often the loop polls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "bpm/MprlsAcquisition.h"
+
+/**
+ * @brief An MPRLS sensor on an I2C bus, both running on a virtual clock
+ */
+class MockMprlsBus
+{
+public:
+    MockMprlsBus(int frequencyHz, uint32_t conversionMicroseconds)
+        : nowMicroseconds(0), busMicroseconds(0), busFrequency(frequencyHz),
+          conversionTime(conversionMicroseconds), conversionDoneMicroseconds(0), counts(0x200000)
+    {
+    }
+
+    int write(int address, const char *data, int length, bool repeated = false)
+    {
+        (void)address;
+        (void)repeated;
+        spendBusTime(length);
+        //0xAA starts a new conversion
+        if(length == 3 && (uint8_t)data[0] == 0xAA)
+            conversionDoneMicroseconds = nowMicroseconds + conversionTime;
+        return 0;
+    }
+
+    int read(int address, char *data, int length, bool repeated = false)
+    {
+        (void)address;
+        (void)repeated;
+        spendBusTime(length);
+        uint8_t status = MPRLS_STATUS_POWERED;
+        if(nowMicroseconds < conversionDoneMicroseconds)
+            status |= MPRLS_STATUS_BUSY;
+        data[0] = (char)status;
+        if(length >= 4)
+        {
+            counts = (counts + 7) & 0xFFFFFF;
+            data[1] = (char)(counts >> 16);
+            data[2] = (char)(counts >> 8);
+            data[3] = (char)counts;
+        }
+        return 0;
+    }
+
+    //Stands in for wait_us()
+    void wait(uint32_t microseconds) { nowMicroseconds += microseconds; }
+
+    //The EOC pin is high once the conversion is done
+    int endOfConversion() const { return nowMicroseconds >= conversionDoneMicroseconds; }
+
+    //Virtual time
+    double nowMicroseconds;
+    //Time the bus spent transferring
+    double busMicroseconds;
+
+private:
+    //Start + address byte + data bytes (9 clocks each, acknowledge included) + stop
+    void spendBusTime(int length)
+    {
+        double microseconds = (2.0 + 9.0 * (length + 1)) * 1e6 / busFrequency;
+        nowMicroseconds += microseconds;
+        busMicroseconds += microseconds;
+    }
+
+    int busFrequency;
+    uint32_t conversionTime;
+    double conversionDoneMicroseconds;
+    uint32_t counts;
+};
+
+/**
+ * @brief The EOC pin of the mock sensor
+ */
+struct MockEndOfConversionPin
+{
+    MockMprlsBus *bus;
+    int read() { return bus->endOfConversion(); }
+};
+
+struct BenchmarkResult
+{
+    double samplesPerSecond;
+    double busMicrosecondsPerSample;
+    double transfersPerSample;
+};
+
+static void printResult(const char *name, const BenchmarkResult &result)
+{
+    printf("%-28s %10.1f samples/s %10.1f us bus/sample %8.2f transfers/sample\n",
+           name, result.samplesPerSecond, result.busMicrosecondsPerSample, result.transfersPerSample);
+}
+
+/**
+ * @brief The sequence the firmware used before: write, wait, status read, wait, data read, wait
+ */
+static BenchmarkResult runBlockingLoop(double seconds, int frequencyHz)
+{
+    MockMprlsBus bus(frequencyHz, MPRLS_CONVERSION_TIME_US);
+    const char command[] = { (char)0xAA, 0x00, 0x00 };
+    char status = 0;
+    char reading[4] = {0};
+    uint32_t samples = 0;
+    uint32_t transfers = 0;
+
+    while(bus.nowMicroseconds < seconds * 1e6)
+    {
+        bus.write(0x30, command, 3);
+        bus.wait(5000);
+        bus.read(0x31, &status, 1);
+        transfers += 2;
+        if(((status & 0x40) >> 6) == 0x1)
+        {
+            bus.read(0x31, &status, 1);
+            bus.wait(5000);
+            transfers++;
+        }
+        bus.read(0x30, reading, 4);
+        bus.wait(10000);
+        transfers++;
+        samples++;
+    }
+
+    BenchmarkResult result;
+    result.samplesPerSecond = samples / (bus.nowMicroseconds / 1e6);
+    result.busMicrosecondsPerSample = bus.busMicroseconds / samples;
+    result.transfersPerSample = (double)transfers / samples;
+    return result;
+}
+
+/**
+ * @brief The state machine, polled every pollIntervalMicroseconds of loop work
+ */
+template <typename Acquisition>
+static BenchmarkResult runStateMachine(Acquisition &acquisition, MockMprlsBus &bus, double seconds,
+                                       uint32_t pollIntervalMicroseconds)
+{
+    MprlsSample sample;
+    while(bus.nowMicroseconds < seconds * 1e6)
+    {
+        acquisition.poll((uint64_t)bus.nowMicroseconds, sample);
+        bus.wait(pollIntervalMicroseconds);
+    }
+
+    const MprlsAcquisitionStatistics &statistics = acquisition.getStatistics();
+    BenchmarkResult result;
+    result.samplesPerSecond = statistics.samplesRead / (bus.nowMicroseconds / 1e6);
+    result.busMicrosecondsPerSample = bus.busMicroseconds / statistics.samplesRead;
+    result.transfersPerSample = (double)statistics.transfers / statistics.samplesRead;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 40.0;
+    int frequencyHz = argc > 2 ? atoi(argv[2]) : 400000;
+    uint32_t pollIntervalMicroseconds = argc > 3 ? (uint32_t)atoi(argv[3]) : 50;
+
+    printf("Simulated %.0f s, I2C at %d Hz, conversion time %d us, poll every %u us\n",
+           seconds, frequencyHz, MPRLS_CONVERSION_TIME_US, (unsigned)pollIntervalMicroseconds);
+
+    printResult("blocking wait_us loop", runBlockingLoop(seconds, frequencyHz));
+
+    MockMprlsBus statusBus(frequencyHz, MPRLS_CONVERSION_TIME_US);
+    MprlsAcquisition<MockMprlsBus> statusAcquisition(statusBus, 0x18 << 1);
+    printResult("state machine, busy bit", runStateMachine(statusAcquisition, statusBus, seconds, pollIntervalMicroseconds));
+
+    MockMprlsBus pinBus(frequencyHz, MPRLS_CONVERSION_TIME_US);
+    MockEndOfConversionPin pin = { &pinBus };
+    MprlsAcquisition<MockMprlsBus, MockEndOfConversionPin> pinAcquisition(pinBus, 0x18 << 1, pin);
+    printResult("state machine, EOC pin", runStateMachine(pinAcquisition, pinBus, seconds, pollIntervalMicroseconds));
+
+    return 0;
+}
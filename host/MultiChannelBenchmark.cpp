@@ -0,0 +1,135 @@
+/**
+ * @file MultiChannelBenchmark.cpp
+ * @brief Reads several simulated MPRLS sensors, each on its own bus, from one thread and from one thread per channel
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -pthread -I. -DACQUISITION_CHANNEL_BUFFER_SIZE=4096 host/MultiChannelBenchmark.cpp \
+ *         bpm/AcquisitionChannel.cpp -o multi_channel_benchmark
+ *     ./multi_channel_benchmark [channels] [seconds] [bus frequency of channel 0 in Hz]
+ *
+ * Runs in real time. The sensors answer over simulated buses that hold the calling thread for as long as
+ * the transfer would take, so a low bus frequency for channel 0 shows how a slow bus delays the others
+ * when every channel is polled from the same loop, and that it does not when each has its own thread.
+ * Every mode prints the samples/sec of each channel, the aggregate throughput and the sample skew.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "bpm/AcquisitionChannel.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/SteadyMeasurementClock.h"
+
+//Time between two polls once the conversion time has passed, like ACQUISITION_CHANNEL_POLL_INTERVAL_US on the board
+static const uint32_t pollIntervalMicroseconds = 100;
+
+/**
+ * @brief The simulated hardware of one channel: its trace (each sensor keeps its own read cursor) and its bus
+ */
+struct SimulatedChannel
+{
+    SimulatedChannel(int number, MeasurementClock &clock, int busFrequencyHz)
+        : trace(PressureTrace::syntheticDeflation()), sensor(clock, trace, 0x18 << 1, busFrequencyHz),
+          channel(number, sensor, 0x18 << 1)
+    {
+    }
+
+    PressureTrace trace;
+    SimulatedMprlsSensor sensor;
+    AcquisitionChannel channel;
+};
+
+//Sleeps until the given time of the clock, or for one poll interval if it has already passed
+static void waitUntil(MeasurementClock &clock, uint64_t dueMicroseconds)
+{
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    if(dueMicroseconds > nowMicroseconds + pollIntervalMicroseconds)
+        clock.delayMicroseconds((uint32_t)(dueMicroseconds - nowMicroseconds));
+    else
+        clock.delayMicroseconds(pollIntervalMicroseconds);
+}
+
+//Every channel from the calling thread, one after the other
+static void runSequential(MultiChannelAcquisition &channels, MeasurementClock &clock, uint64_t endMicroseconds)
+{
+    while(clock.nowMicroseconds() < endMicroseconds)
+    {
+        if(channels.serviceAll(clock.nowMicroseconds()) == 0)
+            waitUntil(clock, channels.getNextServiceMicroseconds());
+    }
+}
+
+//One thread per channel, the same loop the mbed threads run
+static void runThreaded(MultiChannelAcquisition &channels, MeasurementClock &clock, uint64_t endMicroseconds)
+{
+    std::vector<std::thread> threads;
+    for(int i = 0; i < channels.getChannelCount(); i++)
+    {
+        AcquisitionChannel *channel = &channels.getChannel(i);
+        threads.push_back(std::thread([channel, &clock, endMicroseconds]() {
+            while(clock.nowMicroseconds() < endMicroseconds)
+            {
+                if(!channel->service(clock.nowMicroseconds()))
+                    waitUntil(clock, channel->getNextServiceMicroseconds());
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+static void report(const char *modeName, MultiChannelAcquisition &channels, double seconds)
+{
+    long totalSamples = 0;
+    printf("%s\n", modeName);
+    for(int i = 0; i < channels.getChannelCount(); i++)
+    {
+        const AcquisitionChannel &channel = channels.getChannel(i);
+        totalSamples += channel.getSampleCount() + channel.getDroppedSamples();
+        printf("  channel %d : %7.1f samples/s, %u busy polls, %u dropped\n", channel.getChannelNumber(),
+               (channel.getSampleCount() + channel.getDroppedSamples()) / seconds, channel.getStatistics().busyPolls,
+               channel.getDroppedSamples());
+    }
+    MultiChannelSkew skew = channels.calculateSkew();
+    printf("  aggregate : %7.1f samples/s\n", totalSamples / seconds);
+    printf("  skew      : mean %.1f us, max %llu us over %d samples\n", skew.meanSkewMicroseconds,
+           (unsigned long long)skew.maxSkewMicroseconds, skew.comparedSamples);
+}
+
+int main(int argc, char **argv)
+{
+    int channelCount = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    int firstBusFrequency = argc > 3 ? atoi(argv[3]) : 20000;
+    if(channelCount < 1 || channelCount > MULTI_CHANNEL_MAX_CHANNELS)
+    {
+        fprintf(stderr, "Between 1 and %d channels\n", MULTI_CHANNEL_MAX_CHANNELS);
+        return 1;
+    }
+
+    printf("%d channels, %.1f s, channel 0 at %d Hz, the others at 400000 Hz\n\n", channelCount, seconds, firstBusFrequency);
+    const char *modeNames[] = { "one thread, channels polled in turn", "one thread per channel" };
+    for(int mode = 0; mode < 2; mode++)
+    {
+        SteadyMeasurementClock clock;
+        std::vector<std::unique_ptr<SimulatedChannel> > hardware;
+        MultiChannelAcquisition channels;
+        for(int i = 0; i < channelCount; i++)
+        {
+            hardware.push_back(std::unique_ptr<SimulatedChannel>(new SimulatedChannel(i, clock, i == 0 ? firstBusFrequency : 400000)));
+            channels.addChannel(hardware.back()->channel);
+        }
+
+        uint64_t endMicroseconds = clock.nowMicroseconds() + (uint64_t)(seconds * 1e6);
+        if(mode == 0)
+            runSequential(channels, clock, endMicroseconds);
+        else
+            runThreaded(channels, clock, endMicroseconds);
+        report(modeNames[mode], channels, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file OscillometricWaveform.h
+ * @brief Seedable synthetic cuff pressure with known blood pressure, generated one sample at a time
+ */
+
+#ifndef OSCILLOMETRIC_WAVEFORM_H
+#define OSCILLOMETRIC_WAVEFORM_H
+
+#include <stdint.h>
+#include <math.h>
+
+/**
+ * @brief Everything that shapes a synthetic deflation. The defaults are the 120/80 mmHg deflation the
+ * host tools use when no trace is given.
+ */
+struct WaveformParameters
+{
+    //The blood pressure and heart rate the oscillations are built from
+    double systolic = 120.0;
+    double diastolic = 80.0;
+    double heartRate = 72.0;
+    //Deflation rate in mmHg/s; the firmware asks for 3 to 5
+    double deflationRate = 4.0;
+    //Samples per second; 1 / 5.2 ms is a conversion and two polls as on the board
+    double sampleRateHz = 1000000.0 / 5200.0;
+    //Standard deviation of the white noise added to every sample, in mmHg
+    double noiseMmHg = 0.0;
+    //Seeds the noise; the same parameters and seed always give the same samples
+    uint64_t seed = 1;
+    //The cuff is pumped to the peak pressure in pumpSeconds, held for holdSeconds and deflated to the end
+    //pressure
+    double peakPressure = 160.0;
+    double endPressure = 20.0;
+    double pumpSeconds = 8.0;
+    double holdSeconds = 1.0;
+    //Peak to peak amplitude of the largest oscillation, at the mean arterial pressure
+    double maximumAmplitude = 3.0;
+};
+
+/**
+ * @brief The values a perfect estimator gives for a synthetic deflation
+ */
+struct WaveformGroundTruth
+{
+    double systolic;
+    double diastolic;
+    //Where the oscillation amplitude peaks, diastolic + (systolic - diastolic) / 3
+    double meanArterial;
+    double heartRate;
+};
+
+/**
+ * @brief One generated sample
+ */
+struct WaveformSample
+{
+    //Seconds since the pump started
+    double timeSeconds;
+    //Cuff pressure with the oscillation and the noise, in mmHg
+    double pressure;
+};
+
+/**
+ * @brief Generates a synthetic oscillometric deflation sample by sample, in constant memory.
+ *
+ * The cuff pressure ramps up linearly, holds and deflates at a steady rate; on top of it every beat is a
+ * sharp rise and a slower decay whose amplitude follows a Gaussian in the cuff pressure, peaking at the
+ * mean arterial pressure and falling to 0.5 of the peak at systolic and 0.8 at diastolic, the ratios the
+ * firmware searches for. Sample i is at i / sampleRateHz. The noise comes from a xorshift generator and
+ * the Box-Muller transform, not from <random>, so a seed gives the same samples with every compiler.
+ */
+class OscillometricWaveform
+{
+public:
+    explicit OscillometricWaveform(const WaveformParameters &waveformParameters) : parameters(waveformParameters)
+    {
+        reset();
+    }
+
+    //Starts the deflation again from the first sample, with the same noise
+    void reset()
+    {
+        sampleIndex = 0;
+        randomState = parameters.seed * 0x9E3779B97F4A7C15ull + 1;
+        hasSpareNoise = false;
+        spareNoise = 0.0;
+    }
+
+    /**
+     * @brief The next sample
+     * @return false once the deflation reached the end pressure
+     */
+    bool next(WaveformSample &sample)
+    {
+        if(sampleIndex >= getSampleCount())
+            return false;
+        sample.timeSeconds = sampleIndex / parameters.sampleRateHz;
+        sample.pressure = pressureAt(parameters, sample.timeSeconds);
+        if(parameters.noiseMmHg > 0.0)
+            sample.pressure += parameters.noiseMmHg * nextGaussian();
+        sampleIndex++;
+        return true;
+    }
+
+    //Samples in the whole deflation
+    uint64_t getSampleCount() const { return (uint64_t)(durationSeconds(parameters) * parameters.sampleRateHz) + 1; }
+    const WaveformParameters &getParameters() const { return parameters; }
+
+    WaveformGroundTruth getGroundTruth() const
+    {
+        WaveformGroundTruth truth;
+        truth.systolic = parameters.systolic;
+        truth.diastolic = parameters.diastolic;
+        truth.meanArterial = meanArterialPressure(parameters);
+        truth.heartRate = parameters.heartRate;
+        return truth;
+    }
+
+    //Seconds from the start of the pumping to the end of the deflation
+    static double durationSeconds(const WaveformParameters &parameters)
+    {
+        return parameters.pumpSeconds + parameters.holdSeconds +
+               (parameters.peakPressure - parameters.endPressure) / parameters.deflationRate;
+    }
+
+    static double meanArterialPressure(const WaveformParameters &parameters)
+    {
+        return parameters.diastolic + (parameters.systolic - parameters.diastolic) / 3.0;
+    }
+
+    //The noiseless cuff pressure with its oscillation at any time
+    static double pressureAt(const WaveformParameters &parameters, double timeSeconds)
+    {
+        double cuff = 0.0;
+        if(timeSeconds < parameters.pumpSeconds)
+            cuff = parameters.peakPressure * timeSeconds / parameters.pumpSeconds;
+        else if(timeSeconds < parameters.pumpSeconds + parameters.holdSeconds)
+            cuff = parameters.peakPressure;
+        else
+            cuff = parameters.peakPressure - parameters.deflationRate * (timeSeconds - parameters.pumpSeconds - parameters.holdSeconds);
+
+        //The oscillation envelope falls to about half at systolic and 0.8 at diastolic
+        const double meanArterial = meanArterialPressure(parameters);
+        double width = cuff > meanArterial ? (parameters.systolic - meanArterial) / sqrt(log(2.0))
+                                           : (meanArterial - parameters.diastolic) / sqrt(log(1.0 / 0.8));
+        double amplitude = parameters.maximumAmplitude * exp(-pow((cuff - meanArterial) / width, 2.0));
+
+        //A sharp rise followed by a slower decay within every beat
+        const double beatSeconds = 60.0 / parameters.heartRate;
+        double phase = fmod(timeSeconds, beatSeconds) / beatSeconds;
+        double pulse = phase < 0.15 ? sin(M_PI / 2.0 * phase / 0.15) : exp(-(phase - 0.15) / 0.25);
+
+        return cuff + amplitude * (pulse - 0.5);
+    }
+
+private:
+    //Uniform in (0, 1), xorshift64*
+    double nextUniform()
+    {
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        return ((randomState * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0) + 0.5 / 9007199254740992.0;
+    }
+
+    //Standard normal, two at a time
+    double nextGaussian()
+    {
+        if(hasSpareNoise)
+        {
+            hasSpareNoise = false;
+            return spareNoise;
+        }
+        double radius = sqrt(-2.0 * log(nextUniform()));
+        double angle = 2.0 * M_PI * nextUniform();
+        spareNoise = radius * sin(angle);
+        hasSpareNoise = true;
+        return radius * cos(angle);
+    }
+
+    WaveformParameters parameters;
+    //Index of the next sample
+    uint64_t sampleIndex;
+    //State of the noise generator and the second value of the last Box-Muller pair
+    uint64_t randomState;
+    bool hasSpareNoise;
+    double spareNoise;
+};
+
+#endif
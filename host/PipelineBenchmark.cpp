@@ -0,0 +1,206 @@
+/**
+ * @file PipelineBenchmark.cpp
+ * @brief Checks the preset MeasurementPipelines against BloodPressureMeasurement and times them per sample
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/PipelineBenchmark.cpp bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o pipeline_benchmark
+ *     ./pipeline_benchmark [trace.csv]
+ *
+ * The samples of the trace (a synthetic 120/80 deflation by default) are read once through a simulated
+ * sensor, then pushed through every preset of bpm/PipelinePolicies.h as fast as they go; the cost per
+ * sample is the wall time, and the time stamp counter ticks on x86. The presets that poll a sensor are
+ * also run against the simulated sensor and must give the result of BloodPressureMeasurement with the
+ * same stages, heart rate included.
+ *
+ * The object bytes printed are sizeof the pipeline, the RAM it takes, not its code. Code size: build with
+ * -DPIPELINE_BENCHMARK_PRESETS=n, a mask of the presets to put in (1 minimal, 2 telemetry, 4 host batch,
+ * 0 none; the checks need all of them), and compare the text and data of `size` for each build with the
+ * one of 0. Add -Os -ffunction-sections -fdata-sections -Wl,--gc-sections to see what a firmware build keeps.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "bpm/PipelinePolicies.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+//Which presets are built in: 1 minimal, 2 telemetry, 4 host batch
+#ifndef PIPELINE_BENCHMARK_PRESETS
+#define PIPELINE_BENCHMARK_PRESETS 7
+#endif
+
+//Each preset is timed over the recording until at least this many samples went through
+static const size_t timedSampleCount = 20000000;
+
+/**
+ * @brief Telemetry that goes nowhere but is counted
+ */
+class CountingTelemetrySink : public TelemetrySink
+{
+public:
+    CountingTelemetrySink() : bytes(0) {}
+    virtual void write(const uint8_t *, size_t length) { bytes += length; }
+    size_t bytes;
+};
+
+static uint64_t readTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//Reads the trace through a simulated sensor, polling it the way BloodPressureMeasurement::run() does
+static std::vector<MprlsSample> recordSamples(const PressureTrace &trace)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    MprlsAcquisition<SimulatedMprlsSensor> acquisition(sensor, 0x18 << 1);
+    std::vector<MprlsSample> samples;
+    while(clock.nowMicroseconds() < (uint64_t)(trace.durationSeconds() * 1e6))
+    {
+        MprlsSample sample;
+        if(acquisition.poll(clock.nowMicroseconds(), sample))
+            samples.push_back(sample);
+        else
+            clock.delayMicroseconds(MEASUREMENT_POLL_INTERVAL_US);
+    }
+    return samples;
+}
+
+//Pushes the recording through a pipeline again and again, returns the result of the last pass
+template <typename Pipeline>
+static BloodPressureResult timePipeline(const char *name, Pipeline &pipeline, const std::vector<MprlsSample> &samples)
+{
+    BloodPressureResult result;
+    size_t processedSamples = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startTicks = readTicks();
+    while(processedSamples < timedSampleCount)
+    {
+        pipeline.reset();
+        for(size_t i = 0; i < samples.size() && !pipeline.isFinished(); i++)
+        {
+            pipeline.push(samples[i]);
+            processedSamples++;
+        }
+        result = pipeline.finish();
+    }
+    uint64_t ticks = readTicks() - startTicks;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-26s %8.1f ns %8.1f ticks   %6.2f/%6.2f mmHg, heart rate %d, %d samples, %zu object bytes\n", name,
+           seconds * 1e9 / processedSamples, (double)ticks / processedSamples, result.systolicPressure,
+           result.diastolicPressure, result.heartRate, result.sampleCount, sizeof(Pipeline));
+    return result;
+}
+
+static bool isSameResult(const BloodPressureResult &a, const BloodPressureResult &b)
+{
+    return a.sampleCount == b.sampleCount && a.systolicIndex == b.systolicIndex && a.diastolicIndex == b.diastolicIndex &&
+           a.systolicPressure == b.systolicPressure && a.diastolicPressure == b.diastolicPressure &&
+           a.meanArterialPressureSlope == b.meanArterialPressureSlope && a.heartRate == b.heartRate &&
+           a.confidence == b.confidence;
+}
+
+static BloodPressureResult runReference(const PressureTrace &trace, bool isEnvelopeAnalysisEnabled)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+    return measurement.run();
+}
+
+//Runs a preset that polls the simulated sensor and compares it with BloodPressureMeasurement
+template <typename Pipeline>
+static bool checkAgainstReference(const char *name, const PressureTrace &trace, const BloodPressureResult &reference,
+                                  const typename Pipeline::SinkType &sink)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    Pipeline pipeline(MprlsAcquisition<SimulatedMprlsSensor>(sensor, 0x18 << 1), sink);
+    BloodPressureResult result = pipeline.run(clock);
+    bool isSame = isSameResult(result, reference) && result.maxSlope == reference.maxSlope;
+    printf("%-26s %s BloodPressureMeasurement (%.2f/%.2f mmHg, heart rate %d)\n", name,
+           isSame ? "gives the result of" : "DIFFERS from", result.systolicPressure, result.diastolicPressure,
+           result.heartRate);
+    return isSame;
+}
+
+int main(int argc, char **argv)
+{
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    if(argc > 1 && (!trace.loadCsv(argv[1]) || trace.size() < 2))
+    {
+        fprintf(stderr, "Could not read a pressure trace from %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<MprlsSample> samples = recordSamples(trace);
+    printf("%zu samples recorded\n\n", samples.size());
+
+    bool isPassed = true;
+    CountingTelemetrySink telemetrySink;
+    TelemetryEncoder telemetryEncoder(telemetrySink);
+    (void)telemetryEncoder;
+
+#if PIPELINE_BENCHMARK_PRESETS == 7
+    typedef OnTargetMinimalPipeline<SimulatedMprlsSensor> SimulatedMinimalPipeline;
+    typedef OnTargetTelemetryPipeline<SimulatedMprlsSensor> SimulatedTelemetryPipeline;
+    BloodPressureResult slopeReference = runReference(trace, false);
+    BloodPressureResult envelopeReference = runReference(trace, true);
+    isPassed = checkAgainstReference<SimulatedMinimalPipeline>("on-target minimal", trace, slopeReference,
+                                                               NoSampleSink()) && isPassed;
+    isPassed = checkAgainstReference<SimulatedTelemetryPipeline>("on-target with telemetry", trace, envelopeReference,
+                                                                 TelemetrySampleSink(telemetryEncoder)) && isPassed;
+    printf("\n");
+#endif
+
+    printf("%-26s %11s %14s   %s\n", "Per sample", "time", "TSC", "result, object bytes");
+#if PIPELINE_BENCHMARK_PRESETS & 1
+    {
+        VirtualMeasurementClock clock;
+        SimulatedMprlsSensor sensor(clock, trace);
+        OnTargetMinimalPipeline<SimulatedMprlsSensor> pipeline((MprlsAcquisition<SimulatedMprlsSensor>(sensor, 0x18 << 1)));
+        timePipeline("on-target minimal", pipeline, samples);
+    }
+#endif
+#if PIPELINE_BENCHMARK_PRESETS & 2
+    {
+        VirtualMeasurementClock clock;
+        SimulatedMprlsSensor sensor(clock, trace);
+        OnTargetTelemetryPipeline<SimulatedMprlsSensor> pipeline(MprlsAcquisition<SimulatedMprlsSensor>(sensor, 0x18 << 1),
+                                                                 TelemetrySampleSink(telemetryEncoder));
+        timePipeline("on-target with telemetry", pipeline, samples);
+    }
+#endif
+#if PIPELINE_BENCHMARK_PRESETS & 4
+    {
+        HostBatchPipeline pipeline((PushedSampleSource()));
+        BloodPressureResult result = timePipeline("host batch", pipeline, samples);
+#if PIPELINE_BENCHMARK_PRESETS == 7
+        if(!isSameResult(result, envelopeReference))
+        {
+            printf("host batch DIFFERS from BloodPressureMeasurement\n");
+            isPassed = false;
+        }
+#else
+        (void)result;
+#endif
+    }
+#endif
+
+    printf("\n%s\n", isPassed ? "All checks passed" : "Some checks FAILED");
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file PressureTrace.h
+ * @brief A cuff pressure over time, read from a CSV file or synthesised, used to drive simulated sensors
+ */
+
+#ifndef PRESSURE_TRACE_H
+#define PRESSURE_TRACE_H
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "OscillometricWaveform.h"
+
+/**
+ * @brief Cuff pressure points in time order, linearly interpolated in between
+ */
+class PressureTrace
+{
+public:
+    //Adds a point, times must increase
+    void addPoint(double timeSeconds, double pressureMmHg)
+    {
+        times.push_back(timeSeconds);
+        pressures.push_back(pressureMmHg);
+    }
+
+    //The pressure at any time; before the first and after the last point the end values are held
+    double pressureAt(double timeSeconds) const
+    {
+        if(times.empty())
+            return 0.0;
+        if(timeSeconds <= times.front())
+            return pressures.front();
+        if(timeSeconds >= times.back())
+            return pressures.back();
+
+        //Points are usually read in order, so start the search where the last one ended
+        if(cursor >= times.size() || times[cursor] > timeSeconds)
+            cursor = 0;
+        while(cursor + 1 < times.size() && times[cursor + 1] < timeSeconds)
+            cursor++;
+
+        double fraction = (timeSeconds - times[cursor]) / (times[cursor + 1] - times[cursor]);
+        return pressures[cursor] + fraction * (pressures[cursor + 1] - pressures[cursor]);
+    }
+
+    double durationSeconds() const { return times.empty() ? 0.0 : times.back(); }
+
+    size_t size() const { return times.size(); }
+
+    /**
+     * @brief Reads "time in seconds, pressure in mmHg" lines; lines that do not start with a number are skipped
+     * @return false if the file could not be opened
+     */
+    bool loadCsv(const char *path)
+    {
+        FILE *file = fopen(path, "r");
+        if(file == 0)
+            return false;
+
+        char line[256];
+        while(fgets(line, sizeof(line), file))
+        {
+            double timeSeconds = 0.0;
+            double pressureMmHg = 0.0;
+            if(sscanf(line, "%lf , %lf", &timeSeconds, &pressureMmHg) == 2)
+                addPoint(timeSeconds, pressureMmHg);
+        }
+        fclose(file);
+        return true;
+    }
+
+    /**
+     * @brief A cuff pumped to 160 mmHg and deflated at a steady rate down to 20 mmHg, with oscillations
+     * whose amplitude peaks at the mean arterial pressure (the model of host/OscillometricWaveform.h)
+     */
+    static PressureTrace syntheticDeflation(double systolic = 120.0, double diastolic = 80.0, double heartRate = 72.0,
+                                            double deflationRate = 4.0, double stepSeconds = 0.001)
+    {
+        WaveformParameters parameters;
+        parameters.systolic = systolic;
+        parameters.diastolic = diastolic;
+        parameters.heartRate = heartRate;
+        parameters.deflationRate = deflationRate;
+
+        PressureTrace trace;
+        const double totalSeconds = OscillometricWaveform::durationSeconds(parameters);
+        for(double t = 0.0; t <= totalSeconds; t += stepSeconds)
+            trace.addPoint(t, OscillometricWaveform::pressureAt(parameters, t));
+        return trace;
+    }
+
+private:
+    std::vector<double> times;
+    std::vector<double> pressures;
+    mutable size_t cursor = 0;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @file RepeatMeasurementBenchmark.cpp
+ * @brief Repeated measurements with one reused BloodPressureMeasurement: same results, no heap, and the turnaround
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/RepeatMeasurementBenchmark.cpp bpm/MeasurementScheduler.cpp \
+ *         bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp \
+ *         bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp bpm/EnvelopeFit.cpp -o repeat_measurement_benchmark
+ *     ./repeat_measurement_benchmark [--envelope] [--count N] [trace.csv]
+ *
+ * The trace (a synthetic 120/80 deflation by default) is measured by a fresh measurement object, then by
+ * one object over and over through bpm/MeasurementScheduler: back to back, every 60 s and every 30 s
+ * (shorter than a measurement, so slots are missed). Every repeat must give the result of the fresh
+ * object and allocate nothing; the times are on the virtual clock, but for reset() which is timed for
+ * real. A second run() without reset() must measure anew and match too. Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include "bpm/MeasurementScheduler.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+//Every allocation of the program, so the repeats can be checked to make none
+static std::atomic<uint64_t> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+    heapAllocations++;
+    void *memory = malloc(size);
+    if(memory == 0)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+static bool isSameResult(const BloodPressureResult &a, const BloodPressureResult &b)
+{
+    return a.sampleCount == b.sampleCount && a.maxSlope == b.maxSlope && a.systolicIndex == b.systolicIndex &&
+           a.diastolicIndex == b.diastolicIndex && a.systolicPressure == b.systolicPressure &&
+           a.diastolicPressure == b.diastolicPressure && a.meanArterialPressureSlope == b.meanArterialPressureSlope &&
+           a.positiveSlopeCount == b.positiveSlopeCount && a.heartRate == b.heartRate && a.confidence == b.confidence;
+}
+
+static void printResult(const char *name, const BloodPressureResult &result, double seconds)
+{
+    printf("%-24s: %.2f/%.2f mmHg, MAP %.2f, heart rate %d, %d samples, %.2f s\n", name, result.systolicPressure,
+           result.diastolicPressure, result.meanArterialPressureSlope, result.heartRate, result.sampleCount, seconds);
+}
+
+//Runs count measurements of the trace through the scheduler, each one checked against the reference
+static bool runRepeats(const char *name, const PressureTrace &trace, bool isEnvelopeAnalysisEnabled,
+                       uint64_t intervalMicroseconds, int count, const BloodPressureResult &reference)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+    MeasurementScheduler scheduler(measurement, clock);
+    scheduler.setInterval(intervalMicroseconds);
+
+    int identicalCount = 0;
+    double resetSeconds = 0.0;
+    uint64_t allocationsBefore = heapAllocations.load();
+    printf("%-24s: starts at", name);
+    for(int i = 0; i < count; i++)
+    {
+        //Back to back means every measurement is asked for as soon as the previous one ended
+        if(intervalMicroseconds == 0)
+            scheduler.requestMeasurement();
+        scheduler.waitUntilDue();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scheduler.beginMeasurement();
+        resetSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        //The patient is ready the moment the measurement starts
+        sensor.restartTrace(clock.nowMicroseconds());
+        printf(" %.1f", clock.nowMicroseconds() / 1e6);
+        BloodPressureResult result = measurement.run();
+        scheduler.completeMeasurement();
+        identicalCount += isSameResult(result, reference) ? 1 : 0;
+    }
+    uint64_t allocations = heapAllocations.load() - allocationsBefore;
+
+    const MeasurementSchedulerStatistics &statistics = scheduler.getStatistics();
+    printf(" s\n");
+    printf("%-24s  identical to a fresh object : %d of %d | heap allocations : %llu\n", "", identicalCount, count,
+           (unsigned long long)allocations);
+    printf("%-24s  turnaround : mean %.2f ms, %.2f to %.2f ms | start latency max %.2f ms | missed slots %lu | reset() %.2f us\n",
+           "", scheduler.getMeanTurnaroundMicroseconds() / 1e3, statistics.minTurnaroundMicroseconds / 1e3,
+           statistics.maxTurnaroundMicroseconds / 1e3, statistics.maxStartLatencyMicroseconds / 1e3,
+           (unsigned long)statistics.missedSlots, resetSeconds * 1e6 / count);
+    return identicalCount == count && allocations == 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool isEnvelopeAnalysisEnabled = false;
+    int count = 20;
+    const char *tracePath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--envelope") == 0)
+            isEnvelopeAnalysisEnabled = true;
+        else if(strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+            count = atoi(argv[++i]);
+        else
+            tracePath = argv[i];
+    }
+
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    if(tracePath != 0 && (!trace.loadCsv(tracePath) || trace.size() < 2))
+    {
+        fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+        return 1;
+    }
+
+    //The reference: a measurement object that never measured before
+    BloodPressureResult reference;
+    bool isSecondRunMeasured = false;
+    {
+        VirtualMeasurementClock clock;
+        SimulatedMprlsSensor sensor(clock, trace);
+        BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+        measurement.setSampleEcho(false);
+        measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+        reference = measurement.run();
+        printResult("Fresh object", reference, clock.nowMicroseconds() / 1e6);
+
+        //run() on a finished measurement resets it first, so a second run samples the trace again
+        sensor.restartTrace(clock.nowMicroseconds());
+        uint64_t startMicroseconds = clock.nowMicroseconds();
+        BloodPressureResult second = measurement.run();
+        double secondSeconds = (clock.nowMicroseconds() - startMicroseconds) / 1e6;
+        printResult("Second run, no reset()", second, secondSeconds);
+        isSecondRunMeasured = secondSeconds > 0.0 && isSameResult(second, reference);
+        if(!isSecondRunMeasured)
+            printf("%-24s  did not measure anew\n", "");
+    }
+
+    bool isPassed = isSecondRunMeasured;
+    isPassed = runRepeats("Back to back", trace, isEnvelopeAnalysisEnabled, 0, count, reference) && isPassed;
+    isPassed = runRepeats("Every 60 s", trace, isEnvelopeAnalysisEnabled, 60000000, count / 4 + 1, reference) && isPassed;
+    isPassed = runRepeats("Every 30 s", trace, isEnvelopeAnalysisEnabled, 30000000, count / 4 + 1, reference) && isPassed;
+    printf("%s\n", isPassed ? "All checks passed" : "Some checks FAILED");
+    return isPassed ? 0 : 1;
+}
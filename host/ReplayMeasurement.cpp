@@ -0,0 +1,104 @@
+/**
+ * @file ReplayMeasurement.cpp
+ * @brief Runs the firmware measurement flow against a simulated MPRLS sensor on a virtual clock
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/ReplayMeasurement.cpp bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o replay_measurement
+ *     ./replay_measurement [--echo] [--envelope] [--early] [--fit] [trace.csv]
+ *
+ * Add -DHOT_PATH_PROFILING and bpm/HotPathProfiler.cpp to print the sample rate, the timestamp jitter and
+ * the cost of every hot path stage (bus transfers on the simulated sensor, conversion, filters, output, analysis).
+ *
+ * The trace is a CSV file of "time in seconds, pressure in mmHg" covering the pumping and the deflation.
+ * Without a file, a synthetic 120/80 mmHg deflation at 4 mmHg/s is used. The BloodPressureMeasurement
+ * class is the same one main.cpp runs on the board; only the bus and the clock are simulated.
+ * --envelope analyses the filtered envelope of the pulses instead of the raw slopes. --early (implies
+ * --envelope) ends the deflation as soon as the diastolic point is settled. --fit (implies --envelope) takes
+ * the pressures from the envelope fit (bpm/EnvelopeFit.h) and prints the fitted widths.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "bpm/BloodPressureMeasurement.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+int main(int argc, char **argv)
+{
+    bool isEchoEnabled = false;
+    bool isEnvelopeAnalysisEnabled = false;
+    bool isEarlyTerminationEnabled = false;
+    bool isEnvelopeFitEnabled = false;
+    const char *tracePath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--echo") == 0)
+            isEchoEnabled = true;
+        else if(strcmp(argv[i], "--envelope") == 0)
+            isEnvelopeAnalysisEnabled = true;
+        else if(strcmp(argv[i], "--early") == 0)
+            isEnvelopeAnalysisEnabled = isEarlyTerminationEnabled = true;
+        else if(strcmp(argv[i], "--fit") == 0)
+            isEnvelopeAnalysisEnabled = isEnvelopeFitEnabled = true;
+        else
+            tracePath = argv[i];
+    }
+
+    PressureTrace trace;
+    if(tracePath != 0)
+    {
+        if(!trace.loadCsv(tracePath) || trace.size() < 2)
+        {
+            fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+            return 1;
+        }
+    }
+    else
+    {
+        trace = PressureTrace::syntheticDeflation();
+    }
+
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(isEchoEnabled);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+    measurement.setEarlyTermination(isEarlyTerminationEnabled);
+    measurement.setEnvelopeFit(isEnvelopeFitEnabled);
+#ifdef HOT_PATH_PROFILING
+    HotPathProfiler profiler;
+    measurement.setProfiler(&profiler);
+#endif
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BloodPressureResult result = measurement.run();
+    double wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\nSimulated time        : %.3f s\n", clock.nowMicroseconds() / 1e6);
+    printf("Wall time             : %.3f ms\n", wallMilliseconds);
+    printf("Samples analysed      : %d\n", result.sampleCount);
+    printf("Systolic              : %f (index %d)\n", result.systolicPressure, result.systolicIndex);
+    printf("Diastolic             : %f (index %d)\n", result.diastolicPressure, result.diastolicIndex);
+    printf("MAP (slope)           : %f (index %d)\n", result.meanArterialPressureSlope, result.maxSlopeIndex);
+    printf("MAP (weighted)        : %f\n", result.meanArterialPressureWeightedAverage);
+    printf("Pulse pressure        : %f\n", result.pulsePressure);
+    printf("Positive slopes       : %d\n", result.positiveSlopeCount);
+    printf("Heart rate            : %d\n", result.heartRate);
+    printf("Confidence            : %.2f\n", result.confidence);
+    printf("Exact                 : %s\n", result.isExact ? "yes" : "no");
+    printf("Ended early           : %s\n", measurement.isEndedEarly() ? "yes" : "no");
+    if(isEnvelopeFitEnabled)
+    {
+        EnvelopeFitResult fit = measurement.getEnvelopeFit();
+        printf("Envelope fit          : %s, widths %.2f / %.2f mmHg, %d bins, residual %.6f\n", fit.isValid ? "valid" : "failed",
+               fit.systolicWidth, fit.diastolicWidth, fit.fittedBins, fit.residual);
+    }
+#ifdef HOT_PATH_PROFILING
+    profiler.printSummary();
+#endif
+    return 0;
+}
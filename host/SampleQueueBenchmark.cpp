@@ -0,0 +1,265 @@
+/**
+ * @file SampleQueueBenchmark.cpp
+ * @brief Timestamp jitter with the console printed from the sampling loop and through a SampleQueue
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -pthread -I. host/SampleQueueBenchmark.cpp -o sample_queue_benchmark
+ *     ./sample_queue_benchmark [seconds] [console baud rate]
+ *
+ * First the raw cost of push() and pop() is measured, and the order of a million samples handed from one
+ * thread to another is checked. Then a
+ * simulated MPRLS sensor is read in real time for a few seconds, once printing every sample from the
+ * sampling loop (as the firmware used to) and once with the sampling thread only queueing the samples
+ * for a console thread. The console is a simulated UART that holds the caller for 10 bit times per
+ * character. For both runs it prints how late the samples were read after their conversion was due,
+ * the spread of the time between samples, the cost of the sampling step and the samples lost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "bpm/MprlsAcquisition.h"
+#include "bpm/SampleQueue.h"
+#include "bpm/MprlsTransferFunction.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/SteadyMeasurementClock.h"
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+//Keeps the compiler from dropping the work being timed
+static volatile uint32_t benchmarkSink;
+
+//Time between two polls once the conversion time has passed
+static const uint32_t pollIntervalMicroseconds = 100;
+
+/**
+ * @brief A serial console: writing a line takes as long as the UART needs to shift it out
+ */
+class SimulatedConsole
+{
+public:
+    SimulatedConsole(int baudRate) : baud(baudRate), characters(0) {}
+
+    void printSample(const MprlsSample &sample)
+    {
+        char line[96];
+        int length = snprintf(line, sizeof(line), "\nTimeStamp : %d | Pressure : %f \n", (int)(sample.timeMicroseconds / 1000),
+                              MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(sample.counts));
+        characters += length;
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)length * 10 * 1000000 / baud));
+    }
+
+private:
+    int baud;
+    long characters;
+};
+
+/**
+ * @brief What one run measured
+ */
+struct JitterReport
+{
+    std::vector<double> latenessMicroseconds;
+    std::vector<double> intervalMicroseconds;
+    double totalProduceNanoseconds = 0.0;
+    double maxProduceNanoseconds = 0.0;
+    long samples = 0;
+    uint32_t overflows = 0;
+    uint32_t highWaterMark = 0;
+};
+
+//One sampling step: poll once, remember how late the sample was and how long the step took
+template <typename Handler>
+static bool sampleOnce(MprlsAcquisition<PressureSensorBus> &acquisition, MeasurementClock &clock, JitterReport &report,
+                       uint64_t &previousTime, Handler handleSample)
+{
+    MprlsSample sample;
+    uint64_t dueMicroseconds = acquisition.getNextPollMicroseconds();
+    BenchmarkClock::time_point start = BenchmarkClock::now();
+    if(!acquisition.poll(clock.nowMicroseconds(), sample))
+        return false;
+    handleSample(sample);
+    double produceNanoseconds = std::chrono::duration<double, std::nano>(BenchmarkClock::now() - start).count();
+
+    report.totalProduceNanoseconds += produceNanoseconds;
+    if(produceNanoseconds > report.maxProduceNanoseconds)
+        report.maxProduceNanoseconds = produceNanoseconds;
+    if(dueMicroseconds != 0)
+        report.latenessMicroseconds.push_back((double)(sample.timeMicroseconds - dueMicroseconds));
+    if(previousTime != 0)
+        report.intervalMicroseconds.push_back((double)(sample.timeMicroseconds - previousTime));
+    previousTime = sample.timeMicroseconds;
+    report.samples++;
+    return true;
+}
+
+//Sleeps until the conversion is due, or one poll interval if it already is
+static void waitForConversion(MprlsAcquisition<PressureSensorBus> &acquisition, MeasurementClock &clock)
+{
+    uint64_t nowMicroseconds = clock.nowMicroseconds();
+    uint64_t dueMicroseconds = acquisition.getNextPollMicroseconds();
+    clock.delayMicroseconds(dueMicroseconds > nowMicroseconds + pollIntervalMicroseconds ?
+                            (uint32_t)(dueMicroseconds - nowMicroseconds) : pollIntervalMicroseconds);
+}
+
+static JitterReport runInline(double seconds, int baud)
+{
+    SteadyMeasurementClock clock;
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    SimulatedMprlsSensor sensor(clock, trace);
+    MprlsAcquisition<PressureSensorBus> acquisition(sensor, 0x18 << 1);
+    SimulatedConsole console(baud);
+    JitterReport report;
+    uint64_t previousTime = 0;
+
+    uint64_t endMicroseconds = (uint64_t)(seconds * 1e6);
+    while(clock.nowMicroseconds() < endMicroseconds)
+    {
+        if(!sampleOnce(acquisition, clock, report, previousTime, [&](const MprlsSample &sample) { console.printSample(sample); }))
+            waitForConversion(acquisition, clock);
+    }
+    return report;
+}
+
+static JitterReport runQueued(double seconds, int baud)
+{
+    SteadyMeasurementClock clock;
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    SimulatedMprlsSensor sensor(clock, trace);
+    MprlsAcquisition<PressureSensorBus> acquisition(sensor, 0x18 << 1);
+    SimulatedConsole console(baud);
+    SampleQueue<MprlsSample, 64> sampleQueue;
+    JitterReport report;
+    std::atomic<bool> isSampling(true);
+
+    std::thread consoleThread([&]() {
+        MprlsSample sample;
+        while(isSampling.load() || sampleQueue.size() > 0)
+        {
+            if(sampleQueue.pop(sample))
+                console.printSample(sample);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    uint64_t previousTime = 0;
+    uint64_t endMicroseconds = (uint64_t)(seconds * 1e6);
+    while(clock.nowMicroseconds() < endMicroseconds)
+    {
+        if(!sampleOnce(acquisition, clock, report, previousTime, [&](const MprlsSample &sample) { sampleQueue.push(sample); }))
+            waitForConversion(acquisition, clock);
+    }
+    isSampling.store(false);
+    consoleThread.join();
+
+    report.overflows = sampleQueue.getOverflows();
+    report.highWaterMark = sampleQueue.getHighWaterMark();
+    return report;
+}
+
+static void summarise(const std::vector<double> &values, double &mean, double &deviation, double &maximum)
+{
+    mean = deviation = maximum = 0.0;
+    if(values.empty())
+        return;
+    for(size_t i = 0; i < values.size(); i++)
+    {
+        mean += values[i];
+        if(values[i] > maximum)
+            maximum = values[i];
+    }
+    mean /= values.size();
+    for(size_t i = 0; i < values.size(); i++)
+        deviation += (values[i] - mean) * (values[i] - mean);
+    deviation = sqrt(deviation / values.size());
+}
+
+static void printReport(const char *name, const JitterReport &report, double seconds)
+{
+    double latenessMean, latenessDeviation, latenessMaximum;
+    double intervalMean, intervalDeviation, intervalMaximum;
+    summarise(report.latenessMicroseconds, latenessMean, latenessDeviation, latenessMaximum);
+    summarise(report.intervalMicroseconds, intervalMean, intervalDeviation, intervalMaximum);
+    printf("%s\n", name);
+    printf("  samples/s             : %.1f\n", report.samples / seconds);
+    printf("  read after due (us)   : mean %.1f, stddev %.1f, max %.1f\n", latenessMean, latenessDeviation, latenessMaximum);
+    printf("  sample interval (us)  : mean %.1f, stddev %.1f, max %.1f\n", intervalMean, intervalDeviation, intervalMaximum);
+    printf("  sampling step (us)    : mean %.1f, max %.1f\n", report.samples ? report.totalProduceNanoseconds / report.samples / 1000.0 : 0.0,
+           report.maxProduceNanoseconds / 1000.0);
+    printf("  queue                 : %u lost, deepest %u\n", report.overflows, report.highWaterMark);
+}
+
+//Raw cost of the ring: push() and pop() in batches from one thread, then the order check across two threads
+static void benchmarkQueue()
+{
+    const long batchCount = 200000;
+    SampleQueue<MprlsSample, 1024> sampleQueue;
+    MprlsSample sample = { MPRLS_STATUS_POWERED, 0, 0 };
+
+    double pushNanoseconds = 0.0;
+    double popNanoseconds = 0.0;
+    for(long batch = 0; batch < batchCount; batch++)
+    {
+        BenchmarkClock::time_point start = BenchmarkClock::now();
+        for(uint32_t i = 0; i < sampleQueue.capacity(); i++)
+        {
+            sample.counts = i;
+            sampleQueue.push(sample);
+        }
+        BenchmarkClock::time_point middle = BenchmarkClock::now();
+        while(sampleQueue.pop(sample))
+            benchmarkSink += sample.counts;
+        BenchmarkClock::time_point end = BenchmarkClock::now();
+        pushNanoseconds += std::chrono::duration<double, std::nano>(middle - start).count();
+        popNanoseconds += std::chrono::duration<double, std::nano>(end - middle).count();
+    }
+    double operations = (double)batchCount * sampleQueue.capacity();
+    printf("push : %.2f ns per sample, pop : %.2f ns per sample\n", pushNanoseconds / operations, popNanoseconds / operations);
+
+    //A producer and a consumer thread hand over a counter; either side yields when it cannot go on
+    const uint32_t elementCount = 1000000;
+    SampleQueue<MprlsSample, 64> sharedQueue;
+    bool isOrdered = true;
+    std::thread consumer([&]() {
+        MprlsSample received;
+        for(uint32_t expected = 0; expected < elementCount;)
+        {
+            if(!sharedQueue.pop(received))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if(received.counts != expected)
+                isOrdered = false;
+            expected++;
+        }
+    });
+    for(uint32_t sent = 0; sent < elementCount;)
+    {
+        sample.counts = sent;
+        if(sharedQueue.push(sample))
+            sent++;
+        else
+            std::this_thread::yield();
+    }
+    consumer.join();
+    printf("%u samples across two threads : order %s\n\n", elementCount, isOrdered ? "kept" : "BROKEN");
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int baud = argc > 2 ? atoi(argv[2]) : 115200;
+
+    benchmarkQueue();
+    printf("%.1f s per run, console at %d baud\n\n", seconds, baud);
+    printReport("printing from the sampling loop", runInline(seconds, baud), seconds);
+    printReport("sampling thread -> SampleQueue -> console thread", runQueued(seconds, baud), seconds);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * @file SamplingSchedulerBenchmark.cpp
+ * @brief The cadence, duty cycle and wake ups of bpm/SamplingScheduler against the busy polling loop it replaces
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/SamplingSchedulerBenchmark.cpp bpm/SamplingScheduler.cpp \
+ *         bpm/BloodPressureMeasurement.cpp bpm/Telemetry.cpp bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp \
+ *         bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp bpm/EnvelopeFit.cpp -o sampling_scheduler_benchmark
+ *     ./sampling_scheduler_benchmark [--envelope] [trace.csv]
+ *
+ * Time is simulated: the sensor moves a virtual clock forward for every bus transfer and the sleeps of
+ * host/VirtualSamplingTimer.h move it to the wake up time, late by up to the latency of the row. Awake
+ * therefore means busy with the bus, which is what the CPU is on the board while the I2C driver blocks.
+ * The busy polling row does what BloodPressureMeasurement::run() does: it never sleeps, every pass of
+ * its loop counts as a wake up. The fixed period rows must keep their mean sample interval within 1 us
+ * of the period without missing one, however late the wake ups; the program exits with 1 if one does not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bpm/SamplingScheduler.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+#include "host/VirtualSamplingTimer.h"
+
+/**
+ * @brief How one way of pacing the sampling did
+ */
+struct PacingResult
+{
+    BloodPressureResult result;
+    uint32_t samples;
+    float meanIntervalMicroseconds;
+    uint32_t minIntervalMicroseconds;
+    uint32_t maxIntervalMicroseconds;
+    uint32_t missedPeriods;
+    float dutyCycle;
+    float wakeupsPerSecond;
+    //The share of the time the timer slept, to check the duty cycle against
+    float sleepShare;
+};
+
+static void printRow(const char *name, const PacingResult &pacing)
+{
+    printf("%-28s %6.1f/%5.1f %4d %7lu %9.1f %6lu %6lu %7lu %8.2f %% %8.1f %8.2f %%\n", name,
+           pacing.result.systolicPressure, pacing.result.diastolicPressure, pacing.result.heartRate,
+           (unsigned long)pacing.samples, pacing.meanIntervalMicroseconds, (unsigned long)pacing.minIntervalMicroseconds,
+           (unsigned long)pacing.maxIntervalMicroseconds, (unsigned long)pacing.missedPeriods, pacing.dutyCycle * 100.0f,
+           pacing.wakeupsPerSecond, pacing.sleepShare * 100.0f);
+}
+
+//The loop of BloodPressureMeasurement::run(), counting its passes and the sample intervals
+static PacingResult runBusyPolling(const PressureTrace &trace, bool isEnvelopeAnalysisEnabled)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+
+    PacingResult pacing;
+    memset(&pacing, 0, sizeof(pacing));
+    uint32_t passes = 0;
+    uint64_t previousSampleMicroseconds = 0;
+    uint64_t totalIntervalMicroseconds = 0;
+    while(!measurement.consume())
+    {
+        passes++;
+        uint64_t pollMicroseconds = clock.nowMicroseconds();
+        if(!measurement.produce())
+        {
+            clock.delayMicroseconds(MEASUREMENT_POLL_INTERVAL_US);
+            continue;
+        }
+        pacing.samples++;
+        if(pacing.samples > 1)
+        {
+            uint32_t interval = (uint32_t)(pollMicroseconds - previousSampleMicroseconds);
+            if(pacing.samples == 2 || interval < pacing.minIntervalMicroseconds)
+                pacing.minIntervalMicroseconds = interval;
+            if(interval > pacing.maxIntervalMicroseconds)
+                pacing.maxIntervalMicroseconds = interval;
+            totalIntervalMicroseconds += interval;
+        }
+        previousSampleMicroseconds = pollMicroseconds;
+    }
+
+    pacing.result = measurement.getResult();
+    pacing.meanIntervalMicroseconds = pacing.samples > 1 ? (float)totalIntervalMicroseconds / (pacing.samples - 1) : 0.0f;
+    //wait_us() spins, so the CPU never rests
+    pacing.dutyCycle = 1.0f;
+    pacing.wakeupsPerSecond = passes * 1000000.0f / clock.nowMicroseconds();
+    return pacing;
+}
+
+static PacingResult runScheduled(const PressureTrace &trace, bool isEnvelopeAnalysisEnabled, uint32_t periodMicroseconds,
+                                 uint32_t maxLatencyMicroseconds)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    measurement.setSampleEcho(false);
+    measurement.setEnvelopeAnalysis(isEnvelopeAnalysisEnabled);
+    VirtualSamplingTimer timer(clock, maxLatencyMicroseconds);
+    SamplingScheduler scheduler(measurement, clock, timer);
+    scheduler.setSamplePeriod(periodMicroseconds);
+
+    PacingResult pacing;
+    pacing.result = scheduler.run();
+    const SamplingSchedulerStatistics &statistics = scheduler.getStatistics();
+    pacing.samples = statistics.samples;
+    pacing.meanIntervalMicroseconds = scheduler.getMeanSampleIntervalMicroseconds();
+    pacing.minIntervalMicroseconds = statistics.minSampleIntervalMicroseconds;
+    pacing.maxIntervalMicroseconds = statistics.maxSampleIntervalMicroseconds;
+    pacing.missedPeriods = measurement.getProducerStatistics().missedSamplePeriods;
+    pacing.dutyCycle = scheduler.getDutyCycle();
+    pacing.wakeupsPerSecond = scheduler.getWakeupsPerSecond();
+    pacing.sleepShare = statistics.elapsedMicroseconds > 0 ? (float)timer.getSleptMicroseconds() / statistics.elapsedMicroseconds : 0.0f;
+    return pacing;
+}
+
+int main(int argc, char **argv)
+{
+    bool isEnvelopeAnalysisEnabled = false;
+    const char *tracePath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--envelope") == 0)
+            isEnvelopeAnalysisEnabled = true;
+        else
+            tracePath = argv[i];
+    }
+
+    PressureTrace trace = PressureTrace::syntheticDeflation();
+    if(tracePath != 0 && (!trace.loadCsv(tracePath) || trace.size() < 2))
+    {
+        fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+        return 1;
+    }
+
+    printf("%-28s %12s %4s %7s %9s %6s %6s %7s %10s %8s %10s\n", "Pacing", "Sys/Dia", "HR", "Samples", "Mean us",
+           "Min us", "Max us", "Missed", "Duty", "Wakes/s", "Slept");
+    printRow("busy polling", runBusyPolling(trace, isEnvelopeAnalysisEnabled));
+
+    bool isPassed = true;
+    static const uint32_t latencies[] = { 0, 200 };
+    static const uint32_t periods[] = { 0, 8000, 10000, 20000, 4000 };
+    for(size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); p++)
+    {
+        for(size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++)
+        {
+            char name[64];
+            if(periods[p] == 0)
+                snprintf(name, sizeof(name), "free running, late %lu us", (unsigned long)latencies[l]);
+            else
+                snprintf(name, sizeof(name), "%lu us period, late %lu us", (unsigned long)periods[p], (unsigned long)latencies[l]);
+            PacingResult pacing = runScheduled(trace, isEnvelopeAnalysisEnabled, periods[p], latencies[l]);
+            printRow(name, pacing);
+
+            //A period the sensor can keep up with must be held exactly, whatever the wake ups do
+            bool isPeriodKept = periods[p] == 0 || periods[p] < MPRLS_CONVERSION_TIME_US + 1000 ||
+                                (fabsf(pacing.meanIntervalMicroseconds - periods[p]) < 1.0f && pacing.missedPeriods == 0);
+            bool isDutyCycleConsistent = fabsf(pacing.dutyCycle + pacing.sleepShare - 1.0f) < 0.001f;
+            if(!isPeriodKept || !isDutyCycleConsistent)
+            {
+                printf("    FAILED: %s\n", !isPeriodKept ? "the period was not kept" : "the duty cycle does not add up");
+                isPassed = false;
+            }
+        }
+    }
+    printf("%s\n", isPassed ? "All checks passed" : "Some checks FAILED");
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+/**
+ * @file SessionArchive.h
+ * @brief A binary archive of many recorded sessions, stored as columns and read through mmap without parsing
+ *
+ * Layout, little endian, every part starting on an 8-byte boundary:
+ *     SessionArchiveHeader                         64 bytes at offset 0
+ *     per session, at SessionArchiveEntry::columnsOffset:
+ *         time column    uint32 x sampleCount      microseconds since the first sample of the session
+ *         counts column  uint32 x sampleCount      24-bit sensor output
+ *         status column  uint8  x sampleCount      status byte, padded to 8 bytes
+ *     SessionArchiveEntry x sessionCount           48 bytes each at SessionArchiveHeader::indexOffset
+ *
+ * The index is written last, so sessions are streamed to disk as they come and only the 48-byte entries
+ * are held until the archive is closed; the header is rewritten then. Session i is found at
+ * indexOffset + 48 * i, so any session of an archive of millions costs the same to reach.
+ */
+
+#ifndef SESSION_ARCHIVE_H
+#define SESSION_ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "bpm/MprlsAcquisition.h"
+#include "bpm/BloodPressureResult.h"
+
+//"BPMARCH" and a format version
+#define SESSION_ARCHIVE_MAGIC "BPMARCH"
+#define SESSION_ARCHIVE_VERSION 1
+//Written as a uint32, reads back differently on a big endian machine
+#define SESSION_ARCHIVE_BYTE_ORDER 0x01020304u
+
+//SessionArchiveEntry::flags: the device result below is valid
+#define SESSION_ARCHIVE_HAS_RESULT 0x1u
+
+/**
+ * @brief At offset 0 of the archive
+ */
+struct SessionArchiveHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sessionCount;
+    uint64_t indexOffset;
+    //Size of the whole file, to catch a truncated copy
+    uint64_t fileSize;
+    //Size of SessionArchiveHeader and SessionArchiveEntry, so later versions can grow them
+    uint32_t headerSize;
+    uint32_t entrySize;
+    uint8_t reserved[16];
+};
+
+/**
+ * @brief One session in the index
+ */
+struct SessionArchiveEntry
+{
+    //Where the time column starts
+    uint64_t columnsOffset;
+    uint32_t sampleCount;
+    uint32_t flags;
+    //Timestamp of the first sample on the device clock, in microseconds
+    uint64_t startMicroseconds;
+    //Any number the writer wants to find the session by, for example the index in the source list
+    uint64_t sessionId;
+    //The result the device reported, if SESSION_ARCHIVE_HAS_RESULT is set
+    float systolicPressure;
+    float diastolicPressure;
+    float meanArterialPressure;
+    int32_t heartRate;
+};
+
+static_assert(sizeof(SessionArchiveHeader) == 64, "the archive header is 64 bytes");
+static_assert(sizeof(SessionArchiveEntry) == 48, "an archive index entry is 48 bytes");
+
+//Bytes the columns of a session take, the status column padded to 8 bytes
+inline uint64_t sessionArchiveColumnsSize(uint32_t sampleCount)
+{
+    return 8ull * sampleCount + ((sampleCount + 7ull) & ~7ull);
+}
+
+/**
+ * @brief A session as it sits in the mapped archive: the columns point into the mapping, nothing is copied
+ */
+struct SessionView
+{
+    const SessionArchiveEntry *entry;
+    uint32_t sampleCount;
+    const uint32_t *timeMicroseconds;
+    const uint32_t *counts;
+    const uint8_t *status;
+};
+
+/**
+ * @brief Writes an archive one session at a time
+ */
+class SessionArchiveWriter
+{
+public:
+    SessionArchiveWriter() : file(0), offset(0) {}
+    ~SessionArchiveWriter() { close(); }
+
+    //Creates the file; the header is filled in by close()
+    bool open(const char *path)
+    {
+        file = fopen(path, "wb");
+        if(file == 0)
+            return false;
+        SessionArchiveHeader header;
+        memset(&header, 0, sizeof(header));
+        offset = sizeof(header);
+        entries.clear();
+        return fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    /**
+     * @brief Appends a session. Sessions longer than the 32-bit microsecond time column (71 minutes) are
+     * refused. result may be 0 when the device result is not known.
+     */
+    bool addSession(const MprlsSample *samples, uint32_t sampleCount, uint64_t sessionId,
+                    const BloodPressureResult *result = 0)
+    {
+        if(file == 0)
+            return false;
+        uint64_t startMicroseconds = sampleCount > 0 ? samples[0].timeMicroseconds : 0;
+        if(sampleCount > 0 && samples[sampleCount - 1].timeMicroseconds - startMicroseconds > UINT32_MAX)
+            return false;
+
+        SessionArchiveEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.columnsOffset = offset;
+        entry.sampleCount = sampleCount;
+        entry.startMicroseconds = startMicroseconds;
+        entry.sessionId = sessionId;
+        if(result != 0)
+        {
+            entry.flags |= SESSION_ARCHIVE_HAS_RESULT;
+            entry.systolicPressure = result->systolicPressure;
+            entry.diastolicPressure = result->diastolicPressure;
+            entry.meanArterialPressure = result->meanArterialPressureSlope;
+            entry.heartRate = result->heartRate;
+        }
+
+        //The columns are gathered in a buffer reused from session to session and written in one go
+        columns.resize(sessionArchiveColumnsSize(sampleCount));
+        uint32_t *timeColumn = (uint32_t *)columns.data();
+        uint32_t *countsColumn = timeColumn + sampleCount;
+        uint8_t *statusColumn = (uint8_t *)(countsColumn + sampleCount);
+        for(uint32_t i = 0; i < sampleCount; i++)
+        {
+            timeColumn[i] = (uint32_t)(samples[i].timeMicroseconds - startMicroseconds);
+            countsColumn[i] = samples[i].counts & 0xFFFFFF;
+            statusColumn[i] = samples[i].status;
+        }
+        memset(statusColumn + sampleCount, 0, columns.size() - 8ull * sampleCount - sampleCount);
+
+        if(!columns.empty() && fwrite(columns.data(), 1, columns.size(), file) != columns.size())
+            return false;
+        offset += columns.size();
+        entries.push_back(entry);
+        return true;
+    }
+
+    //Writes the index and the header and closes the file
+    bool close()
+    {
+        if(file == 0)
+            return false;
+        SessionArchiveHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SESSION_ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = SESSION_ARCHIVE_VERSION;
+        header.byteOrder = SESSION_ARCHIVE_BYTE_ORDER;
+        header.sessionCount = entries.size();
+        header.indexOffset = offset;
+        header.fileSize = offset + entries.size() * sizeof(SessionArchiveEntry);
+        header.headerSize = sizeof(SessionArchiveHeader);
+        header.entrySize = sizeof(SessionArchiveEntry);
+
+        bool isWritten = entries.empty() || fwrite(entries.data(), sizeof(SessionArchiveEntry), entries.size(), file) == entries.size();
+        isWritten = isWritten && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        isWritten = (fclose(file) == 0) && isWritten;
+        file = 0;
+        return isWritten;
+    }
+
+    uint64_t getSessionCount() const { return entries.size(); }
+
+private:
+    FILE *file;
+    //Where the next session goes
+    uint64_t offset;
+    //The index, written by close()
+    std::vector<SessionArchiveEntry> entries;
+    //The columns of the session being written
+    std::vector<uint8_t> columns;
+};
+
+/**
+ * @brief Maps an archive read-only. getSession() is a bounds check and some pointer arithmetic; the pages
+ * of a session are only read from disk when its columns are touched.
+ */
+class SessionArchiveReader
+{
+public:
+    SessionArchiveReader() : data(0), size(0), header(0), index(0) {}
+    ~SessionArchiveReader() { close(); }
+
+    SessionArchiveReader(const SessionArchiveReader &) = delete;
+    SessionArchiveReader &operator=(const SessionArchiveReader &) = delete;
+
+    /**
+     * @brief Maps the file and checks the header and that the index lies inside it
+     * @return false if the file cannot be mapped or is not a complete archive of this version
+     */
+    bool open(const char *path)
+    {
+        close();
+        int descriptor = ::open(path, O_RDONLY);
+        if(descriptor < 0)
+            return false;
+        struct stat status;
+        if(fstat(descriptor, &status) != 0 || status.st_size < (off_t)sizeof(SessionArchiveHeader))
+        {
+            ::close(descriptor);
+            return false;
+        }
+        size = (uint64_t)status.st_size;
+        void *mapping = mmap(0, size, PROT_READ, MAP_SHARED, descriptor, 0);
+        //The mapping stays valid after the descriptor is closed
+        ::close(descriptor);
+        if(mapping == MAP_FAILED)
+            return false;
+        data = (const uint8_t *)mapping;
+
+        header = (const SessionArchiveHeader *)data;
+        bool isValid = memcmp(header->magic, SESSION_ARCHIVE_MAGIC, sizeof(header->magic)) == 0 &&
+                       header->version == SESSION_ARCHIVE_VERSION && header->byteOrder == SESSION_ARCHIVE_BYTE_ORDER &&
+                       header->headerSize == sizeof(SessionArchiveHeader) &&
+                       header->entrySize == sizeof(SessionArchiveEntry) && header->fileSize == size &&
+                       header->indexOffset % 8 == 0 && header->indexOffset <= size &&
+                       header->sessionCount <= (size - header->indexOffset) / sizeof(SessionArchiveEntry);
+        if(!isValid)
+        {
+            close();
+            return false;
+        }
+        index = (const SessionArchiveEntry *)(data + header->indexOffset);
+        return true;
+    }
+
+    void close()
+    {
+        if(data != 0)
+            munmap((void *)data, size);
+        data = 0;
+        size = 0;
+        header = 0;
+        index = 0;
+    }
+
+    uint64_t getSessionCount() const { return header != 0 ? header->sessionCount : 0; }
+
+    uint64_t getFileSize() const { return size; }
+
+    const SessionArchiveEntry &getEntry(uint64_t session) const { return index[session]; }
+
+    /**
+     * @brief The columns of a session, straight from the mapping
+     * @return false if the session does not exist or its columns would lie outside the file
+     */
+    bool getSession(uint64_t session, SessionView &view) const
+    {
+        if(session >= getSessionCount())
+            return false;
+        const SessionArchiveEntry &entry = index[session];
+        uint64_t columnsSize = sessionArchiveColumnsSize(entry.sampleCount);
+        if(entry.columnsOffset % 8 != 0 || entry.columnsOffset < sizeof(SessionArchiveHeader) ||
+           entry.columnsOffset > header->indexOffset || columnsSize > header->indexOffset - entry.columnsOffset)
+            return false;
+
+        view.entry = &entry;
+        view.sampleCount = entry.sampleCount;
+        view.timeMicroseconds = (const uint32_t *)(data + entry.columnsOffset);
+        view.counts = view.timeMicroseconds + entry.sampleCount;
+        view.status = (const uint8_t *)(view.counts + entry.sampleCount);
+        return true;
+    }
+
+    //Tells the kernel the sessions will be read in order, for full scans
+    void adviseSequential() const
+    {
+        if(data != 0)
+            madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+
+private:
+    //The whole file
+    const uint8_t *data;
+    uint64_t size;
+    const SessionArchiveHeader *header;
+    const SessionArchiveEntry *index;
+};
+
+#endif
@@ -0,0 +1,272 @@
+/**
+ * @file SessionArchiveTool.cpp
+ * @brief Packs recorded sessions into a session archive, lists it, dumps sessions and times the reader
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/SessionArchiveTool.cpp bpm/Telemetry.cpp -o session_archive
+ *     ./session_archive pack archive.bpa [--synthetic N] [--list paths.txt] [session files or folders ...]
+ *     ./session_archive info archive.bpa
+ *     ./session_archive dump archive.bpa session
+ *     ./session_archive bench archive.bpa [lookups]
+ *
+ * pack reads the files host/SessionFiles.h knows (telemetry captures keep the result the device sent) and
+ * writes them as host/SessionArchive.h describes. dump prints one session as the CSV TelemetryDecode
+ * writes. bench times opening the archive, random access to single sessions, a full scan of every counts
+ * column converted to mmHg, and, for comparison, reading the same samples back from CSV text.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "bpm/MprlsTransferFunction.h"
+#include "host/SessionArchive.h"
+#include "host/SessionFiles.h"
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+static double secondsSince(BenchmarkClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+static int pack(const char *archivePath, int argc, char **argv)
+{
+    std::vector<std::string> paths;
+    int syntheticCount = 0;
+    for(int i = 0; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc)
+            syntheticCount = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+        {
+            if(!addSessionList(argv[++i], paths))
+            {
+                fprintf(stderr, "Could not open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+            addSessionPath(argv[i], paths);
+    }
+
+    SessionArchiveWriter writer;
+    if(!writer.open(archivePath))
+    {
+        fprintf(stderr, "Could not create %s\n", archivePath);
+        return 1;
+    }
+
+    BenchmarkClock::time_point start = BenchmarkClock::now();
+    std::vector<MprlsSample> samples;
+    uint64_t totalSamples = 0;
+    uint64_t sessionId = 0;
+    for(size_t i = 0; i < paths.size(); i++, sessionId++)
+    {
+        samples.clear();
+        bool hasDeviceResult = false;
+        BloodPressureResult deviceResult;
+        if(!readSessionFile(paths[i].c_str(), samples, &hasDeviceResult, &deviceResult))
+        {
+            fprintf(stderr, "Skipped %s, it could not be read\n", paths[i].c_str());
+            continue;
+        }
+        if(!writer.addSession(samples.data(), (uint32_t)samples.size(), sessionId, hasDeviceResult ? &deviceResult : 0))
+        {
+            fprintf(stderr, "Could not add %s to the archive\n", paths[i].c_str());
+            return 1;
+        }
+        totalSamples += samples.size();
+    }
+    for(int index = 0; index < syntheticCount; index++, sessionId++)
+    {
+        samples.clear();
+        makeSyntheticSession(index, samples);
+        if(!writer.addSession(samples.data(), (uint32_t)samples.size(), sessionId))
+        {
+            fprintf(stderr, "Could not add synthetic session %d to the archive\n", index);
+            return 1;
+        }
+        totalSamples += samples.size();
+    }
+
+    uint64_t sessionCount = writer.getSessionCount();
+    if(!writer.close())
+    {
+        fprintf(stderr, "Could not write %s\n", archivePath);
+        return 1;
+    }
+    fprintf(stderr, "%llu sessions, %llu samples packed in %.3f s\n", (unsigned long long)sessionCount,
+            (unsigned long long)totalSamples, secondsSince(start));
+    return 0;
+}
+
+static int info(const SessionArchiveReader &archive)
+{
+    uint64_t totalSamples = 0;
+    uint64_t resultCount = 0;
+    for(uint64_t session = 0; session < archive.getSessionCount(); session++)
+    {
+        totalSamples += archive.getEntry(session).sampleCount;
+        resultCount += (archive.getEntry(session).flags & SESSION_ARCHIVE_HAS_RESULT) != 0;
+    }
+    printf("Sessions              : %llu\n", (unsigned long long)archive.getSessionCount());
+    printf("Samples               : %llu\n", (unsigned long long)totalSamples);
+    printf("With a device result  : %llu\n", (unsigned long long)resultCount);
+    printf("File size             : %llu bytes\n", (unsigned long long)archive.getFileSize());
+    if(totalSamples > 0)
+        printf("Bytes per sample      : %.2f\n", (double)archive.getFileSize() / totalSamples);
+    return 0;
+}
+
+static int dump(const SessionArchiveReader &archive, uint64_t session)
+{
+    SessionView view;
+    if(!archive.getSession(session, view))
+    {
+        fprintf(stderr, "No session %llu in the archive\n", (unsigned long long)session);
+        return 1;
+    }
+    printf("time_us,counts,status,mmHg\n");
+    for(uint32_t i = 0; i < view.sampleCount; i++)
+        printf("%llu,%lu,%u,%.4f\n", (unsigned long long)(view.entry->startMicroseconds + view.timeMicroseconds[i]),
+               (unsigned long)view.counts[i], (unsigned)view.status[i],
+               MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(view.counts[i]));
+    if(view.entry->flags & SESSION_ARCHIVE_HAS_RESULT)
+        fprintf(stderr, "Device result: Systolic %.2f | Diastolic %.2f | MAP %.2f | Heart rate %d\n",
+                view.entry->systolicPressure, view.entry->diastolicPressure, view.entry->meanArterialPressure,
+                view.entry->heartRate);
+    return 0;
+}
+
+static int bench(const char *archivePath, uint64_t lookups)
+{
+    BenchmarkClock::time_point start = BenchmarkClock::now();
+    SessionArchiveReader archive;
+    if(!archive.open(archivePath))
+    {
+        fprintf(stderr, "%s is not a session archive\n", archivePath);
+        return 1;
+    }
+    double openSeconds = secondsSince(start);
+    uint64_t sessionCount = archive.getSessionCount();
+    if(sessionCount == 0)
+    {
+        fprintf(stderr, "The archive is empty\n");
+        return 1;
+    }
+
+    //Random sessions, each touched at its first and last sample, so the cost includes the page faults
+    std::mt19937_64 generator(1);
+    std::uniform_int_distribution<uint64_t> pick(0, sessionCount - 1);
+    uint64_t checksum = 0;
+    start = BenchmarkClock::now();
+    for(uint64_t i = 0; i < lookups; i++)
+    {
+        SessionView view;
+        if(archive.getSession(pick(generator), view) && view.sampleCount > 0)
+            checksum += view.counts[0] + view.counts[view.sampleCount - 1];
+    }
+    double lookupSeconds = secondsSince(start);
+
+    //Every counts column, converted the way the analysis does
+    archive.adviseSequential();
+    uint64_t totalSamples = 0;
+    double pressureSum = 0.0;
+    start = BenchmarkClock::now();
+    for(uint64_t session = 0; session < sessionCount; session++)
+    {
+        SessionView view;
+        if(!archive.getSession(session, view))
+            continue;
+        for(uint32_t i = 0; i < view.sampleCount; i++)
+            pressureSum += MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(view.counts[i]);
+        totalSamples += view.sampleCount;
+    }
+    double scanSeconds = secondsSince(start);
+
+    //The same kind of samples as text, the way the console logs and the decoded CSV hold them
+    std::string text;
+    uint64_t textSamples = 0;
+    for(uint64_t session = 0; session < sessionCount && textSamples < 1000000; session++)
+    {
+        SessionView view;
+        if(!archive.getSession(session, view))
+            continue;
+        char line[96];
+        for(uint32_t i = 0; i < view.sampleCount; i++)
+        {
+            snprintf(line, sizeof(line), "%llu,%lu,%u,%.4f\n", (unsigned long long)view.timeMicroseconds[i],
+                     (unsigned long)view.counts[i], (unsigned)view.status[i],
+                     MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(view.counts[i]));
+            text += line;
+        }
+        textSamples += view.sampleCount;
+    }
+    start = BenchmarkClock::now();
+    double textPressureSum = 0.0;
+    const char *position = text.c_str();
+    while(*position != 0)
+    {
+        //Line by line, as fgets() would hand them over; sscanf() on the whole text would measure strlen()
+        const char *lineEnd = strchr(position, '\n');
+        size_t length = lineEnd != 0 ? (size_t)(lineEnd - position) : strlen(position);
+        char line[96];
+        if(length >= sizeof(line))
+            length = sizeof(line) - 1;
+        memcpy(line, position, length);
+        line[length] = 0;
+
+        unsigned long long timeMicroseconds = 0;
+        unsigned long counts = 0;
+        unsigned status = 0;
+        float pressure = 0.0f;
+        if(sscanf(line, "%llu,%lu,%u,%f", &timeMicroseconds, &counts, &status, &pressure) == 4)
+            textPressureSum += pressure;
+        if(lineEnd == 0)
+            break;
+        position = lineEnd + 1;
+    }
+    double textSeconds = secondsSince(start);
+
+    printf("Sessions              : %llu\n", (unsigned long long)sessionCount);
+    printf("Open and check        : %.1f us\n", openSeconds * 1e6);
+    printf("Random session access : %.1f ns (%llu lookups, checksum %llu)\n", lookupSeconds * 1e9 / lookups,
+           (unsigned long long)lookups, (unsigned long long)checksum);
+    printf("Archive scan          : %.1f M samples/s (%llu samples, mean %.2f mmHg)\n", totalSamples / scanSeconds / 1e6,
+           (unsigned long long)totalSamples, totalSamples > 0 ? pressureSum / totalSamples : 0.0);
+    printf("CSV text parse        : %.1f M samples/s (%llu samples, mean %.2f mmHg)\n", textSamples / textSeconds / 1e6,
+           (unsigned long long)textSamples, textSamples > 0 ? textPressureSum / textSamples : 0.0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "Usage: %s pack|info|dump|bench archive.bpa ...\n", argv[0]);
+        return 1;
+    }
+    const char *command = argv[1];
+    const char *archivePath = argv[2];
+    if(strcmp(command, "pack") == 0)
+        return pack(archivePath, argc - 3, argv + 3);
+    if(strcmp(command, "bench") == 0)
+        return bench(archivePath, argc > 3 ? strtoull(argv[3], 0, 10) : 1000000);
+
+    SessionArchiveReader archive;
+    if(!archive.open(archivePath))
+    {
+        fprintf(stderr, "%s is not a session archive\n", archivePath);
+        return 1;
+    }
+    if(strcmp(command, "info") == 0)
+        return info(archive);
+    if(strcmp(command, "dump") == 0 && argc > 3)
+        return dump(archive, strtoull(argv[3], 0, 10));
+    fprintf(stderr, "Unknown command %s\n", command);
+    return 1;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file SessionFiles.h
+ * @brief Reads recorded sessions as raw sensor samples, whatever file they were saved in
+ *
+ * A session is a capture of the binary telemetry stream (*.bin), the CSV written by TelemetryDecode
+ * (time_us,counts,status,mmHg) or a "time in seconds, pressure in mmHg" CSV as used by the replay tools,
+ * whose pressures are turned back into the counts the MPRLS0300YG would give. Needs bpm/Telemetry.cpp.
+ */
+
+#ifndef SESSION_FILES_H
+#define SESSION_FILES_H
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "bpm/MprlsAcquisition.h"
+#include "bpm/Telemetry.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+
+//The sample rate of the synthetic sessions, a conversion and two polls as on the board
+#define SYNTHETIC_SESSION_RATE_HZ (1000000.0 / 5200.0)
+
+/**
+ * @brief Collects the samples and the result of a decoded telemetry stream
+ */
+class SessionSampleCollector : public TelemetryListener
+{
+public:
+    SessionSampleCollector(std::vector<MprlsSample> &sessionSamples) : samples(sessionSamples), hasResult(false) {}
+
+    virtual void onSample(const MprlsSample &sample) { samples.push_back(sample); }
+
+    virtual void onResult(const BloodPressureResult &deviceResult)
+    {
+        result = deviceResult;
+        hasResult = true;
+    }
+
+    std::vector<MprlsSample> &samples;
+    //The result the device sent at the end of the measurement, if any
+    BloodPressureResult result;
+    bool hasResult;
+};
+
+inline bool hasFileSuffix(const std::string &text, const char *suffix)
+{
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+/**
+ * @brief Appends the samples of a session file
+ * @param hasDeviceResult if not 0, set to whether deviceResult was filled in; only telemetry captures
+ * carry the result the device sent
+ * @return false if the file could not be opened
+ */
+inline bool readSessionFile(const char *path, std::vector<MprlsSample> &samples, bool *hasDeviceResult = 0,
+                            BloodPressureResult *deviceResult = 0)
+{
+    if(hasDeviceResult != 0)
+        *hasDeviceResult = false;
+
+    if(hasFileSuffix(path, ".bin"))
+    {
+        FILE *file = fopen(path, "rb");
+        if(file == 0)
+            return false;
+        SessionSampleCollector collector(samples);
+        TelemetryDecoder decoder(collector);
+        uint8_t buffer[4096];
+        size_t length;
+        while((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            decoder.feed(buffer, length);
+        fclose(file);
+        if(hasDeviceResult != 0 && deviceResult != 0 && collector.hasResult)
+        {
+            *hasDeviceResult = true;
+            *deviceResult = collector.result;
+        }
+        return true;
+    }
+
+    FILE *file = fopen(path, "r");
+    if(file == 0)
+        return false;
+
+    //The decoded telemetry has a time_us,counts,status,mmHg header; anything else is seconds,mmHg
+    bool isTelemetryCsv = false;
+    bool isFirstLine = true;
+    char line[256];
+    while(fgets(line, sizeof(line), file))
+    {
+        if(isFirstLine && strstr(line, "time_us") != 0)
+            isTelemetryCsv = true;
+        isFirstLine = false;
+
+        MprlsSample sample;
+        if(isTelemetryCsv)
+        {
+            unsigned long long timeMicroseconds = 0;
+            unsigned long counts = 0;
+            unsigned status = 0;
+            if(sscanf(line, "%llu,%lu,%u", &timeMicroseconds, &counts, &status) != 3)
+                continue;
+            sample.timeMicroseconds = timeMicroseconds;
+            sample.counts = (uint32_t)counts;
+            sample.status = (uint8_t)status;
+        }
+        else
+        {
+            double timeSeconds = 0.0;
+            double pressure = 0.0;
+            if(sscanf(line, "%lf , %lf", &timeSeconds, &pressure) != 2)
+                continue;
+            bool isSaturated = false;
+            sample.timeMicroseconds = (uint64_t)(timeSeconds * 1e6 + 0.5);
+            sample.counts = SimulatedMprlsSensor::countsForPressure(pressure, isSaturated);
+            sample.status = MPRLS_STATUS_POWERED | (isSaturated ? MPRLS_STATUS_MATH_SATURATION : 0);
+        }
+        samples.push_back(sample);
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief Appends the index-th synthetic deflation, the same every time: blood pressures from 100/70 to
+ * 140/90, heart rates from 50 to 110 and deflation rates from 3 to 5 mmHg/s
+ */
+inline void makeSyntheticSession(int index, std::vector<MprlsSample> &samples)
+{
+    double systolic = 100.0 + (index * 7) % 41;
+    double diastolic = systolic - 30.0 - (index * 11) % 21;
+    double heartRate = 50.0 + (index * 13) % 61;
+    double deflationRate = 3.0 + index % 3;
+    PressureTrace trace = PressureTrace::syntheticDeflation(systolic, diastolic, heartRate, deflationRate,
+                                                            1.0 / SYNTHETIC_SESSION_RATE_HZ);
+    for(size_t i = 0; i < trace.size(); i++)
+    {
+        double timeSeconds = i / SYNTHETIC_SESSION_RATE_HZ;
+        bool isSaturated = false;
+        MprlsSample sample;
+        sample.timeMicroseconds = (uint64_t)(timeSeconds * 1e6 + 0.5);
+        sample.counts = SimulatedMprlsSensor::countsForPressure(trace.pressureAt(timeSeconds), isSaturated);
+        sample.status = MPRLS_STATUS_POWERED;
+        samples.push_back(sample);
+    }
+}
+
+/**
+ * @brief Adds a file, or every file of a folder (one level, in name order), to a list of paths
+ */
+inline void addSessionPath(const char *path, std::vector<std::string> &paths)
+{
+    DIR *folder = opendir(path);
+    if(folder == 0)
+    {
+        paths.push_back(path);
+        return;
+    }
+    std::vector<std::string> names;
+    while(struct dirent *entry = readdir(folder))
+    {
+        if(entry->d_name[0] != '.')
+            names.push_back(std::string(path) + "/" + entry->d_name);
+    }
+    closedir(folder);
+    std::sort(names.begin(), names.end());
+    paths.insert(paths.end(), names.begin(), names.end());
+}
+
+/**
+ * @brief Adds every file or folder named in a list file, one per line
+ * @return false if the list could not be opened
+ */
+inline bool addSessionList(const char *listPath, std::vector<std::string> &paths)
+{
+    FILE *list = fopen(listPath, "r");
+    if(list == 0)
+        return false;
+    char line[4096];
+    while(fgets(line, sizeof(line), list))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if(line[0] != 0)
+            addSessionPath(line, paths);
+    }
+    fclose(list);
+    return true;
+}
+
+#endif
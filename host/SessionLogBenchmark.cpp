@@ -0,0 +1,353 @@
+/**
+ * @file SessionLogBenchmark.cpp
+ * @brief What the session log costs in flash writes, erases and time per sample, and whether it survives power cuts
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/SessionLogBenchmark.cpp bpm/SessionLog.cpp bpm/Telemetry.cpp -o session_log_benchmark
+ *     ./session_log_benchmark [sessions] [power cut trials]
+ *
+ * Synthetic deflations (host/SessionFiles.h) are logged on host/HeapSessionStorage.h with two geometries:
+ * an SPI NOR part with 4 KB sectors and 256 byte pages, and internal flash with 2 KB pages programmed 8
+ * bytes at a time. service() is called after every sample, as the firmware does while the sensor
+ * converts, and the log is mounted again every ten sessions as after a reboot. Then the sessions are
+ * read back and compared with what was logged. The power cut trials stop the flash at a random byte
+ * of a session, mount the log again, log one more session and check that every committed session is
+ * intact, the cut one lost nothing but its tail and the new one was logged. Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "bpm/SessionLog.h"
+#include "host/HeapSessionStorage.h"
+#include "host/SessionFiles.h"
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+//The size of an MprlsSample as the firmware keeps it: timestamp, counts and status
+#define RAW_SAMPLE_BYTES (8 + 4 + 1)
+
+//Sessions between two mounts of the log
+#define REMOUNT_INTERVAL 10
+
+struct StorageGeometry
+{
+    const char *name;
+    uint64_t size;
+    uint64_t eraseSize;
+    uint64_t programSize;
+};
+
+static const StorageGeometry geometries[] = {
+    { "SPI NOR, 4 KB sectors, 256 B pages", 2 * 1024 * 1024, 4096, 256 },
+    { "Internal flash, 2 KB pages, 8 B writes", 512 * 1024, 2048, 8 },
+};
+
+//A session as it was logged, or as it was read back
+struct LoggedSession
+{
+    uint32_t sessionId;
+    uint64_t startMicroseconds;
+    std::vector<MprlsSample> samples;
+    bool hasResult;
+    BloodPressureResult result;
+};
+
+class SessionCollector : public SessionLogListener
+{
+public:
+    virtual void onSessionStart(uint32_t sessionId, uint64_t startMicroseconds)
+    {
+        sessions.push_back(LoggedSession());
+        sessions.back().sessionId = sessionId;
+        sessions.back().startMicroseconds = startMicroseconds;
+        sessions.back().hasResult = false;
+    }
+
+    virtual void onSample(uint32_t sessionId, const MprlsSample &sample)
+    {
+        (void)sessionId;
+        sessions.back().samples.push_back(sample);
+    }
+
+    virtual void onSessionEnd(uint32_t sessionId, const BloodPressureResult *result)
+    {
+        (void)sessionId;
+        if(result != 0)
+        {
+            sessions.back().hasResult = true;
+            sessions.back().result = *result;
+        }
+    }
+
+    std::vector<LoggedSession> sessions;
+};
+
+static bool isSameSample(const MprlsSample &a, const MprlsSample &b)
+{
+    return a.timeMicroseconds == b.timeMicroseconds && a.counts == b.counts && a.status == b.status;
+}
+
+//True if the first count samples of read are the ones of logged, from the given offset
+static bool matchesSamples(const std::vector<MprlsSample> &read, const std::vector<MprlsSample> &logged, size_t offset)
+{
+    if(offset + read.size() > logged.size())
+        return false;
+    for(size_t i = 0; i < read.size(); i++)
+    {
+        if(!isSameSample(read[i], logged[offset + i]))
+            return false;
+    }
+    return true;
+}
+
+static bool isSameResult(const BloodPressureResult &a, const BloodPressureResult &b)
+{
+    return a.systolicPressure == b.systolicPressure && a.diastolicPressure == b.diastolicPressure &&
+           a.meanArterialPressureSlope == b.meanArterialPressureSlope && a.heartRate == b.heartRate &&
+           a.sampleCount == b.sampleCount && a.confidence == b.confidence && a.isExact == b.isExact;
+}
+
+//The index-th synthetic session, moved to start a minute after the previous one, with a made-up result
+static LoggedSession makeSession(int index)
+{
+    LoggedSession session;
+    makeSyntheticSession(index, session.samples);
+    session.startMicroseconds = (uint64_t)index * 60000000ULL;
+    for(size_t i = 0; i < session.samples.size(); i++)
+        session.samples[i].timeMicroseconds += session.startMicroseconds;
+    memset(&session.result, 0, sizeof(session.result));
+    session.result.sampleCount = (int)session.samples.size();
+    session.result.systolicPressure = 100.0f + index % 41;
+    session.result.diastolicPressure = 60.0f + index % 23;
+    session.result.meanArterialPressureSlope = 80.0f + index % 17;
+    session.result.heartRate = 50 + index % 61;
+    session.result.confidence = 1.0f;
+    session.result.isExact = true;
+    session.hasResult = true;
+    return session;
+}
+
+//Logs a session the way the firmware does; the time spent in addSample() is added to sampleSeconds
+static uint32_t logSession(SessionLog &log, const LoggedSession &session, double &sampleSeconds)
+{
+    uint32_t sessionId = log.beginSession(session.startMicroseconds);
+    for(size_t i = 0; i < session.samples.size(); i++)
+    {
+        BenchmarkClock::time_point start = BenchmarkClock::now();
+        log.addSample(session.samples[i]);
+        sampleSeconds += std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+        log.service();
+    }
+    log.endSession(session.result);
+    log.flush();
+    return sessionId;
+}
+
+//Time per addSample() without the clock reads around every call: the samples of a record are added in
+//one go, then the record is written
+static double measureAddSampleNanoseconds(const StorageGeometry &geometry, const LoggedSession &session)
+{
+    HeapSessionStorage storage(geometry.size, geometry.eraseSize, geometry.programSize);
+    SessionLog log(storage);
+    log.mount();
+    log.beginSession(session.startMicroseconds);
+    double seconds = 0.0;
+    for(size_t i = 0; i < session.samples.size(); i += SESSION_LOG_BATCH_SAMPLES)
+    {
+        size_t end = i + SESSION_LOG_BATCH_SAMPLES < session.samples.size() ? i + SESSION_LOG_BATCH_SAMPLES : session.samples.size();
+        BenchmarkClock::time_point start = BenchmarkClock::now();
+        for(size_t k = i; k < end; k++)
+            log.addSample(session.samples[k]);
+        seconds += std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+        log.flush();
+    }
+    log.endSession(session.result);
+    log.flush();
+    return seconds * 1e9 / session.samples.size();
+}
+
+static bool runGeometry(const StorageGeometry &geometry, int sessionCount)
+{
+    HeapSessionStorage storage(geometry.size, geometry.eraseSize, geometry.programSize);
+    std::vector<LoggedSession> logged;
+    SessionLogStatistics total;
+    memset(&total, 0, sizeof(total));
+    double sampleSeconds = 0.0;
+    uint64_t sampleCount = 0;
+
+    SessionLog *log = 0;
+    for(int index = 0; index < sessionCount; index++)
+    {
+        if(index % REMOUNT_INTERVAL == 0)
+        {
+            //A reboot: the statistics of the old log are kept, the new one starts from the flash alone
+            if(log != 0)
+            {
+                const SessionLogStatistics &statistics = log->getStatistics();
+                total.samplesLogged += statistics.samplesLogged;
+                total.samplesDropped += statistics.samplesDropped;
+                total.recordsWritten += statistics.recordsWritten;
+                total.recordBytes += statistics.recordBytes;
+                total.programmedBytes += statistics.programmedBytes;
+                total.erases += statistics.erases;
+                total.skippedErases += statistics.skippedErases;
+                total.sessionErases += statistics.sessionErases;
+                total.storageErrors += statistics.storageErrors;
+                delete log;
+            }
+            log = new SessionLog(storage);
+            if(log->mount() != 0)
+            {
+                printf("%s : the log does not fit this geometry\n", geometry.name);
+                delete log;
+                return false;
+            }
+        }
+        logged.push_back(makeSession(index));
+        logged.back().sessionId = logSession(*log, logged.back(), sampleSeconds);
+        sampleCount += logged.back().samples.size();
+    }
+    const SessionLogStatistics &statistics = log->getStatistics();
+    total.samplesLogged += statistics.samplesLogged;
+    total.samplesDropped += statistics.samplesDropped;
+    total.recordsWritten += statistics.recordsWritten;
+    total.recordBytes += statistics.recordBytes;
+    total.programmedBytes += statistics.programmedBytes;
+    total.erases += statistics.erases;
+    total.skippedErases += statistics.skippedErases;
+    total.sessionErases += statistics.sessionErases;
+    total.storageErrors += statistics.storageErrors;
+
+    //Every session read back must be one that was logged, whole, except the oldest whose start was overwritten
+    SessionCollector collector;
+    log->readSessions(collector);
+    uint32_t sectorCount = log->getSectorCount();
+    delete log;
+    int intactSessions = 0;
+    int badSessions = 0;
+    for(size_t i = 0; i < collector.sessions.size(); i++)
+    {
+        const LoggedSession &read = collector.sessions[i];
+        const LoggedSession *original = 0;
+        for(size_t k = 0; k < logged.size(); k++)
+        {
+            if(logged[k].sessionId == read.sessionId)
+                original = &logged[k];
+        }
+        bool isIntact = original != 0 && read.hasResult && isSameResult(read.result, original->result) &&
+                        read.startMicroseconds == original->startMicroseconds && read.samples.size() == original->samples.size() &&
+                        matchesSamples(read.samples, original->samples, 0);
+        bool isOverwrittenStart = i == 0 && original != 0 && read.startMicroseconds == 0 && read.hasResult &&
+                                  matchesSamples(read.samples, original->samples, original->samples.size() - read.samples.size());
+        if(isIntact)
+            intactSessions++;
+        else if(!isOverwrittenStart)
+            badSessions++;
+    }
+    bool hasNewest = !collector.sessions.empty() && collector.sessions.back().sessionId == logged.back().sessionId;
+
+    uint32_t minimumErases = 0xFFFFFFFF;
+    uint32_t maximumErases = 0;
+    for(size_t i = 0; i < storage.getEraseCounts().size(); i++)
+    {
+        uint32_t erases = storage.getEraseCounts()[i];
+        minimumErases = erases < minimumErases ? erases : minimumErases;
+        maximumErases = erases > maximumErases ? erases : maximumErases;
+    }
+
+    printf("%s, %llu KB (%lu sectors)\n", geometry.name, (unsigned long long)(geometry.size / 1024), (unsigned long)sectorCount);
+    printf("  Sessions / samples logged     : %d / %llu (%lu dropped)\n", sessionCount, (unsigned long long)sampleCount,
+           (unsigned long)total.samplesDropped);
+    printf("  Programmed bytes per sample   : %.2f (%d bytes in RAM)\n", (double)storage.bytesProgrammed / sampleCount, RAW_SAMPLE_BYTES);
+    printf("  Write amplification           : %.3f (programmed bytes / record bytes, padding and sector headers)\n",
+           (double)storage.bytesProgrammed / total.recordBytes);
+    printf("  Erase amplification           : %.3f (erased bytes / programmed bytes)\n",
+           (double)storage.bytesErased / storage.bytesProgrammed);
+    printf("  Erases                        : %lu (%lu blank sectors skipped, %lu during a session)\n",
+           (unsigned long)total.erases, (unsigned long)total.skippedErases, (unsigned long)total.sessionErases);
+    printf("  Erases per sector             : %lu to %lu\n", (unsigned long)minimumErases, (unsigned long)maximumErases);
+    printf("  addSample()                   : %.1f ns per sample (%.1f ns with a clock read around every call)\n",
+           measureAddSampleNanoseconds(geometry, logged.back()), sampleSeconds * 1e9 / sampleCount);
+    printf("  Read back                     : %d sessions, %d intact, %d damaged, newest %s\n", (int)collector.sessions.size(),
+           intactSessions, badSessions, hasNewest ? "present" : "missing");
+    printf("  Storage errors / bad programs : %lu / %llu\n", (unsigned long)total.storageErrors,
+           (unsigned long long)storage.programViolations);
+    return badSessions == 0 && hasNewest && total.samplesDropped == 0 && total.storageErrors == 0 && storage.programViolations == 0;
+}
+
+//Three sessions, the power cut somewhere in the fourth, then a reboot and a fifth
+static bool runPowerCutTrial(const StorageGeometry &geometry, std::mt19937 &generator, int trial)
+{
+    HeapSessionStorage storage(geometry.size, geometry.eraseSize, geometry.programSize);
+    std::vector<LoggedSession> logged;
+    double sampleSeconds = 0.0;
+    {
+        SessionLog log(storage);
+        log.mount();
+        for(int index = 0; index < 4; index++)
+        {
+            logged.push_back(makeSession(trial * 5 + index));
+            if(index == 3)
+            {
+                //Up to a bit past the programmed size of a session, so some cuts miss the session entirely
+                std::uniform_int_distribution<uint64_t> cut(0, logged.back().samples.size() * 8);
+                storage.cutPowerAfter(cut(generator));
+            }
+            logged.back().sessionId = logSession(log, logged.back(), sampleSeconds);
+        }
+    }
+    bool wasCut = storage.isPowerCut();
+    storage.restorePower();
+
+    SessionLog log(storage);
+    if(log.mount() != 0)
+        return false;
+    logged.push_back(makeSession(trial * 5 + 4));
+    logged.back().sessionId = logSession(log, logged.back(), sampleSeconds);
+
+    SessionCollector collector;
+    log.readSessions(collector);
+    std::vector<LoggedSession> &read = collector.sessions;
+    //The committed sessions, whole and in order
+    bool isRecovered = read.size() >= 4;
+    for(int index = 0; index < 3 && isRecovered; index++)
+        isRecovered = read[index].hasResult && read[index].samples.size() == logged[index].samples.size() &&
+                      matchesSamples(read[index].samples, logged[index].samples, 0);
+    //The cut session: its samples up to the cut, never committed if the cut came before its end
+    size_t next = 3;
+    if(isRecovered && read.size() == 5)
+    {
+        isRecovered = matchesSamples(read[3].samples, logged[3].samples, 0) &&
+                      (read[3].hasResult ? !wasCut || read[3].samples.size() == logged[3].samples.size() : wasCut);
+        next = 4;
+    }
+    //The session after the reboot
+    isRecovered = isRecovered && read.size() == next + 1 && read[next].hasResult &&
+                  read[next].samples.size() == logged[4].samples.size() && matchesSamples(read[next].samples, logged[4].samples, 0) &&
+                  storage.programViolations == 0;
+    return isRecovered;
+}
+
+int main(int argc, char **argv)
+{
+    int sessionCount = argc > 1 ? atoi(argv[1]) : 200;
+    int trialCount = argc > 2 ? atoi(argv[2]) : 100;
+    bool isPassed = true;
+    for(size_t i = 0; i < sizeof(geometries) / sizeof(geometries[0]); i++)
+    {
+        isPassed = runGeometry(geometries[i], sessionCount) && isPassed;
+
+        std::mt19937 generator(1);
+        int recovered = 0;
+        for(int trial = 0; trial < trialCount; trial++)
+            recovered += runPowerCutTrial(geometries[i], generator, trial) ? 1 : 0;
+        printf("  Power cuts                    : %d of %d recovered\n\n", recovered, trialCount);
+        isPassed = isPassed && recovered == trialCount;
+    }
+    printf("%s\n", isPassed ? "All checks passed" : "Some checks FAILED");
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file SimulatedMprlsSensor.h
+ * @brief An MPRLS0300YG on an I2C bus, emulated from a pressure trace
+ */
+
+#ifndef SIMULATED_MPRLS_SENSOR_H
+#define SIMULATED_MPRLS_SENSOR_H
+
+#include <stdint.h>
+#include <math.h>
+#include "hal/MeasurementHardware.h"
+#include "bpm/MprlsAcquisition.h"
+#include "PressureTrace.h"
+
+/**
+ * @brief Answers the MPRLS register protocol the way the real part does:
+ * the 0xAA 0x00 0x00 command starts a conversion, the status byte has the powered bit (0x40) set and the
+ * busy bit (0x20) set until the conversion time has passed, and a 4-byte read returns the status byte
+ * followed by the 24-bit output of the last finished conversion. Transfers to any other address are not
+ * acknowledged. Every transfer waits on the clock for the time it keeps the bus busy: on a
+ * VirtualMeasurementClock that just moves the time forward, on a real clock it stalls the calling thread.
+ */
+class SimulatedMprlsSensor : public PressureSensorBus
+{
+public:
+    SimulatedMprlsSensor(MeasurementClock &sensorClock, const PressureTrace &pressureTrace,
+                         int sensorAddress = (0x18 << 1), int busFrequencyHz = 400000,
+                         uint32_t conversionMicroseconds = MPRLS_CONVERSION_TIME_US)
+        : clock(sensorClock), trace(pressureTrace), address(sensorAddress), busFrequency(busFrequencyHz),
+          conversionTime(conversionMicroseconds), conversionDoneMicroseconds(0), isConverting(false),
+          outputCounts(0), outputStatus(MPRLS_STATUS_POWERED), traceStartMicroseconds(0)
+    {
+    }
+
+    //Plays the trace from its beginning again, starting at the given clock time
+    void restartTrace(uint64_t startMicroseconds) { traceStartMicroseconds = startMicroseconds; }
+
+    virtual int write(int transferAddress, const char *data, int length, bool repeated = false)
+    {
+        (void)repeated;
+        spendBusTime(length);
+        if((transferAddress & 0xFE) != address)
+            return 1;
+
+        //0xAA starts a conversion
+        if(length == 3 && (uint8_t)data[0] == 0xAA)
+        {
+            isConverting = true;
+            conversionDoneMicroseconds = clock.nowMicroseconds() + conversionTime;
+        }
+        return 0;
+    }
+
+    virtual int read(int transferAddress, char *data, int length, bool repeated = false)
+    {
+        (void)repeated;
+        spendBusTime(length);
+        if((transferAddress & 0xFE) != address)
+            return 1;
+
+        finishConversion();
+        uint8_t status = outputStatus;
+        if(isConverting)
+            status |= MPRLS_STATUS_BUSY;
+
+        if(length >= 1)
+            data[0] = (char)status;
+        if(length >= 4)
+        {
+            data[1] = (char)(outputCounts >> 16);
+            data[2] = (char)(outputCounts >> 8);
+            data[3] = (char)outputCounts;
+        }
+        return 0;
+    }
+
+    //The output the sensor gives for a pressure, using the same transfer function as the firmware
+    static uint32_t countsForPressure(double pressureMmHg, bool &isSaturated)
+    {
+        const double outputMinimum = 419430.4;
+        const double outputMaximum = 3774873.6;
+        const double pressureMinimum = 0.0;
+        const double pressureMaximum = 300.0;
+
+        double counts = (pressureMmHg - pressureMinimum) * (outputMaximum - outputMinimum) /
+                        (pressureMaximum - pressureMinimum) + outputMinimum;
+        isSaturated = pressureMmHg < pressureMinimum || pressureMmHg > pressureMaximum;
+        if(counts < 0.0)
+            counts = 0.0;
+        if(counts > 16777215.0)
+            counts = 16777215.0;
+        return (uint32_t)floor(counts + 0.5);
+    }
+
+private:
+    //Latches the output once the conversion time has passed
+    void finishConversion()
+    {
+        if(!isConverting || clock.nowMicroseconds() < conversionDoneMicroseconds)
+            return;
+
+        bool isSaturated = false;
+        double traceSeconds = conversionDoneMicroseconds >= traceStartMicroseconds ?
+                              (conversionDoneMicroseconds - traceStartMicroseconds) / 1e6 : 0.0;
+        outputCounts = countsForPressure(trace.pressureAt(traceSeconds), isSaturated);
+        outputStatus = MPRLS_STATUS_POWERED | (isSaturated ? MPRLS_STATUS_MATH_SATURATION : 0);
+        isConverting = false;
+    }
+
+    //Start + address byte + data bytes (9 clocks each, acknowledge included) + stop
+    void spendBusTime(int length)
+    {
+        uint64_t clocks = 2 + 9 * (uint64_t)(length + 1);
+        clock.delayMicroseconds((uint32_t)((clocks * 1000000 + busFrequency - 1) / busFrequency));
+    }
+
+    MeasurementClock &clock;
+    const PressureTrace &trace;
+    int address;
+    int busFrequency;
+    uint32_t conversionTime;
+    uint64_t conversionDoneMicroseconds;
+    bool isConverting;
+    uint32_t outputCounts;
+    uint8_t outputStatus;
+    //Clock time the trace starts at
+    uint64_t traceStartMicroseconds;
+};
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * @file SlopeKernelBenchmark.cpp
+ * @brief The vectorised slope kernels of bpm/SlopeKernels.h against the scalar stages, for every
+ * instruction set this CPU runs: same results to the bit, and how much faster
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/SlopeKernelBenchmark.cpp bpm/SlopeKernels.cpp bpm/OscillometricStages.cpp \
+ *         bpm/BloodPressureKernel.cpp -o slope_kernel_benchmark
+ *     ./slope_kernel_benchmark [--seconds S]
+ *
+ * The check runs first. Synthetic deflations (host/OscillometricWaveform.h) at 11 Hz to 20 kHz, with
+ * noise, timestamps rounded to the float milliseconds the firmware stores, plus short recordings of every
+ * length from 0 to 40 with repeated timestamps and repeated slopes, go through every kernel table. The
+ * slope table must equal calculatePressureSlopes() bit for bit, the indices must equal the ones of the
+ * scalar stages, and estimateBloodPressureVectorized() must equal estimateBloodPressure() field by
+ * field. uniformSlopes() is only compared with its own scalar version, it multiplies by a reciprocal.
+ * Any difference is printed and the program exits with 1.
+ *
+ * Then every kernel is timed per recording size, in ns per sample, with the speedup over the scalar
+ * table of the same kernels and, for the whole estimate, over the two-pass estimateBloodPressure().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "bpm/SlopeKernels.h"
+#include "bpm/OscillometricStages.h"
+#include "host/OscillometricWaveform.h"
+
+/**
+ * @brief A recording held as the firmware holds it: float milliseconds and float mmHg
+ */
+struct Recording
+{
+    const char *name;
+    double sampleRateHz;
+    std::vector<float> timeValues;
+    std::vector<float> pressureValues;
+
+    PressureSampleSpan span() const
+    {
+        PressureSampleSpan samples;
+        samples.timeValues = timeValues.data();
+        samples.pressureValues = pressureValues.data();
+        samples.sampleCount = (int)timeValues.size();
+        return samples;
+    }
+};
+
+static Recording synthesiseRecording(const char *name, double sampleRateHz)
+{
+    WaveformParameters parameters;
+    parameters.sampleRateHz = sampleRateHz;
+    parameters.noiseMmHg = 0.05;
+    parameters.seed = (uint64_t)sampleRateHz;
+    OscillometricWaveform waveform(parameters);
+
+    Recording recording;
+    recording.name = name;
+    recording.sampleRateHz = sampleRateHz;
+    WaveformSample sample;
+    while(waveform.next(sample))
+    {
+        recording.timeValues.push_back((float)(sample.timeSeconds * 1000.0));
+        recording.pressureValues.push_back((float)sample.pressure);
+    }
+    return recording;
+}
+
+//Linear congruential generator, so every run sees the same values
+static uint32_t randomState = 12345;
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1103515245u + 12345u;
+    return randomState >> 8;
+}
+
+/**
+ * @brief A short recording on a coarse grid: timestamps that repeat and pressures on a few levels, so
+ * there are zero time differences, equal slopes and equal distances to the thresholds
+ */
+static Recording coarseRecording(int sampleCount)
+{
+    Recording recording;
+    recording.name = "coarse";
+    recording.sampleRateHz = 0.0;
+    float time = 0.0f;
+    for(int i = 0; i < sampleCount; i++)
+    {
+        time += (float)(nextRandom() % 3);
+        recording.timeValues.push_back(time);
+        recording.pressureValues.push_back(100.0f + (float)(nextRandom() % 5) * 0.5f);
+    }
+    return recording;
+}
+
+static bool isSameFloat(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static bool isSameResult(const BloodPressureResult &a, const BloodPressureResult &b)
+{
+    return a.sampleCount == b.sampleCount && a.maxSlopeIndex == b.maxSlopeIndex && a.systolicIndex == b.systolicIndex &&
+           a.diastolicIndex == b.diastolicIndex && a.positiveSlopeCount == b.positiveSlopeCount &&
+           a.isExact == b.isExact && a.heartRate == b.heartRate && isSameFloat(a.maxSlope, b.maxSlope) &&
+           isSameFloat(a.systolicPressure, b.systolicPressure) && isSameFloat(a.diastolicPressure, b.diastolicPressure) &&
+           isSameFloat(a.meanArterialPressureSlope, b.meanArterialPressureSlope) &&
+           isSameFloat(a.meanArterialPressureWeightedAverage, b.meanArterialPressureWeightedAverage) &&
+           isSameFloat(a.pulsePressure, b.pulsePressure) && isSameFloat(a.systolicTime, b.systolicTime) &&
+           isSameFloat(a.diastolicTime, b.diastolicTime) && isSameFloat(a.confidence, b.confidence);
+}
+
+/**
+ * @brief Runs every kernel of one table on a recording and compares it with the scalar stages
+ * @return the number of differences
+ */
+static int checkKernels(const SlopeKernels &kernels, const Recording &recording)
+{
+    const PressureSampleSpan samples = recording.span();
+    const int sampleCount = samples.sampleCount;
+    const size_t tableSize = sampleCount > 0 ? sampleCount : 1;
+    std::vector<float> reference(tableSize), slopes(tableSize), expected(tableSize), actual(tableSize);
+    int failures = 0;
+
+    calculatePressureSlopes(samples.timeValues, samples.pressureValues, sampleCount, reference.data());
+    kernels.slopes(samples.timeValues, samples.pressureValues, sampleCount, slopes.data());
+    if(sampleCount > 0 && memcmp(reference.data(), slopes.data(), sampleCount * sizeof(float)) != 0)
+    {
+        printf("%s: slopes differ on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+        failures++;
+    }
+
+    float referenceMax = 0.0f;
+    float kernelMax = 0.0f;
+    int referenceMaxIndex = findMaximumPositiveSlope(reference.data(), sampleCount, referenceMax);
+    int maxIndex = kernels.maximumPositiveSlope(slopes.data(), sampleCount, kernelMax);
+    if(maxIndex != referenceMaxIndex || !isSameFloat(kernelMax, referenceMax))
+    {
+        printf("%s: maximum slope at %d instead of %d on %s (%d samples)\n", kernels.name, maxIndex, referenceMaxIndex,
+               recording.name, sampleCount);
+        failures++;
+    }
+
+    int systolicIndex = kernels.nearestBelowThreshold(slopes.data(), 0, maxIndex - 1, (float)(0.5 * kernelMax)) + 1;
+    int diastolicIndex =
+        kernels.nearestBelowThreshold(slopes.data(), maxIndex + 1, sampleCount, (float)(0.8 * kernelMax)) + 1;
+    if(systolicIndex != findSystolicPressureIndex(reference.data(), referenceMax, referenceMaxIndex) ||
+       diastolicIndex != findDiastolicPressureIndex(reference.data(), sampleCount, referenceMax, referenceMaxIndex))
+    {
+        printf("%s: threshold search differs on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+        failures++;
+    }
+    if(kernels.countPositiveSlopes(slopes.data(), 0, sampleCount) != countPositiveSlopes(reference.data(), 0, sampleCount))
+    {
+        printf("%s: positive slope count differs on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+        failures++;
+    }
+
+    if(!isSameResult(estimateBloodPressureVectorized(samples, slopes.data(), kernels), estimateBloodPressure(samples)))
+    {
+        printf("%s: estimate differs on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+        failures++;
+    }
+
+    //The kernels that have no scalar stage are compared with the scalar table
+    const SlopeKernels &scalarKernels = *getSlopeKernels(SLOPE_KERNEL_SCALAR);
+    float reciprocalTimeStep = recording.sampleRateHz > 0.0 ? (float)(recording.sampleRateHz / 1000.0) : 1.0f;
+    scalarKernels.uniformSlopes(samples.pressureValues, sampleCount, reciprocalTimeStep, expected.data());
+    kernels.uniformSlopes(samples.pressureValues, sampleCount, reciprocalTimeStep, actual.data());
+    if(sampleCount > 0 && memcmp(expected.data(), actual.data(), sampleCount * sizeof(float)) != 0)
+    {
+        printf("%s: uniform slopes differ on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+        failures++;
+    }
+    if(sampleCount > 1)
+    {
+        scalarKernels.differences(samples.timeValues, sampleCount, expected.data());
+        kernels.differences(samples.timeValues, sampleCount, actual.data());
+        if(memcmp(expected.data(), actual.data(), (sampleCount - 1) * sizeof(float)) != 0)
+        {
+            printf("%s: differences differ on %s (%d samples)\n", kernels.name, recording.name, sampleCount);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+//Keeps the compiler from dropping a result that is never used
+static volatile float sink;
+
+/**
+ * @brief Runs work() until at least minimumSeconds have passed
+ * @return nanoseconds per sample
+ */
+template <typename Work>
+static double timeWork(int sampleCount, double minimumSeconds, Work work)
+{
+    typedef std::chrono::steady_clock Clock;
+    long iterations = 0;
+    double elapsedSeconds = 0.0;
+    Clock::time_point start = Clock::now();
+    while(elapsedSeconds < minimumSeconds || iterations < 3)
+    {
+        work();
+        iterations++;
+        elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return elapsedSeconds * 1e9 / iterations / sampleCount;
+}
+
+static void printRow(const char *kernelName, const char *isaName, const Recording &recording, double nanosecondsPerSample,
+                     double scalarNanosecondsPerSample)
+{
+    printf("%s\t%s\t%d\t%.0f\t%.3f\t%.2f\n", kernelName, isaName, (int)recording.timeValues.size(), recording.sampleRateHz,
+           nanosecondsPerSample, scalarNanosecondsPerSample / nanosecondsPerSample);
+}
+
+static void benchmarkRecording(const Recording &recording, const std::vector<const SlopeKernels *> &kernelTables,
+                               double minimumSeconds)
+{
+    const PressureSampleSpan samples = recording.span();
+    const int sampleCount = samples.sampleCount;
+    const float reciprocalTimeStep = (float)(recording.sampleRateHz / 1000.0);
+    std::vector<float> slopeTable(sampleCount);
+    float *slopes = slopeTable.data();
+
+    //The scalar references: the stages of the firmware and the two-pass kernel
+    double stagesTime = timeWork(sampleCount, minimumSeconds, [&]() {
+        calculatePressureSlopes(samples.timeValues, samples.pressureValues, sampleCount, slopes);
+        float maxSlope = 0.0f;
+        int maxIndex = findMaximumPositiveSlope(slopes, sampleCount, maxSlope);
+        int systolicIndex = findSystolicPressureIndex(slopes, maxSlope, maxIndex);
+        int diastolicIndex = findDiastolicPressureIndex(slopes, sampleCount, maxSlope, maxIndex);
+        sink = (float)countPositiveSlopes(slopes, systolicIndex, diastolicIndex);
+    });
+    double twoPassTime =
+        timeWork(sampleCount, minimumSeconds, [&]() { sink = estimateBloodPressure(samples).systolicPressure; });
+    printRow("estimate", "stages", recording, stagesTime, twoPassTime);
+    printRow("estimate", "two-pass", recording, twoPassTime, twoPassTime);
+
+    double scalarTimes[5] = { 0.0 };
+    for(size_t t = 0; t < kernelTables.size(); t++)
+    {
+        const SlopeKernels &kernels = *kernelTables[t];
+        double times[5];
+        times[0] = timeWork(sampleCount, minimumSeconds, [&]() {
+            kernels.slopes(samples.timeValues, samples.pressureValues, sampleCount, slopes);
+            sink = slopes[0];
+        });
+        times[1] = timeWork(sampleCount, minimumSeconds, [&]() {
+            kernels.uniformSlopes(samples.pressureValues, sampleCount, reciprocalTimeStep, slopes);
+            sink = slopes[0];
+        });
+        kernels.slopes(samples.timeValues, samples.pressureValues, sampleCount, slopes);
+        times[2] = timeWork(sampleCount, minimumSeconds, [&]() {
+            float maxSlope = 0.0f;
+            sink = (float)kernels.maximumPositiveSlope(slopes, sampleCount, maxSlope);
+        });
+        times[3] = timeWork(sampleCount, minimumSeconds, [&]() {
+            sink = (float)kernels.nearestBelowThreshold(slopes, 0, sampleCount, 0.01f);
+        });
+        times[4] = timeWork(sampleCount, minimumSeconds, [&]() {
+            sink = estimateBloodPressureVectorized(samples, slopes, kernels).systolicPressure;
+        });
+        if(kernels.isa == SLOPE_KERNEL_SCALAR)
+            memcpy(scalarTimes, times, sizeof(times));
+
+        printRow("slopes", kernels.name, recording, times[0], scalarTimes[0]);
+        printRow("uniformSlopes", kernels.name, recording, times[1], scalarTimes[1]);
+        printRow("maximumSlope", kernels.name, recording, times[2], scalarTimes[2]);
+        printRow("thresholdSearch", kernels.name, recording, times[3], scalarTimes[3]);
+        //The whole estimate is compared with the two-pass kernel it replaces
+        printRow("estimate", kernels.name, recording, times[4], twoPassTime);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double minimumSeconds = 0.2;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+            minimumSeconds = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--seconds S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<const SlopeKernels *> kernelTables;
+    for(int isa = SLOPE_KERNEL_SCALAR; isa < SLOPE_KERNEL_ISA_COUNT; isa++)
+    {
+        const SlopeKernels *kernels = getSlopeKernels((SlopeKernelIsa)isa);
+        if(kernels != 0)
+            kernelTables.push_back(kernels);
+    }
+    printf("Kernels on this CPU:");
+    for(size_t t = 0; t < kernelTables.size(); t++)
+        printf(" %s", kernelTables[t]->name);
+    printf(" (picked: %s)\n", getSlopeKernels().name);
+
+    std::vector<Recording> recordings;
+    recordings.push_back(synthesiseRecording("11 Hz", 11.0));
+    recordings.push_back(synthesiseRecording("192 Hz", 1000000.0 / 5200.0));
+    recordings.push_back(synthesiseRecording("2 kHz", 2000.0));
+    recordings.push_back(synthesiseRecording("20 kHz", 20000.0));
+
+    int failures = 0;
+    int checks = 0;
+    for(size_t t = 0; t < kernelTables.size(); t++)
+    {
+        for(size_t r = 0; r < recordings.size(); r++, checks++)
+            failures += checkKernels(*kernelTables[t], recordings[r]);
+        for(int sampleCount = 0; sampleCount <= 40; sampleCount++)
+        {
+            for(int repeat = 0; repeat < 50; repeat++, checks++)
+                failures += checkKernels(*kernelTables[t], coarseRecording(sampleCount));
+        }
+    }
+    printf("Bit-identical check: %d recordings, %d differences\n\n", checks, failures);
+
+    printf("kernel\tisa\tsamples\trate_hz\tns_per_sample\tspeedup\n");
+    for(size_t r = 0; r < recordings.size(); r++)
+        benchmarkRecording(recordings[r], kernelTables, minimumSeconds);
+
+    return failures == 0 ? 0 : 1;
+}
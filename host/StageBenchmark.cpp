@@ -0,0 +1,308 @@
+/**
+ * @file StageBenchmark.cpp
+ * @brief Times every post-processing stage over synthetic (or recorded) sessions of growing length
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/StageBenchmark.cpp bpm/OscillometricStages.cpp bpm/OscillometricAnalyzer.cpp \
+ *         bpm/BloodPressureKernel.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp -o stage_benchmark
+ *     ./stage_benchmark [--trace recorded.csv] [--quick]
+ *
+ * Output is one tab separated row per stage, session length and sample rate, with a fixed column order
+ * so two revisions can be compared with diff or a spreadsheet:
+ *     stage  samples  rate_hz  ns_per_sample  latency_us  working_set_bytes
+ * latency_us is the time one call over the whole session takes and working_set_bytes is the memory the
+ * stage itself reads and writes.
+ *
+ * The streaming analyzer and the fused kernel are checked against the array stages on every session. The
+ * shortest session is as long as the candidate set of the analyzer can take in full, so its result must
+ * be exact; on longer ones an inexact result is only counted, and the count is printed at the end. The
+ * program exits with 1 if a result flagged exact disagrees, or if a session within the capacity is inexact.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "bpm/OscillometricStages.h"
+#include "bpm/OscillometricAnalyzer.h"
+#include "bpm/BloodPressureKernel.h"
+#include "bpm/OscillationExtractor.h"
+#include "bpm/BeatDetector.h"
+#include "bpm/MprlsTransferFunction.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+
+//Keeps the compiler from dropping the work being timed
+static volatile float benchmarkSink;
+
+/**
+ * @brief One deflation from 150 mmHg to 30 mmHg, stretched so it takes sampleCount samples at rateHz
+ */
+struct BenchmarkSession
+{
+    std::vector<float> timeValues;
+    std::vector<float> pressureValues;
+};
+
+//The firmware conversion, so the benchmark sees the same quantisation
+static float pressureFromCounts(uint32_t counts)
+{
+    return MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(counts);
+}
+
+static BenchmarkSession makeSyntheticSession(int sampleCount, double rateHz)
+{
+    BenchmarkSession session;
+    session.timeValues.resize(sampleCount);
+    session.pressureValues.resize(sampleCount);
+
+    const double beatSeconds = 60.0 / 72.0;
+    const double meanArterial = 93.0;
+    for(int i = 0; i < sampleCount; i++)
+    {
+        double t = i / rateHz;
+        double cuff = 150.0 - 120.0 * i / sampleCount;
+        double amplitude = 3.0 * exp(-pow((cuff - meanArterial) / 30.0, 2.0));
+        double phase = fmod(t, beatSeconds) / beatSeconds;
+        double pulse = phase < 0.15 ? sin(M_PI / 2.0 * phase / 0.15) : exp(-(phase - 0.15) / 0.25);
+        bool isSaturated = false;
+        uint32_t counts = SimulatedMprlsSensor::countsForPressure(cuff + amplitude * (pulse - 0.5), isSaturated);
+
+        //Timestamps are in milliseconds, like the ones the firmware hands to the analysis
+        session.timeValues[i] = (float)(t * 1000.0);
+        session.pressureValues[i] = pressureFromCounts(counts);
+    }
+    return session;
+}
+
+static BenchmarkSession makeRecordedSession(const PressureTrace &trace, double rateHz)
+{
+    BenchmarkSession session;
+    for(double t = 0.0; t <= trace.durationSeconds(); t += 1.0 / rateHz)
+    {
+        bool isSaturated = false;
+        session.timeValues.push_back((float)(t * 1000.0));
+        session.pressureValues.push_back(pressureFromCounts(SimulatedMprlsSensor::countsForPressure(trace.pressureAt(t), isSaturated)));
+    }
+    return session;
+}
+
+/**
+ * @brief Runs stage() until at least minimumSeconds have passed and prints one row
+ */
+template <typename Stage>
+static void timeStage(const char *stageName, const char *sessionName, int sampleCount, double rateHz,
+                      size_t workingSetBytes, double minimumSeconds, Stage stage)
+{
+    typedef std::chrono::steady_clock Clock;
+    long iterations = 0;
+    double elapsedSeconds = 0.0;
+    Clock::time_point start = Clock::now();
+    while(elapsedSeconds < minimumSeconds || iterations < 3)
+    {
+        stage();
+        iterations++;
+        elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double latencyMicroseconds = elapsedSeconds * 1e6 / iterations;
+    double nanosecondsPerSample = sampleCount > 0 ? latencyMicroseconds * 1e3 / sampleCount : 0.0;
+    printf("%s%s\t%d\t%.0f\t%.3f\t%.3f\t%zu\n", stageName, sessionName, sampleCount, rateHz,
+           nanosecondsPerSample, latencyMicroseconds, workingSetBytes);
+}
+
+//Times every stage over one session; false if the streaming analyzer or the fused kernel disagrees with the
+//array stages. Inexact results of the streaming analyzer are added to inexactSessions
+static bool benchmarkSession(const BenchmarkSession &session, const char *sessionName, double rateHz, double minimumSeconds,
+                             int &inexactSessions)
+{
+    const int sampleCount = (int)session.timeValues.size();
+    const float *timeValues = session.timeValues.data();
+    const float *pressureValues = session.pressureValues.data();
+    std::vector<float> slopeTable(sampleCount > 0 ? sampleCount : 1);
+    float *pressureSlope = slopeTable.data();
+    const size_t floatArray = sampleCount * sizeof(float);
+
+    //The indices every later stage needs
+    calculatePressureSlopes(timeValues, pressureValues, sampleCount, pressureSlope);
+    float maxSlope = 0;
+    int maxIndex = findMaximumPositiveSlope(pressureSlope, sampleCount, maxSlope);
+    int systolicIndex = findSystolicPressureIndex(pressureSlope, maxSlope, maxIndex);
+    int diastolicIndex = findDiastolicPressureIndex(pressureSlope, sampleCount, maxSlope, maxIndex);
+    int positiveSlopes = countPositiveSlopes(pressureSlope, systolicIndex, diastolicIndex);
+    float systolic = sampleValueAt(pressureValues, sampleCount, systolicIndex);
+    float diastolic = sampleValueAt(pressureValues, sampleCount, diastolicIndex);
+
+    timeStage("postProcessing", sessionName, sampleCount, rateHz, 3 * floatArray, minimumSeconds, [&]() {
+        calculatePressureSlopes(timeValues, pressureValues, sampleCount, pressureSlope);
+        float stageMaxSlope = 0;
+        benchmarkSink = (float)findMaximumPositiveSlope(pressureSlope, sampleCount, stageMaxSlope) + stageMaxSlope;
+    });
+    timeStage("evaluateSystolicPressure", sessionName, sampleCount, rateHz, floatArray, minimumSeconds, [&]() {
+        benchmarkSink = (float)findSystolicPressureIndex(pressureSlope, maxSlope, maxIndex);
+    });
+    timeStage("evaluateDiastolicPressure", sessionName, sampleCount, rateHz, floatArray, minimumSeconds, [&]() {
+        benchmarkSink = (float)findDiastolicPressureIndex(pressureSlope, sampleCount, maxSlope, maxIndex);
+    });
+    timeStage("evaluateHeartRate", sessionName, sampleCount, rateHz, 2 * floatArray, minimumSeconds, [&]() {
+        int count = countPositiveSlopes(pressureSlope, systolicIndex, diastolicIndex);
+        benchmarkSink = (float)calculateHeartRate(timeValues, sampleCount, systolicIndex, diastolicIndex, count);
+    });
+    timeStage("evaluateMeanArterialPressureUsingWeightedAverageMethod", sessionName, sampleCount, rateHz, 2 * sizeof(float),
+              minimumSeconds, [&]() {
+        benchmarkSink = calculateMeanArterialPressureWeightedAverage(systolic, diastolic);
+    });
+    timeStage("evaluateMeanArterialPressureUsingSlopeMethod", sessionName, sampleCount, rateHz, sizeof(float),
+              minimumSeconds, [&]() {
+        benchmarkSink = calculateMeanArterialPressureSlope(pressureValues, sampleCount, maxIndex);
+    });
+    timeStage("streamingAnalyzer", sessionName, sampleCount, rateHz, sizeof(OscillometricAnalyzer), minimumSeconds, [&]() {
+        OscillometricAnalyzer analyzer;
+        for(int i = 0; i < sampleCount; i++)
+            analyzer.addSample(timeValues[i], pressureValues[i]);
+        benchmarkSink = analyzer.finish().systolicPressure;
+    });
+    PressureSampleSpan span = { timeValues, pressureValues, sampleCount };
+    timeStage("fusedKernel", sessionName, sampleCount, rateHz, 2 * floatArray, minimumSeconds, [&]() {
+        benchmarkSink = estimateBloodPressure(span).systolicPressure;
+    });
+
+    //The band pass, envelope and cuff pressure filters, fed one sample at a time and in full blocks
+    OscillationExtractor extractor((float)rateHz);
+    OscillationBlock block;
+    const int blockSizes[] = { 1, OSCILLATION_BLOCK_SIZE };
+    for(size_t b = 0; b < sizeof(blockSizes) / sizeof(blockSizes[0]); b++)
+    {
+        const int blockSize = blockSizes[b];
+        char stageName[64];
+        snprintf(stageName, sizeof(stageName), "oscillationFilters/block%d", blockSize);
+        timeStage(stageName, sessionName, sampleCount, rateHz, sizeof(OscillationExtractor) + sizeof(OscillationBlock),
+                  minimumSeconds, [&]() {
+            extractor.reset();
+            for(int i = 0; i < sampleCount; i += blockSize)
+            {
+                block.sampleCount = (sampleCount - i < blockSize) ? sampleCount - i : blockSize;
+                memcpy(block.pressureValues, pressureValues + i, block.sampleCount * sizeof(float));
+                extractor.processBlock(block);
+            }
+            benchmarkSink = block.envelopeValues[0];
+        });
+    }
+    //The beat detector on its own, over the oscillation of the whole session
+    std::vector<float> oscillationValues(sampleCount);
+    extractor.reset();
+    for(int i = 0; i < sampleCount; i += OSCILLATION_BLOCK_SIZE)
+    {
+        block.sampleCount = (sampleCount - i < OSCILLATION_BLOCK_SIZE) ? sampleCount - i : OSCILLATION_BLOCK_SIZE;
+        memcpy(block.pressureValues, pressureValues + i, block.sampleCount * sizeof(float));
+        extractor.processBlock(block);
+        memcpy(oscillationValues.data() + i, block.oscillationValues, block.sampleCount * sizeof(float));
+    }
+    timeStage("beatDetector", sessionName, sampleCount, rateHz, sizeof(BeatDetector), minimumSeconds, [&]() {
+        BeatDetector detector;
+        for(int i = 0; i < sampleCount; i++)
+            detector.addSample(timeValues[i], oscillationValues[i]);
+        benchmarkSink = detector.getMedianHeartRate();
+    });
+
+    timeStage("envelopeAnalyzer", sessionName, sampleCount, rateHz,
+              sizeof(OscillationExtractor) + sizeof(OscillationBlock) + sizeof(OscillometricAnalyzer) + sizeof(BeatDetector),
+              minimumSeconds, [&]() {
+        OscillometricAnalyzer analyzer;
+        BeatDetector detector;
+        extractor.reset();
+        for(int i = 0; i < sampleCount; i += OSCILLATION_BLOCK_SIZE)
+        {
+            block.sampleCount = (sampleCount - i < OSCILLATION_BLOCK_SIZE) ? sampleCount - i : OSCILLATION_BLOCK_SIZE;
+            memcpy(block.pressureValues, pressureValues + i, block.sampleCount * sizeof(float));
+            extractor.processBlock(block);
+            int beats = 0;
+            for(int j = 0; j < block.sampleCount; j++)
+                beats += detector.addSample(timeValues[i + j], block.oscillationValues[j]);
+            analyzer.addEnvelopeSample(timeValues[i], block.cuffPressureValues[block.sampleCount - 1],
+                                       block.envelopeValues[block.sampleCount - 1], beats);
+        }
+        benchmarkSink = analyzer.finish().systolicPressure;
+    });
+
+    //The streaming analyzer must agree with the array stages it replaces
+    OscillometricAnalyzer analyzer;
+    for(int i = 0; i < sampleCount; i++)
+        analyzer.addSample(timeValues[i], pressureValues[i]);
+    BloodPressureResult result = analyzer.finish();
+    bool isPassed = true;
+    if(!result.isExact)
+    {
+        inexactSessions++;
+        if(sampleCount <= OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY + 1)
+        {
+            fprintf(stderr, "streaming analyzer is inexact within its candidate capacity (%d samples at %.0f Hz)\n",
+                    sampleCount, rateHz);
+            isPassed = false;
+        }
+    }
+    else if(result.systolicIndex != systolicIndex || result.diastolicIndex != diastolicIndex ||
+            result.maxSlopeIndex != maxIndex || result.positiveSlopeCount != positiveSlopes)
+    {
+        fprintf(stderr, "streaming analyzer disagrees with the array stages (%d samples at %.0f Hz)\n", sampleCount, rateHz);
+        isPassed = false;
+    }
+    BloodPressureResult fused = estimateBloodPressure(span);
+    if(fused.systolicIndex != systolicIndex || fused.diastolicIndex != diastolicIndex ||
+       fused.maxSlopeIndex != maxIndex || fused.positiveSlopeCount != positiveSlopes)
+    {
+        fprintf(stderr, "fused kernel disagrees with the array stages (%d samples at %.0f Hz)\n", sampleCount, rateHz);
+        isPassed = false;
+    }
+    return isPassed;
+}
+
+int main(int argc, char **argv)
+{
+    const char *tracePath = 0;
+    double minimumSeconds = 0.2;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if(strcmp(argv[i], "--quick") == 0)
+            minimumSeconds = 0.02;
+    }
+
+    const int sessionLengths[] = { OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY + 1, 500, 5000, 50000, 500000 };
+    const double sampleRates[] = { 50.0, 200.0, 1000.0 };
+
+    bool isPassed = true;
+    int sessionCount = 0;
+    int inexactSessions = 0;
+    printf("stage\tsamples\trate_hz\tns_per_sample\tlatency_us\tworking_set_bytes\n");
+    for(size_t r = 0; r < sizeof(sampleRates) / sizeof(sampleRates[0]); r++)
+    {
+        for(size_t n = 0; n < sizeof(sessionLengths) / sizeof(sessionLengths[0]); n++)
+        {
+            isPassed = benchmarkSession(makeSyntheticSession(sessionLengths[n], sampleRates[r]), "", sampleRates[r],
+                                        minimumSeconds, inexactSessions) && isPassed;
+            sessionCount++;
+        }
+    }
+
+    if(tracePath != 0)
+    {
+        PressureTrace trace;
+        if(!trace.loadCsv(tracePath) || trace.size() < 2)
+        {
+            fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+            return 1;
+        }
+        for(size_t r = 0; r < sizeof(sampleRates) / sizeof(sampleRates[0]); r++)
+        {
+            isPassed = benchmarkSession(makeRecordedSession(trace, sampleRates[r]), "/recorded", sampleRates[r],
+                                        minimumSeconds, inexactSessions) && isPassed;
+            sessionCount++;
+        }
+    }
+    fprintf(stderr, "streaming analyzer inexact on %d of %d sessions (candidate capacity %d)\n", inexactSessions,
+            sessionCount, OSCILLOMETRIC_ANALYZER_CANDIDATE_CAPACITY);
+    return isPassed ? 0 : 1;
+}
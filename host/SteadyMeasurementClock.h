@@ -0,0 +1,36 @@
+/**
+ * @file SteadyMeasurementClock.h
+ * @brief A measurement clock on the monotonic clock of the PC, shared by several threads
+ */
+
+#ifndef STEADY_MEASUREMENT_CLOCK_H
+#define STEADY_MEASUREMENT_CLOCK_H
+
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include "hal/MeasurementHardware.h"
+
+/**
+ * @brief Real time since construction. Only reads the time, so any number of threads can use it together.
+ */
+class SteadyMeasurementClock : public MeasurementClock
+{
+public:
+    SteadyMeasurementClock() : start(std::chrono::steady_clock::now()) {}
+
+    virtual uint64_t nowMicroseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    virtual void delayMicroseconds(uint32_t microseconds)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+    }
+
+private:
+    const std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file TelemetryBenchmark.cpp
+ * @brief Bytes per sample of the text echo and of the binary telemetry, and the speed of encoder and decoder
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/TelemetryBenchmark.cpp bpm/Telemetry.cpp bpm/BloodPressureMeasurement.cpp \
+ *         bpm/SessionLog.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp bpm/BeatDetector.cpp \
+ *         bpm/EnvelopeFit.cpp -o telemetry_benchmark
+ *     ./telemetry_benchmark [--capture capture.bin] [trace.csv]
+ *
+ * The measurement flow is replayed twice against a simulated sensor: once printing every sample as the
+ * firmware does (the text is captured and counted) and once sending binary telemetry. The frames are then
+ * decoded and compared with the samples that were sent, decoded again with 1% of the frames damaged, and
+ * both directions are timed. --capture writes the frames to a file that host/TelemetryDecode.cpp reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include "bpm/BloodPressureMeasurement.h"
+#include "bpm/Telemetry.h"
+#include "host/PressureTrace.h"
+#include "host/SimulatedMprlsSensor.h"
+#include "host/VirtualMeasurementClock.h"
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+/**
+ * @brief Keeps every byte written, or only counts them
+ */
+class MemoryTelemetrySink : public TelemetrySink
+{
+public:
+    MemoryTelemetrySink(bool isKeepingBytes) : isKeeping(isKeepingBytes), byteCount(0) {}
+
+    virtual void write(const uint8_t *data, size_t length)
+    {
+        if(isKeeping)
+            bytes.insert(bytes.end(), data, data + length);
+        byteCount += length;
+    }
+
+    bool isKeeping;
+    size_t byteCount;
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * @brief Collects what the decoder finds
+ */
+class CollectingListener : public TelemetryListener
+{
+public:
+    CollectingListener() : hasResult(false) {}
+    virtual void onSample(const MprlsSample &sample) { samples.push_back(sample); }
+    virtual void onResult(const BloodPressureResult &measurementResult) { result = measurementResult; hasResult = true; }
+
+    std::vector<MprlsSample> samples;
+    BloodPressureResult result;
+    bool hasResult;
+};
+
+/**
+ * @brief Remembers every sample that is sent, on top of sending it
+ */
+class RecordingSink : public TelemetrySink
+{
+public:
+    virtual void write(const uint8_t *data, size_t length) { bytes.insert(bytes.end(), data, data + length); }
+    std::vector<uint8_t> bytes;
+};
+
+//Replays the measurement with the text echo on and returns the number of bytes it printed
+static long measureTextBytes(const PressureTrace &trace)
+{
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+
+    //Send stdout to a temporary file for the replay and measure how much was written
+    fflush(stdout);
+    int savedOutput = dup(STDOUT_FILENO);
+    FILE *capture = tmpfile();
+    dup2(fileno(capture), STDOUT_FILENO);
+    measurement.run();
+    fflush(stdout);
+    long textBytes = lseek(STDOUT_FILENO, 0, SEEK_END);
+    dup2(savedOutput, STDOUT_FILENO);
+    close(savedOutput);
+    fclose(capture);
+    return textBytes;
+}
+
+int main(int argc, char **argv)
+{
+    const char *tracePath = 0;
+    const char *capturePath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            capturePath = argv[++i];
+        else
+            tracePath = argv[i];
+    }
+
+    PressureTrace trace;
+    if(tracePath != 0)
+    {
+        if(!trace.loadCsv(tracePath) || trace.size() < 2)
+        {
+            fprintf(stderr, "Could not read a pressure trace from %s\n", tracePath);
+            return 1;
+        }
+    }
+    else
+    {
+        trace = PressureTrace::syntheticDeflation();
+    }
+
+    //The session as the firmware sends it in binary mode
+    VirtualMeasurementClock clock;
+    SimulatedMprlsSensor sensor(clock, trace);
+    BloodPressureMeasurement measurement(sensor, clock, 0x18 << 1);
+    MemoryTelemetrySink captureSink(true);
+    TelemetryEncoder captureEncoder(captureSink);
+    measurement.setTelemetry(&captureEncoder);
+    BloodPressureResult result = measurement.run();
+    captureEncoder.sendResult(result);
+    long sampleCount = captureEncoder.getStatistics().samples;
+    long textBytes = measureTextBytes(trace);
+
+    if(capturePath != 0)
+    {
+        FILE *capture = fopen(capturePath, "wb");
+        if(capture == 0)
+        {
+            fprintf(stderr, "Could not write %s\n", capturePath);
+            return 1;
+        }
+        fwrite(captureSink.bytes.data(), 1, captureSink.bytes.size(), capture);
+        fclose(capture);
+    }
+
+    printf("Session               : %ld samples\n", sampleCount);
+    printf("Text echo             : %ld bytes, %.1f bytes/sample\n", textBytes, (double)textBytes / sampleCount);
+    printf("Binary telemetry      : %zu bytes, %.2f bytes/sample (%lu frames, result included)\n", captureSink.bytes.size(),
+           (double)captureSink.bytes.size() / sampleCount, (unsigned long)captureEncoder.getStatistics().frames);
+    printf("Reduction             : %.1fx\n", (double)textBytes / captureSink.bytes.size());
+
+    //Decode and compare with what went in: replay the encoder on the decoded samples, the frames must match
+    CollectingListener decoded;
+    TelemetryDecoder decoder(decoded);
+    decoder.feed(captureSink.bytes.data(), captureSink.bytes.size());
+    MemoryTelemetrySink reencodedSink(true);
+    TelemetryEncoder reencoder(reencodedSink);
+    for(size_t i = 0; i < decoded.samples.size(); i++)
+        reencoder.addSample(decoded.samples[i]);
+    if(decoded.hasResult)
+        reencoder.sendResult(decoded.result);
+    bool isRoundTripExact = reencodedSink.bytes == captureSink.bytes && (long)decoded.samples.size() == sampleCount &&
+                            decoded.hasResult && decoded.result.systolicIndex == result.systolicIndex;
+    printf("Round trip            : %s\n", isRoundTripExact ? "identical" : "DIFFERENT");
+
+    //Damage one byte in 1% of the frames and see what survives
+    std::vector<uint8_t> damaged = captureSink.bytes;
+    srand(7);
+    long damagedFrames = 0;
+    size_t frameStart = 0;
+    for(size_t i = 0; i < damaged.size(); i++)
+    {
+        if(damaged[i] != 0x00)
+            continue;
+        if(i > frameStart && rand() % 100 == 0)
+        {
+            size_t position = frameStart + rand() % (i - frameStart);
+            damaged[position] ^= (uint8_t)(1 + rand() % 255);
+            damagedFrames++;
+        }
+        frameStart = i + 1;
+    }
+    CollectingListener recovered;
+    TelemetryDecoder damagedDecoder(recovered);
+    damagedDecoder.feed(damaged.data(), damaged.size());
+    const TelemetryStatistics &damagedStatistics = damagedDecoder.getStatistics();
+    printf("1%% frames damaged     : %ld damaged, %lu rejected, %lu deltas skipped until a keyframe, %zu of %ld samples kept\n",
+           damagedFrames, (unsigned long)damagedStatistics.corruptFrames, (unsigned long)damagedStatistics.skippedPackets,
+           recovered.samples.size(), sampleCount);
+
+    //Throughput of both directions over the same samples
+    const int repetitions = 200;
+    MemoryTelemetrySink countingSink(false);
+    TelemetryEncoder encoder(countingSink);
+    BenchmarkClock::time_point start = BenchmarkClock::now();
+    for(int r = 0; r < repetitions; r++)
+    {
+        encoder.reset();
+        for(size_t i = 0; i < decoded.samples.size(); i++)
+            encoder.addSample(decoded.samples[i]);
+        encoder.flush();
+    }
+    double encodeSeconds = std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+
+    CollectingListener discarded;
+    TelemetryDecoder timedDecoder(discarded);
+    start = BenchmarkClock::now();
+    for(int r = 0; r < repetitions; r++)
+    {
+        discarded.samples.clear();
+        timedDecoder.reset();
+        timedDecoder.feed(captureSink.bytes.data(), captureSink.bytes.size());
+    }
+    double decodeSeconds = std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+
+    double totalSamples = (double)repetitions * decoded.samples.size();
+    printf("Encoder               : %.1f ns/sample, %.1f MB/s of frames\n", encodeSeconds * 1e9 / totalSamples,
+           countingSink.byteCount / encodeSeconds / 1e6);
+    printf("Decoder               : %.1f ns/sample, %.1f MB/s of frames\n", decodeSeconds * 1e9 / totalSamples,
+           (double)repetitions * captureSink.bytes.size() / decodeSeconds / 1e6);
+    return isRoundTripExact ? 0 : 1;
+}
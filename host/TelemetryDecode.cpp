@@ -0,0 +1,117 @@
+/**
+ * @file TelemetryDecode.cpp
+ * @brief Rebuilds a measurement from the binary telemetry stream of the firmware
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/TelemetryDecode.cpp bpm/Telemetry.cpp -o telemetry_decode
+ *     ./telemetry_decode [--binary] [capture.bin|-] [output]
+ *
+ * The input is the raw byte stream captured from the serial port of a board built with BINARY_TELEMETRY
+ * (for example with "cat /dev/ttyACM0 > capture.bin"), or stdin. The samples are written as CSV
+ *     time_us,counts,status,mmHg
+ * or with --binary as 16-byte little endian records: time in us (uint64), counts | status << 24 (uint32),
+ * pressure in mmHg (float32). The result and the stream counters are printed on stderr.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bpm/Telemetry.h"
+#include "bpm/MprlsTransferFunction.h"
+
+/**
+ * @brief Writes every decoded sample to the output and keeps the result
+ */
+class SessionWriter : public TelemetryListener
+{
+public:
+    SessionWriter(FILE *outputFile, bool isBinaryOutput) : output(outputFile), isBinary(isBinaryOutput), hasResult(false)
+    {
+        if(!isBinary)
+            fprintf(output, "time_us,counts,status,mmHg\n");
+    }
+
+    virtual void onSample(const MprlsSample &sample)
+    {
+        float pressure = MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(sample.counts);
+        if(!isBinary)
+        {
+            fprintf(output, "%llu,%lu,%u,%.4f\n", (unsigned long long)sample.timeMicroseconds, (unsigned long)sample.counts,
+                    (unsigned)sample.status, pressure);
+            return;
+        }
+
+        uint8_t record[16];
+        uint32_t countsAndStatus = (sample.counts & 0xFFFFFF) | ((uint32_t)sample.status << 24);
+        uint32_t pressureBits;
+        memcpy(&pressureBits, &pressure, sizeof(pressureBits));
+        for(int i = 0; i < 8; i++)
+            record[i] = (uint8_t)(sample.timeMicroseconds >> (8 * i));
+        for(int i = 0; i < 4; i++)
+        {
+            record[8 + i] = (uint8_t)(countsAndStatus >> (8 * i));
+            record[12 + i] = (uint8_t)(pressureBits >> (8 * i));
+        }
+        fwrite(record, 1, sizeof(record), output);
+    }
+
+    virtual void onResult(const BloodPressureResult &measurementResult)
+    {
+        result = measurementResult;
+        hasResult = true;
+    }
+
+    FILE *output;
+    bool isBinary;
+    bool hasResult;
+    BloodPressureResult result;
+};
+
+int main(int argc, char **argv)
+{
+    bool isBinaryOutput = false;
+    const char *inputPath = 0;
+    const char *outputPath = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--binary") == 0)
+            isBinaryOutput = true;
+        else if(inputPath == 0)
+            inputPath = argv[i];
+        else
+            outputPath = argv[i];
+    }
+
+    FILE *input = (inputPath == 0 || strcmp(inputPath, "-") == 0) ? stdin : fopen(inputPath, "rb");
+    FILE *output = outputPath == 0 ? stdout : fopen(outputPath, isBinaryOutput ? "wb" : "w");
+    if(input == 0 || output == 0)
+    {
+        fprintf(stderr, "Could not open %s\n", input == 0 ? inputPath : outputPath);
+        return 1;
+    }
+
+    SessionWriter writer(output, isBinaryOutput);
+    TelemetryDecoder decoder(writer);
+    uint8_t buffer[4096];
+    size_t length;
+    while((length = fread(buffer, 1, sizeof(buffer), input)) > 0)
+        decoder.feed(buffer, length);
+
+    const TelemetryStatistics &statistics = decoder.getStatistics();
+    fprintf(stderr, "%lu samples from %lu frames (%lu bytes), %lu corrupt frames, %lu missed and %lu skipped packets\n",
+            (unsigned long)statistics.samples, (unsigned long)statistics.frames, (unsigned long)statistics.bytes,
+            (unsigned long)statistics.corruptFrames, (unsigned long)statistics.missedPackets, (unsigned long)statistics.skippedPackets);
+    if(writer.hasResult)
+    {
+        const BloodPressureResult &result = writer.result;
+        fprintf(stderr, "Systolic %.2f | Diastolic %.2f | MAP (slope) %.2f | MAP (weighted) %.2f | Pulse pressure %.2f | "
+                "Heart rate %d | Confidence %.2f%s\n", result.systolicPressure, result.diastolicPressure,
+                result.meanArterialPressureSlope, result.meanArterialPressureWeightedAverage, result.pulsePressure,
+                result.heartRate, result.confidence, result.isExact ? "" : " | not exact");
+    }
+
+    if(output != stdout)
+        fclose(output);
+    if(input != stdin)
+        fclose(input);
+    return 0;
+}
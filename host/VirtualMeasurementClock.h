@@ -0,0 +1,28 @@
+/**
+ * @file VirtualMeasurementClock.h
+ * @brief A measurement clock that never sleeps: delays just move the time forward
+ */
+
+#ifndef VIRTUAL_MEASUREMENT_CLOCK_H
+#define VIRTUAL_MEASUREMENT_CLOCK_H
+
+#include <stdint.h>
+#include "hal/MeasurementHardware.h"
+
+class VirtualMeasurementClock : public MeasurementClock
+{
+public:
+    VirtualMeasurementClock() : now(0) {}
+
+    virtual uint64_t nowMicroseconds() { return now; }
+
+    virtual void delayMicroseconds(uint32_t microseconds) { now += microseconds; }
+
+    //Used by simulated devices to account for the time they keep the bus busy
+    void advance(uint64_t microseconds) { now += microseconds; }
+
+private:
+    uint64_t now;
+};
+
+#endif
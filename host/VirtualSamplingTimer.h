@@ -0,0 +1,52 @@
+/**
+ * @file VirtualSamplingTimer.h
+ * @brief A sampling timer that sleeps by moving a virtual clock forward, optionally waking up late
+ */
+
+#ifndef VIRTUAL_SAMPLING_TIMER_H
+#define VIRTUAL_SAMPLING_TIMER_H
+
+#include <stdint.h>
+#include "hal/MeasurementHardware.h"
+#include "VirtualMeasurementClock.h"
+
+/**
+ * @brief Stands in for hal/MbedSamplingTimer.h on a PC. Every sleep moves the clock to the wake up time
+ * plus a wake up latency drawn evenly from 0 to maxLatencyMicroseconds (a fixed sequence, so runs repeat),
+ * to see what a late interrupt or a slow wake up from deep sleep does to the cadence. The time slept is
+ * counted, so the idle share can be checked against the one the scheduler reports.
+ */
+class VirtualSamplingTimer : public SamplingTimer
+{
+public:
+    VirtualSamplingTimer(VirtualMeasurementClock &virtualClock, uint32_t maxLatencyMicroseconds = 0)
+        : clock(virtualClock), maxLatency(maxLatencyMicroseconds), randomState(12345), sleeps(0), sleptMicroseconds(0)
+    {
+    }
+
+    virtual void sleepUntil(uint64_t wakeMicroseconds)
+    {
+        uint64_t nowMicroseconds = clock.nowMicroseconds();
+        if(wakeMicroseconds <= nowMicroseconds)
+            return;
+        randomState = randomState * 1103515245u + 12345u;
+        uint64_t latency = maxLatency > 0 ? (randomState >> 8) % (maxLatency + 1) : 0;
+        sleeps++;
+        sleptMicroseconds += wakeMicroseconds + latency - nowMicroseconds;
+        clock.advance(wakeMicroseconds + latency - nowMicroseconds);
+    }
+
+    uint32_t getSleeps() const { return sleeps; }
+    uint64_t getSleptMicroseconds() const { return sleptMicroseconds; }
+
+private:
+    VirtualMeasurementClock &clock;
+    //Longest time a wake up comes late
+    uint32_t maxLatency;
+    //Linear congruential generator for the latencies
+    uint32_t randomState;
+    uint32_t sleeps;
+    uint64_t sleptMicroseconds;
+};
+
+#endif
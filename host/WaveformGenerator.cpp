@@ -0,0 +1,354 @@
+/**
+ * @file WaveformGenerator.cpp
+ * @brief Writes synthetic deflations with a known blood pressure, or sweeps the firmware's analysis over
+ * many of them and reports its error against the truth and its throughput
+ *
+ * Build and run on a Linux PC from the repository root:
+ *     g++ -std=c++14 -O2 -I. host/WaveformGenerator.cpp bpm/OscillometricAnalyzer.cpp bpm/OscillationExtractor.cpp \
+ *         bpm/BeatDetector.cpp -o waveform_generator
+ *     ./waveform_generator trace [--counts] [options] > session.csv
+ *     ./waveform_generator sweep [--sessions N] [--rows] [--slopes] [--no-estimate] [options]
+ *
+ * Options (A or A:B for a range the sessions of a sweep are drawn from evenly):
+ *     --sbp A:B  --dbp A:B  --hr A:B  --rate A:B (deflation, mmHg/s)  --noise A:B (mmHg)
+ *     --sample-rate HZ  --seed S
+ * trace writes one deflation (120/80 mmHg, 72 bpm, 4 mmHg/s, no noise, or the low end of every range given)
+ * as "seconds,mmHg" lines, which every replay tool reads, or with --counts as the time_us,counts,status,mmHg
+ * CSV of TelemetryDecode with the counts the MPRLS0300YG would give. sweep draws from 100:150/60:95 mmHg,
+ * 50:110 bpm, 3:5 mmHg/s and 0:0.1 mmHg of noise unless told otherwise, and generates the sessions one after
+ * the other, each from its own seed, so memory does not grow with their number and session i is the same
+ * whatever N. Every sample goes through the counts of the sensor into the host batch pipeline of
+ * bpm/PipelinePolicies.h, which cuts the deflation as the firmware does (from below 151 mmHg after the pump
+ * passed 150 down to 30 mmHg) and gives the result of BloodPressureMeasurement with ENVELOPE_ANALYSIS: the
+ * envelope for the pressures, the beat detector for the heart rate. --slopes scores the slope search with
+ * the beat detector instead, as the firmware does without ENVELOPE_ANALYSIS. The error of systolic,
+ * diastolic, MAP and heart rate against the truth is summed up; --rows also writes one tab separated row
+ * per session. --no-estimate only generates, to see what the generator costs alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "bpm/MprlsTransferFunction.h"
+#include "bpm/PipelinePolicies.h"
+#include "host/OscillometricWaveform.h"
+#include "host/SimulatedMprlsSensor.h"
+
+//The firmware without ENVELOPE_ANALYSIS over pushed samples: the slopes for the pressures, the beats for the heart rate
+typedef MeasurementPipeline<PushedSampleSource, MprlsCountsConverter<Mprls0300YG>, BiquadOscillationFilter,
+                            SlopeBeatFeatureDetector, NoSampleSink>
+    SlopeBatchPipeline;
+
+/**
+ * @brief A value or a range of values for one parameter
+ */
+struct ParameterRange
+{
+    double low;
+    double high;
+
+    //A point of the range, fraction from 0 to 1
+    double at(double fraction) const { return low + (high - low) * fraction; }
+};
+
+/**
+ * @brief Error of one estimated value against the truth over all sessions
+ */
+struct ErrorSummary
+{
+    ErrorSummary() : count(0), sum(0.0), sumAbsolute(0.0), sumSquares(0.0), maxAbsolute(0.0) {}
+
+    void add(double error)
+    {
+        count++;
+        sum += error;
+        sumAbsolute += fabs(error);
+        sumSquares += error * error;
+        if(fabs(error) > maxAbsolute)
+            maxAbsolute = fabs(error);
+    }
+
+    void print(const char *name, const char *unit) const
+    {
+        if(count == 0)
+            return;
+        printf("%-14s bias %+7.2f | mean absolute %6.2f | RMS %6.2f | max %6.2f %s\n", name, sum / count,
+               sumAbsolute / count, sqrt(sumSquares / count), maxAbsolute, unit);
+    }
+
+    uint64_t count;
+    double sum;
+    double sumAbsolute;
+    double sumSquares;
+    double maxAbsolute;
+};
+
+//splitmix64, turns the seed and a session number into an independent seed
+static uint64_t mixSeed(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+//A fraction from 0 to 1 out of a seed, moving the seed on
+static double nextFraction(uint64_t &state)
+{
+    state = mixSeed(state);
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool parseRange(const char *text, ParameterRange &range)
+{
+    char *end = 0;
+    range.low = strtod(text, &end);
+    if(end == text)
+        return false;
+    range.high = range.low;
+    if(*end == ':')
+    {
+        const char *high = end + 1;
+        range.high = strtod(high, &end);
+        if(end == high)
+            return false;
+    }
+    return *end == '\0' && range.high >= range.low;
+}
+
+/**
+ * @brief The parameters of the index-th session of a sweep: every range drawn from evenly with the
+ * session's own seed, redrawn until the pulse pressure is at least 10 mmHg
+ */
+static WaveformParameters sessionParameters(const WaveformParameters &base, const ParameterRange &systolic,
+                                            const ParameterRange &diastolic, const ParameterRange &heartRate,
+                                            const ParameterRange &deflationRate, const ParameterRange &noise,
+                                            uint64_t index)
+{
+    WaveformParameters parameters = base;
+    uint64_t state = mixSeed(base.seed ^ mixSeed(index));
+    do
+    {
+        parameters.systolic = systolic.at(nextFraction(state));
+        parameters.diastolic = diastolic.at(nextFraction(state));
+    } while(parameters.systolic - parameters.diastolic < 10.0);
+    parameters.heartRate = heartRate.at(nextFraction(state));
+    parameters.deflationRate = deflationRate.at(nextFraction(state));
+    parameters.noiseMmHg = noise.at(nextFraction(state));
+    parameters.seed = state;
+    return parameters;
+}
+
+//Writes one deflation to stdout
+static void writeTrace(const WaveformParameters &parameters, bool isCountsOutput)
+{
+    OscillometricWaveform waveform(parameters);
+    WaveformSample sample;
+    if(isCountsOutput)
+        printf("time_us,counts,status,mmHg\n");
+    while(waveform.next(sample))
+    {
+        if(!isCountsOutput)
+        {
+            printf("%.6f,%.4f\n", sample.timeSeconds, sample.pressure);
+            continue;
+        }
+        bool isSaturated = false;
+        uint32_t counts = SimulatedMprlsSensor::countsForPressure(sample.pressure, isSaturated);
+        uint8_t status = MPRLS_STATUS_POWERED | (isSaturated ? MPRLS_STATUS_MATH_SATURATION : 0);
+        printf("%llu,%lu,%u,%.4f\n", (unsigned long long)(sample.timeSeconds * 1e6 + 0.5), (unsigned long)counts,
+               (unsigned)status, MprlsCountsConverter<Mprls0300YG>::toMillimetresOfMercury(counts));
+    }
+}
+
+/**
+ * @brief Runs one deflation through the sensor counts and a pipeline the way the firmware measures it
+ * @return the number of samples generated
+ */
+template <typename Pipeline>
+static uint64_t estimateSession(const WaveformParameters &parameters, bool isEstimated, Pipeline &pipeline,
+                                BloodPressureResult &result, double &checksum)
+{
+    OscillometricWaveform waveform(parameters);
+    pipeline.reset();
+    uint64_t samples = 0;
+    WaveformSample sample;
+    while(!pipeline.isFinished() && waveform.next(sample))
+    {
+        samples++;
+        if(!isEstimated)
+        {
+            checksum += sample.pressure;
+            continue;
+        }
+        bool isSaturated = false;
+        MprlsSample sensorSample;
+        sensorSample.counts = SimulatedMprlsSensor::countsForPressure(sample.pressure, isSaturated);
+        sensorSample.status = MPRLS_STATUS_POWERED | (isSaturated ? MPRLS_STATUS_MATH_SATURATION : 0);
+        sensorSample.timeMicroseconds = (uint64_t)(sample.timeSeconds * 1e6 + 0.5);
+        pipeline.push(sensorSample);
+    }
+    if(isEstimated)
+        result = pipeline.finish();
+    return samples;
+}
+
+static void printUsage()
+{
+    fprintf(stderr, "Usage: waveform_generator trace [--counts] [options] > session.csv\n"
+                    "       waveform_generator sweep [--sessions N] [--rows] [--slopes] [--no-estimate] [options]\n"
+                    "Options: --sbp A[:B] --dbp A[:B] --hr A[:B] --rate A[:B] --noise A[:B] --sample-rate HZ --seed S\n");
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || (strcmp(argv[1], "trace") != 0 && strcmp(argv[1], "sweep") != 0))
+    {
+        printUsage();
+        return 1;
+    }
+    bool isSweep = strcmp(argv[1], "sweep") == 0;
+
+    //A trace is the default deflation, a sweep covers adult pressures and heart rates at the deflation
+    //rates the firmware asks for, with some sensor noise
+    WaveformParameters base;
+    ParameterRange systolic = { base.systolic, base.systolic };
+    ParameterRange diastolic = { base.diastolic, base.diastolic };
+    ParameterRange heartRate = { base.heartRate, base.heartRate };
+    ParameterRange deflationRate = { base.deflationRate, base.deflationRate };
+    ParameterRange noise = { 0.0, 0.0 };
+    if(isSweep)
+    {
+        systolic = { 100.0, 150.0 };
+        diastolic = { 60.0, 95.0 };
+        heartRate = { 50.0, 110.0 };
+        deflationRate = { 3.0, 5.0 };
+        noise = { 0.0, 0.1 };
+    }
+    uint64_t sessionCount = 1000;
+    bool isCountsOutput = false;
+    bool isRowOutput = false;
+    bool isEstimated = true;
+    bool isSlopeAnalysis = false;
+    for(int i = 2; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        bool isValid = true;
+        if(strcmp(argv[i], "--counts") == 0)
+            isCountsOutput = true;
+        else if(strcmp(argv[i], "--rows") == 0)
+            isRowOutput = true;
+        else if(strcmp(argv[i], "--no-estimate") == 0)
+            isEstimated = false;
+        else if(strcmp(argv[i], "--slopes") == 0)
+            isSlopeAnalysis = true;
+        else if(strcmp(argv[i], "--sbp") == 0 && hasValue)
+            isValid = parseRange(argv[++i], systolic);
+        else if(strcmp(argv[i], "--dbp") == 0 && hasValue)
+            isValid = parseRange(argv[++i], diastolic);
+        else if(strcmp(argv[i], "--hr") == 0 && hasValue)
+            isValid = parseRange(argv[++i], heartRate);
+        else if(strcmp(argv[i], "--rate") == 0 && hasValue)
+            isValid = parseRange(argv[++i], deflationRate);
+        else if(strcmp(argv[i], "--noise") == 0 && hasValue)
+            isValid = parseRange(argv[++i], noise);
+        else if(strcmp(argv[i], "--sample-rate") == 0 && hasValue)
+            base.sampleRateHz = atof(argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0 && hasValue)
+            base.seed = strtoull(argv[++i], 0, 10);
+        else if(strcmp(argv[i], "--sessions") == 0 && hasValue)
+            sessionCount = strtoull(argv[++i], 0, 10);
+        else
+            isValid = false;
+        if(!isValid)
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if(systolic.high - diastolic.low < 10.0 || heartRate.low <= 0.0 || deflationRate.low <= 0.0 ||
+       base.sampleRateHz <= 0.0 || systolic.high > base.peakPressure)
+    {
+        fprintf(stderr, "The ranges leave no deflation to generate: systolic at least 10 mmHg above diastolic, "
+                        "heart rate, deflation rate and sample rate above 0\n");
+        return 1;
+    }
+
+    if(!isSweep)
+    {
+        WaveformParameters parameters = base;
+        parameters.systolic = systolic.low;
+        parameters.diastolic = systolic.low - diastolic.low < 10.0 ? systolic.low - 10.0 : diastolic.low;
+        parameters.heartRate = heartRate.low;
+        parameters.deflationRate = deflationRate.low;
+        parameters.noiseMmHg = noise.low;
+        writeTrace(parameters, isCountsOutput);
+        return 0;
+    }
+
+    if(isRowOutput)
+        printf("session\tsbp\tdbp\tmap\thr\trate\tnoise\test_sbp\test_dbp\test_map\test_hr\tconfidence\n");
+    ErrorSummary systolicError;
+    ErrorSummary diastolicError;
+    ErrorSummary meanArterialError;
+    ErrorSummary heartRateError;
+    uint64_t failedSessions = 0;
+    uint64_t totalSamples = 0;
+    double checksum = 0.0;
+    //The filters are tuned to the sample rate of the sessions
+    HostBatchPipeline envelopePipeline((PushedSampleSource()));
+    SlopeBatchPipeline slopePipeline((PushedSampleSource()));
+    envelopePipeline.getFilter().configure((float)base.sampleRateHz);
+    slopePipeline.getFilter().configure((float)base.sampleRateHz);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(uint64_t index = 0; index < sessionCount; index++)
+    {
+        WaveformParameters parameters =
+            sessionParameters(base, systolic, diastolic, heartRate, deflationRate, noise, index);
+        BloodPressureResult result;
+        if(isSlopeAnalysis)
+            totalSamples += estimateSession(parameters, isEstimated, slopePipeline, result, checksum);
+        else
+            totalSamples += estimateSession(parameters, isEstimated, envelopePipeline, result, checksum);
+        if(!isEstimated)
+            continue;
+
+        WaveformGroundTruth truth = OscillometricWaveform(parameters).getGroundTruth();
+        if(result.systolicIndex == 0 || result.diastolicIndex == 0)
+            failedSessions++;
+        else
+        {
+            systolicError.add(result.systolicPressure - truth.systolic);
+            diastolicError.add(result.diastolicPressure - truth.diastolic);
+            meanArterialError.add(result.meanArterialPressureSlope - truth.meanArterial);
+            if(result.heartRate > 0)
+                heartRateError.add(result.heartRate - truth.heartRate);
+        }
+        if(isRowOutput)
+            printf("%llu\t%.2f\t%.2f\t%.2f\t%.1f\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\t%d\t%.2f\n", (unsigned long long)index,
+                   truth.systolic, truth.diastolic, truth.meanArterial, truth.heartRate, parameters.deflationRate,
+                   parameters.noiseMmHg, result.systolicPressure, result.diastolicPressure,
+                   result.meanArterialPressureSlope, result.heartRate, result.confidence);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE *summary = isRowOutput ? stderr : stdout;
+    fprintf(summary, "%llu sessions, %llu samples in %.2f s: %.0f sessions/s, %.2f M samples/s%s\n",
+            (unsigned long long)sessionCount, (unsigned long long)totalSamples, seconds, sessionCount / seconds,
+            totalSamples / seconds / 1e6, isEstimated ? "" : " (generated only)");
+    if(!isEstimated)
+    {
+        fprintf(summary, "Checksum %.3f\n", checksum);
+        return 0;
+    }
+    if(isRowOutput)
+        return 0;
+    systolicError.print("Systolic", "mmHg");
+    diastolicError.print("Diastolic", "mmHg");
+    meanArterialError.print("MAP", "mmHg");
+    heartRateError.print("Heart rate", "bpm");
+    printf("No systolic or diastolic found in %llu sessions\n", (unsigned long long)failedSessions);
+    return 0;
+}
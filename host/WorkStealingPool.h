@@ -0,0 +1,131 @@
+/**
+ * @file WorkStealingPool.h
+ * @brief Runs a task for every index of a range on several threads, idle threads stealing from busy ones
+ */
+
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Splits [0, count) into one contiguous range per thread. Every thread takes the indices of its own
+ * range from the front; a thread whose range is empty steals the back half of the range of another thread,
+ * so threads that drew slow tasks never hold the others up. Every index is run exactly once.
+ *
+ * Tasks only get an index and must write their results to a slot of their own, which keeps the results
+ * independent of the thread count and of which thread ran what.
+ */
+class WorkStealingPool
+{
+public:
+    //threadCount below 1 uses one thread per core
+    explicit WorkStealingPool(int threadCount = 0)
+    {
+        workerCount = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+        if(workerCount < 1)
+            workerCount = 1;
+        steals = 0;
+    }
+
+    int getThreadCount() const { return workerCount; }
+
+    //Ranges taken from another thread during the last run()
+    size_t getSteals() const { return steals; }
+
+    /**
+     * @brief Calls task(index) for every index in [0, count) and returns once all of them finished.
+     * The calling thread is one of the workers.
+     */
+    void run(size_t count, const std::function<void(size_t)> &task)
+    {
+        std::vector<WorkRange> ranges(workerCount);
+        for(int i = 0; i < workerCount; i++)
+        {
+            ranges[i].begin = count * i / workerCount;
+            ranges[i].end = count * (i + 1) / workerCount;
+        }
+        steals = 0;
+
+        std::vector<std::thread> threads;
+        for(int i = 1; i < workerCount; i++)
+            threads.push_back(std::thread([this, &ranges, &task, i]() { work(ranges, task, i); }));
+        work(ranges, task, 0);
+        for(size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+private:
+    //The indices a thread still has to run, [begin, end)
+    struct WorkRange
+    {
+        std::mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void work(std::vector<WorkRange> &ranges, const std::function<void(size_t)> &task, int self)
+    {
+        WorkRange &own = ranges[self];
+        for(;;)
+        {
+            size_t index = 0;
+            bool hasIndex = false;
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                if(own.begin < own.end)
+                {
+                    index = own.begin++;
+                    hasIndex = true;
+                }
+            }
+            if(hasIndex)
+            {
+                task(index);
+                continue;
+            }
+            //Nothing is ever added to a range, so once no range has work left the run is over
+            if(!steal(ranges, self))
+                return;
+        }
+    }
+
+    //Moves the back half of the first busy range after our own into our range
+    bool steal(std::vector<WorkRange> &ranges, int self)
+    {
+        for(int offset = 1; offset < workerCount; offset++)
+        {
+            WorkRange &victim = ranges[(self + offset) % workerCount];
+            size_t begin = 0;
+            size_t end = 0;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if(victim.begin >= victim.end)
+                    continue;
+                //A single index left is taken whole; the one the victim is running was removed already
+                size_t middle = victim.begin + (victim.end - victim.begin) / 2;
+                begin = middle;
+                end = victim.end;
+                victim.end = middle;
+            }
+            std::lock_guard<std::mutex> guard(ranges[self].lock);
+            ranges[self].begin = begin;
+            ranges[self].end = end;
+            steals++;
+            return true;
+        }
+        return false;
+    }
+
+    //Number of worker threads, the calling one included
+    int workerCount;
+    //Ranges stolen during the current run
+    std::atomic<size_t> steals;
+};
+
+#endif
@@ -11,235 +11,275 @@
  
 #include "mbed.h" 
 #include "stdio.h"
+#include "hal/MbedMeasurementHardware.h"
+#include "bpm/BloodPressureMeasurement.h"
+#include "bpm/SamplingScheduler.h"
+#include "hal/MbedMeasurementProducerThread.h"
+#include "hal/MbedSamplingTimer.h"
+
+/**
+* Define MEASUREMENT_SAMPLE_PERIOD_US to sample on a fixed grid of that many microseconds instead of as fast as
+* the sensor converts; the sampling sleeps on the low power ticker between samples either way. Define
+* MEASUREMENT_LOW_POWER_TIMER as well to time the measurement with a LowPowerTimer, so that sleep can be a
+* deep sleep (timestamps are then as fine as the low power ticker)
+*/
+
+/**
+* Define BINARY_TELEMETRY to send the samples and the result as compact binary frames (bpm/Telemetry.h)
+* instead of text; decode them on a PC with host/TelemetryDecode.cpp
+*/
+#ifdef BINARY_TELEMETRY
+#include "hal/MbedTelemetrySink.h"
+#endif
+
+/**
+* Define ENVELOPE_ANALYSIS to search the filtered envelope of the oscillometric pulses (bpm/OscillationExtractor.h)
+* instead of the raw slopes between consecutive samples
+*/
+
+/**
+* Define ARTIFACT_REJECTION to replace the spikes a movement of the arm puts into the pressure with the median
+* of the last few samples (bpm/HampelFilter.h) before the analysis sees them; replaced samples are marked in the
+* printout and counted
+*/
+
+/**
+* Define ENVELOPE_FIT (implies ENVELOPE_ANALYSIS) to take systolic, diastolic and MAP from an asymmetric Gaussian
+* fitted to the whole envelope (bpm/EnvelopeFit.h) instead of from single envelope points, so they fall between
+* the samples and no single noisy point decides them; the fitted widths are printed as well
+*/
+
+/**
+* Define EARLY_TERMINATION (implies ENVELOPE_ANALYSIS) to end the deflation as soon as the envelope is clearly
+* past the diastolic point and the provisional result passes every check, instead of waiting for 30 mmHg
+*/
+
+/**
+* Define SESSION_LOG to keep the samples and the result of every measurement in the flash of the board
+* (bpm/SessionLog.h, on the default BlockDevice of the target); add SESSION_LOG_DUMP to print the sessions
+* already in the log before measuring
+*/
+#ifdef SESSION_LOG
+#include "hal/MbedSessionStorage.h"
+#include "bpm/SessionLog.h"
+#endif
+
+/**
+* Define REPEAT_MEASUREMENT_INTERVAL_S to keep measuring instead of stopping after one measurement: a new
+* one starts every that many seconds (0 for none) and whenever the user button is pressed, reusing the
+* same measurement object, and the turnaround from the previous one is printed with every result
+*/
+#ifdef REPEAT_MEASUREMENT_INTERVAL_S
+#include "bpm/MeasurementScheduler.h"
+#endif
+
+/**
+* Define MEASUREMENT_PIPELINE to measure with a pipeline put together at compile time (bpm/PipelinePolicies.h)
+* straight on the I2C bus instead: the on-target minimal preset (the slopes and the beats, the result only), or with BINARY_TELEMETRY the
+* one sending every sample as telemetry with the envelope analysis. Nothing is printed per sample and the graph
+* data stays empty; change the stages in its typedef below to build another. The session log is not a stage of
+* the pipeline yet, so SESSION_LOG cannot be combined with it
+*/
+#ifdef MEASUREMENT_PIPELINE
+#ifdef SESSION_LOG
+#error "SESSION_LOG needs BloodPressureMeasurement to feed the log, the MEASUREMENT_PIPELINE would only log empty sessions"
+#endif
+#include "bpm/PipelinePolicies.h"
+#endif
+
+/**
+* Define HOT_PATH_PROFILING to time every stage of the sampling and processing path with the cycle counter
+* and print the sample rate, the timing jitter and the cost of every stage at the end of the measurement
+*/
 
 /**
 * Define the Pins inorder to communicate with Honeywell Sensor through I2C (Inter-Integrated Circuit) Protocol
 */
 #define I2C_SDA PC_9
 #define I2C_SCL PA_8
+
+/**
+* Define MULTI_CHANNEL_ACQUISITION to record the cuff sensor together with a reference sensor on a second
+* I2C bus, each from its own thread, instead of running a measurement
+*/
+#ifdef MULTI_CHANNEL_ACQUISITION
+#include "bpm/AcquisitionChannel.h"
+#include "hal/MbedAcquisitionChannelThread.h"
+#ifndef I2C2_SDA
+#define I2C2_SDA PB_9
+#endif
+#ifndef I2C2_SCL
+#define I2C2_SCL PB_8
+#endif
+//How long both channels are recorded in milliseconds
+#ifndef MULTI_CHANNEL_RECORD_MS
+#define MULTI_CHANNEL_RECORD_MS 1000
+#endif
+#endif
  
 //::::::::::::::::::::::::::::::::::All Timer related variable::::::::::::::::::::::::::::::   
 
 //Timer Object
+#ifdef MEASUREMENT_LOW_POWER_TIMER
+LowPowerTimer timerVal;
+#else
 Timer timerVal;
-//Time array to store the time values which will be plotted on the X axis 
-float timerDataArray[500];
+#endif
+//The measurement reads the time and waits through this clock
+MbedMeasurementClock measurementClock(timerVal);
 
 //::::::::::::::::::::::::::::All Sensor related variables:::::::::::::::::::::::::::::::::::::
 
 //I2C Object for Honeywell I2C (PinName sda, PinName scl)
 I2C i2cForHoneywell(I2C_SDA, I2C_SCL);
+//The measurement talks to the sensor through this bus
+MbedPressureSensorBus honeywellBus(i2cForHoneywell);
 //The address of the Honeywell sensor to send during I2C communication
 int honeywellSensorAddress = (0x18 << 1);
-//The address to send for the read command of the Honeywell sensor
-int honeywellSensorReadAddress = 0x31;
-//The commands to send in order for I2C write communication
-const char honewellSensorCommand[] = { 0xAA, 0x00, 0x00 };
-//The 4 byte result returned by the sensor after reading from the Honeywell sensor
-char sensorReading[4] = {0};
-//The output value calculated using sensorReading
-float pressureOutput = 0.0;
-//The minimum output given by the sensor (refer the datasheet)
-float sensorMinimumPressureReading = 419430.4;
-//The maximum output given by the sensor (refer the datasheet)
-float sensorMaximumPressureReading = 3774873.6;
-//Sensor result status
-char sensorReadingStatusBit = '0';
+
+#ifdef MULTI_CHANNEL_ACQUISITION
+//I2C Object for the reference sensor
+I2C i2cForReference(I2C2_SDA, I2C2_SCL);
+//The reference sensor talks through this bus
+MbedPressureSensorBus referenceBus(i2cForReference);
+//Channel 0 is the cuff sensor, channel 1 the reference sensor
+AcquisitionChannel cuffChannel(0, honeywellBus, honeywellSensorAddress);
+AcquisitionChannel referenceChannel(1, referenceBus, honeywellSensorAddress);
+#endif
 
 //:::::::::::::::::::::::::All pressure calculation variables::::::::::::::::::::::::::::::::::::
- 
-//This is the lowest value in mm Hg that our pressure sensor can read
-float lowestPressure = 0.0;
-//Stores the pressure calculated from the sensor
-float pressure = 0.0;
-//This is the highest value in mm hg that our pressure sensor can read
-float highestPressure = 300.0;
-//The previous pressure value that was calculated
-float previousPressureVal = 0.0;
-
-//Check if pressure is increasing or decreasing
-bool isPressureIncreasing = true;
-bool isPressureDecreasing = false;
-
-//Loop counter variable for pressure array , it stores the total values recorded from the sensor between 150 mm hg and 30 mm hg
-int pressureCounter = 0;
-// Array to store all the pressure values
-float pressureArrayValues[500];
-//Counts the number of positive slopes throughout the graph
-float heartRateCount = 0;
-//Store the mean arterial pressure 
-float meanArterialPressureWA = 0.0;
-//Store the mean arterial pressure 
-float meanArterialPressureSlope = 0.0;
-//Store Pulse Pressure 
-float pulsePressure = 0.0;
-
-//:::::::::::::::::::::::::All slope calculation variables::::::::::::::::::::::::::::::::::::
-
-//Array to store al/ the slopes between various pressure data points. We initialize the slopes to 1
-float pressureSlope[500] = {1.0};
-//The value of the maximum positive slope
-float maxSlope=0;
-//The index of the maximum positive slope which is there in the slope array
-int MaxIndexPositiveSlope = 0;
-//Stores the index of the Systolic Pressure which is there in the pressure array
-int systolicPressureSlopeIndex = 0;
-//Stores the index of the Diastolic Pressure which is there in the pressure array
-int diastolic_pressureSlopeIndex = 0;
- 
-//:::::::::::::::::::::::::Deflation rate variables:::::::::::::::::::::::::::
- 
-//The deflation rate message
-char *deflationRateMessage;
+
+//Samples the sensor, gives the deflation rate remarks and runs the slope search
+BloodPressureMeasurement bloodPressureMeasurement(honeywellBus, measurementClock, honeywellSensorAddress);
+//The sampling sleeps on it until the sensor has something to give
+MbedSamplingTimer samplingTimer(measurementClock);
+//Wakes the sampling when a conversion is due and keeps the duty cycle and the cadence
+SamplingScheduler samplingScheduler(bloodPressureMeasurement, measurementClock, samplingTimer);
+//Reads the sensor in a thread above the console, so printing never delays a timestamp
+//(define MEASUREMENT_SINGLE_THREAD to sample and print from one thread as before)
+MbedMeasurementProducerThread measurementProducerThread(bloodPressureMeasurement, samplingScheduler);
+#ifdef BINARY_TELEMETRY
+//The serial port the frames are written to
+MbedTelemetrySink telemetrySink;
+//Packs the samples and the result into frames
+TelemetryEncoder telemetryEncoder(telemetrySink);
+#endif
+#ifdef MEASUREMENT_PIPELINE
+#ifdef BINARY_TELEMETRY
+//The stages of the measurement, chosen at compile time
+typedef OnTargetTelemetryPipeline<I2C> HoneywellPipeline;
+//Samples, analyses and sends the samples with no virtual call in between
+HoneywellPipeline measurementPipeline(MprlsAcquisition<I2C>(i2cForHoneywell, honeywellSensorAddress),
+                                      TelemetrySampleSink(telemetryEncoder));
+#else
+//The stages of the measurement, chosen at compile time
+typedef OnTargetMinimalPipeline<I2C> HoneywellPipeline;
+//Samples and analyses with no virtual call in between
+HoneywellPipeline measurementPipeline((MprlsAcquisition<I2C>(i2cForHoneywell, honeywellSensorAddress)));
+#endif
+#endif
+#ifdef SESSION_LOG
+//The flash the log is kept on
+MbedSessionStorage sessionStorage;
+//Appends every measurement to the flash, a few samples per write
+SessionLog sessionLog(sessionStorage);
+//False when the flash could not be used
+bool isSessionLogMounted = false;
+#endif
+#ifdef REPEAT_MEASUREMENT_INTERVAL_S
+//Starts the measurements at the interval or when asked
+MeasurementScheduler measurementScheduler(bloodPressureMeasurement, measurementClock);
+//Pressing it asks for a measurement
+DigitalIn userButton(BUTTON1);
+#endif
+#ifdef HOT_PATH_PROFILING
+//Latency histograms of the hot path stages and of the sample intervals
+HotPathProfiler hotPathProfiler;
+#endif
+//The values found once the pressure drops to 30mmHg, the evaluate functions below only print them
+BloodPressureResult bloodPressureResult;
  
 void measurePressureValuesFromTheHoneywellSensor()
 {
-    while(1)
+#ifdef SESSION_LOG
+    //The sectors the session needs are erased here, before the sampling starts
+    if(isSessionLogMounted)
+        sessionLog.beginSession(measurementClock.nowMicroseconds());
+#endif
+
+    //Sample the cuff until the pressure drops below 30mmHg after the deflation, then finish the slope search
+#if defined(MEASUREMENT_PIPELINE)
+    measurementPipeline.reset();
+    bloodPressureResult = measurementPipeline.run(measurementClock);
+#elif defined(MEASUREMENT_SINGLE_THREAD)
+    bloodPressureResult = samplingScheduler.run();
+#else
+    measurementProducerThread.start();
+    //Print and analyse the queued samples whenever the sampling thread is idle
+    while(!bloodPressureMeasurement.consume())
     {
-        //printf (" Pressure value at the start of calculate pressure = %.2f \n", pressure);
-        //As and when the pressure goes above 150 for the first time as we pump, then isPressureIncreasing shall be false as we do 
-        //not want to take this value into calculations.
-        if(pressure > 150)
-            isPressureIncreasing = false;
-
-        //now that we are releasing the valve and the pressure goes below than 151 mm Hg at that time isPressureDecreasing will
-        //be set to true
-        //isPressureIncreasing is false when we finished pumping (i.e After 150)
-        if (pressure < 151 && !isPressureIncreasing)
-            isPressureDecreasing = true;
-
-        //As soon as the pressure goes below 30 and isPressureDecreasing is set to true that means
-        //we now have to break out of the whole loop and show final readings
-        if (pressure < 30 and isPressureDecreasing)
-            break;
-
-        //Write the commands 0xAA, 0x00 and 0x00 at the given sensor address
-        i2cForHoneywell.write(honeywellSensorAddress, honewellSensorCommand, 3);
-
-        //Introduced wait time here after writing through i2c to ensure writing is complete 
-        wait_us(5000);
-
-        //printf (" Pressure Sensor result status Before read= %d \n", sensorReadingStatusBit); //only print pressure readings
-        //Reads the status byte using read (int address, char *data, int length, bool repeated=false)
-        i2cForHoneywell.read(honeywellSensorReadAddress, &sensorReadingStatusBit, 1);
-
-        //printf (" Pressure Sensor result status After read = %d \n", sensorReadingStatusBit);
-        //printf (" Pressure Sensor result status After read and with 0x40= %x \n", (sensorReadingStatusBit & 0x40) >> 6 );
-        
-        //Reading the 6th bit in status byte and checking if its 1
-        if(((sensorReadingStatusBit & 0x40) >> 6) == 0x1)
-        {
-            //printf (" While True \n");
-            i2cForHoneywell.read(honeywellSensorReadAddress, &sensorReadingStatusBit, 1);
-            //We are introducing wait after reading through i2c
-            wait_us(5000);
-        }
-
-        //Read the sensor output and storing it in 4 bytes in the array sensorReading
-        i2cForHoneywell.read(honeywellSensorAddress, sensorReading, 4);
-
-        //printf (" Pressure sensorReading = %d \n", sensorReading[3]); 
-        //printf (" Pressure sensorReading = %d \n", sensorReading[2]);
-        //printf (" Pressure sensorReading = %d \n", sensorReading[1]); 
-
-        //Generate the 24-bit output from the sensor using bit shifting and then we type cast if to float 
-        pressureOutput = (float)((sensorReading[1] << 16) | (sensorReading[2] << 8) | (sensorReading[3]));
-
-        //The first byte is ignored as it is the status byte and we collect the other 3 bytes
-        //printf (" Pressure pressureOutput = %f \n", pressureOutput); 
-        //printf (" Pressure sensorReading = %d \n", sensorReading[3]); 
-        //printf (" Pressure sensorReading = %d \n", sensorReading[2]<<8); 
-        //printf (" Pressure sensorReading = %d \n", sensorReading[1]<<16); 
-        
-        //Calcuate the pressure using the formula referring the datasheet 
-        pressure = (((pressureOutput - sensorMinimumPressureReading) * (highestPressure - lowestPressure)) / (sensorMaximumPressureReading - sensorMinimumPressureReading)) + lowestPressure;
-
-        //printf ("\nPressure value  = %f \n", pressure);
-    
-        //If the difference between the consecutive pressure values is less than 3.0 mmHg/sec, the deflation rate is too slow
-        if((previousPressureVal - pressure) < 3.0)
-        {
-            deflationRateMessage = "Deflation Rate too slow, Please make it fast";
-        }
-
-        //If the difference between the consecutive pressure values is greater than 5.0 mmHg/sec, the deflation rate is too fast
-        else if ((previousPressureVal - pressure) > 5.0)
-        {
-            deflationRateMessage = "Deflation Rate too fast, Please make it slow";
-        }
-
-        //If deflation rate is between 3.0 mmHg/sec and 5.0 mmHg/sec, it is Okay since we have been asked to keep reducing by 4.0 mmHg/sec
-        else
-        {
-            deflationRateMessage = "Deflation Rate Okay, continue";
-        }
-
-        //Read the time value using ticker object "timerVal"
-        int time_ms = timerVal.elapsed_time().count();
-
-        //If the isPressureDecreasing is true , we are deflating and going below 151mmHg
-        if(isPressureDecreasing)
-        {
-            printf ("\nTimeStamp : %d | Pressure : %f \n", time_ms/1000, pressure);
-            //The current calculated pressure is saved into the pressure array
-            pressureArrayValues[pressureCounter] = pressure;
-            //The time in seconds is saved in the time array
-            timerDataArray[pressureCounter] = time_ms/1000;
-            //increment the counter value
-            pressureCounter++;
-        }
-
-        //If the pressure is pumped beyond 151 then start showing deflation rate remarks
-        else if(isPressureIncreasing == false)
-        {
-            printf ("\nTimeStamp : %d | Pressure : %f | Deflation Comment : %s \n", time_ms/1000, pressure, deflationRateMessage);
-        }
-        //The increasing pressure when we pump the cuff
-        else
-        {   
-            printf ("\nTimeStamp : %d | Pressure : %f\n", time_ms/1000, pressure);
-        }
-
-        //Save the current pressure value into previousPressureVal before calculating the new pressure value
-        previousPressureVal = pressure;
-
-        //Wait time before taking the next sample
-        wait_us(10000);
-
+#ifdef SESSION_LOG
+        //Records waiting for the flash are written before sleeping
+        if(sessionLog.service())
+            continue;
+#endif
+        measurementProducerThread.waitForSamples();
     }
+    measurementProducerThread.join();
+    bloodPressureResult = bloodPressureMeasurement.getResult();
+#endif
 
+#ifndef REPEAT_MEASUREMENT_INTERVAL_S
     //Stop the timer after all the pressure readings and calculations are over
     timerVal.stop();
+#endif
+
+#ifdef SESSION_LOG
+    //The result commits the session to the log
+    sessionLog.endSession(bloodPressureResult);
+    sessionLog.flush();
+#endif
+
+#ifdef BINARY_TELEMETRY
+    //The decoder on the PC shows the result, nothing but frames goes to the console
+    telemetryEncoder.sendResult(bloodPressureResult);
+    return;
+#endif
+
+#if !defined(MEASUREMENT_SINGLE_THREAD) && !defined(MEASUREMENT_PIPELINE)
+    MeasurementProducerStatistics producerStatistics = bloodPressureMeasurement.getProducerStatistics();
+    printf("\nSamples queued : %lu | Lost : %lu | Deepest queue : %lu | Longest sampling step : %lu us | Skipped printouts : %lu\n",
+           (unsigned long)producerStatistics.samplesQueued, (unsigned long)producerStatistics.queueOverflows,
+           (unsigned long)producerStatistics.queueHighWaterMark, (unsigned long)producerStatistics.maxProduceMicroseconds,
+           (unsigned long)producerStatistics.skippedEchoLines);
+#endif
+#ifndef MEASUREMENT_PIPELINE
+    const SamplingSchedulerStatistics &samplingStatistics = samplingScheduler.getStatistics();
+    printf("\nSample interval : mean %.1f us, %lu to %lu us | Missed periods : %lu | Duty cycle : %.2f %% | Wakeups : %.1f per second | Latest wakeup : %lu us\n",
+           samplingScheduler.getMeanSampleIntervalMicroseconds(), (unsigned long)samplingStatistics.minSampleIntervalMicroseconds,
+           (unsigned long)samplingStatistics.maxSampleIntervalMicroseconds,
+           (unsigned long)bloodPressureMeasurement.getProducerStatistics().missedSamplePeriods,
+           samplingScheduler.getDutyCycle() * 100.0f, samplingScheduler.getWakeupsPerSecond(),
+           (unsigned long)samplingStatistics.maxWakeLatencyMicroseconds);
+#endif
+#if defined(ENVELOPE_FIT) && !defined(MEASUREMENT_PIPELINE)
+    EnvelopeFitResult envelopeFitResult = bloodPressureMeasurement.getEnvelopeFit();
+    if(envelopeFitResult.isValid)
+        printf("\nEnvelope fit : MAP %.1f mmHg | Widths %.1f / %.1f mmHg | Bins %d | Residual %.4f\n",
+               envelopeFitResult.meanArterialPressure, envelopeFitResult.systolicWidth, envelopeFitResult.diastolicWidth,
+               envelopeFitResult.fittedBins, envelopeFitResult.residual);
+    else
+        printf("\nEnvelope fit failed, the pressures come from the envelope search\n");
+#endif
+#if defined(ARTIFACT_REJECTION) && !defined(MEASUREMENT_PIPELINE)
+    printf("\nArtifacts replaced : %lu\n", (unsigned long)bloodPressureMeasurement.getRejectedSampleCount());
+#endif
+#ifdef HOT_PATH_PROFILING
+    hotPathProfiler.printSummary();
+#endif
+    if(bloodPressureMeasurement.isEndedEarly())
+        printf("\nDiastolic pressure found at %f mmHg, the cuff can be released now\n", bloodPressureResult.diastolicPressure);
 
-    //loop for calculating slopes
-    for(int i=1;i<pressureCounter;i++)
-    {
-        //The consecutive pressure differences
-        float consecutivePressureDifference = pressureArrayValues[i] - pressureArrayValues[i-1];
-        //The consecutive time differences
-        float consecutiveTimeDifference=(timerDataArray[i]-timerDataArray[i-1]);
-        //Ensure that the time difference not zero 
-        //This prevents getting an infinite slope
-        if(consecutiveTimeDifference != 0.000000 )
-        //Slope array will be calcuated by dividing the change in Pressure with change in time
-        pressureSlope[i-1]= (consecutivePressureDifference/consecutiveTimeDifference);
-        //printf("Pressure diff, Time Diff, Max diff: %.2f %.2f %.2f\n\r", consecutivePressureDifference, consecutiveTimeDifference, pressureSlope[i-1]);
-    }
-
-    //loop for finding the maximum positive slope 
-    for(int j=0; j<pressureCounter; j++)
-    {
-        //If the current slope in the array is greater than our current max positive slope
-        if(pressureSlope[j] > maxSlope)
-        {
-            //Save the new higher value in max_Positive Slope
-            maxSlope = pressureSlope[j];
-            //add 1 to The index of this slope value to use it in pressure array because we want the higher pressure reading used to calculate the postive slope
-
-            MaxIndexPositiveSlope = j+1;           
-        }
-    }
- 
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
     printf("::                                                                                                    ::\n");
     printf("::                                                                                                    ::\n");
@@ -252,22 +292,22 @@ void measurePressureValuesFromTheHoneywellSensor()
     printf("::                                                                                                    ::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
     
-    printf("\nMaximum Pressure Value: is %f\n", pressureArrayValues[MaxIndexPositiveSlope]);
+    printf("\nMaximum Pressure Value: is %f\n", bloodPressureResult.meanArterialPressureSlope);
 
     //Need to print Data for Graphs  
     printf("\n::::::::::::::::::::::::::::::::: Pressure Value on x axis ::::::::::::::::::::::::::::::::::::::::::::\n");
     
-    for(int i = 0; i<50; i++) {
+    for(int i = 0; i<GRAPH_SAMPLE_COUNT; i++) {
     
-        printf("%f", pressureArrayValues[i]);
+        printf("%f", bloodPressureMeasurement.getGraphPressureValues()[i]);
     
     }
     
     printf("\n:::::::::::::::::::::::::::::::: Time Value on x axis :::::::::::::::::::::::::::::::::::::::::::::::::\n");
     
-    for(int i = 0; i<50; i++) {
+    for(int i = 0; i<GRAPH_SAMPLE_COUNT; i++) {
     
-        printf("%f", timerDataArray[i]);
+        printf("%f", bloodPressureMeasurement.getGraphTimeValues()[i]);
     
     }
 
@@ -275,35 +315,10 @@ void measurePressureValuesFromTheHoneywellSensor()
  
 void evaluateSystolicPressure()
 {
-
-    //The Systolic pressure slope minimum threshold is calculated by multiplying the maximum slop by 0.5
-    float sysSlopeMinThreshold = 0.5 * maxSlope;
-    //The difference between slope readings
-    float diffInSlope = 0.0;
-    //The smallest difference in slope readings. We initialize it with a large value (INT32_MAX)
-    float minDiffInSlope=INT32_MAX;
-
-    //Run the loop through the slope array from the start till we reach a value lesser than the index of the slope of the MAP.
-    for(int k=0; k < MaxIndexPositiveSlope - 1; k++)
-    {
-        //If slope is positive && if the slope is less than our systolic threshold value
-        if((pressureSlope[k]>=0.0) && (pressureSlope[k] < sysSlopeMinThreshold))
-        {
-            //The difference between our threshold value and the current slope reading
-            diffInSlope = sysSlopeMinThreshold - pressureSlope[k];
-
-            //Iff the calculated difference is less than minimum difference in slope
-            if(diffInSlope < minDiffInSlope)
-            {
-                //The minimum difference in slope 
-                minDiffInSlope=diffInSlope;
-                //The index for the value in pressure array
-                systolicPressureSlopeIndex=k+1; 
-            }
-        }
-    }
-  //print the corresponding pressure reading from the pressure array as "Systolic Pressure"
-  //printf("\nCalculated Systolic values from oscillations : %.2f \n",  pressureArrayValues[systolicPressureSlopeIndex]);
+  //The analyzer already searched the slopes before the maximum for the one closest to 0.5 * maxSlope
+  //(with ENVELOPE_ANALYSIS, the envelope points before the peak for the one closest to 0.5 * peak)
+  //print the corresponding pressure reading as "Systolic Pressure"
+  //printf("\nCalculated Systolic values from oscillations : %.2f \n",  bloodPressureResult.systolicPressure);
   printf("\n:::::::::::::::::::::::::::  Calculated Systolic values from oscillations  :::::::::::::::::::::::::::::\n");
   printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
   printf("::                                                                                                    ::\n");
@@ -311,7 +326,7 @@ void evaluateSystolicPressure()
   printf("::                                                                                                    ::\n");
   printf("::                                                                                                    ::\n");
   printf("::%-60s | %-240s%-80s", "            Name              ", "                                          Value","                     ::\n");
-  printf("::%-60s | %-60f%-80s","      Systolic values          ",pressureArrayValues[systolicPressureSlopeIndex],"::\n");
+  printf("::%-60s | %-60f%-80s","      Systolic values          ",bloodPressureResult.systolicPressure,"::\n");
   printf("::                                                                                                    ::\n");
   printf("::                                                                                                    ::\n");
   printf("::                                                                                                    ::\n");
@@ -321,35 +336,10 @@ void evaluateSystolicPressure()
 
 void evaluateDiastolicPressure()
 {
-  //Diastolic pressure slope minimum threshold is calculated by multiplying the maximum slope with 0.8
-  float diaSlopeMinThreshold = 0.8 * maxSlope; 
-  //The difference in slope readings
-  float diffInSlope_dia=0.0; 
-  //The smallest difference in slope readings. We initialize it with a very large value using int32_max
-  float minDiffInSlope_dia=INT32_MAX; 
-  
-  //Loop through the slope array from the index post MAP untill we reach a value lesser than the last slope in the slope array
-  for(int l=MaxIndexPositiveSlope+1; l < pressureCounter; l++)
-   {
-      //check first if slope is positive && is the slope less than our diastolic threshold value
-      if((pressureSlope[l]>=0.0) && (pressureSlope[l] < diaSlopeMinThreshold))
-      {
-          //calculate the difference between our threshold value and the current slope reading
-          diffInSlope_dia = diaSlopeMinThreshold - pressureSlope[l];
-          //check if the calculated difference is less than minimum difference in slope
-          if(diffInSlope_dia < minDiffInSlope_dia)
-          {
-              //then store minimum difference in slope as this calculated difference
-              minDiffInSlope_dia=diffInSlope_dia;
-              //store the corresponding index for the value in pressure array
-              diastolic_pressureSlopeIndex=l+1;
-            
-          }
-      }
-   }
-
-    //print the corresponding pressure reading from the pressure array as "Diastolic Pressure"
-    //printf("\nCalculated Diastolic values from oscillations: %.2f \n",  pressureArrayValues[diastolic_pressureSlopeIndex]);
+    //The analyzer already searched the slopes after the maximum for the one closest to 0.8 * maxSlope
+    //(with ENVELOPE_ANALYSIS, the envelope points after the peak for the one closest to 0.8 * peak)
+    //print the corresponding pressure reading as "Diastolic Pressure"
+    //printf("\nCalculated Diastolic values from oscillations: %.2f \n",  bloodPressureResult.diastolicPressure);
     printf("\n::::::::::::::::::::::::::  Calculated Diastolic values from oscillations  ::::::::::::::::::::::::::::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
     printf("::                                                                                                    ::\n");
@@ -357,7 +347,7 @@ void evaluateDiastolicPressure()
     printf("::                                                                                                    ::\n");
     printf("::                                                                                                    ::\n");
     printf("::%-60s | %-120s%-80s", "            Name", "                                                      Value","                      ::\n");
-    printf("::%-60s | %-60f%-80s","      Diastolic        ",pressureArrayValues[diastolic_pressureSlopeIndex],"     ::\n");
+    printf("::%-60s | %-60f%-80s","      Diastolic        ",bloodPressureResult.diastolicPressure,"     ::\n");
     printf("::                                                                                                    ::\n");
     printf("::                                                                                                    ::\n");
     printf("::                                                                                                    ::\n");
@@ -368,23 +358,8 @@ void evaluateDiastolicPressure()
  
 void evaluateHeartRate()
 {
-    //Loop through the pressures and get the heart rate count
-    for(int m = systolicPressureSlopeIndex-1; m < diastolic_pressureSlopeIndex; m++)
-    {
-        //check for all positive slopes greater than 0.0
-        if(pressureSlope[m] > 0.0)
-            {
-                //count these positive slopes
-                heartRateCount++;
-            }  
-    }
-
-    //printf("Heart Rate Count : %.2f", heartRateCount);
-    //printf("Heart Rate Count : %.2f", (timerDataArray[diastolic_pressureSlopeIndex]/1000 - timerDataArray[systolicPressureSlopeIndex]/1000));
-    //printf("\nHeart Rate Val : %.2f", (heartRateCount) / (timerDataArray[diastolic_pressureSlopeIndex] - timerDataArray[systolicPressureSlopeIndex])* 60.0f);
-    
-    int heart_Rate = (int)(((heartRateCount) / (timerDataArray[diastolic_pressureSlopeIndex]/1000 - timerDataArray[systolicPressureSlopeIndex]/1000))* 60.0f);
-    //calculate the heart rate by dividing by the time and then multiplying by 60
+    //The median beat to beat interval of the beats found while deflating, as beats per minute
+    int heart_Rate = bloodPressureResult.heartRate;
     //printf("\nCalculated Heart Rate values from oscillations: %d beats per minute\n",heart_Rate);
     printf("\n::::::::::::::::::::::  Calculated Heart Rate values from oscillations  ::::::::::::::::::::::::::::::::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
@@ -406,7 +381,7 @@ void evaluatePulsePressure()
 {
 
     //Pulse pressure is calculated as the difference between the Systolic and the Diastolic values
-    pulsePressure = pressureArrayValues[systolicPressureSlopeIndex] - pressureArrayValues[diastolic_pressureSlopeIndex];
+    float pulsePressure = bloodPressureResult.pulsePressure;
 
     printf("\n::::::::::::::::::::::  Calculated Pulse pressure from oscillations  ::::::::::::::::::::::::::::::::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
@@ -428,10 +403,7 @@ void evaluateMeanArterialPressureUsingWeightedAverageMethod()
 {
  
     //MAP = 1/3 Systolic Value + 2/3 Diastolic Value
-    //printf("Systolic Pressure ---------- %.2f\n",pressureArrayValues[systolicPressureSlopeIndex]);
-    //printf("Diastolic Pressure ---------- %.2f\n",pressureArrayValues[diastolic_pressureSlopeIndex]);
-    
-    meanArterialPressureWA =  (0.33) * pressureArrayValues[systolicPressureSlopeIndex] + (0.67) * pressureArrayValues[diastolic_pressureSlopeIndex];
+    float meanArterialPressureWA = bloodPressureResult.meanArterialPressureWeightedAverage;
     //printf("\nMean Arterial Pressure(MAP) using Weigted Average Method is : %.2f\n", meanArterialPressureWA);
     printf("\n::::::::::::::::::::::  Mean Arterial Pressure Using Weighted Average  ::::::::::::::::::::::::::::::::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
@@ -453,7 +425,7 @@ void evaluateMeanArterialPressureUsingSlopeMethod()
 {
  
     //MAP is taken as the value when the slope is maximum
-    meanArterialPressureSlope =  pressureArrayValues[MaxIndexPositiveSlope];
+    float meanArterialPressureSlope = bloodPressureResult.meanArterialPressureSlope;
     //printf("\nMean Arterial Pressure(MAP) using Slope Method is : %.2f\n", meanArterialPressureSlope);
     printf("\n:::::::::::::::::::::::::::::  Mean Arterial Pressure Using Slope :::::::::::::::::::::::::::::::::::::\n");
     printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
@@ -472,54 +444,81 @@ void evaluateMeanArterialPressureUsingSlopeMethod()
 }
 
 
-int main()
+#ifdef MULTI_CHANNEL_ACQUISITION
+void recordAllChannels()
 {
-    //Start the timer
-    timerVal.start();
-    
-    //Waits 10000 microseconds 
-    wait_us(10000);
+    MultiChannelAcquisition channels;
+    channels.addChannel(cuffChannel);
+    channels.addChannel(referenceChannel);
+
+    //Every channel gets its own thread, all of them stamp their samples with the same timer
+    MbedAcquisitionChannelThread cuffThread(cuffChannel, measurementClock);
+    MbedAcquisitionChannelThread referenceThread(referenceChannel, measurementClock);
+    cuffThread.start();
+    referenceThread.start();
+    ThisThread::sleep_for(std::chrono::milliseconds(MULTI_CHANNEL_RECORD_MS));
+    cuffThread.stop();
+    referenceThread.stop();
+
+    //Channel, timestamp in microseconds and pressure in mmHg, one sample per line
+    for(int i = 0; i < channels.getChannelCount(); i++)
+    {
+        const AcquisitionChannel &channel = channels.getChannel(i);
+        for(int k = 0; k < channel.getSampleCount(); k++)
+        {
+            const MprlsSample &sample = channel.getSample(k);
+            printf("%d,%llu,%f\n", channel.getChannelNumber(), (unsigned long long)sample.timeMicroseconds,
+                   MprlsCountsConverter<MeasurementSensorVariant>::toMillimetresOfMercury(sample.counts));
+        }
+        printf("Channel %d : %d samples, %lu dropped, %lu bus errors\n", channel.getChannelNumber(), channel.getSampleCount(),
+               (unsigned long)channel.getDroppedSamples(), (unsigned long)channel.getStatistics().busErrors);
+    }
 
-    printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                       BLOOD PRESSURE MONITORING SYSTEM                             ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::                                                                                                    ::\n");
-    printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");   
-    
-    //Waits 10000 microseconds  
-    wait_us(10000);
+    MultiChannelSkew skew = channels.calculateSkew();
+    printf("Skew over %d samples : mean %.1f us, max %llu us\n", skew.comparedSamples, skew.meanSkewMicroseconds,
+           (unsigned long long)skew.maxSkewMicroseconds);
+}
+#endif
 
-    printf("\n:::::::::::::::::::::::::::::::::::INSTRUCTIONS:::::::::::::::::::::::::::::::::::\n");
-    printf("Put on the cuff2.While measuring the pressure, increase the cuff pressure to 150mmHg3.\n");
-    printf("While continuously measuring the pressure, open the pressure relief valve, causing the pressure to reduce about 4mmHg/sec.\n"); 
-    printf("The system shall provide notices if the release rate is too fast or too slow\n");
-    
-    //Waits 10000 microseconds 
-    wait_us(10000);
+#if defined(SESSION_LOG) && defined(SESSION_LOG_DUMP)
+/**
+ * @brief Prints the logged sessions: session, timestamp in microseconds and pressure in mmHg, one sample
+ * per line, and the result of every session that was committed
+ */
+class SessionLogPrinter : public SessionLogListener
+{
+public:
+    virtual void onSessionStart(uint32_t sessionId, uint64_t startMicroseconds)
+    {
+        printf("Session %lu started at %llu us\n", (unsigned long)sessionId, (unsigned long long)startMicroseconds);
+    }
 
-    //To measure the pressure values from the HoneyWell Sensor and Evaluate the Deflation rate
-    /**
-     * @brief The 24 bit values read from the sensor are stored. The first byte is ignored as it is the status byte. 
-     * The calculated pressure value is used to check the deflation rate.
-    The deflation rate is printed in the terminal. The timer stops once all the pressure calculations are over. 
-    The slope of the pressure is also calculated as follows :
+    virtual void onSample(uint32_t sessionId, const MprlsSample &sample)
+    {
+        printf("%lu,%llu,%f\n", (unsigned long)sessionId, (unsigned long long)sample.timeMicroseconds,
+               MprlsCountsConverter<MeasurementSensorVariant>::toMillimetresOfMercury(sample.counts));
+    }
 
-                        slope=(pressure_Difference / time_Difference) 
-    The difference between two consecutive values is calculated.
-    If it is <3 mm Hg, the deflation rate is too slow and it is printed in the terminal.
-    If it is >5 mm Hg, the deflation rate is too fast and it is printed in the terminal.
-    If the values are between 3 mm Hg and 5 mm Hg, the deflation rate is ideal
-    This helps us to properly release the valve for pressure calculation.
-     * 
-     */
-    measurePressureValuesFromTheHoneywellSensor();
+    virtual void onSessionEnd(uint32_t sessionId, const BloodPressureResult *result)
+    {
+        if(result == 0)
+            printf("Session %lu was cut short\n", (unsigned long)sessionId);
+        else
+            printf("Session %lu : Systolic %f | Diastolic %f | MAP %f | Heart rate %d\n", (unsigned long)sessionId,
+                   result->systolicPressure, result->diastolicPressure, result->meanArterialPressureSlope, result->heartRate);
+    }
+};
+
+void printSessionLog()
+{
+    SessionLogPrinter printer;
+    int sessionCount = sessionLog.readSessions(printer);
+    printf("%d sessions in the log\n", sessionCount);
+}
+#endif
 
+void evaluateBloodPressure()
+{
     //Evaluation for Systolic Pressure 
     /**
      * @brief the value of 0.5* maximum peak value is taken for systolic calculation. 
@@ -574,5 +573,129 @@ int main()
      * 
      */
     evaluateMeanArterialPressureUsingSlopeMethod();
+}
+
+#ifdef REPEAT_MEASUREMENT_INTERVAL_S
+void runScheduledMeasurements()
+{
+    measurementScheduler.setInterval((uint64_t)(REPEAT_MEASUREMENT_INTERVAL_S * 1000000.0));
+    while(true)
+    {
+        //Sleep until the next slot, waking up now and then for the button
+        uint64_t microsecondsUntilDue;
+        while((microsecondsUntilDue = measurementScheduler.getMicrosecondsUntilDue()) > 0)
+        {
+            if(userButton.read())
+                measurementScheduler.requestMeasurement();
+            else
+                ThisThread::sleep_for(std::chrono::milliseconds(microsecondsUntilDue < 50000 ? microsecondsUntilDue / 1000 + 1 : 50));
+        }
+
+        measurementScheduler.beginMeasurement();
+        measurePressureValuesFromTheHoneywellSensor();
+        measurementScheduler.completeMeasurement();
+#ifndef BINARY_TELEMETRY
+        evaluateBloodPressure();
+        const MeasurementSchedulerStatistics &statistics = measurementScheduler.getStatistics();
+        printf("\nMeasurement %lu | Turnaround : %llu ms (mean %llu ms) | Start latency : %lu us | Missed slots : %lu\n",
+               (unsigned long)statistics.measurementsCompleted, (unsigned long long)(statistics.lastTurnaroundMicroseconds / 1000),
+               (unsigned long long)(measurementScheduler.getMeanTurnaroundMicroseconds() / 1000),
+               (unsigned long)statistics.lastStartLatencyMicroseconds, (unsigned long)statistics.missedSlots);
+#endif
+    }
+}
+#endif
+
+int main()
+{
+    //Start the timer
+    timerVal.start();
+
+#ifdef MULTI_CHANNEL_ACQUISITION
+    recordAllChannels();
+    return 0;
+#endif
+
+    samplingScheduler.setSamplePeriod(MEASUREMENT_SAMPLE_PERIOD_US);
+#ifdef BINARY_TELEMETRY
+    bloodPressureMeasurement.setTelemetry(&telemetryEncoder);
+#endif
+#if defined(ENVELOPE_ANALYSIS) || defined(EARLY_TERMINATION) || defined(ENVELOPE_FIT)
+    bloodPressureMeasurement.setEnvelopeAnalysis(true);
+#endif
+#ifdef ENVELOPE_FIT
+    bloodPressureMeasurement.setEnvelopeFit(true);
+#endif
+#ifdef EARLY_TERMINATION
+    bloodPressureMeasurement.setEarlyTermination(true);
+#endif
+#ifdef ARTIFACT_REJECTION
+    bloodPressureMeasurement.setArtifactRejection(true);
+#endif
+#ifdef SESSION_LOG
+    isSessionLogMounted = sessionStorage.init() == 0 && sessionLog.mount() == 0;
+    if(isSessionLogMounted)
+    {
+#ifdef SESSION_LOG_DUMP
+        printSessionLog();
+#endif
+        bloodPressureMeasurement.setSessionLog(&sessionLog);
+    }
+#endif
+#ifdef HOT_PATH_PROFILING
+    hotPathStartTicks();
+    bloodPressureMeasurement.setProfiler(&hotPathProfiler);
+#endif
+    
+    //Sleeps 10 milliseconds
+    ThisThread::sleep_for(std::chrono::milliseconds(10));
+
+    printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                       BLOOD PRESSURE MONITORING SYSTEM                             ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::                                                                                                    ::\n");
+    printf("::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::\n");   
+    
+    //Sleeps 10 milliseconds
+    ThisThread::sleep_for(std::chrono::milliseconds(10));
+
+    printf("\n:::::::::::::::::::::::::::::::::::INSTRUCTIONS:::::::::::::::::::::::::::::::::::\n");
+    printf("Put on the cuff2.While measuring the pressure, increase the cuff pressure to 150mmHg3.\n");
+    printf("While continuously measuring the pressure, open the pressure relief valve, causing the pressure to reduce about 4mmHg/sec.\n"); 
+    printf("The system shall provide notices if the release rate is too fast or too slow\n");
+    
+    //Sleeps 10 milliseconds
+    ThisThread::sleep_for(std::chrono::milliseconds(10));
+
+    //To measure the pressure values from the HoneyWell Sensor and Evaluate the Deflation rate
+    /**
+     * @brief The 24 bit values read from the sensor are stored. The first byte is ignored as it is the status byte. 
+     * The calculated pressure value is used to check the deflation rate.
+    The deflation rate is printed in the terminal. The timer stops once all the pressure calculations are over. 
+    The slope of the pressure is also calculated as follows :
+
+                        slope=(pressure_Difference / time_Difference) 
+    The difference between two consecutive values is calculated.
+    If it is <3 mm Hg, the deflation rate is too slow and it is printed in the terminal.
+    If it is >5 mm Hg, the deflation rate is too fast and it is printed in the terminal.
+    If the values are between 3 mm Hg and 5 mm Hg, the deflation rate is ideal
+    This helps us to properly release the valve for pressure calculation.
+     * 
+     */
+#ifdef REPEAT_MEASUREMENT_INTERVAL_S
+    runScheduledMeasurements();
+#endif
+    measurePressureValuesFromTheHoneywellSensor();
+#ifdef BINARY_TELEMETRY
+    return 0;
+#endif
+
+    evaluateBloodPressure();
  
 }
\ No newline at end of file